@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+
+"""
+Measure the throughput and latency of tagging instances one by one with the
+serve command, compared with running the tag command for each instance.
+
+Usage: bench_serve.py CRFSUITE MODEL DATA [CLIENTS] [REQUESTS]
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from serve_client import Client
+
+def read_instances(fn):
+    """Split the data into instances (separated by empty lines)."""
+    instances = []
+    lines = []
+    for line in open(fn, 'rb'):
+        if line.strip():
+            lines.append(line)
+        elif lines:
+            instances.append(b''.join(lines))
+            lines = []
+    if lines:
+        instances.append(b''.join(lines))
+    return instances
+
+def percentile(X, p):
+    X = sorted(X)
+    return X[min(len(X) - 1, int(len(X) * p))]
+
+def report(name, elapsed, latencies):
+    sys.stdout.write(
+        '%-24s %8d requests %10.1f req/s  p50 %8.3f ms  p99 %8.3f ms\n' % (
+        name, len(latencies), len(latencies) / elapsed,
+        percentile(latencies, 0.5) * 1000, percentile(latencies, 0.99) * 1000))
+
+def bench_tag(crfsuite, model, instances):
+    """Start the tag command for every request."""
+    latencies = []
+    start = time.time()
+    for data in instances:
+        t = time.time()
+        p = subprocess.Popen(
+            [crfsuite, 'tag', '-m', model],
+            stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+        p.communicate(data)
+        latencies.append(time.time() - t)
+    report('tag (process/request)', time.time() - start, latencies)
+
+def bench_serve(path, instances, num_clients):
+    """Send the requests from concurrent clients."""
+    latencies = []
+    errors = []
+    lock = threading.Lock()
+
+    def run(chunk):
+        L = []
+        try:
+            client = Client(path)
+            for data in chunk:
+                t = time.time()
+                client.tag(data)
+                L.append(time.time() - t)
+            client.close()
+        except Exception as e:
+            errors.append(e)
+        with lock:
+            latencies.extend(L)
+
+    threads = [
+        threading.Thread(target=run, args=(instances[i::num_clients],))
+        for i in range(num_clients)]
+    start = time.time()
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    if errors:
+        sys.stderr.write('ERROR: %s\n' % errors[0])
+    report('serve (%d clients)' % num_clients, time.time() - start, latencies)
+
+if __name__ == '__main__':
+    if len(sys.argv) < 4:
+        sys.stderr.write(__doc__.lstrip())
+        sys.exit(1)
+    crfsuite, model, data = sys.argv[1:4]
+    num_clients = int(sys.argv[4]) if 4 < len(sys.argv) else 4
+    num_requests = int(sys.argv[5]) if 5 < len(sys.argv) else 1000
+
+    instances = read_instances(data)
+    instances = (instances * (num_requests // len(instances) + 1))[:num_requests]
+
+    bench_tag(crfsuite, model, instances[:min(len(instances), 100)])
+
+    path = os.path.join(tempfile.mkdtemp(), 'crfsuite.sock')
+    server = subprocess.Popen(
+        [crfsuite, 'serve', '-m', model, '-s', path, '-T', str(num_clients)])
+    try:
+        while not os.path.exists(path):
+            time.sleep(0.01)
+        bench_serve(path, instances, 1)
+        if 1 < num_clients:
+            bench_serve(path, instances, num_clients)
+    finally:
+        server.terminate()
+        server.wait()
+        os.rmdir(os.path.dirname(path))
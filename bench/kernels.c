@@ -0,0 +1,637 @@
+/*
+ *      Microbenchmarks of the inference and training kernels.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+/*
+    This program measures the kernels of CRFSuite in isolation on synthetic
+    data, for every combination of the number of labels (L), the length of
+    sequences (T), and the sparsity of state features (the fraction of the
+    labels associated with an attribute):
+
+    - crf1dc_exp_state, crf1dc_alpha_score, crf1dc_beta_score,
+      crf1dc_marginals, crf1dc_viterbi: the forward-backward and Viterbi
+      algorithms on random scores.
+    - crf1dt_state_score: the state scores computed by the tagger for
+      random attributes (through crfsuite_tagger_t::set()) on a random model
+      with ${-A} attributes.
+    - cqdb_to_id: the lookup of attribute names in the model (through
+      crfsuite_dictionary_t::to_id()).
+
+    Each measurement runs a few calls for warming up, and then repeats
+    calls for about ${-m} milliseconds ${-r} times. The result is written
+    to STDOUT as tab-separated values, one line per measurement:
+
+        kernel  L  T  sparsity  reps  ns_per_item  ns_per_item_min  gflops  bytes_per_item
+
+    where ns_per_item is the median over the repetitions, an item is a
+    position in a sequence (a lookup for cqdb_to_id), and "-" stands for a
+    value that does not apply. gflops and bytes_per_item are computed from
+    the nominal number of floating-point operations and the bytes of the
+    arrays read or written by the kernel per item (an exponential counts as
+    one operation). Lines starting with '#' are comments.
+*/
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+#include "logging.h"
+#include "crf1d.h"
+
+#define    MAX_VALUES    64
+#define    NUM_INSTANCES 16
+#define    NUM_NAMES     4096
+
+typedef struct {
+    int labels[MAX_VALUES];
+    int num_labels;
+    int lengths[MAX_VALUES];
+    int num_lengths;
+    double sparsities[MAX_VALUES];
+    int num_sparsities;
+    int num_attributes;
+    int num_contents;
+    int warmup;
+    int reps;
+    double msec;
+    const char *model;
+} bench_option_t;
+
+/**
+ * The nominal cost of a kernel.
+ */
+typedef struct {
+    const char *kernel;
+    int L;
+    int T;
+    double sparsity;        /**< The sparsity (negative if not applicable). */
+    double items;           /**< The number of items per call. */
+    double flops;           /**< Floating-point operations per item. */
+    double bytes;           /**< Bytes read or written per item. */
+} kernel_info_t;
+
+typedef void (*kernel_func_t)(void *arg);
+
+static unsigned int rng_state = 1;
+
+static unsigned int rng_next(void)
+{
+    /* xorshift32. */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double rng_uniform(void)
+{
+    return (rng_next() & 0xFFFFFF) / (double)0x1000000;
+}
+
+static double now_ns(void)
+{
+#ifdef  CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#else
+    return clock() * (1e9 / CLOCKS_PER_SEC);
+#endif/*CLOCK_MONOTONIC*/
+}
+
+static int compare_double(const void *x, const void *y)
+{
+    const double a = *(const double*)x, b = *(const double*)y;
+    return (a < b) ? -1 : ((b < a) ? 1 : 0);
+}
+
+static void put_value(double value, const char *format, int last)
+{
+    if (value < 0) {
+        printf("-");
+    } else {
+        printf(format, value);
+    }
+    printf(last ? "\n" : "\t");
+}
+
+static void measure(const bench_option_t *opt, const kernel_info_t *info, kernel_func_t func, void *arg)
+{
+    int i, r, calls;
+    double begin, elapsed, median;
+    double *samples = (double*)calloc(opt->reps, sizeof(double));
+
+    if (samples == NULL) {
+        return;
+    }
+
+    /* Warm up, and determine the number of calls per repetition. */
+    begin = now_ns();
+    for (i = 0;i < opt->warmup;++i) {
+        func(arg);
+    }
+    elapsed = (now_ns() - begin) / (opt->warmup < 1 ? 1 : opt->warmup);
+    calls = (int)(opt->msec * 1e6 / (elapsed < 1. ? 1. : elapsed));
+    if (calls < 1) {
+        calls = 1;
+    }
+
+    for (r = 0;r < opt->reps;++r) {
+        begin = now_ns();
+        for (i = 0;i < calls;++i) {
+            func(arg);
+        }
+        samples[r] = (now_ns() - begin) / (calls * info->items);
+    }
+    qsort(samples, opt->reps, sizeof(double), compare_double);
+    median = samples[opt->reps / 2];
+
+    printf("%s\t", info->kernel);
+    put_value(info->L, "%.0f", 0);
+    put_value(info->T, "%.0f", 0);
+    put_value(info->sparsity, "%g", 0);
+    printf("%d\t", opt->reps);
+    put_value(median, "%.3f", 0);
+    put_value(samples[0], "%.3f", 0);
+    put_value(0 < info->flops ? info->flops / median : -1, "%.3f", 0);
+    put_value(info->bytes, "%.0f", 1);
+    fflush(stdout);
+    free(samples);
+}
+
+/*
+ *  Kernels of the forward-backward and Viterbi algorithms.
+ */
+
+typedef struct {
+    crf1d_context_t *ctx;
+    int *labels;
+} context_arg_t;
+
+static void run_exp_state(void *arg)
+{
+    crf1dc_exp_state(((context_arg_t*)arg)->ctx);
+}
+
+static void run_alpha_score(void *arg)
+{
+    crf1dc_alpha_score(((context_arg_t*)arg)->ctx);
+}
+
+static void run_beta_score(void *arg)
+{
+    crf1dc_beta_score(((context_arg_t*)arg)->ctx);
+}
+
+static void run_marginals(void *arg)
+{
+    crf1dc_marginals(((context_arg_t*)arg)->ctx);
+}
+
+static void run_viterbi(void *arg)
+{
+    context_arg_t *ca = (context_arg_t*)arg;
+    crf1dc_viterbi(ca->ctx, ca->labels);
+}
+
+static int bench_context(const bench_option_t *opt, int L, int T)
+{
+    int i, t;
+    context_arg_t ca;
+    kernel_info_t info;
+    const double S = sizeof(floatval_t);
+
+    ca.ctx = crf1dc_new(CTXF_MARGINALS | CTXF_VITERBI, L, T);
+    ca.labels = (int*)calloc(T, sizeof(int));
+    if (ca.ctx == NULL || ca.labels == NULL) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return 1;
+    }
+    crf1dc_set_num_items(ca.ctx, T);
+
+    /* Random scores in [-1, 1). */
+    crf1dc_reset(ca.ctx, RF_STATE | RF_TRANS);
+    for (t = 0;t < T;++t) {
+        floatval_t *state = STATE_SCORE(ca.ctx, t);
+        for (i = 0;i < L;++i) {
+            state[i] = 2. * rng_uniform() - 1.;
+        }
+    }
+    for (i = 0;i < L;++i) {
+        int j;
+        floatval_t *trans = TRANS_SCORE(ca.ctx, i);
+        for (j = 0;j < L;++j) {
+            trans[j] = 2. * rng_uniform() - 1.;
+        }
+    }
+    crf1dc_exp_transition(ca.ctx);
+    crf1dc_exp_state(ca.ctx);
+    crf1dc_alpha_score(ca.ctx);
+    crf1dc_beta_score(ca.ctx);
+
+    info.L = L;
+    info.T = T;
+    info.sparsity = -1;
+    info.items = T;
+
+    info.kernel = "crf1dc_exp_state";
+    info.flops = L;
+    info.bytes = 2 * L * S;
+    measure(opt, &info, run_exp_state, &ca);
+
+    info.kernel = "crf1dc_alpha_score";
+    info.flops = 2. * L * L + 2. * L;
+    info.bytes = ((double)L * L + 3. * L) * S;
+    measure(opt, &info, run_alpha_score, &ca);
+
+    info.kernel = "crf1dc_beta_score";
+    info.flops = 2. * L * L + 2. * L;
+    info.bytes = ((double)L * L + 3. * L) * S;
+    measure(opt, &info, run_beta_score, &ca);
+
+    info.kernel = "crf1dc_marginals";
+    info.flops = 3. * L * L + 3. * L;
+    info.bytes = (3. * L * L + 6. * L) * S;
+    measure(opt, &info, run_marginals, &ca);
+
+    info.kernel = "crf1dc_viterbi";
+    info.flops = 2. * L * L;
+    info.bytes = ((double)L * L + 2. * L) * S + L * sizeof(int);
+    measure(opt, &info, run_viterbi, &ca);
+
+    free(ca.labels);
+    crf1dc_delete(ca.ctx);
+    return 0;
+}
+
+/*
+ *  Kernels of the tagger on a random model.
+ */
+
+typedef struct {
+    crfsuite_tagger_t *tagger;
+    crfsuite_dictionary_t *attrs;
+    crfsuite_instance_t *instances;
+    char (*names)[16];
+    int i;
+} tagger_arg_t;
+
+static void run_state_score(void *arg)
+{
+    tagger_arg_t *ta = (tagger_arg_t*)arg;
+    ta->tagger->set(ta->tagger, &ta->instances[ta->i++ % NUM_INSTANCES]);
+}
+
+static void run_to_id(void *arg)
+{
+    int i;
+    tagger_arg_t *ta = (tagger_arg_t*)arg;
+    for (i = 0;i < NUM_NAMES;++i) {
+        ta->attrs->to_id(ta->attrs, ta->names[i]);
+    }
+}
+
+static int build_model(const bench_option_t *opt, int L, int S)
+{
+    int a, i, j, k, ret = 0;
+    char name[16];
+    logging_t lg;
+    floatval_t *w = NULL;
+    crf1df_feature_t *features = NULL;
+    feature_refs_t *attributes = NULL, *trans = NULL;
+    crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
+    const int A = opt->num_attributes;
+    const int K = A * S + L * L;
+
+    memset(&lg, 0, sizeof(lg));
+    features = (crf1df_feature_t*)calloc(K, sizeof(crf1df_feature_t));
+    w = (floatval_t*)calloc(K, sizeof(floatval_t));
+    if (features == NULL || w == NULL ||
+        crfsuite_create_instance("dictionary", (void**)&attrs) == 0 ||
+        crfsuite_create_instance("dictionary", (void**)&labels) == 0) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto exit;
+    }
+
+    for (i = 0;i < L;++i) {
+        sprintf(name, "L%d", i);
+        labels->get(labels, name);
+    }
+    for (a = 0;a < A;++a) {
+        sprintf(name, "a%d", a);
+        attrs->get(attrs, name);
+    }
+
+    /* Associate an attribute with S labels, and connect all label pairs. */
+    k = 0;
+    for (a = 0;a < A;++a) {
+        for (j = 0;j < S;++j) {
+            features[k].type = FT_STATE;
+            features[k].src = a;
+            features[k].dst = (a + j) % L;
+            features[k].freq = 1;
+            ++k;
+        }
+    }
+    for (i = 0;i < L;++i) {
+        for (j = 0;j < L;++j) {
+            features[k].type = FT_TRANS;
+            features[k].src = i;
+            features[k].dst = j;
+            features[k].freq = 1;
+            ++k;
+        }
+    }
+
+    /* Non-zero random weights in [-1, 1). */
+    for (k = 0;k < K;++k) {
+        w[k] = 2. * rng_uniform() - 1.;
+        if (w[k] == 0.) {
+            w[k] = 0.5;
+        }
+    }
+
+    if ((ret = crf1df_init_references(&attributes, &trans, features, K, A, L))) {
+        goto exit;
+    }
+    ret = crf1df_save_model(opt->model, 2, features, attributes, trans, K, A, L, w, attrs, labels, &lg);
+
+exit:
+    if (attributes != NULL) {
+        for (a = 0;a < A;++a) {
+            free(attributes[a].fids);
+        }
+        free(attributes);
+    }
+    if (trans != NULL) {
+        for (i = 0;i < L;++i) {
+            free(trans[i].fids);
+        }
+        free(trans);
+    }
+    if (labels != NULL) {
+        labels->release(labels);
+    }
+    if (attrs != NULL) {
+        attrs->release(attrs);
+    }
+    free(w);
+    free(features);
+    return ret;
+}
+
+static int bench_tagger(const bench_option_t *opt, int L, double sparsity, int lookups)
+{
+    int i, n, t, c, ret = 0;
+    int S = (int)(sparsity * L + 0.5);
+    crfsuite_model_t *model = NULL;
+    tagger_arg_t ta;
+    kernel_info_t info;
+    const int A = opt->num_attributes;
+    const int C = opt->num_contents;
+
+    memset(&ta, 0, sizeof(ta));
+    if (S < 1) S = 1;
+    if (L < S) S = L;
+
+    /* Build a random model, and open the tagger. */
+    if ((ret = build_model(opt, L, S)) ||
+        (ret = crfsuite_create_instance_from_file(opt->model, (void**)&model)) ||
+        (ret = model->get_tagger(model, &ta.tagger)) ||
+        (ret = model->get_attrs(model, &ta.attrs))) {
+        fprintf(stderr, "ERROR: Failed to build a model (%d)\n", ret);
+        goto exit;
+    }
+
+    ta.instances = (crfsuite_instance_t*)calloc(NUM_INSTANCES, sizeof(crfsuite_instance_t));
+    ta.names = (char (*)[16])calloc(NUM_NAMES, sizeof(*ta.names));
+    if (ta.instances == NULL || ta.names == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto exit;
+    }
+
+    /* Look up random attribute names (which do not depend on L). */
+    if (lookups) {
+        for (i = 0;i < NUM_NAMES;++i) {
+            sprintf(ta.names[i], "a%u", rng_next() % A);
+        }
+        info.kernel = "cqdb_to_id";
+        info.L = -1;
+        info.T = -1;
+        info.sparsity = -1;
+        info.items = NUM_NAMES;
+        info.flops = -1;
+        info.bytes = -1;
+        measure(opt, &info, run_to_id, &ta);
+    }
+
+    for (n = 0;n < opt->num_lengths;++n) {
+        const int T = opt->lengths[n];
+
+        /* Random instances with C attributes per item. */
+        for (i = 0;i < NUM_INSTANCES;++i) {
+            crfsuite_instance_t *inst = &ta.instances[i];
+            crfsuite_instance_init(inst);
+            for (t = 0;t < T;++t) {
+                crfsuite_item_t item;
+                crfsuite_item_init(&item);
+                for (c = 0;c < C;++c) {
+                    crfsuite_attribute_t cont;
+                    crfsuite_attribute_set(&cont, rng_next() % A, 1.);
+                    crfsuite_item_append_attribute(&item, &cont);
+                }
+                crfsuite_instance_append_move(inst, &item, 0);
+            }
+        }
+
+        info.kernel = "crf1dt_state_score";
+        info.L = L;
+        info.T = T;
+        info.sparsity = sparsity;
+        info.items = T;
+        info.flops = 2. * C * S;
+        info.bytes = C * (S * (sizeof(floatval_t) + (S < L ? sizeof(int) : 0)) + sizeof(crfsuite_attribute_t)) + L * sizeof(floatval_t);
+        measure(opt, &info, run_state_score, &ta);
+
+        for (i = 0;i < NUM_INSTANCES;++i) {
+            crfsuite_instance_finish(&ta.instances[i]);
+        }
+    }
+
+exit:
+    free(ta.names);
+    free(ta.instances);
+    if (ta.attrs != NULL) {
+        ta.attrs->release(ta.attrs);
+    }
+    if (ta.tagger != NULL) {
+        ta.tagger->release(ta.tagger);
+    }
+    if (model != NULL) {
+        model->release(model);
+    }
+    remove(opt->model);
+    return ret;
+}
+
+static int parse_ints(const char *arg, int *values)
+{
+    int n = 0;
+    char *end = NULL;
+    while (n < MAX_VALUES) {
+        values[n] = (int)strtol(arg, &end, 10);
+        if (end == arg || values[n] <= 0) {
+            return -1;
+        }
+        ++n;
+        if (*end != ',') break;
+        arg = end + 1;
+    }
+    return (*end == '\0') ? n : -1;
+}
+
+static int parse_doubles(const char *arg, double *values)
+{
+    int n = 0;
+    char *end = NULL;
+    while (n < MAX_VALUES) {
+        values[n] = strtod(arg, &end);
+        if (end == arg || values[n] <= 0. || 1. < values[n]) {
+            return -1;
+        }
+        ++n;
+        if (*end != ',') break;
+        arg = end + 1;
+    }
+    return (*end == '\0') ? n : -1;
+}
+
+static void show_usage(FILE *fp, const char *argv0)
+{
+    fprintf(fp, "USAGE: %s [OPTIONS]\n", argv0);
+    fprintf(fp, "Measure the kernels of CRFSuite on synthetic data, and write the results in\n");
+    fprintf(fp, "tab-separated values to STDOUT\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "OPTIONS:\n");
+    fprintf(fp, "    -L LIST     numbers of labels (DEFAULT='2,8,32,128')\n");
+    fprintf(fp, "    -T LIST     lengths of sequences (DEFAULT='10,100,1000')\n");
+    fprintf(fp, "    -s LIST     fractions of labels associated with an attribute\n");
+    fprintf(fp, "                (DEFAULT='0.1,1')\n");
+    fprintf(fp, "    -A N        number of attributes in a model (DEFAULT=10000)\n");
+    fprintf(fp, "    -c N        number of attributes per item (DEFAULT=10)\n");
+    fprintf(fp, "    -w N        number of calls for warming up (DEFAULT=3)\n");
+    fprintf(fp, "    -r N        number of repetitions (DEFAULT=10)\n");
+    fprintf(fp, "    -m MSEC     approximate milliseconds per repetition (DEFAULT=10)\n");
+    fprintf(fp, "    -o FILE     temporary model file (DEFAULT='kernels.model')\n");
+    fprintf(fp, "    -h          show this help message and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int i, j, ret = 0;
+    bench_option_t opt;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.num_labels = parse_ints("2,8,32,128", opt.labels);
+    opt.num_lengths = parse_ints("10,100,1000", opt.lengths);
+    opt.num_sparsities = parse_doubles("0.1,1", opt.sparsities);
+    opt.num_attributes = 10000;
+    opt.num_contents = 10;
+    opt.warmup = 3;
+    opt.reps = 10;
+    opt.msec = 10.;
+    opt.model = "kernels.model";
+
+    /* Parse the command-line options. */
+    for (i = 1;i < argc;++i) {
+        const char *arg = (i + 1 < argc) ? argv[i+1] : NULL;
+        if (strcmp(argv[i], "-h") == 0) {
+            show_usage(stdout, argv[0]);
+            return 0;
+        } else if (arg == NULL || argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0') {
+            ret = 1;
+        } else if (argv[i][1] == 'L') {
+            ret = ((opt.num_labels = parse_ints(arg, opt.labels)) < 0);
+        } else if (argv[i][1] == 'T') {
+            ret = ((opt.num_lengths = parse_ints(arg, opt.lengths)) < 0);
+        } else if (argv[i][1] == 's') {
+            ret = ((opt.num_sparsities = parse_doubles(arg, opt.sparsities)) < 0);
+        } else if (argv[i][1] == 'A') {
+            ret = ((opt.num_attributes = atoi(arg)) <= 0);
+        } else if (argv[i][1] == 'c') {
+            ret = ((opt.num_contents = atoi(arg)) <= 0);
+        } else if (argv[i][1] == 'w') {
+            ret = ((opt.warmup = atoi(arg)) < 0);
+        } else if (argv[i][1] == 'r') {
+            ret = ((opt.reps = atoi(arg)) <= 0);
+        } else if (argv[i][1] == 'm') {
+            ret = ((opt.msec = atof(arg)) <= 0.);
+        } else if (argv[i][1] == 'o') {
+            opt.model = arg;
+        } else {
+            ret = 1;
+        }
+        if (ret) {
+            fprintf(stderr, "ERROR: Invalid option: %s\n", argv[i]);
+            show_usage(stderr, argv[0]);
+            return 1;
+        }
+        ++i;
+    }
+
+    printf("# CRFSuite %s kernels (floatval_t: %d bytes)\n", CRFSUITE_VERSION, (int)sizeof(floatval_t));
+    printf("kernel\tL\tT\tsparsity\treps\tns_per_item\tns_per_item_min\tgflops\tbytes_per_item\n");
+
+    for (i = 0;i < opt.num_labels;++i) {
+        for (j = 0;j < opt.num_lengths;++j) {
+            if ((ret = bench_context(&opt, opt.labels[i], opt.lengths[j]))) {
+                return ret;
+            }
+        }
+        for (j = 0;j < opt.num_sparsities;++j) {
+            if ((ret = bench_tagger(&opt, opt.labels[i], opt.sparsities[j], i == 0 && j == 0))) {
+                return ret;
+            }
+        }
+    }
+
+    return 0;
+}
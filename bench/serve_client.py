@@ -0,0 +1,53 @@
+#!/usr/bin/env python
+
+"""
+A client for the serve command of CRFsuite.
+
+Usage: serve_client.py SOCKET [FILE]
+Send the instances in FILE (or STDIN) to the server listening on SOCKET,
+and write the tagging result to STDOUT.
+"""
+
+import socket
+import sys
+
+class ServeError(Exception):
+    pass
+
+class Client:
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.fi = self.sock.makefile('rb')
+
+    def close(self):
+        self.fi.close()
+        self.sock.close()
+
+    def tag(self, data):
+        """Send data (bytes in the format of the tag command) and return the
+        tagging result as bytes."""
+        self.sock.sendall(('%d\n' % len(data)).encode('ascii') + data)
+        line = self.fi.readline()
+        if not line:
+            raise ServeError('the connection was closed by the server')
+        line = line.decode('ascii').rstrip('\n')
+        if line.startswith('OK '):
+            size = int(line[3:])
+            out = self.fi.read(size)
+            if len(out) != size:
+                raise ServeError('the response was truncated')
+            return out
+        raise ServeError(line)
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.stderr.write(__doc__.lstrip())
+        sys.exit(1)
+    fi = open(sys.argv[2], 'rb') if 2 < len(sys.argv) else sys.stdin
+    fi = getattr(fi, 'buffer', fi)
+    fo = getattr(sys.stdout, 'buffer', sys.stdout)
+
+    client = Client(sys.argv[1])
+    fo.write(client.tag(fi.read()))
+    client.close()
@@ -0,0 +1,443 @@
+/*
+ *        Generate command for CRFsuite frontend.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* $Id$ */
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include <crfsuite.h>
+#include "option.h"
+
+/* The initial state of the random number generator. */
+#define    RNG_SEED    88172645463325252ULL
+
+enum {
+    LENGTH_FIXED = 0,   /**< Every instance has the mean length. */
+    LENGTH_UNIFORM,     /**< Uniform in [1, 2*mean-1]. */
+    LENGTH_GEOMETRIC    /**< Geometric with the mean. */
+};
+
+typedef struct {
+    long num_train;
+    long num_test;
+    int length;
+    int length_dist;
+    int max_length;
+    int num_labels;
+    int num_attributes;
+    double zipf;
+    int attributes_per_item;
+    int successors;
+    double stickiness;
+    double signal;
+    unsigned long seed;
+    int help;
+} generate_option_t;
+
+/**
+ * The generative model of a synthetic dataset.
+ *  Labels follow a first-order Markov chain in which every label has a
+ *  fixed number of successors. Attributes follow a Zipfian distribution
+ *  over the vocabulary; an attribute is drawn from a label-specific
+ *  rotation of the vocabulary with the probability of the signal, and
+ *  from the shared vocabulary otherwise.
+ */
+typedef struct {
+    uint64_t rng; /**< The state of the random number generator. */
+    int L;                  /**< The number of labels. */
+    int V;                  /**< The number of attributes. */
+    double *zipf;           /**< [V] The cumulative distribution of the attribute ranks. */
+    double *initial;        /**< [L] The cumulative distribution of the first label. */
+    double *trans;          /**< [L][L] The cumulative distributions of the successors. */
+} generator_t;
+
+static void generate_option_init(generate_option_t* opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->num_train = 10000;
+    opt->num_test = -1;
+    opt->length = 20;
+    opt->length_dist = LENGTH_UNIFORM;
+    opt->max_length = 1000;
+    opt->num_labels = 10;
+    opt->num_attributes = 100000;
+    opt->zipf = 1.0;
+    opt->attributes_per_item = 10;
+    opt->successors = 3;
+    opt->stickiness = 0.;
+    opt->signal = 0.5;
+    opt->seed = 1;
+}
+
+static void generate_option_finish(generate_option_t* opt)
+{
+}
+
+BEGIN_OPTION_MAP(parse_generate_options, generate_option_t)
+
+    ON_OPTION_WITH_ARG(SHORTOPT('n') || LONGOPT("instances"))
+        opt->num_train = atol(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('N') || LONGOPT("test-instances"))
+        opt->num_test = atol(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('l') || LONGOPT("length"))
+        opt->length = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('d') || LONGOPT("length-dist"))
+        if (strcmp(arg, "fixed") == 0) {
+            opt->length_dist = LENGTH_FIXED;
+        } else if (strcmp(arg, "uniform") == 0) {
+            opt->length_dist = LENGTH_UNIFORM;
+        } else if (strcmp(arg, "geometric") == 0) {
+            opt->length_dist = LENGTH_GEOMETRIC;
+        } else {
+            fprintf(stderr, "ERROR: Unknown length distribution: %s\n", arg);
+            return -1;
+        }
+
+    ON_OPTION_WITH_ARG(SHORTOPT('x') || LONGOPT("max-length"))
+        opt->max_length = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('L') || LONGOPT("labels"))
+        opt->num_labels = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('V') || LONGOPT("attributes"))
+        opt->num_attributes = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('z') || LONGOPT("zipf"))
+        opt->zipf = atof(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('a') || LONGOPT("attributes-per-item"))
+        opt->attributes_per_item = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('k') || LONGOPT("successors"))
+        opt->successors = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('t') || LONGOPT("stickiness"))
+        opt->stickiness = atof(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('g') || LONGOPT("signal"))
+        opt->signal = atof(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('s') || LONGOPT("seed"))
+        opt->seed = strtoul(arg, NULL, 10);
+
+    ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
+        opt->help = 1;
+
+END_OPTION_MAP()
+
+static void show_usage(FILE *fp, const char *argv0, const char *command)
+{
+    fprintf(fp, "USAGE: %s %s [OPTIONS] <TRAIN> <TEST>\n", argv0, command);
+    fprintf(fp, "Write a synthetic dataset in the IWA format to the files of the training (TRAIN)\n");
+    fprintf(fp, "and test (TEST) splits. Both splits are drawn from the same generative model, so\n");
+    fprintf(fp, "that the same options and seed reproduce the same files on every platform.\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "OPTIONS:\n");
+    fprintf(fp, "    -n, --instances=N   Write N instances to the training split (DEFAULT=10000)\n");
+    fprintf(fp, "    -N, --test-instances=N\n");
+    fprintf(fp, "                        Write N instances to the test split (DEFAULT=N/10 of the\n");
+    fprintf(fp, "                        training split)\n");
+    fprintf(fp, "    -l, --length=M      Set the mean number of items per instance (DEFAULT=20)\n");
+    fprintf(fp, "    -d, --length-dist=NAME\n");
+    fprintf(fp, "                        Specify the distribution of the lengths (DEFAULT='uniform')\n");
+    fprintf(fp, "        fixed               Every instance has M items\n");
+    fprintf(fp, "        uniform             Uniform in [1, 2M-1]\n");
+    fprintf(fp, "        geometric           Geometric with the mean M\n");
+    fprintf(fp, "    -x, --max-length=M  Truncate the instances to M items (DEFAULT=1000)\n");
+    fprintf(fp, "    -L, --labels=L      Use L labels (DEFAULT=10)\n");
+    fprintf(fp, "    -V, --attributes=V  Use a vocabulary of V attributes (DEFAULT=100000)\n");
+    fprintf(fp, "    -z, --zipf=S        Set the exponent of the Zipfian distribution of the\n");
+    fprintf(fp, "                        attributes (DEFAULT=1.0)\n");
+    fprintf(fp, "    -a, --attributes-per-item=A\n");
+    fprintf(fp, "                        Draw A attributes for every item (DEFAULT=10)\n");
+    fprintf(fp, "    -k, --successors=K  Allow K successors of every label in the label\n");
+    fprintf(fp, "                        transitions; 0 allows all labels (DEFAULT=3)\n");
+    fprintf(fp, "    -t, --stickiness=P  Repeat the previous label with the probability P in\n");
+    fprintf(fp, "                        addition to the successors (DEFAULT=0)\n");
+    fprintf(fp, "    -g, --signal=P      Draw an attribute from the vocabulary specific to the label\n");
+    fprintf(fp, "                        with the probability P (DEFAULT=0.5)\n");
+    fprintf(fp, "    -s, --seed=SEED     Set the seed of the random numbers (DEFAULT=1)\n");
+    fprintf(fp, "    -h, --help          Show the usage of this command and exit\n");
+}
+
+static uint64_t generator_random(generator_t* gen)
+{
+    /* xorshift64*; the state must not be zero. */
+    uint64_t x = gen->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    gen->rng = x;
+    return x * 2685821657736338717ULL;
+}
+
+static double generator_uniform(generator_t* gen)
+{
+    /* A uniform number in [0, 1) from the upper 53 bits. */
+    return (generator_random(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Draw an index from a cumulative distribution.
+ *  @param  cdf         The cumulative distribution of n elements.
+ *  @param  n           The number of elements.
+ *  @return int         The index drawn.
+ */
+static int generator_draw(generator_t* gen, const double *cdf, int n)
+{
+    int lo = 0, hi = n - 1;
+    double u = generator_uniform(gen) * cdf[n-1];
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (u < cdf[mid]) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+static void generator_delete(generator_t* gen)
+{
+    free(gen->zipf);
+    free(gen->initial);
+    free(gen->trans);
+}
+
+static int generator_init(generator_t* gen, const generate_option_t* opt)
+{
+    int i, j;
+    const int L = opt->num_labels;
+    const int V = opt->num_attributes;
+    const int K = (opt->successors <= 0 || L < opt->successors) ? L : opt->successors;
+    int *perm = NULL;
+
+    memset(gen, 0, sizeof(*gen));
+    gen->rng = RNG_SEED ^ ((uint64_t)opt->seed * 0x9E3779B97F4A7C15ULL);
+    if (gen->rng == 0) {
+        gen->rng = RNG_SEED;
+    }
+    gen->L = L;
+    gen->V = V;
+
+    gen->zipf = (double*)malloc(sizeof(double) * V);
+    gen->initial = (double*)malloc(sizeof(double) * L);
+    gen->trans = (double*)calloc((size_t)L * L, sizeof(double));
+    perm = (int*)malloc(sizeof(int) * L);
+    if (gen->zipf == NULL || gen->initial == NULL || gen->trans == NULL || perm == NULL) {
+        free(perm);
+        generator_delete(gen);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    /* The attribute of rank r has the weight 1 / r^s. */
+    for (i = 0;i < V;++i) {
+        gen->zipf[i] = (0 < i ? gen->zipf[i-1] : 0.) + pow(i + 1, -opt->zipf);
+    }
+
+    /* The first label follows random weights. */
+    for (i = 0;i < L;++i) {
+        gen->initial[i] = (0 < i ? gen->initial[i-1] : 0.) + generator_uniform(gen) + 1e-3;
+    }
+
+    /*
+        Every label moves to K successors chosen at random (a partial
+        Fisher-Yates shuffle) with random weights, and stays at itself
+        with the probability of the stickiness.
+     */
+    for (i = 0;i < L;++i) {
+        double *cdf = &gen->trans[(size_t)i * L];
+        double sum = 0.;
+
+        for (j = 0;j < L;++j) {
+            perm[j] = j;
+        }
+        for (j = 0;j < K;++j) {
+            int r = j + (int)(generator_random(gen) % (uint64_t)(L - j));
+            int tmp = perm[j]; perm[j] = perm[r]; perm[r] = tmp;
+            cdf[perm[j]] = generator_uniform(gen) + 1e-3;
+            sum += cdf[perm[j]];
+        }
+        for (j = 0;j < L;++j) {
+            cdf[j] *= (1. - opt->stickiness) / sum;
+        }
+        cdf[i] += opt->stickiness;
+        for (j = 1;j < L;++j) {
+            cdf[j] += cdf[j-1];
+        }
+    }
+
+    free(perm);
+    return 0;
+}
+
+static int generator_length(generator_t* gen, const generate_option_t* opt)
+{
+    int n = opt->length;
+
+    switch (opt->length_dist) {
+    case LENGTH_UNIFORM:
+        n = 1 + (int)(generator_random(gen) % (uint64_t)(2 * opt->length - 1));
+        break;
+    case LENGTH_GEOMETRIC:
+        /* The number of trials up to the first success of the probability 1/mean. */
+        n = 1 + (int)floor(log(1. - generator_uniform(gen)) / log(1. - 1. / opt->length));
+        break;
+    }
+    return (opt->max_length < n) ? opt->max_length : n;
+}
+
+/**
+ * Write instances drawn from the generative model.
+ *  @param  gen         The generative model.
+ *  @param  opt         The options.
+ *  @param  fp          The output stream.
+ *  @param  n           The number of instances.
+ *  @return long        The number of items written.
+ */
+static long generate_instances(generator_t* gen, const generate_option_t* opt, FILE *fp, long n)
+{
+    long i, num_items = 0;
+    int t, a, T;
+
+    for (i = 0;i < n;++i) {
+        int y = -1;
+        T = generator_length(gen, opt);
+        for (t = 0;t < T;++t) {
+            y = (y < 0) ?
+                generator_draw(gen, gen->initial, gen->L) :
+                generator_draw(gen, &gen->trans[(size_t)y * gen->L], gen->L);
+            fprintf(fp, "L%d", y);
+            for (a = 0;a < opt->attributes_per_item;++a) {
+                int r = generator_draw(gen, gen->zipf, gen->V);
+                if (generator_uniform(gen) < opt->signal) {
+                    /* Rotate the vocabulary by the offset of the label. */
+                    r = (int)((r + (int64_t)gen->V * y / gen->L) % gen->V);
+                }
+                fprintf(fp, "\ta%d", r);
+            }
+            fprintf(fp, "\n");
+        }
+        fprintf(fp, "\n");
+        num_items += T;
+    }
+    return num_items;
+}
+
+int main_generate(int argc, char *argv[], const char *argv0)
+{
+    int ret = 0, arg_used = 0;
+    long num_items = 0;
+    generate_option_t opt;
+    generator_t gen;
+    const char *command = argv[0];
+    FILE *fp = NULL, *fpo = stdout, *fpe = stderr;
+
+    memset(&gen, 0, sizeof(gen));
+
+    /* Parse the command-line option. */
+    generate_option_init(&opt);
+    arg_used = option_parse(++argv, --argc, parse_generate_options, &opt);
+    if (arg_used < 0) {
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Show the help message for this command if specified. */
+    if (opt.help) {
+        show_usage(fpo, argv0, command);
+        goto force_exit;
+    }
+
+    /* Check for the files of the splits. */
+    if (argc < arg_used + 2) {
+        fprintf(fpe, "ERROR: The files of the training and test splits must be specified.\n");
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Check the options. */
+    if (opt.num_test < 0) {
+        opt.num_test = opt.num_train / 10;
+    }
+    if (opt.num_train < 0 || opt.length < 1 || opt.max_length < 1 ||
+        opt.num_labels < 1 || opt.num_attributes < 1 || opt.attributes_per_item < 0 ||
+        opt.stickiness < 0. || 1. < opt.stickiness || opt.signal < 0. || 1. < opt.signal) {
+        fprintf(fpe, "ERROR: Invalid options. See help (-h) for the usage.\n");
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Build the generative model. */
+    if (ret = generator_init(&gen, &opt)) {
+        fprintf(fpe, "ERROR: Failed to build the generative model.\n");
+        goto force_exit;
+    }
+
+    /* Write the training split, and the test split from the subsequent random numbers. */
+    fp = fopen(argv[arg_used], "w");
+    if (fp == NULL) {
+        fprintf(fpe, "ERROR: Failed to open the file: %s\n", argv[arg_used]);
+        ret = 1;
+        goto force_exit;
+    }
+    num_items = generate_instances(&gen, &opt, fp, opt.num_train);
+    fclose(fp);
+    fprintf(fpo, "Training split: %ld instances, %ld items (%s)\n",
+        opt.num_train, num_items, argv[arg_used]);
+
+    fp = fopen(argv[arg_used+1], "w");
+    if (fp == NULL) {
+        fprintf(fpe, "ERROR: Failed to open the file: %s\n", argv[arg_used+1]);
+        ret = 1;
+        goto force_exit;
+    }
+    num_items = generate_instances(&gen, &opt, fp, opt.num_test);
+    fclose(fp);
+    fprintf(fpo, "Test split: %ld instances, %ld items (%s)\n",
+        opt.num_test, num_items, argv[arg_used+1]);
+
+force_exit:
+    generator_delete(&gen);
+    generate_option_finish(&opt);
+    return ret;
+}
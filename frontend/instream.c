@@ -0,0 +1,455 @@
+/*
+ *        Input stream with transparent decompression.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  HAVE_PTHREAD_H
+#include <pthread.h>
+#endif/*HAVE_PTHREAD_H*/
+
+#ifdef    HAVE_LIBZ
+#include <zlib.h>
+#endif/*HAVE_LIBZ*/
+
+#include "instream.h"
+
+/*
+ * A compressed stream is decompressed by a background thread into a ring
+ * of blocks so that decompression overlaps with parsing. Each block
+ * remembers the position in the compressed file at which it was produced,
+ * which lets a reader report progress against the compressed size.
+ * Without pthreads, the reader decompresses a single block on demand.
+ */
+
+#define    RAW_SIZE        (1 << 16)
+#define    BLOCK_SIZE      (1 << 18)
+#ifdef  HAVE_PTHREAD_H
+#define    NUM_BLOCKS      4
+#else
+#define    NUM_BLOCKS      1
+#endif/*HAVE_PTHREAD_H*/
+
+enum {
+    FORMAT_PLAIN = 0,
+    FORMAT_GZIP,
+};
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t offset;
+    long position;
+} block_t;
+
+struct tag_instream {
+    FILE *fp;
+    int format;
+    long begin;
+    long position;
+    int error;
+
+    /* The bytes read ahead to detect the format. */
+    unsigned char magic[2];
+    size_t num_magic;
+    size_t offset_magic;
+
+#ifdef    HAVE_LIBZ
+    /* The state of the decompressor. */
+    z_stream zs;
+    unsigned char *in;
+    int ret;
+    long zposition;
+#endif/*HAVE_LIBZ*/
+
+    /* The ring of blocks. */
+    block_t blocks[NUM_BLOCKS];
+    int num_produced;
+    int num_consumed;
+    int eof;
+    int stop;
+
+#ifdef  HAVE_PTHREAD_H
+    /* The decompression thread. */
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif/*HAVE_PTHREAD_H*/
+};
+
+#ifdef    HAVE_LIBZ
+
+static int gzip_begin(instream_t* ins)
+{
+    ins->in = (unsigned char*)malloc(RAW_SIZE);
+    if (ins->in == NULL) {
+        return -1;
+    }
+    memset(&ins->zs, 0, sizeof(ins->zs));
+    if (inflateInit2(&ins->zs, 15 + 32) != Z_OK) {
+        free(ins->in);
+        ins->in = NULL;
+        return -1;
+    }
+
+    /* Feed the magic bytes read for detecting the format. */
+    memcpy(ins->in, ins->magic, ins->num_magic);
+    ins->zs.next_in = ins->in;
+    ins->zs.avail_in = (uInt)ins->num_magic;
+    ins->zposition = ins->begin + (long)ins->num_magic;
+    ins->ret = Z_OK;
+    return 0;
+}
+
+static void gzip_end(instream_t* ins)
+{
+    if (ins->in != NULL) {
+        inflateEnd(&ins->zs);
+        free(ins->in);
+        ins->in = NULL;
+    }
+}
+
+/**
+ * Fill a block with decompressed data.
+ *  @param  ins         The input stream.
+ *  @param  block       The block to be filled.
+ *  @param  error       The pointer to the error flag, set on an error.
+ *  @return int         Non-zero if the decompression has finished.
+ */
+static int gzip_fill(instream_t* ins, block_t* block, int *error)
+{
+    int done = 0;
+    z_stream *zs = &ins->zs;
+
+    while (block->size < BLOCK_SIZE) {
+        if (zs->avail_in == 0) {
+            size_t count = fread(ins->in, 1, RAW_SIZE, ins->fp);
+            if (count == 0) {
+                /* The stream must not end in the middle of a member. */
+                *error |= (ins->ret != Z_STREAM_END || ferror(ins->fp));
+                done = 1;
+                break;
+            }
+            ins->zposition += (long)count;
+            zs->next_in = ins->in;
+            zs->avail_in = (uInt)count;
+        }
+
+        /* Start the next member of a concatenated stream. */
+        if (ins->ret == Z_STREAM_END) {
+            inflateReset(zs);
+        }
+
+        zs->next_out = (Bytef*)block->data + block->size;
+        zs->avail_out = (uInt)(BLOCK_SIZE - block->size);
+        ins->ret = inflate(zs, Z_NO_FLUSH);
+        block->size = BLOCK_SIZE - zs->avail_out;
+        if (ins->ret != Z_OK && ins->ret != Z_STREAM_END && ins->ret != Z_BUF_ERROR) {
+            *error = 1;
+            done = 1;
+            break;
+        }
+    }
+
+    block->position = ins->zposition - (long)zs->avail_in;
+    return done;
+}
+
+#ifdef  HAVE_PTHREAD_H
+
+/**
+ * Obtain a vacant block for the decompressor.
+ *  @return block_t*    The block, or \c NULL if the stream is closed.
+ */
+static block_t* produce_begin(instream_t* ins)
+{
+    block_t* block = NULL;
+
+    pthread_mutex_lock(&ins->mutex);
+    while (!ins->stop && NUM_BLOCKS <= ins->num_produced - ins->num_consumed) {
+        pthread_cond_wait(&ins->cond, &ins->mutex);
+    }
+    if (!ins->stop) {
+        block = &ins->blocks[ins->num_produced % NUM_BLOCKS];
+        block->size = 0;
+        block->offset = 0;
+    }
+    pthread_mutex_unlock(&ins->mutex);
+    return block;
+}
+
+static void produce_end(instream_t* ins, int eof, int error)
+{
+    pthread_mutex_lock(&ins->mutex);
+    if (!eof || 0 < ins->blocks[ins->num_produced % NUM_BLOCKS].size) {
+        ++ins->num_produced;
+    }
+    ins->eof = eof;
+    ins->error |= error;
+    pthread_cond_broadcast(&ins->cond);
+    pthread_mutex_unlock(&ins->mutex);
+}
+
+static void* gzip_thread(void *arg)
+{
+    int error = 0, done = 0;
+    block_t* block = NULL;
+    instream_t* ins = (instream_t*)arg;
+
+    while (!done && (block = produce_begin(ins)) != NULL) {
+        done = gzip_fill(ins, block, &error);
+        produce_end(ins, done, error);
+    }
+
+    gzip_end(ins);
+    return NULL;
+}
+
+/**
+ * Obtain a block produced by the decompressor.
+ *  @return block_t*    The block, or \c NULL at the end of the stream.
+ */
+static block_t* consume_begin(instream_t* ins)
+{
+    block_t* block = NULL;
+
+    pthread_mutex_lock(&ins->mutex);
+    while (!ins->eof && ins->num_consumed == ins->num_produced) {
+        pthread_cond_wait(&ins->cond, &ins->mutex);
+    }
+    if (ins->num_consumed < ins->num_produced) {
+        block = &ins->blocks[ins->num_consumed % NUM_BLOCKS];
+    }
+    pthread_mutex_unlock(&ins->mutex);
+    return block;
+}
+
+/**
+ * Return a block to the decompressor.
+ */
+static void consume_end(instream_t* ins)
+{
+    pthread_mutex_lock(&ins->mutex);
+    ++ins->num_consumed;
+    pthread_cond_broadcast(&ins->cond);
+    pthread_mutex_unlock(&ins->mutex);
+}
+
+#else
+
+static block_t* consume_begin(instream_t* ins)
+{
+    block_t* block = &ins->blocks[0];
+
+    /* Decompress the next block in place. */
+    while (block->offset == block->size) {
+        if (ins->eof) {
+            return NULL;
+        }
+        block->size = 0;
+        block->offset = 0;
+        ins->eof = gzip_fill(ins, block, &ins->error);
+    }
+    return block;
+}
+
+static void consume_end(instream_t* ins)
+{
+}
+
+#endif/*HAVE_PTHREAD_H*/
+
+#endif/*HAVE_LIBZ*/
+
+instream_t* instream_open(FILE *fp)
+{
+    int i;
+    instream_t* ins = (instream_t*)calloc(1, sizeof(instream_t));
+
+    if (ins == NULL) {
+        return NULL;
+    }
+
+    ins->fp = fp;
+    ins->begin = ftell(fp);
+    if (ins->begin < 0) {
+        ins->begin = 0;
+    }
+    ins->position = ins->begin;
+
+    /* Detect the format from the magic bytes. */
+    ins->num_magic = fread(ins->magic, 1, sizeof(ins->magic), fp);
+    if (ins->num_magic == 2 && ins->magic[0] == 0x1F && ins->magic[1] == 0x8B) {
+        ins->format = FORMAT_GZIP;
+    } else {
+        ins->format = FORMAT_PLAIN;
+    }
+
+    if (ins->format == FORMAT_GZIP) {
+#ifdef    HAVE_LIBZ
+        for (i = 0;i < NUM_BLOCKS;++i) {
+            ins->blocks[i].data = (char*)malloc(BLOCK_SIZE);
+            if (ins->blocks[i].data == NULL) {
+                goto error_exit;
+            }
+        }
+        if (gzip_begin(ins) != 0) {
+            goto error_exit;
+        }
+#ifdef  HAVE_PTHREAD_H
+        pthread_mutex_init(&ins->mutex, NULL);
+        pthread_cond_init(&ins->cond, NULL);
+        if (pthread_create(&ins->thread, NULL, gzip_thread, ins) != 0) {
+            pthread_cond_destroy(&ins->cond);
+            pthread_mutex_destroy(&ins->mutex);
+            gzip_end(ins);
+            goto error_exit;
+        }
+#endif/*HAVE_PTHREAD_H*/
+#else
+        fprintf(stderr, "ERROR: This program was built without the support of gzip.\n");
+        goto error_exit;
+#endif/*HAVE_LIBZ*/
+    }
+
+    return ins;
+
+error_exit:
+    for (i = 0;i < NUM_BLOCKS;++i) {
+        free(ins->blocks[i].data);
+    }
+    free(ins);
+    return NULL;
+}
+
+size_t instream_read(instream_t* ins, char *buffer, size_t size)
+{
+    size_t n = 0;
+
+    if (ins->format == FORMAT_PLAIN) {
+        size_t count;
+
+        /* Return the magic bytes first. */
+        while (n < size && ins->offset_magic < ins->num_magic) {
+            buffer[n++] = (char)ins->magic[ins->offset_magic++];
+        }
+        count = fread(buffer + n, 1, size - n, ins->fp);
+        ins->position += (long)(n + count);
+        return n + count;
+    }
+
+#ifdef    HAVE_LIBZ
+    while (n < size) {
+        size_t count;
+        block_t* block = consume_begin(ins);
+        if (block == NULL) {
+            break;
+        }
+
+        /* Copy the decompressed data. */
+        count = block->size - block->offset;
+        if (size - n < count) {
+            count = size - n;
+        }
+        memcpy(buffer + n, block->data + block->offset, count);
+        block->offset += count;
+        ins->position = block->position;
+        n += count;
+
+        /* Return the block to the decompressor. */
+        if (block->offset == block->size) {
+            consume_end(ins);
+        }
+    }
+#endif/*HAVE_LIBZ*/
+
+    return n;
+}
+
+long instream_tell(instream_t* ins)
+{
+    return ins->position;
+}
+
+int instream_error(instream_t* ins)
+{
+    int error;
+
+    if (ins->format == FORMAT_PLAIN) {
+        return ferror(ins->fp);
+    }
+
+#ifdef  HAVE_PTHREAD_H
+    pthread_mutex_lock(&ins->mutex);
+    error = ins->error;
+    pthread_mutex_unlock(&ins->mutex);
+#else
+    error = ins->error;
+#endif/*HAVE_PTHREAD_H*/
+    return error;
+}
+
+void instream_close(instream_t* ins)
+{
+    int i;
+
+    if (ins != NULL) {
+        if (ins->format != FORMAT_PLAIN) {
+#ifdef  HAVE_PTHREAD_H
+            /* Stop the decompressor. */
+            pthread_mutex_lock(&ins->mutex);
+            ins->stop = 1;
+            pthread_cond_broadcast(&ins->cond);
+            pthread_mutex_unlock(&ins->mutex);
+            pthread_join(ins->thread, NULL);
+            pthread_cond_destroy(&ins->cond);
+            pthread_mutex_destroy(&ins->mutex);
+#else
+#ifdef    HAVE_LIBZ
+            gzip_end(ins);
+#endif/*HAVE_LIBZ*/
+#endif/*HAVE_PTHREAD_H*/
+        }
+        for (i = 0;i < NUM_BLOCKS;++i) {
+            free(ins->blocks[i].data);
+        }
+        free(ins);
+    }
+}
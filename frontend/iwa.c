@@ -34,58 +34,40 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "iwa.h"
+#ifdef  USE_SSE
+#include <emmintrin.h>
+#endif/*USE_SSE*/
 
-typedef struct {
-    size_t size;
-    size_t offset;
-    char *value;
-} iwa_string_t;
+#include "instream.h"
+#include "iwa.h"
 
+/*
+ * The reader tokenizes the data in its buffer in place: a field without
+ * escape sequences is returned as a pointer to the buffer, and the NUL
+ * character terminating the field overwrites the delimiter following the
+ * field. The overwritten delimiter is kept in the reader, and restored at
+ * the next call of iwa_read(). A field with escape sequences is unescaped
+ * in place; it becomes shorter than the original text, and thus, never
+ * overwrites the delimiter.
+ */
 struct tag_iwa {
-    FILE *fp;
+    instream_t* ins;    /**< The input stream (NULL when reading a memory block). */
+    int eof;
 
     iwa_token_t token;
 
-    char *buffer;
-    char *offset;
-    char *end;
+    char *buffer;       /**< The buffer (NULL when reading a memory block). */
+    size_t size;        /**< The size of the buffer. */
+    char *offset;       /**< The current position. */
+    char *end;          /**< The end of the data; *end is always NUL. */
 
-    iwa_string_t attr;
-    iwa_string_t value;
+    char *held;         /**< The position of the overwritten delimiter. */
+    char hold;          /**< The overwritten delimiter. */
 };
 
-#define    DEFAULT_SIZE    4096
-#define    BUFFER_SIZE        (DEFAULT_SIZE * 16)
+#define    BUFFER_SIZE     (4096 * 16)
 
-static void string_init(iwa_string_t* str)
-{
-    str->value = (char*)calloc(DEFAULT_SIZE, sizeof(char));
-    str->size = DEFAULT_SIZE;
-    str->offset = 0;
-}
-
-static void string_finish(iwa_string_t* str)
-{
-    free(str->value);
-    memset(str, 0, sizeof(*str));
-}
-
-static void string_clear(iwa_string_t* str)
-{
-    memset(str->value, 0, str->size);
-    str->offset = 0;
-}
-
-static void string_append(iwa_string_t* str, int c)
-{
-    if (str->size <= str->offset) {
-        str->size *= 2;
-        str->value = (char*)realloc(str->value, str->size);
-        memset(&str->value[str->offset], 0, str->size - str->offset);
-    }
-    str->value[str->offset++] = c;
-}
+static const char empty_string[] = "";
 
 iwa_t* iwa_reader(FILE *fp)
 {
@@ -97,18 +79,41 @@ iwa_t* iwa_reader(FILE *fp)
 
     memset(iwa, 0, sizeof(iwa_t));
 
-    iwa->fp = fp;
+    iwa->ins = instream_open(fp);
+    if (iwa->ins == NULL) {
+        goto error_exit;
+    }
 
-    iwa->buffer = (char*)malloc(sizeof(char) * BUFFER_SIZE);
-    iwa->offset = iwa->buffer + BUFFER_SIZE;
-    iwa->end = iwa->buffer + BUFFER_SIZE;
+    iwa->size = BUFFER_SIZE;
+    iwa->buffer = (char*)malloc(sizeof(char) * (iwa->size + 1));
     if (iwa->buffer == NULL) {
         goto error_exit;
     }
+    iwa->offset = iwa->buffer;
+    iwa->end = iwa->buffer;
+    *iwa->end = 0;
+
+    return iwa;
+
+error_exit:
+    iwa_delete(iwa);
+    return NULL;
+}
+
+/*
+ * The memory block is modified by the reader, and must have a writable
+ * byte just after the data (data[size]).
+ */
+iwa_t* iwa_reader_memory(char *data, size_t size)
+{
+    iwa_t* iwa = (iwa_t*)malloc(sizeof(iwa_t));
 
-    string_init(&iwa->attr);
-    string_init(&iwa->value);
+    if (iwa == NULL) {
+        goto error_exit;
+    }
 
+    memset(iwa, 0, sizeof(iwa_t));
+    iwa_reset_memory(iwa, data, size);
     return iwa;
 
 error_exit:
@@ -116,107 +121,255 @@ error_exit:
     return NULL;
 }
 
+/*
+ * The reader must have been created by iwa_reader_memory(), so that it owns
+ * neither a stream nor a buffer.
+ */
+void iwa_reset_memory(iwa_t* iwa, char *data, size_t size)
+{
+    memset(iwa, 0, sizeof(iwa_t));
+
+    /* Read the memory block directly without a buffer of our own. */
+    iwa->ins = NULL;
+    iwa->eof = 1;
+    iwa->buffer = NULL;
+    iwa->offset = data;
+    iwa->end = data + size;
+}
+
 void iwa_delete(iwa_t* iwa)
 {
     if (iwa != NULL) {
-        string_finish(&iwa->value);
-        string_finish(&iwa->attr);
+        instream_close(iwa->ins);
         free(iwa->buffer);
     }
     free(iwa);
 }
 
-static int peek_char(iwa_t* iwa)
+/*
+ * The position is measured in the (possibly compressed) input file, and
+ * thus, is suitable for reporting progress.
+ */
+long iwa_tell(iwa_t* iwa)
 {
-    /* Refill the buffer if necessary. */
-    if (iwa->end <= iwa->offset) {
-        size_t count = fread(iwa->buffer, sizeof(char), BUFFER_SIZE, iwa->fp);
-        iwa->offset = iwa->buffer;
-        iwa->end = iwa->buffer + count;
-        if (count == 0) {
-            return EOF;
-        }
-    }
+    return (iwa->ins != NULL) ? instream_tell(iwa->ins) : 0;
+}
 
-    /* Return the current character */
-    return *iwa->offset;
+int iwa_error(iwa_t* iwa)
+{
+    return (iwa->ins != NULL) ? instream_error(iwa->ins) : 0;
 }
 
-static int get_char(iwa_t* iwa)
+/**
+ * Make sure that the buffer has the whole line at the current position.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+static int fill_line(iwa_t* iwa)
 {
-    int c = peek_char(iwa);
-    if (c != EOF) {
-        ++iwa->offset;
+    size_t scanned = 0;
+
+    for (;;) {
+        size_t count, rest = iwa->end - iwa->offset;
+
+        /* Exit if the line is terminated in the buffer. */
+        if (memchr(iwa->offset + scanned, '\n', rest - scanned) != NULL) {
+            return 0;
+        }
+        scanned = rest;
+        if (iwa->eof) {
+            return 0;
+        }
+
+        /* Move the rest of the data to the head of the buffer. */
+        if (iwa->offset != iwa->buffer) {
+            memmove(iwa->buffer, iwa->offset, rest);
+            iwa->offset = iwa->buffer;
+            iwa->end = iwa->buffer + rest;
+        }
+
+        /* Expand the buffer if the line does not fit into it. */
+        if (iwa->size <= rest) {
+            size_t size = iwa->size * 2;
+            char *buffer = (char*)realloc(iwa->buffer, sizeof(char) * (size + 1));
+            if (buffer == NULL) {
+                return -1;
+            }
+            iwa->buffer = buffer;
+            iwa->size = size;
+            iwa->offset = buffer;
+            iwa->end = buffer + rest;
+        }
+
+        /* Read the data that follows. */
+        count = instream_read(iwa->ins, iwa->end, iwa->size - rest);
+        if (count == 0) {
+            iwa->eof = 1;
+        }
+        iwa->end += count;
+        *iwa->end = 0;
     }
-    return c;
 }
 
-static void read_field_unquoted(iwa_t* iwa, iwa_string_t* str)
+static int peek_char(iwa_t* iwa)
 {
-    int c;
-    /* Read until a colon, space, tab, or break-line character. */
-    while (c = peek_char(iwa), c != ':' && c != '\t' && c != '\n' && c != EOF) {
-        get_char(iwa);
-        string_append(str, c);
-    }
-    /* The input stream points to the character just after the field is terminated. */
+    return (iwa->offset < iwa->end) ? (unsigned char)*iwa->offset : EOF;
 }
 
-static void read_field_unescaped(iwa_t* iwa, iwa_string_t* str)
+#ifdef  USE_SSE
+static int first_bit(unsigned int x)
+{
+#ifdef  _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+#endif/*USE_SSE*/
+
+/**
+ * Find the end of a field.
+ *  @param  p           The beginning of the field.
+ *  @param  end         The end of the data.
+ *  @param  escaped     Set to non-zero if the field has escape sequences.
+ *  @return char*       The position of the delimiter (a colon, tab, or
+ *                      break-line character) terminating the field, or
+ *                      the end of the data.
+ */
+static char* scan_field(char *p, const char *end, int *escaped)
 {
-    int c, d;
-    /* Read until a colon, space, tab, or break-line character. */
-    while (c = peek_char(iwa), c != ':' && c != '\t' && c != '\n' && c != EOF) {
-        get_char(iwa);
-        if (c == '\\') {
-            /* Possibly a escape sequence. */
-            d = peek_char(iwa);
-            switch (d) {
-            case ':':
-            case '\\':
-                c = d;
-                get_char(iwa);
+#ifdef  USE_SSE
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i bs = _mm_set1_epi8('\\');
+#endif/*USE_SSE*/
+
+    for (;;) {
+#ifdef  USE_SSE
+        /* Find a special character in every 16 bytes. */
+        while (p + 16 <= end) {
+            __m128i x = _mm_loadu_si128((const __m128i*)p);
+            __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(x, colon), _mm_cmpeq_epi8(x, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, bs))
+                );
+            int mask = _mm_movemask_epi8(m);
+            if (mask) {
+                p += first_bit((unsigned int)mask);
                 break;
             }
+            p += 16;
+        }
+#endif/*USE_SSE*/
+
+        while (p < end && *p != ':' && *p != '\t' && *p != '\n' && *p != '\\') {
+            ++p;
+        }
+
+        if (end <= p || *p != '\\') {
+            return (end < p) ? (char*)end : p;
+        }
+
+        /* Skip an escape sequence (a backslash followed by a colon or backslash). */
+        if (p + 1 < end && (p[1] == ':' || p[1] == '\\')) {
+            *escaped = 1;
+            p += 2;
+        } else {
+            ++p;
         }
+    }
+}
+
+/**
+ * Unescape a field in place.
+ *  @return char*       The end of the unescaped field.
+ */
+static char* unescape_field(char *p, const char *end)
+{
+    char *q = p;
 
-        string_append(str, c);
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end && (p[1] == ':' || p[1] == '\\')) {
+            ++p;
+        }
+        *q++ = *p++;
     }
-    /* The input stream points to the character just after the field is terminated. */
+    return q;
 }
 
-static int read_item(iwa_t* iwa)
+/**
+ * Terminate a field with a NUL character.
+ *  The character at the current position is kept in the reader if it is
+ *  overwritten by the NUL character.
+ */
+static void terminate_field(iwa_t* iwa, char *p)
 {
-    int c;
-    
-    read_field_unescaped(iwa, &iwa->attr);
+    if (p == iwa->offset && p < iwa->end) {
+        iwa->held = p;
+        iwa->hold = *p;
+    }
+    *p = 0;
+}
 
-    /* Check the character just after the attribute field is terminated. */
-    c = peek_char(iwa);
-    if (c == ':') {
-        /* Discard the colon. */
-        get_char(iwa);
+static void read_item(iwa_t* iwa, iwa_token_t* token)
+{
+    int escaped = 0;
+    char *attr = iwa->offset, *attr_end = NULL;
+    char *value = NULL, *value_end = NULL;
+    char *p = scan_field(attr, iwa->end, &escaped);
 
-        read_field_unescaped(iwa, &iwa->value);
+    attr_end = escaped ? unescape_field(attr, p) : p;
+    iwa->offset = p;
 
-        c = peek_char(iwa);
-        if (c == ':') {
-            return 1;
-        }
+    /* Check the character just after the attribute field is terminated. */
+    if (peek_char(iwa) == ':') {
+        /* Discard the colon. */
+        value = ++iwa->offset;
+        escaped = 0;
+        p = scan_field(value, iwa->end, &escaped);
+        value_end = escaped ? unescape_field(value, p) : p;
+        iwa->offset = p;
     }
 
-    return 0;
+    /* Terminate the fields. */
+    terminate_field(iwa, attr_end);
+    token->attr = attr;
+    token->attr_length = attr_end - attr;
+    if (value != NULL) {
+        terminate_field(iwa, value_end);
+        token->value = value;
+        token->value_length = value_end - value;
+    } else {
+        token->value = empty_string;
+        token->value_length = 0;
+    }
 }
 
 const iwa_token_t* iwa_read(iwa_t* iwa)
 {
+    int c;
     iwa_token_t* token = &iwa->token;
 
     /* Initialization. */
     token->attr = NULL;
     token->value = NULL;
-    string_clear(&iwa->attr);
-    string_clear(&iwa->value);
+    token->attr_length = 0;
+    token->value_length = 0;
+
+    /* Restore the delimiter overwritten by the previous token. */
+    if (iwa->held != NULL) {
+        *iwa->held = iwa->hold;
+        iwa->held = NULL;
+    }
+
+    /* Read the whole line at the beginning of a line. */
+    if (token->type == IWA_NONE || token->type == IWA_EOI) {
+        if (iwa->ins != NULL && fill_line(iwa) != 0) {
+            return NULL;
+        }
+    }
 
     /* Return NULL if the stream hits EOF. */
     if (peek_char(iwa) == EOF) {
@@ -224,6 +377,7 @@ const iwa_token_t* iwa_read(iwa_t* iwa)
         case IWA_EOF:
             return NULL;
         case IWA_BOI:
+        case IWA_ITEM:
             token->type = IWA_EOI;
             return token;
         case IWA_NONE:
@@ -239,7 +393,7 @@ const iwa_token_t* iwa_read(iwa_t* iwa)
     case IWA_EOI:
         if (peek_char(iwa) == '\n') {
             /* A empty line. */
-            get_char(iwa);
+            ++iwa->offset;
             token->type = IWA_NONE;
         } else {
             /* A non-empty line. */
@@ -248,26 +402,80 @@ const iwa_token_t* iwa_read(iwa_t* iwa)
         break;
     case IWA_BOI:
     case IWA_ITEM:
-        for (;;) {
-            int c = peek_char(iwa);
-
-            if (c == '\t') {
-                /* Skip white spaces. */
-                get_char(iwa);
-            } else if (c == '\n') {
-                get_char(iwa);
-                token->type = IWA_EOI;
-                break;
-            } else {
-                read_item(iwa);
-                token->type = IWA_ITEM;
-                token->attr = iwa->attr.value;
-                token->value = iwa->value.value;
-                break;
+        /* Skip white spaces. */
+        while (c = peek_char(iwa), c == '\t') {
+            ++iwa->offset;
+        }
+
+        if (c == '\n' || c == EOF) {
+            if (c == '\n') {
+                ++iwa->offset;
             }
+            token->type = IWA_EOI;
+        } else {
+            read_item(iwa, token);
+            token->type = IWA_ITEM;
         }
         break;
     }
 
     return token;
 }
+
+double iwa_atof(const char *str)
+{
+    /* Powers of ten that are exactly representable in double. */
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const char *p = str;
+    int neg = 0, digits = 0, exp10 = 0;
+    unsigned long long m = 0;
+    double x;
+
+    /*
+     * Parse a decimal number [+-]digits[.digits][(e|E)[+-]digits]. The
+     * result is identical to that of atof() as long as the mantissa and
+     * the power of ten are exactly representable in double; otherwise,
+     * fall back to atof().
+     */
+    if (*p == '-' || *p == '+') {
+        neg = (*p++ == '-');
+    }
+    for (;'0' <= *p && *p <= '9';++p, ++digits) {
+        if (19 <= digits) return atof(str);
+        m = m * 10 + (*p - '0');
+    }
+    if (*p == '.') {
+        for (++p;'0' <= *p && *p <= '9';++p, ++digits, --exp10) {
+            if (19 <= digits) return atof(str);
+            m = m * 10 + (*p - '0');
+        }
+    }
+    if (digits == 0) {
+        return atof(str);
+    }
+    if (*p == 'e' || *p == 'E') {
+        int e = 0, eneg = 0;
+        ++p;
+        if (*p == '-' || *p == '+') {
+            eneg = (*p++ == '-');
+        }
+        if (*p < '0' || '9' < *p) {
+            return atof(str);
+        }
+        for (;'0' <= *p && *p <= '9';++p) {
+            if (1000 <= e) return atof(str);
+            e = e * 10 + (*p - '0');
+        }
+        exp10 += eneg ? -e : e;
+    }
+    if (*p != 0 || (1ULL << 53) < m || exp10 < -22 || 22 < exp10) {
+        return atof(str);
+    }
+
+    x = (double)m;
+    x = (exp10 < 0) ? x / pow10[-exp10] : x * pow10[exp10];
+    return neg ? -x : x;
+}
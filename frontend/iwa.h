@@ -51,12 +51,19 @@ struct tag_iwa_token {
     int type;
     const char *attr;
     const char *value;
+    size_t attr_length;
+    size_t value_length;
 };
 typedef struct tag_iwa_token iwa_token_t;
 
 iwa_t* iwa_reader(FILE *fp);
+iwa_t* iwa_reader_memory(char *data, size_t size);
+void iwa_reset_memory(iwa_t* iwa, char *data, size_t size);
 const iwa_token_t* iwa_read(iwa_t* iwa);
 void iwa_delete(iwa_t* iwa);
+long iwa_tell(iwa_t* iwa);
+int iwa_error(iwa_t* iwa);
+double iwa_atof(const char *str);
 
 #ifdef    __cplusplus
 }
@@ -49,18 +49,29 @@ typedef struct {
     char *type;
     char *algorithm;
     char *model;
+    char *init_model;
+    char *checkpoint;
     char *logbase;
+    char *stream;
 
     int split;
     int cross_validation;
     int holdout;
     int logfile;
+    int shard_size;
+    int shuffle_window;
+    int checkpoint_period;
+    int resume;
+    int num_threads;
 
     int help;
     int help_params;
 
     int num_params;
     char **params;
+
+    int num_sweeps;
+    char **sweeps;
 } learn_option_t;
 
 static char* mystrdup(const char *src)
@@ -88,14 +99,24 @@ static void learn_option_init(learn_option_t* opt)
     opt->type = mystrdup("crf1d");
     opt->algorithm = mystrdup("lbfgs");
     opt->model = mystrdup("");
+    opt->init_model = mystrdup("");
+    opt->checkpoint = mystrdup("");
     opt->logbase = mystrdup("log.crfsuite");
+    opt->stream = mystrdup("");
+    opt->shard_size = 10000;
+    opt->shuffle_window = 10000;
+    opt->checkpoint_period = 1;
+    opt->num_threads = 1;
 }
 
 static void learn_option_finish(learn_option_t* opt)
 {
     int i;
 
+    free(opt->stream);
     free(opt->logbase);
+    free(opt->checkpoint);
+    free(opt->init_model);
     free(opt->model);
     free(opt->algorithm);
     free(opt->type);
@@ -104,6 +125,11 @@ static void learn_option_finish(learn_option_t* opt)
         free(opt->params[i]);
     }
     free(opt->params);
+
+    for (i = 0;i < opt->num_sweeps;++i) {
+        free(opt->sweeps[i]);
+    }
+    free(opt->sweeps);
 }
 
 BEGIN_OPTION_MAP(parse_learn_options, learn_option_t)
@@ -133,6 +159,15 @@ BEGIN_OPTION_MAP(parse_learn_options, learn_option_t)
         } else if (strcmp(arg, "arow") == 0) {
             free(opt->algorithm);
             opt->algorithm = mystrdup("arow");
+        } else if (strcmp(arg, "hybrid") == 0) {
+            free(opt->algorithm);
+            opt->algorithm = mystrdup("hybrid");
+        } else if (strcmp(arg, "svrg") == 0) {
+            free(opt->algorithm);
+            opt->algorithm = mystrdup("svrg");
+        } else if (strcmp(arg, "l1sgd") == 0) {
+            free(opt->algorithm);
+            opt->algorithm = mystrdup("l1sgd");
         } else {
             fprintf(stderr, "ERROR: Unknown algorithm: %s\n", arg);
             return -1;
@@ -143,10 +178,39 @@ BEGIN_OPTION_MAP(parse_learn_options, learn_option_t)
         opt->params[opt->num_params] = mystrdup(arg);
         ++opt->num_params;
 
+    ON_OPTION_WITH_ARG(LONGOPT("sweep"))
+        if (strchr(arg, '=') == NULL) {
+            fprintf(stderr, "ERROR: The sweep option requires NAME=VALUE1,VALUE2,...: %s\n", arg);
+            return -1;
+        }
+        opt->sweeps = (char **)realloc(opt->sweeps, sizeof(char*) * (opt->num_sweeps + 1));
+        opt->sweeps[opt->num_sweeps] = mystrdup(arg);
+        ++opt->num_sweeps;
+
+    ON_OPTION_WITH_ARG(SHORTOPT('T') || LONGOPT("threads"))
+        opt->num_threads = atoi(arg);
+        if (opt->num_threads < 1) {
+            opt->num_threads = 1;
+        }
+
     ON_OPTION_WITH_ARG(SHORTOPT('m') || LONGOPT("model"))
         free(opt->model);
         opt->model = mystrdup(arg);
 
+    ON_OPTION_WITH_ARG(LONGOPT("init-model"))
+        free(opt->init_model);
+        opt->init_model = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(LONGOPT("checkpoint"))
+        free(opt->checkpoint);
+        opt->checkpoint = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(LONGOPT("checkpoint-period"))
+        opt->checkpoint_period = atoi(arg);
+
+    ON_OPTION(LONGOPT("resume"))
+        opt->resume = 1;
+
     ON_OPTION_WITH_ARG(SHORTOPT('g') || LONGOPT("split"))
         opt->split = atoi(arg);
 
@@ -156,6 +220,16 @@ BEGIN_OPTION_MAP(parse_learn_options, learn_option_t)
     ON_OPTION(SHORTOPT('x') || LONGOPT("cross-validate"))
         opt->cross_validation = 1;
 
+    ON_OPTION_WITH_ARG(SHORTOPT('S') || LONGOPT("stream"))
+        free(opt->stream);
+        opt->stream = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(LONGOPT("shard-size"))
+        opt->shard_size = atoi(arg);
+
+    ON_OPTION_WITH_ARG(LONGOPT("shuffle-window"))
+        opt->shuffle_window = atoi(arg);
+
     ON_OPTION(SHORTOPT('l') || LONGOPT("log-to-file"))
         opt->logfile = 1;
 
@@ -190,22 +264,49 @@ static void show_usage(FILE *fp, const char *argv0, const char *command)
     fprintf(fp, "  -a, --algorithm=NAME  specify a training algorithm (DEFAULT='lbfgs')\n");
     fprintf(fp, "      lbfgs                 L-BFGS with L1/L2 regularization\n");
     fprintf(fp, "      l2sgd                 SGD with L2-regularization\n");
+    fprintf(fp, "      l1sgd                 SGD with L1-regularization (AdaGrad)\n");
     fprintf(fp, "      ap                    Averaged Perceptron\n");
     fprintf(fp, "      pa                    Passive Aggressive\n");
     fprintf(fp, "      arow                  Adaptive Regularization of Weights (AROW)\n");
+    fprintf(fp, "      hybrid                SGD for a few epochs followed by L-BFGS\n");
+    fprintf(fp, "      svrg                  Stochastic Variance Reduced Gradient (SVRG)\n");
     fprintf(fp, "  -p, --set=NAME=VALUE  set the algorithm-specific parameter NAME to VALUE;\n");
     fprintf(fp, "                        use '-H' or '--help-parameters' with the algorithm name\n");
     fprintf(fp, "                        specified by '-a' or '--algorithm' and the graphical\n");
     fprintf(fp, "                        model specified by '-t' or '--type' to see the list of\n");
     fprintf(fp, "                        algorithm-specific parameters\n");
+    fprintf(fp, "      --sweep=NAME=V1,V2,...  train a model for each value of the parameter\n");
+    fprintf(fp, "                        NAME; if specified multiple times, train a model for\n");
+    fprintf(fp, "                        every combination of the values; the models are\n");
+    fprintf(fp, "                        evaluated on the holdout data specified by '-e', and\n");
+    fprintf(fp, "                        the best one is stored; the values of the last NAME\n");
+    fprintf(fp, "                        form a path on which each model starts from the\n");
+    fprintf(fp, "                        weights of the previous one (e.g., --sweep=c2=10,1,0.1)\n");
+    fprintf(fp, "  -T, --threads=N       train N models of a sweep concurrently (DEFAULT=1)\n");
     fprintf(fp, "  -m, --model=FILE      store the model to FILE (DEFAULT=''); if the value is\n");
     fprintf(fp, "                        empty, this utility does not store the model\n");
+    fprintf(fp, "      --init-model=FILE initialize the weights of the features from the model\n");
+    fprintf(fp, "                        FILE, matching attributes and labels by their names;\n");
+    fprintf(fp, "                        features unknown to FILE start from zero\n");
+    fprintf(fp, "      --checkpoint=FILE save the state of the training to FILE periodically;\n");
+    fprintf(fp, "                        the file is replaced atomically at every checkpoint\n");
+    fprintf(fp, "      --checkpoint-period=N save a checkpoint every N iterations (DEFAULT=1)\n");
+    fprintf(fp, "      --resume          resume the training from the checkpoint FILE, which\n");
+    fprintf(fp, "                        must be specified with the same data and parameters\n");
     fprintf(fp, "  -g, --split=N         split the instances into N groups; this option is\n");
     fprintf(fp, "                        useful for holdout evaluation and cross validation\n");
     fprintf(fp, "  -e, --holdout=M       use the M-th data for holdout evaluation and the rest\n");
     fprintf(fp, "                        for training\n");
     fprintf(fp, "  -x, --cross-validate  repeat holdout evaluations for #i in {1, ..., N} groups\n");
     fprintf(fp, "                        (N-fold cross validation)\n");
+    fprintf(fp, "  -S, --stream=PREFIX   store the training data in temporary shard files\n");
+    fprintf(fp, "                        PREFIX.NNNNN.shard instead of the memory, and read\n");
+    fprintf(fp, "                        them in each epoch; this option is useful for online\n");
+    fprintf(fp, "                        algorithms (l2sgd, ap, pa, arow) with a data set\n");
+    fprintf(fp, "                        larger than the memory\n");
+    fprintf(fp, "      --shard-size=N    store at most N instances in a shard (DEFAULT=10000)\n");
+    fprintf(fp, "      --shuffle-window=N shuffle instances within a window of N instances\n");
+    fprintf(fp, "                        read ahead from shards (DEFAULT=10000)\n");
     fprintf(fp, "  -l, --log-to-file     write the training log to a file instead of to STDOUT;\n");
     fprintf(fp, "                        The filename is determined automatically by the training\n");
     fprintf(fp, "                        algorithm, parameters, and source files\n");
@@ -218,6 +319,98 @@ static void show_usage(FILE *fp, const char *argv0, const char *command)
 
 
 
+static void free_sweep(crfsuite_sweep_t* settings, int num_settings)
+{
+    int i;
+    for (i = 0;i < num_settings;++i) {
+        free((char*)settings[i].params);
+    }
+    free(settings);
+}
+
+/*
+ *  Expand the sweep options into the grid of settings. The values of the
+ *  last option vary fastest, and each setting warm-starts from the setting
+ *  with the previous value of the last option.
+ */
+static crfsuite_sweep_t* build_sweep(const learn_option_t* opt, int *ptr_num_settings)
+{
+    int i, j, n = 1, size = 1;
+    const int M = opt->num_sweeps;
+    int *num_values = (int*)calloc(M, sizeof(int));
+    int *digits = (int*)calloc(M, sizeof(int));
+    crfsuite_sweep_t* settings = NULL;
+
+    if (num_values == NULL || digits == NULL) {
+        goto error_exit;
+    }
+
+    /* Count the values of each parameter. */
+    for (i = 0;i < M;++i) {
+        const char *p = strchr(opt->sweeps[i], '=') + 1;
+        num_values[i] = 1;
+        for (;*p;++p) {
+            if (*p == ',') ++num_values[i];
+        }
+        n *= num_values[i];
+        size += strlen(opt->sweeps[i]) + 1;
+    }
+
+    settings = (crfsuite_sweep_t*)calloc(n, sizeof(crfsuite_sweep_t));
+    if (settings == NULL) {
+        goto error_exit;
+    }
+
+    for (j = 0;j < n;++j) {
+        int index = j;
+        char *str = (char*)malloc(size);
+        if (str == NULL) {
+            free_sweep(settings, j);
+            settings = NULL;
+            goto error_exit;
+        }
+        *str = 0;
+
+        /* Select a value of each parameter, the last one fastest. */
+        for (i = M-1;0 <= i;--i) {
+            digits[i] = index % num_values[i];
+            index /= num_values[i];
+        }
+
+        /* Join "NAME=VALUE" assignments with commas. */
+        for (i = 0;i < M;++i) {
+            int k;
+            const char *name = opt->sweeps[i];
+            const char *eq = strchr(name, '=');
+            const char *value = eq + 1;
+            const char *end = NULL;
+
+            for (k = 0;k < digits[i];++k) {
+                value = strchr(value, ',') + 1;
+            }
+            end = strchr(value, ',');
+            if (end == NULL) {
+                end = value + strlen(value);
+            }
+
+            if (0 < i) {
+                strcat(str, ",");
+            }
+            strncat(str, name, eq - name + 1);
+            strncat(str, value, end - value);
+        }
+
+        settings[j].params = str;
+        settings[j].warm_start = (0 < digits[M-1]) ? j-1 : -1;
+    }
+    *ptr_num_settings = n;
+
+error_exit:
+    free(digits);
+    free(num_values);
+    return settings;
+}
+
 static int message_callback(void *instance, const char *format, va_list args)
 {
     vfprintf(stdout, format, args);
@@ -238,6 +431,8 @@ int main_learn(int argc, char *argv[], const char *argv0)
     crfsuite_data_t data;
     crfsuite_trainer_t *trainer = NULL;
     crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
+    crfsuite_sweep_t *settings = NULL;
+    int num_settings = 0;
 
     /* Initializations. */
     learn_option_init(&opt);
@@ -349,12 +544,73 @@ int main_learn(int argc, char *argv[], const char *argv0)
         params->release(params);
     }
 
+    /* Warm-start from an existing model if specified. */
+    if (*opt.init_model) {
+        crfsuite_params_t* params = trainer->params(trainer);
+        params->set(params, "init_model", opt.init_model);
+        params->release(params);
+    }
+
+    /* Save checkpoints (and resume from one) if specified. */
+    if (opt.resume && !*opt.checkpoint) {
+        fprintf(fpe, "ERROR: The resume option requires the checkpoint option.\n");
+        ret = 1;
+        goto force_exit;
+    }
+    if (*opt.checkpoint) {
+        crfsuite_params_t* params = NULL;
+        if (opt.cross_validation) {
+            fprintf(fpe, "ERROR: The checkpoint option cannot be used with cross validation.\n");
+            ret = 1;
+            goto force_exit;
+        }
+        params = trainer->params(trainer);
+        params->set(params, "checkpoint.file", opt.checkpoint);
+        params->set_int(params, "checkpoint.period", opt.checkpoint_period);
+        params->set_int(params, "checkpoint.resume", opt.resume);
+        params->release(params);
+    }
+
+    /* Expand the parameter sweep if specified. */
+    if (0 < opt.num_sweeps) {
+        if (opt.holdout < 0 || opt.cross_validation) {
+            fprintf(fpe, "ERROR: The sweep option requires the holdout option without cross validation.\n");
+            ret = 1;
+            goto force_exit;
+        }
+        if (*opt.stream || *opt.checkpoint) {
+            fprintf(fpe, "ERROR: The sweep option cannot be used with the stream or checkpoint option.\n");
+            ret = 1;
+            goto force_exit;
+        }
+        settings = build_sweep(&opt, &num_settings);
+        if (settings == NULL) {
+            fprintf(fpe, "ERROR: Out of memory.\n");
+            ret = 1;
+            goto force_exit;
+        }
+    }
+
     /* Log the start time. */
     time(&ts);
     strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&ts));
     fprintf(fpo, "Start time of the training: %s\n", timestamp);
     fprintf(fpo, "\n");
 
+    /* Store the training data in shards if specified. */
+    if (*opt.stream) {
+        if (0 < opt.split) {
+            fprintf(fpe, "ERROR: The split option cannot be used with the stream option.\n");
+            ret = 1;
+            goto force_exit;
+        }
+        if (crfsuite_data_stream(&data, opt.stream, opt.shard_size, opt.shuffle_window) != 0) {
+            fprintf(fpe, "ERROR: Failed to initialize the shards: %s\n", opt.stream);
+            ret = 1;
+            goto force_exit;
+        }
+    }
+
     /* Read the training data. */
     fprintf(fpo, "Reading the data set(s)\n");
     for (i = arg_used;i < argc;++i) {
@@ -399,7 +655,7 @@ int main_learn(int argc, char *argv[], const char *argv0)
     /* Report the statistics of the training data. */
     fprintf(fpo, "Statistics the data set(s)\n");
     fprintf(fpo, "Number of data sets (groups): %d\n", groups);
-    fprintf(fpo, "Number of instances: %d\n", data.num_instances);
+    fprintf(fpo, "Number of instances: %d\n", crfsuite_data_totalinstances(&data));
     fprintf(fpo, "Number of items: %d\n", crfsuite_data_totalitems(&data));
     fprintf(fpo, "Number of attributes: %d\n", data.attrs->num(data.attrs));
     fprintf(fpo, "Number of labels: %d\n", data.labels->num(data.labels));
@@ -419,6 +675,11 @@ int main_learn(int argc, char *argv[], const char *argv0)
             fprintf(fpo, "\n");
         }
 
+    } else if (settings != NULL) {
+        if (ret = trainer->sweep(trainer, &data, opt.model, opt.holdout, settings, num_settings, opt.num_threads)) {
+            goto force_exit;
+        }
+
     } else {
         if (ret = trainer->train(trainer, &data, opt.model, opt.holdout)) {
             goto force_exit;
@@ -433,6 +694,9 @@ int main_learn(int argc, char *argv[], const char *argv0)
     fprintf(fpo, "\n");
 
 force_exit:
+    if (settings != NULL) {
+        free_sweep(settings, num_settings);
+    }
     SAFE_RELEASE(trainer);
     SAFE_RELEASE(data.labels);
     SAFE_RELEASE(data.attrs);
@@ -42,7 +42,10 @@
 
 int main_learn(int argc, char *argv[], const char *argv0);
 int main_tag(int argc, char *argv[], const char *argv0);
+int main_serve(int argc, char *argv[], const char *argv0);
+int main_online(int argc, char *argv[], const char *argv0);
 int main_dump(int argc, char *argv[], const char *argv0);
+int main_generate(int argc, char *argv[], const char *argv0);
 
 
 
@@ -85,7 +88,10 @@ static void show_usage(FILE *fp, const char *argv0)
     fprintf(fp, "COMMAND:\n");
     fprintf(fp, "    learn       Obtain a model from a training set of instances\n");
     fprintf(fp, "    tag         Assign suitable labels to given instances by using a model\n");
+    fprintf(fp, "    serve       Load a model once and tag the instances sent by clients\n");
+    fprintf(fp, "    online      Update a model with labeled instances one at a time\n");
     fprintf(fp, "    dump        Output a model in a plain-text format\n");
+    fprintf(fp, "    generate    Write a synthetic dataset of training and test instances\n");
     fprintf(fp, "\n");
     fprintf(fp, "For the usage of each command, specify -h option in the command argument.\n");
 }
@@ -126,8 +132,14 @@ int main(int argc, char *argv[])
         return main_learn(argc-arg_used, argv+arg_used, argv0);
     } else if (strcmp(command, "tag") == 0) {
         return main_tag(argc-arg_used, argv+arg_used, argv0);
+    } else if (strcmp(command, "serve") == 0) {
+        return main_serve(argc-arg_used, argv+arg_used, argv0);
+    } else if (strcmp(command, "online") == 0) {
+        return main_online(argc-arg_used, argv+arg_used, argv0);
     } else if (strcmp(command, "dump") == 0) {
         return main_dump(argc-arg_used, argv+arg_used, argv0);
+    } else if (strcmp(command, "generate") == 0) {
+        return main_generate(argc-arg_used, argv+arg_used, argv0);
     } else {
         fprintf(fpe, "ERROR: Unrecognized command (%s) specified.\n", command);    
         return 1;
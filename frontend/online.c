@@ -0,0 +1,467 @@
+/*
+ *        Online learner command for CRFsuite frontend.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <crfsuite.h>
+#include "option.h"
+#include "iwa.h"
+#include "tag.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+#define    ONLINE_LINE_SIZE     4096
+
+void show_copyright(FILE *fp);
+
+typedef struct {
+    char *input;
+    char *model;
+    char *output;
+    char *algorithm;
+    int snapshot;
+    int quiet;
+    int help;
+
+    int num_params;
+    char **params;
+} online_option_t;
+
+static char* mystrdup(const char *src)
+{
+    char *dst = (char*)malloc(strlen(src)+1);
+    if (dst != NULL) {
+        strcpy(dst, src);
+    }
+    return dst;
+}
+
+static void online_option_init(online_option_t* opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->model = mystrdup("");
+    opt->output = mystrdup("");
+    opt->algorithm = mystrdup("passive-aggressive");
+    opt->snapshot = 1000;
+}
+
+static void online_option_finish(online_option_t* opt)
+{
+    int i;
+
+    free(opt->input);
+    free(opt->model);
+    free(opt->output);
+    free(opt->algorithm);
+    for (i = 0;i < opt->num_params;++i) {
+        free(opt->params[i]);
+    }
+    free(opt->params);
+}
+
+BEGIN_OPTION_MAP(parse_online_options, online_option_t)
+
+    ON_OPTION_WITH_ARG(SHORTOPT('m') || LONGOPT("model"))
+        free(opt->model);
+        opt->model = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('o') || LONGOPT("output"))
+        free(opt->output);
+        opt->output = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('a') || LONGOPT("algorithm"))
+        if (strcmp(arg, "pa") == 0 || strcmp(arg, "passive-aggressive") == 0) {
+            free(opt->algorithm);
+            opt->algorithm = mystrdup("passive-aggressive");
+        } else if (strcmp(arg, "arow") == 0) {
+            free(opt->algorithm);
+            opt->algorithm = mystrdup("arow");
+        } else {
+            fprintf(stderr, "ERROR: Unknown algorithm: %s\n", arg);
+            return -1;
+        }
+
+    ON_OPTION_WITH_ARG(SHORTOPT('s') || LONGOPT("snapshot"))
+        opt->snapshot = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('p') || LONGOPT("param"))
+        opt->params = (char **)realloc(opt->params, sizeof(char*) * (opt->num_params + 1));
+        opt->params[opt->num_params] = mystrdup(arg);
+        ++opt->num_params;
+
+    ON_OPTION(SHORTOPT('q') || LONGOPT("quiet"))
+        opt->quiet = 1;
+
+    ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
+        opt->help = 1;
+
+END_OPTION_MAP()
+
+static void show_usage(FILE *fp, const char *argv0, const char *command)
+{
+    fprintf(fp, "USAGE: %s %s [OPTIONS] [DATA]\n", argv0, command);
+    fprintf(fp, "Update a model with labeled instances one at a time.\n");
+    fprintf(fp, "This utility reads the instances from a file (DATA), or from STDIN if the\n");
+    fprintf(fp, "argument DATA is omitted or '-'. Every instance is first tagged with the\n");
+    fprintf(fp, "current model, and the predicted labels are output in the format of the tag\n");
+    fprintf(fp, "command; the model is then updated with the reference labels. New attributes\n");
+    fprintf(fp, "and labels in the instances add features to the model. The model is stored\n");
+    fprintf(fp, "periodically and at the end of the data, so that a serve command can load the\n");
+    fprintf(fp, "latest model on SIGHUP.\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "OPTIONS:\n");
+    fprintf(fp, "    -m, --model=MODEL   Start from the model in a file (MODEL); start from an\n");
+    fprintf(fp, "                        empty model if omitted\n");
+    fprintf(fp, "    -o, --output=FILE   Store the model to a file (DEFAULT=MODEL)\n");
+    fprintf(fp, "    -a, --algorithm=NAME\n");
+    fprintf(fp, "                        Specify the update algorithm (DEFAULT='pa')\n");
+    fprintf(fp, "        pa                  Passive Aggressive (PA)\n");
+    fprintf(fp, "        arow                Adaptive Regularization Of Weight Vector (AROW)\n");
+    fprintf(fp, "    -s, --snapshot=N    Store the model after every N instances (DEFAULT=1000;\n");
+    fprintf(fp, "                        0 stores the model only at the end)\n");
+    fprintf(fp, "    -p, --param=NAME=VALUE\n");
+    fprintf(fp, "                        Set the algorithm-specific parameter NAME to VALUE\n");
+    fprintf(fp, "    -q, --quiet         Suppress the predicted labels\n");
+    fprintf(fp, "    -h, --help          Show the usage of this command and exit\n");
+}
+
+static int message_callback(void *instance, const char *format, va_list args)
+{
+    FILE *fp = (FILE*)instance;
+    vfprintf(fp, format, args);
+    fflush(fp);
+    return 0;
+}
+
+/**
+ * Read the lines of an instance, up to an empty line or the end of file.
+ *  @return int         The number of bytes read.
+ */
+static size_t read_instance(FILE *fp, textbuf_t* buf)
+{
+    char line[ONLINE_LINE_SIZE];
+    size_t begin = 0;
+
+    buf->size = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t n = strlen(line);
+        if (textbuf_append(buf, line, n) != 0) {
+            break;
+        }
+        if (n == 0 || line[n-1] != '\n') {
+            continue;   /* The rest of a long line follows. */
+        }
+
+        /* An empty line terminates the instance. */
+        if (buf->size - begin <= 2 && (buf->size - begin == 1 || buf->str[begin] == '\r')) {
+            if (0 < begin) {
+                break;
+            }
+            buf->size = 0;
+            continue;
+        }
+        begin = buf->size;
+    }
+
+    /* The parser requires a writable byte after the text. */
+    if (textbuf_reserve(buf, buf->size + 1) != 0) {
+        return 0;
+    }
+    buf->str[buf->size] = 0;
+    return buf->size;
+}
+
+static int parse_instance(
+    iwa_t* iwa,
+    crfsuite_dictionary_t* attrs,
+    crfsuite_dictionary_t* labels,
+    crfsuite_instance_t* inst,
+    crfsuite_item_t* item
+    )
+{
+    int lid = -1;
+    crfsuite_attribute_t cont;
+    const iwa_token_t* token = NULL;
+
+    crfsuite_instance_clear(inst);
+    while (token = iwa_read(iwa), token != NULL) {
+        switch (token->type) {
+        case IWA_BOI:
+            lid = -1;
+            crfsuite_item_clear(item);
+            break;
+        case IWA_EOI:
+            if (crfsuite_instance_append_move(inst, item, lid) != 0) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
+            break;
+        case IWA_ITEM:
+            if (lid == -1) {
+                /* The first field in a line presents a label. */
+                lid = labels->get(labels, token->attr);
+            } else {
+                /* New attributes are registered to the learner. */
+                int aid = attrs->get(attrs, token->attr);
+                if (token->value && *token->value) {
+                    crfsuite_attribute_set(&cont, aid, iwa_atof(token->value));
+                } else {
+                    crfsuite_attribute_set(&cont, aid, 1.0);
+                }
+                if (crfsuite_item_append_attribute(item, &cont) != 0) {
+                    return CRFSUITEERR_OUTOFMEMORY;
+                }
+            }
+            break;
+        case IWA_NONE:
+        case IWA_EOF:
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int online(online_option_t* opt, FILE *fpi, FILE *fpo, FILE *fpe)
+{
+    int i, t, ret = 0, num_instances = 0, num_correct = 0;
+    int num_items = 0, num_items_correct = 0, cap_output = 0;
+    int *output = NULL;
+    floatval_t loss, sum_loss = 0.;
+    char iid[128], period[32];
+    textbuf_t buf;
+    iwa_t* iwa = NULL;
+    crfsuite_instance_t inst;
+    crfsuite_item_t item;
+    crfsuite_learner_t* learner = NULL;
+    crfsuite_params_t* params = NULL;
+    crfsuite_tagger_t* tagger = NULL;
+    crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
+    const char *output_file = (*opt->output ? opt->output : opt->model);
+
+    memset(&buf, 0, sizeof(buf));
+    crfsuite_instance_init(&inst);
+    crfsuite_item_init(&item);
+
+    /* Create a learner with the update algorithm. */
+    sprintf(iid, "learner/crf1d/%s", opt->algorithm);
+    if (!crfsuite_create_instance(iid, (void**)&learner)) {
+        fprintf(fpe, "ERROR: Failed to create a learner instance.\n");
+        ret = 1;
+        goto force_exit;
+    }
+    learner->set_message_callback(learner, fpe, message_callback);
+
+    /* Set parameters. */
+    params = learner->params(learner);
+    for (i = 0;i < opt->num_params;++i) {
+        char *value = NULL;
+        char *name = opt->params[i];
+
+        /* Split the parameter argument by the first '=' character. */
+        value = strchr(name, '=');
+        if (value != NULL) {
+            *value++ = 0;
+        }
+
+        if (params->set(params, name, value) != 0) {
+            fprintf(fpe, "ERROR: parameter not found: %s\n", name);
+            ret = 1;
+            goto force_exit;
+        }
+    }
+    if (*output_file) {
+        params->set(params, "snapshot.file", output_file);
+        sprintf(period, "%d", opt->snapshot);
+        params->set(params, "snapshot.period", period);
+    }
+
+    /* Read the initial model if specified. */
+    if (*opt->model) {
+        if ((ret = learner->open(learner, opt->model))) {
+            fprintf(fpe, "ERROR: Failed to read the model: %s\n", opt->model);
+            ret = 1;
+            goto force_exit;
+        }
+    }
+
+    learner->get_attrs(learner, &attrs);
+    learner->get_labels(learner, &labels);
+    if ((ret = learner->get_tagger(learner, &tagger))) {
+        goto force_exit;
+    }
+
+    iwa = iwa_reader_memory(NULL, 0);
+    if (iwa == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto force_exit;
+    }
+
+    /* Process the instances one by one as they arrive. */
+    while (0 < read_instance(fpi, &buf)) {
+        iwa_reset_memory(iwa, buf.str, buf.size);
+        if ((ret = parse_instance(iwa, attrs, labels, &inst, &item))) {
+            goto force_exit;
+        }
+        if (crfsuite_instance_empty(&inst)) {
+            continue;
+        }
+
+        /* Expand the array to receive the tagging result if necessary. */
+        if (cap_output < inst.num_items) {
+            int *p = (int*)realloc(output, sizeof(int) * inst.num_items);
+            if (p == NULL) {
+                ret = CRFSUITEERR_OUTOFMEMORY;
+                goto force_exit;
+            }
+            output = p;
+            cap_output = inst.num_items;
+        }
+
+        /* Tag the instance with the current model (no label before any update). */
+        for (t = 0;t < inst.num_items;++t) {
+            output[t] = -1;
+        }
+        if (tagger->set(tagger, &inst) == 0) {
+            tagger->viterbi(tagger, output, NULL);
+        }
+
+        /* Accumulate the accuracy of the predictions before updates. */
+        for (i = 0, t = 0;t < inst.num_items;++t) {
+            if (output[t] == inst.labels[t]) {
+                ++i;
+            }
+        }
+        num_items += inst.num_items;
+        num_items_correct += i;
+        if (i == inst.num_items) {
+            ++num_correct;
+        }
+        ++num_instances;
+
+        if (!opt->quiet) {
+            for (t = 0;t < inst.num_items;++t) {
+                const char *label = NULL;
+                if (0 <= output[t] && labels->to_string(labels, output[t], &label) == 0) {
+                    fprintf(fpo, "%s\n", label);
+                    labels->free(labels, label);
+                } else {
+                    fprintf(fpo, "\n");
+                }
+            }
+            fprintf(fpo, "\n");
+            fflush(fpo);
+        }
+
+        /* Update the model with the reference labels. */
+        if ((ret = learner->update(learner, &inst, &loss))) {
+            fprintf(fpe, "ERROR: Failed to update the model (%X)\n", ret);
+            ret = 1;
+            goto force_exit;
+        }
+        sum_loss += loss;
+    }
+
+    /* Store the final model. */
+    if (*output_file) {
+        if ((ret = learner->save(learner, output_file))) {
+            fprintf(fpe, "ERROR: Failed to store the model: %s\n", output_file);
+            ret = 1;
+            goto force_exit;
+        }
+    }
+
+    fprintf(fpe, "Number of instances: %d\n", num_instances);
+    fprintf(fpe, "Loss: %f\n", sum_loss);
+    fprintf(fpe, "Item accuracy (before updates): %d / %d (%1.4f)\n",
+        num_items_correct, num_items,
+        0 < num_items ? num_items_correct / (double)num_items : 0.);
+    fprintf(fpe, "Instance accuracy (before updates): %d / %d (%1.4f)\n",
+        num_correct, num_instances,
+        0 < num_instances ? num_correct / (double)num_instances : 0.);
+
+force_exit:
+    free(output);
+    free(buf.str);
+    iwa_delete(iwa);
+    crfsuite_item_finish(&item);
+    crfsuite_instance_finish(&inst);
+    SAFE_RELEASE(tagger);
+    SAFE_RELEASE(params);
+    SAFE_RELEASE(learner);
+    return ret;
+}
+
+int main_online(int argc, char *argv[], const char *argv0)
+{
+    int ret = 0, arg_used = 0;
+    online_option_t opt;
+    const char *command = argv[0];
+    FILE *fpi = stdin, *fpo = stdout, *fpe = stderr;
+
+    /* Parse the command-line option. */
+    online_option_init(&opt);
+    arg_used = option_parse(++argv, --argc, parse_online_options, &opt);
+    if (arg_used < 0) {
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Show the help message for this command if specified. */
+    if (opt.help) {
+        show_copyright(fpo);
+        show_usage(fpo, argv0, command);
+        goto force_exit;
+    }
+
+    /* Set an input file. */
+    if (arg_used < argc && strcmp(argv[arg_used], "-") != 0) {
+        opt.input = mystrdup(argv[arg_used]);
+        fpi = fopen(opt.input, "r");
+        if (fpi == NULL) {
+            fprintf(fpe, "ERROR: failed to open the data file: %s\n", opt.input);
+            ret = 1;
+            goto force_exit;
+        }
+    }
+
+    ret = online(&opt, fpi, fpo, fpe);
+
+force_exit:
+    if (fpi != NULL && fpi != stdin) {
+        fclose(fpi);
+    }
+    online_option_finish(&opt);
+    return ret;
+}
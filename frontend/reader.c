@@ -70,11 +70,12 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
     long filesize = 0, begin = 0, offset = 0;
     int prev = 0, current = 0;
 
-    /* Initialize the instance.*/
+    /* Initialize the instance and item, whose memory blocks are reused.*/
     crfsuite_instance_init(&inst);
+    crfsuite_item_init(&item);
     inst.group = group;
 
-    /* Obtain the file size. */
+    /* Obtain the file size (compressed size for a compressed file). */
     begin = ftell(fpi);
     fseek(fpi, 0, SEEK_END);
     filesize = ftell(fpi) - begin;
@@ -86,9 +87,15 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
     prev = 0;
 
     iwa = iwa_reader(fpi);
+    if (iwa == NULL) {
+        fprintf(fpo, "\n");
+        fprintf(fpo, "ERROR: failed to open the input stream\n");
+        crfsuite_instance_finish(&inst);
+        return -1;
+    }
     while (token = iwa_read(iwa), token != NULL) {
         /* Progress report. */
-        offset = ftell(fpi);
+        offset = iwa_tell(iwa);
         current = (int)((offset - begin) * 100.0 / (double)filesize);
         prev = progress(fpo, prev, current);
 
@@ -96,14 +103,13 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
         case IWA_BOI:
             /* Initialize an item. */
             lid = -1;
-            crfsuite_item_init(&item);
+            crfsuite_item_clear(&item);
             break;
         case IWA_EOI:
-            /* Append the item to the instance. */
+            /* Move the item to the instance. */
             if (0 <= lid) {
-                crfsuite_instance_append(&inst, &item, lid);
+                crfsuite_instance_append_move(&inst, &item, lid);
             }
-            crfsuite_item_finish(&item);
             break;
         case IWA_ITEM:
             if (lid == -1) {
@@ -111,13 +117,12 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
                     /* Declaration. */
                     if (strcmp(token->attr, "@weight") == 0) {
                         /* Instance weighting. */
-                        inst.weight = atof(token->value);
+                        inst.weight = iwa_atof(token->value);
                     } else {
                         /* Unrecognized declaration. */
                         fprintf(fpo, "\n");
                         fprintf(fpo, "ERROR: unrecognized declaration: %s\n", token->attr);
-                        iwa_delete(iwa);
-                        return -1;
+                        goto error_exit;
                     }
                 } else {
                     /* Label. */
@@ -127,7 +132,7 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
                 crfsuite_attribute_init(&cont);
                 cont.aid = attrs->get(attrs, token->attr);
                 if (token->value && *token->value) {
-                    cont.value = atof(token->value);
+                    cont.value = iwa_atof(token->value);
                 } else {
                     cont.value = 1.0;
                 }
@@ -136,9 +141,13 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
             break;
         case IWA_NONE:
         case IWA_EOF:
-            /* Put the training instance. */
-            crfsuite_data_append(data, &inst);
-            crfsuite_instance_finish(&inst);
+            /* Move the training instance to the data set. */
+            if (crfsuite_data_append_move(data, &inst) != 0) {
+                fprintf(fpo, "\n");
+                fprintf(fpo, "ERROR: failed to store an instance\n");
+                goto error_exit;
+            }
+            crfsuite_instance_clear(&inst);
             inst.group = group;
             inst.weight = 1.;
             ++n;
@@ -146,10 +155,24 @@ int read_data(FILE *fpi, FILE *fpo, crfsuite_data_t* data, int group)
         }
     }
 
+    if (iwa_error(iwa)) {
+        fprintf(fpo, "\n");
+        fprintf(fpo, "ERROR: failed to read the input (truncated or corrupted data)\n");
+        goto error_exit;
+    }
+
     progress(fpo, prev, 100);
     fprintf(fpo, "\n");
 
+    crfsuite_item_finish(&item);
+    crfsuite_instance_finish(&inst);
     iwa_delete(iwa);
 
     return n;
+
+error_exit:
+    crfsuite_item_finish(&item);
+    crfsuite_instance_finish(&inst);
+    iwa_delete(iwa);
+    return -1;
 }
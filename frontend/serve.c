@@ -0,0 +1,840 @@
+/*
+ *        Serve command for CRFsuite frontend.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+
+/* The server requires POSIX threads, signals, and UNIX domain sockets. */
+#if     defined(HAVE_PTHREAD_H) && !defined(_WIN32)
+#define USE_SERVE
+#endif
+
+#ifdef  USE_SERVE
+
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "option.h"
+#include "iwa.h"
+#include "tag.h"
+
+#define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+#define    SERVE_MAX_HEADER     32
+#define    SERVE_MAX_REQUEST    (1 << 28)
+#define    SERVE_READ_SIZE      (1 << 16)
+
+void show_copyright(FILE *fp);
+
+typedef struct {
+    char *model;
+    char *socket;
+    int num_threads;
+    int cache_size;
+    int probability;
+    int marginal;
+    int marginal_all;
+    int reference;
+    int help;
+} serve_option_t;
+
+static char* mystrdup(const char *src)
+{
+    char *dst = (char*)malloc(strlen(src)+1);
+    if (dst != NULL) {
+        strcpy(dst, src);
+    }
+    return dst;
+}
+
+static void serve_option_init(serve_option_t* opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->model = mystrdup("");
+    opt->socket = mystrdup("");
+    opt->num_threads = 4;
+}
+
+static void serve_option_finish(serve_option_t* opt)
+{
+    free(opt->socket);
+    free(opt->model);
+}
+
+BEGIN_OPTION_MAP(parse_serve_options, serve_option_t)
+
+    ON_OPTION_WITH_ARG(SHORTOPT('m') || LONGOPT("model"))
+        free(opt->model);
+        opt->model = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('s') || LONGOPT("socket"))
+        free(opt->socket);
+        opt->socket = mystrdup(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('T') || LONGOPT("threads"))
+        opt->num_threads = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('C') || LONGOPT("cache"))
+        opt->cache_size = atoi(arg);
+
+    ON_OPTION(SHORTOPT('r') || LONGOPT("reference"))
+        opt->reference = 1;
+
+    ON_OPTION(SHORTOPT('p') || LONGOPT("probability"))
+        opt->probability = 1;
+
+    ON_OPTION(SHORTOPT('i') || LONGOPT("marginal"))
+        opt->marginal = 1;
+
+    ON_OPTION(SHORTOPT('l') || LONGOPT("marginal-all"))
+        opt->marginal_all = 1;
+
+    ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
+        opt->help = 1;
+
+END_OPTION_MAP()
+
+static void show_usage(FILE *fp, const char *argv0, const char *command)
+{
+    fprintf(fp, "USAGE: %s %s [OPTIONS]\n", argv0, command);
+    fprintf(fp, "Load a model once and serve tagging requests from clients.\n");
+    fprintf(fp, "The server listens on a Unix-domain socket (with -s option), or serves the\n");
+    fprintf(fp, "requests from STDIN and writes the responses to STDOUT. A request is a line\n");
+    fprintf(fp, "with the size of the data in bytes followed by the data in the format of the\n");
+    fprintf(fp, "tag command. A response is a line 'OK <size>' followed by the tagging result\n");
+    fprintf(fp, "of <size> bytes, or a line 'ERROR <message>'. A connection may send multiple\n");
+    fprintf(fp, "requests. Send SIGHUP to the server to reload the model from the file; the\n");
+    fprintf(fp, "requests being processed are completed with the previous model.\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "OPTIONS:\n");
+    fprintf(fp, "    -m, --model=MODEL   Read a model from a file (MODEL)\n");
+    fprintf(fp, "    -s, --socket=PATH   Listen on a Unix-domain socket at PATH\n");
+    fprintf(fp, "    -T, --threads=N     Serve up to N connections concurrently (DEFAULT=4)\n");
+    fprintf(fp, "    -C, --cache=N       Reuse the results of the N most recently tagged distinct\n");
+    fprintf(fp, "                        instances in each thread (DEFAULT=0, disabled)\n");
+    fprintf(fp, "    -r, --reference     Output the reference labels in the input data\n");
+    fprintf(fp, "    -p, --probability   Output the probability of the label sequences\n");
+    fprintf(fp, "    -i, --marginal      Output the marginal probabilitiy of items for their predicted label\n");
+    fprintf(fp, "    -l, --marginal-all  Output the marginal probabilities of items for all labels\n");
+    fprintf(fp, "    -h, --help          Show the usage of this command and exit\n");
+}
+
+
+
+/**
+ * A model with a tagging context for each worker.
+ *  The server holds a reference to the current model, and a worker holds
+ *  one while processing a request. The last holder releases the model;
+ *  no other thread touches the objects of the model at that time.
+ */
+typedef struct {
+    crfsuite_model_t* model;
+    tag_context_t* contexts;
+    int num_contexts;
+    int nref;
+} serve_model_t;
+
+/**
+ * The server state shared by the threads.
+ */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    serve_model_t* current;     /**< The model for new requests. */
+    int *queue;                 /**< Accepted connections waiting for a worker. */
+    int cap_queue;
+    int num_queued;
+    int head;
+    int *active;                /**< The connection served by each worker (-1 if none). */
+    int stop;
+    int wakeup[2];              /**< A pipe to wake up the accept loop. */
+    const char *filename;
+    tagger_option_t topt;
+    FILE *fpe;
+} server_t;
+
+typedef struct {
+    server_t* sv;
+    int id;
+    pthread_t thread;
+} serve_worker_t;
+
+/**
+ * The reading state of a connection.
+ */
+typedef struct {
+    int fd;
+    int wakeup;                 /**< A pipe that stops the reading when written (-1 if none). */
+    textbuf_t buf;
+    size_t begin;
+} conn_reader_t;
+
+/**
+ * Delete a model.
+ *  The counters of the result cache are reported to fpe unless it is NULL.
+ */
+static void serve_model_delete(serve_model_t* sm, FILE *fpe)
+{
+    int i;
+
+    if (sm != NULL) {
+        if (fpe != NULL && sm->contexts != NULL && 0 < sm->contexts[0].opt->cache_size) {
+            crfsuite_cache_stats_t stats;
+            memset(&stats, 0, sizeof(stats));
+            for (i = 0;i < sm->num_contexts;++i) {
+                tag_context_cache_stats(&sm->contexts[i], &stats);
+            }
+            tag_output_cache_stats(fpe, &stats);
+        }
+        if (sm->contexts != NULL) {
+            for (i = 0;i < sm->num_contexts;++i) {
+                tag_context_finish(&sm->contexts[i]);
+            }
+            free(sm->contexts);
+        }
+        SAFE_RELEASE(sm->model);
+        free(sm);
+    }
+}
+
+static serve_model_t* serve_model_load(const char *filename, int num_contexts, const tagger_option_t* topt)
+{
+    int i;
+    serve_model_t* sm = (serve_model_t*)calloc(1, sizeof(serve_model_t));
+
+    if (sm == NULL) {
+        return NULL;
+    }
+    if (crfsuite_create_instance_from_file(filename, (void**)&sm->model)) {
+        goto error_exit;
+    }
+    sm->contexts = (tag_context_t*)calloc(num_contexts, sizeof(tag_context_t));
+    if (sm->contexts == NULL) {
+        goto error_exit;
+    }
+    sm->num_contexts = num_contexts;
+    for (i = 0;i < num_contexts;++i) {
+        if (tag_context_init(&sm->contexts[i], sm->model, topt)) {
+            goto error_exit;
+        }
+    }
+    sm->nref = 1;
+    return sm;
+
+error_exit:
+    serve_model_delete(sm, NULL);
+    return NULL;
+}
+
+static serve_model_t* acquire_model(server_t* sv)
+{
+    serve_model_t* sm = NULL;
+
+    pthread_mutex_lock(&sv->mutex);
+    sm = sv->current;
+    ++sm->nref;
+    pthread_mutex_unlock(&sv->mutex);
+    return sm;
+}
+
+static void release_model(server_t* sv, serve_model_t* sm)
+{
+    int nref;
+
+    pthread_mutex_lock(&sv->mutex);
+    nref = --sm->nref;
+    pthread_mutex_unlock(&sv->mutex);
+    if (nref == 0) {
+        serve_model_delete(sm, sv->fpe);
+    }
+}
+
+/**
+ * Replace the current model with the one loaded from the model file.
+ */
+static void reload_model(server_t* sv)
+{
+    serve_model_t *sm = NULL, *old = NULL;
+
+    sm = serve_model_load(sv->filename, sv->current->num_contexts, &sv->topt);
+    if (sm == NULL) {
+        fprintf(sv->fpe, "ERROR: failed to reload the model; keep the current one: %s\n", sv->filename);
+        return;
+    }
+
+    pthread_mutex_lock(&sv->mutex);
+    old = sv->current;
+    sv->current = sm;
+    pthread_mutex_unlock(&sv->mutex);
+
+    release_model(sv, old);
+    fprintf(sv->fpe, "Reloaded the model: %s\n", sv->filename);
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (0 < size) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Read more data from the connection.
+ *  @return int         \c 1 if data is read, \c 0 at the end of the
+ *                      stream, or \c -1 if an error occurred.
+ */
+static int read_more(conn_reader_t* rd)
+{
+    ssize_t n;
+    textbuf_t* buf = &rd->buf;
+
+    /* Discard the data consumed by the previous requests. */
+    if (0 < rd->begin) {
+        memmove(buf->str, buf->str + rd->begin, buf->size - rd->begin);
+        buf->size -= rd->begin;
+        rd->begin = 0;
+    }
+
+    if (textbuf_reserve(buf, buf->size + SERVE_READ_SIZE) != 0) {
+        return -1;
+    }
+
+    /* Wait for the data unless the server is stopping; shutdown() cannot
+       interrupt the reading of a connection that is not a socket. */
+    if (0 <= rd->wakeup) {
+        struct pollfd fds[2];
+        fds[0].fd = rd->fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = rd->wakeup;
+        fds[1].events = POLLIN;
+        for (;;) {
+            fds[0].revents = fds[1].revents = 0;
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            if (fds[1].revents) {
+                return 0;
+            }
+            if (fds[0].revents) {
+                break;
+            }
+        }
+    }
+
+    do {
+        n = read(rd->fd, buf->str + buf->size, SERVE_READ_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+    buf->size += (size_t)n;
+    return (0 < n) ? 1 : 0;
+}
+
+/**
+ * Read a request from the connection.
+ *  The data of the request is copied to req, followed by a writable byte.
+ *  @return int         \c 1 if a request is read, \c 0 at the end of the
+ *                      stream, \c -1 if an I/O error occurred, or \c -2 if
+ *                      the request is malformed.
+ */
+static int read_request(conn_reader_t* rd, textbuf_t* req)
+{
+    int ret;
+    char *p = NULL, *end = NULL;
+    size_t size = 0, header = 0;
+
+    /* Read the header line. */
+    for (;;) {
+        const char *head = rd->buf.str + rd->begin;
+        size_t avail = rd->buf.size - rd->begin;
+        p = (0 < avail) ? (char*)memchr(head, '\n', avail) : NULL;
+        if (p != NULL) {
+            header = (size_t)(p - head) + 1;
+            break;
+        }
+        if (SERVE_MAX_HEADER < avail) {
+            return -2;
+        }
+        if ((ret = read_more(rd)) <= 0) {
+            return (ret == 0 && avail == 0) ? 0 : (ret == 0 ? -2 : -1);
+        }
+    }
+
+    /* Parse the size of the data. */
+    p = rd->buf.str + rd->begin;
+    if (*p < '0' || '9' < *p) {
+        return -2;
+    }
+    size = (size_t)strtoul(p, &end, 10);
+    if (end != p + header - 1 && !(end == p + header - 2 && *end == '\r')) {
+        return -2;
+    }
+    if (SERVE_MAX_REQUEST < size) {
+        return -2;
+    }
+
+    /* Read the data. */
+    while (rd->buf.size - rd->begin < header + size) {
+        if ((ret = read_more(rd)) <= 0) {
+            return (ret == 0) ? -2 : -1;
+        }
+    }
+
+    req->size = 0;
+    if (textbuf_append(req, rd->buf.str + rd->begin + header, size) != 0 ||
+        textbuf_reserve(req, size + 1) != 0) {
+        return -1;
+    }
+    rd->begin += header + size;
+    return 1;
+}
+
+/**
+ * Serve the requests on a connection until the client closes it.
+ *  @param  wakeup      The pipe that stops the reading (-1 if the connection
+ *                      is a socket stopped by shutdown()).
+ */
+static void serve_connection(server_t* sv, int id, int fdi, int fdo, int wakeup)
+{
+    int ret;
+    char header[64];
+    conn_reader_t rd;
+    textbuf_t req, out;
+
+    memset(&rd, 0, sizeof(rd));
+    memset(&req, 0, sizeof(req));
+    memset(&out, 0, sizeof(out));
+    rd.fd = fdi;
+    rd.wakeup = wakeup;
+
+    while ((ret = read_request(&rd, &req)) == 1) {
+        /* Tag the data with the current model. */
+        serve_model_t* sm = acquire_model(sv);
+        out.size = 0;
+        ret = tag_text(&sm->contexts[id], req.str, req.size, &out);
+        release_model(sv, sm);
+
+        if (ret) {
+            sprintf(header, "ERROR failed to tag the data (%d)\n", ret);
+            ret = write_all(fdo, header, strlen(header));
+        } else {
+            sprintf(header, "OK %lu\n", (unsigned long)out.size);
+            ret = write_all(fdo, header, strlen(header));
+            if (ret == 0) {
+                ret = write_all(fdo, out.str, out.size);
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    if (ret == -2) {
+        strcpy(header, "ERROR malformed request\n");
+        write_all(fdo, header, strlen(header));
+    }
+
+    free(out.str);
+    free(req.str);
+    free(rd.buf.str);
+}
+
+static void* serve_worker(void *arg)
+{
+    serve_worker_t* wk = (serve_worker_t*)arg;
+    server_t* sv = wk->sv;
+
+    for (;;) {
+        int fd = -1;
+
+        /* Wait for a connection. */
+        pthread_mutex_lock(&sv->mutex);
+        while (!sv->stop && sv->num_queued == 0) {
+            pthread_cond_wait(&sv->cond, &sv->mutex);
+        }
+        if (sv->stop) {
+            pthread_mutex_unlock(&sv->mutex);
+            break;
+        }
+        fd = sv->queue[sv->head];
+        sv->head = (sv->head + 1) % sv->cap_queue;
+        --sv->num_queued;
+        sv->active[wk->id] = fd;
+        pthread_cond_broadcast(&sv->cond);
+        pthread_mutex_unlock(&sv->mutex);
+
+        serve_connection(sv, wk->id, fd, fd, -1);
+
+        pthread_mutex_lock(&sv->mutex);
+        sv->active[wk->id] = -1;
+        pthread_mutex_unlock(&sv->mutex);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/**
+ * Handle the signals for the server.
+ *  SIGHUP reloads the model; SIGINT and SIGTERM stop the server. The other
+ *  threads block these signals.
+ */
+static void* serve_signal(void *arg)
+{
+    int i, sig = 0;
+    sigset_t set;
+    server_t* sv = (server_t*)arg;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+
+    for (;;) {
+        if (sigwait(&set, &sig) != 0) {
+            continue;
+        }
+        if (sig == SIGHUP) {
+            reload_model(sv);
+            continue;
+        }
+
+        /* Stop accepting connections, and stop reading from the active ones;
+           the requests being processed are still answered. */
+        pthread_mutex_lock(&sv->mutex);
+        sv->stop = 1;
+        for (i = 0;i < sv->current->num_contexts;++i) {
+            if (0 <= sv->active[i]) {
+                shutdown(sv->active[i], SHUT_RD);
+            }
+        }
+        pthread_cond_broadcast(&sv->cond);
+        pthread_mutex_unlock(&sv->mutex);
+        if (0 <= sv->wakeup[1]) {
+            write_all(sv->wakeup[1], "x", 1);
+        }
+        break;
+    }
+
+    return NULL;
+}
+
+static int open_socket(const char *path, FILE *fpe)
+{
+    int fd = -1;
+    struct sockaddr_un addr;
+
+    if (sizeof(addr.sun_path) <= strlen(path)) {
+        fprintf(fpe, "ERROR: the socket path is too long: %s\n", path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(fpe, "ERROR: failed to create a socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        fprintf(fpe, "ERROR: failed to listen on the socket %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Accept connections and pass them to the workers until the server stops.
+ */
+static void accept_loop(server_t* sv, int fd)
+{
+    struct pollfd fds[2];
+
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = sv->wakeup[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        int conn;
+
+        fds[0].revents = fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(sv->fpe, "ERROR: poll: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) {
+                fprintf(sv->fpe, "ERROR: accept: %s\n", strerror(errno));
+            }
+            continue;
+        }
+
+        /* Queue the connection for the workers. */
+        pthread_mutex_lock(&sv->mutex);
+        while (!sv->stop && sv->cap_queue <= sv->num_queued) {
+            pthread_cond_wait(&sv->cond, &sv->mutex);
+        }
+        if (sv->stop) {
+            pthread_mutex_unlock(&sv->mutex);
+            close(conn);
+            break;
+        }
+        sv->queue[(sv->head + sv->num_queued) % sv->cap_queue] = conn;
+        ++sv->num_queued;
+        pthread_cond_broadcast(&sv->cond);
+        pthread_mutex_unlock(&sv->mutex);
+    }
+}
+
+static int serve(serve_option_t* opt, FILE *fpe)
+{
+    int i, ret = 0, fd = -1, num_workers = 0, num_started = 0;
+    int signal_started = 0, mutex_initialized = 0;
+    sigset_t set;
+    pthread_t signal_thread;
+    server_t sv;
+    serve_worker_t* workers = NULL;
+
+    memset(&sv, 0, sizeof(sv));
+    sv.wakeup[0] = sv.wakeup[1] = -1;
+    sv.filename = opt->model;
+    sv.fpe = fpe;
+    sv.topt.probability = opt->probability;
+    sv.topt.marginal = opt->marginal;
+    sv.topt.marginal_all = opt->marginal_all;
+    sv.topt.reference = opt->reference;
+    sv.topt.cache_size = opt->cache_size;
+
+    /* A stdio server has a single connection. */
+    num_workers = (*opt->socket && 1 < opt->num_threads) ? opt->num_threads : 1;
+
+    /* Load the model. */
+    sv.current = serve_model_load(opt->model, num_workers, &sv.topt);
+    if (sv.current == NULL) {
+        fprintf(fpe, "ERROR: failed to load the model: %s\n", opt->model);
+        return 1;
+    }
+
+    sv.cap_queue = num_workers * 4;
+    sv.queue = (int*)calloc(sv.cap_queue, sizeof(int));
+    sv.active = (int*)malloc(sizeof(int) * num_workers);
+    workers = (serve_worker_t*)calloc(num_workers, sizeof(serve_worker_t));
+    if (sv.queue == NULL || sv.active == NULL || workers == NULL) {
+        fprintf(fpe, "ERROR: out of memory\n");
+        ret = 1;
+        goto force_exit;
+    }
+    for (i = 0;i < num_workers;++i) {
+        sv.active[i] = -1;
+    }
+
+    if (pipe(sv.wakeup) != 0) {
+        fprintf(fpe, "ERROR: failed to create a pipe: %s\n", strerror(errno));
+        ret = 1;
+        goto force_exit;
+    }
+    if (*opt->socket) {
+        fd = open_socket(opt->socket, fpe);
+        if (fd < 0) {
+            ret = 1;
+            goto force_exit;
+        }
+    }
+
+    pthread_mutex_init(&sv.mutex, NULL);
+    pthread_cond_init(&sv.cond, NULL);
+    mutex_initialized = 1;
+
+    /* Handle the signals in a dedicated thread; ignore SIGPIPE so that a
+       client closing its connection early does not kill the server. */
+    signal(SIGPIPE, SIG_IGN);
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (pthread_create(&signal_thread, NULL, serve_signal, &sv) != 0) {
+        fprintf(fpe, "ERROR: Failed to create a thread.\n");
+        ret = 1;
+        goto force_exit;
+    }
+    signal_started = 1;
+
+    if (fd < 0) {
+        /* Serve the requests from STDIN on this thread until a signal
+           writes to the wakeup pipe. */
+        serve_connection(&sv, 0, STDIN_FILENO, STDOUT_FILENO, sv.wakeup[0]);
+    } else {
+        for (i = 0;i < num_workers;++i) {
+            workers[i].sv = &sv;
+            workers[i].id = i;
+            if (pthread_create(&workers[i].thread, NULL, serve_worker, &workers[i]) != 0) {
+                fprintf(fpe, "ERROR: Failed to create a thread.\n");
+                ret = 1;
+                break;
+            }
+            ++num_started;
+        }
+        if (num_started == num_workers) {
+            accept_loop(&sv, fd);
+        }
+    }
+
+force_exit:
+    /* Stop the threads. */
+    if (signal_started) {
+        pthread_kill(signal_thread, SIGTERM);
+        pthread_join(signal_thread, NULL);
+    } else if (mutex_initialized) {
+        pthread_mutex_lock(&sv.mutex);
+        sv.stop = 1;
+        pthread_cond_broadcast(&sv.cond);
+        pthread_mutex_unlock(&sv.mutex);
+    }
+    for (i = 0;i < num_started;++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    /* Close the connections left in the queue. */
+    for (i = 0;i < sv.num_queued;++i) {
+        close(sv.queue[(sv.head + i) % sv.cap_queue]);
+    }
+    if (0 <= fd) {
+        close(fd);
+        unlink(opt->socket);
+    }
+    for (i = 0;i < 2;++i) {
+        if (0 <= sv.wakeup[i]) {
+            close(sv.wakeup[i]);
+        }
+    }
+    if (mutex_initialized) {
+        pthread_cond_destroy(&sv.cond);
+        pthread_mutex_destroy(&sv.mutex);
+    }
+
+    serve_model_delete(sv.current, fpe);
+    free(workers);
+    free(sv.active);
+    free(sv.queue);
+    return ret;
+}
+
+int main_serve(int argc, char *argv[], const char *argv0)
+{
+    int ret = 0, arg_used = 0;
+    serve_option_t opt;
+    const char *command = argv[0];
+    FILE *fpo = stdout, *fpe = stderr;
+
+    /* Parse the command-line option. */
+    serve_option_init(&opt);
+    arg_used = option_parse(++argv, --argc, parse_serve_options, &opt);
+    if (arg_used < 0) {
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Show the help message for this command if specified. */
+    if (opt.help) {
+        show_copyright(fpo);
+        show_usage(fpo, argv0, command);
+        goto force_exit;
+    }
+
+    if (!*opt.model) {
+        fprintf(fpe, "ERROR: No model specified. See help (-h) for the usage.\n");
+        ret = 1;
+        goto force_exit;
+    }
+
+    ret = serve(&opt, fpe);
+
+force_exit:
+    serve_option_finish(&opt);
+    return ret;
+}
+
+#else/*USE_SERVE*/
+
+int main_serve(int argc, char *argv[], const char *argv0)
+{
+    fprintf(stderr, "ERROR: The serve command is not supported on this platform.\n");
+    return 1;
+}
+
+#endif/*USE_SERVE*/
@@ -30,6 +30,10 @@
 
 /* $Id$ */
 
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
 #include <os.h>
 
 #include <stdio.h>
@@ -37,34 +41,22 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <stdarg.h>
+#ifdef  HAVE_PTHREAD_H
+#include <pthread.h>
+#endif/*HAVE_PTHREAD_H*/
 
 #include <crfsuite.h>
 #include "option.h"
+#include "instream.h"
 #include "iwa.h"
+#include "tag.h"
 
 #define    SAFE_RELEASE(obj)    if ((obj) != NULL) { (obj)->release(obj); (obj) = NULL; }
+#define    TAG_CHUNK_SIZE       (1 << 17)
 
 void show_copyright(FILE *fp);
 
-typedef struct {
-    char *input;
-    char *model;
-    int evaluate;
-    int probability;
-    int marginal;
-    int marginal_all;
-    int quiet;
-    int reference;
-    int help;
-
-    int num_params;
-    char **params;
-
-    FILE *fpi;
-    FILE *fpo;
-    FILE *fpe;
-} tagger_option_t;
-
 static char* mystrdup(const char *src)
 {
     char *dst = (char*)malloc(strlen(src)+1);
@@ -81,6 +73,7 @@ static void tagger_option_init(tagger_option_t* opt)
     opt->fpo = stdout;
     opt->fpe = stderr;
     opt->model = mystrdup("");
+    opt->num_threads = 1;
 }
 
 static void tagger_option_finish(tagger_option_t* opt)
@@ -119,6 +112,15 @@ BEGIN_OPTION_MAP(parse_tagger_options, tagger_option_t)
     ON_OPTION(SHORTOPT('q') || LONGOPT("quiet"))
         opt->quiet = 1;
 
+    ON_OPTION_WITH_ARG(SHORTOPT('T') || LONGOPT("threads"))
+        opt->num_threads = atoi(arg);
+
+    ON_OPTION_WITH_ARG(SHORTOPT('C') || LONGOPT("cache"))
+        opt->cache_size = atoi(arg);
+
+    ON_OPTION(SHORTOPT('s') || LONGOPT("stats"))
+        opt->stats = 1;
+
     ON_OPTION(SHORTOPT('h') || LONGOPT("help"))
         opt->help = 1;
 
@@ -144,14 +146,50 @@ static void show_usage(FILE *fp, const char *argv0, const char *command)
     fprintf(fp, "    -i, --marginal      Output the marginal probabilitiy of items for their predicted label\n");
     fprintf(fp, "    -l, --marginal-all  Output the marginal probabilities of items for all labels\n");
     fprintf(fp, "    -q, --quiet         Suppress tagging results (useful for test mode)\n");
+    fprintf(fp, "    -T, --threads=N     Tag instances with N threads while keeping the order of\n");
+    fprintf(fp, "                        the output identical to that of the input (DEFAULT=1;\n");
+    fprintf(fp, "                        always 1 on builds without POSIX threads)\n");
+    fprintf(fp, "    -C, --cache=N       Reuse the results of the N most recently tagged distinct\n");
+    fprintf(fp, "                        instances for repeated instances (DEFAULT=0, disabled)\n");
+    fprintf(fp, "    -s, --stats         Report the latency percentiles of the tagging stages and\n");
+    fprintf(fp, "                        the counts of unknown attributes and features touched\n");
     fprintf(fp, "    -h, --help          Show the usage of this command and exit\n");
 }
 
 
 
+void textbuf_printf(textbuf_t* buf, const char *format, ...)
+{
+    va_list args;
+
+    for (;;) {
+        int n;
+        size_t avail = buf->cap - buf->size;
+
+        va_start(args, format);
+        n = vsnprintf(buf->str != NULL ? buf->str + buf->size : NULL, avail, format, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if ((size_t)n < avail) {
+            buf->size += n;
+            return;
+        }
+
+        /* Expand the buffer and retry. */
+        buf->cap = (buf->cap + n + 1) * 2;
+        buf->str = (char*)realloc(buf->str, buf->cap);
+        if (buf->str == NULL) {
+            buf->size = buf->cap = 0;
+            return;
+        }
+    }
+}
+
 static void
 output_result(
-    FILE *fpo,
+    textbuf_t *buf,
     crfsuite_tagger_t *tagger,
     const crfsuite_instance_t *inst,
     int *output,
@@ -167,38 +205,38 @@ output_result(
     if (opt->probability) {
         floatval_t lognorm;
         tagger->lognorm(tagger, &lognorm);
-	fprintf(fpo, "@score\t%f\t%f\n", score, lognorm);
-        fprintf(fpo, "@probability\t%f\n", exp(score - lognorm));
+        textbuf_printf(buf, "@score\t%f\t%f\n", score, lognorm);
+        textbuf_printf(buf, "@probability\t%f\n", exp(score - lognorm));
     }
 
     for (i = 0;i < inst->num_items;++i) {
         if (opt->reference) {
             labels->to_string(labels, inst->labels[i], &label);
-            fprintf(fpo, "%s\t", label);
+            textbuf_printf(buf, "%s\t", label);
             labels->free(labels, label);
         }
 
         labels->to_string(labels, output[i], &label);
-        fprintf(fpo, "%s", label);
+        textbuf_printf(buf, "%s", label);
         labels->free(labels, label);
 
         if (opt->marginal) {
             tagger->marginal_point(tagger, output[i], i, &prob);
-            fprintf(fpo, ":%f", prob);
+            textbuf_printf(buf, ":%f", prob);
         }
 
         if (opt->marginal_all) {
             for (l = 0;l < labels->num(labels);++l) {
                 tagger->marginal_point(tagger, l, i, &prob);
                 labels->to_string(labels, l, &label);
-                fprintf(fpo, "\t%s:%f", label, prob);
+                textbuf_printf(buf, "\t%s:%f", label, prob);
                 labels->free(labels, label);
             }
         }
 
-        fprintf(fpo, "\n");
+        textbuf_printf(buf, "\n");
     }
-    fprintf(fpo, "\n");
+    textbuf_printf(buf, "\n");
 }
 
 static void
@@ -237,156 +275,807 @@ static int message_callback(void *instance, const char *format, va_list args)
     return 0;
 }
 
-static int tag(tagger_option_t* opt, crfsuite_model_t* model)
+int textbuf_reserve(textbuf_t* buf, size_t size)
 {
-    int N = 0, L = 0, ret = 0, lid = -1;
-    clock_t clk0, clk1;
-    crfsuite_instance_t inst;
-    crfsuite_item_t item;
-    crfsuite_attribute_t cont;
-    crfsuite_evaluation_t eval;
-    char *comment = NULL;
-    iwa_t* iwa = NULL;
-    const iwa_token_t* token = NULL;
-    crfsuite_tagger_t *tagger = NULL;
-    crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
-    FILE *fp = NULL, *fpi = opt->fpi, *fpo = opt->fpo, *fpe = opt->fpe;
+    if (buf->cap < size) {
+        size_t cap = buf->cap;
+        char *str = NULL;
+        while (cap < size) cap = (cap + 1) * 2;
+        str = (char*)realloc(buf->str, cap);
+        if (str == NULL) {
+            return -1;
+        }
+        buf->str = str;
+        buf->cap = cap;
+    }
+    return 0;
+}
+
+int textbuf_append(textbuf_t* buf, const char *str, size_t size)
+{
+    if (textbuf_reserve(buf, buf->size + size) != 0) {
+        return -1;
+    }
+    memcpy(buf->str + buf->size, str, size);
+    buf->size += size;
+    return 0;
+}
+
+enum {
+    JOB_EMPTY = 0,      /**< The job is free for the reader. */
+    JOB_READY,          /**< The job holds a text to be tagged. */
+    JOB_DONE,           /**< The job holds the results to be written. */
+};
+
+/**
+ * A chunk of the input data passed through the tagging pipeline.
+ */
+typedef struct {
+    textbuf_t input;
+    textbuf_t output;
+    int status;
+} tag_job_t;
+
+/**
+ * The reader stage: splits the input data at instance boundaries.
+ */
+typedef struct {
+    instream_t* ins;
+    textbuf_t rest;
+    int eof;
+} tag_reader_t;
+
+struct tag_pipeline;
+
+/**
+ * A tagging worker owning a tagging context.
+ */
+typedef struct {
+    struct tag_pipeline* pl;
+    tag_context_t ctx;
+    int ret;
+#ifdef  HAVE_PTHREAD_H
+    pthread_t thread;
+#endif/*HAVE_PTHREAD_H*/
+} tag_worker_t;
+
+/**
+ * The tagging pipeline.
+ *  The reader fills jobs in a ring buffer, the workers tag the jobs in any
+ *  order, and the writer outputs the results in the order of the input.
+ *  Job k occupies the slot (k % num_jobs); the counters num_read,
+ *  num_taken, and num_written never decrease.
+ */
+typedef struct tag_pipeline {
+#ifdef  HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif/*HAVE_PTHREAD_H*/
+    tag_job_t* jobs;
+    int num_jobs;
+    int num_read;
+    int num_taken;
+    int num_written;
+    int eof;
+    int abort;
+    FILE* fpo;
+} tag_pipeline_t;
+
+/**
+ * Find the end of the last instance in a text.
+ *  @return size_t      The offset just after the last empty line, or zero
+ *                      if the text has no empty line.
+ */
+static size_t find_boundary(const char *str, size_t size)
+{
+    size_t i;
+
+    for (i = size;1 < i;--i) {
+        if (str[i-1] == '\n' && str[i-2] == '\n') {
+            return i;
+        }
+    }
+    /* The text always begins at the head of a line. */
+    return (0 < size && str[0] == '\n') ? 1 : 0;
+}
+
+/**
+ * Read a chunk of the input data that consists of whole instances.
+ *  @return int         \c 1 if the job receives a chunk, \c 0 at the end
+ *                      of the stream, or \c -1 if an error occurred.
+ */
+static int read_job(tag_reader_t* rd, tag_job_t* job)
+{
+    size_t cut = 0;
+    textbuf_t* buf = &job->input;
+
+    /* Start with the text carried over from the previous chunk. */
+    buf->size = 0;
+    if (textbuf_append(buf, rd->rest.str, rd->rest.size) != 0) {
+        return -1;
+    }
+    rd->rest.size = 0;
+
+    while (!rd->eof) {
+        size_t count;
+
+        /* Split the text if it is large enough. */
+        if (TAG_CHUNK_SIZE <= buf->size) {
+            cut = find_boundary(buf->str, buf->size);
+            if (0 < cut) {
+                break;
+            }
+        }
+
+        /* Read the next block. */
+        if (textbuf_reserve(buf, buf->size + TAG_CHUNK_SIZE) != 0) {
+            return -1;
+        }
+        count = instream_read(rd->ins, buf->str + buf->size, TAG_CHUNK_SIZE);
+        buf->size += count;
+        if (count == 0) {
+            rd->eof = 1;
+        }
+    }
+
+    /* Do not tag the remaining text of a truncated or corrupted stream. */
+    if (rd->eof && instream_error(rd->ins)) {
+        return -1;
+    }
+
+    /* Carry the text after the boundary over to the next chunk. */
+    if (0 < cut) {
+        if (textbuf_append(&rd->rest, buf->str + cut, buf->size - cut) != 0) {
+            return -1;
+        }
+        buf->size = cut;
+    }
+
+    /* The IWA parser needs a writable byte just after the chunk. */
+    if (textbuf_reserve(buf, buf->size + 1) != 0) {
+        return -1;
+    }
+
+    return (0 < buf->size) ? 1 : 0;
+}
+
+int tag_context_init(tag_context_t* ctx, crfsuite_model_t* model, const tagger_option_t* opt)
+{
+    int ret = 0;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->opt = opt;
+    crfsuite_instance_init(&ctx->inst);
+    crfsuite_item_init(&ctx->item);
 
     /* Obtain the dictionary interface representing the labels in the model. */
-    if (ret = model->get_labels(model, &labels)) {
-        goto force_exit;
+    if ((ret = model->get_labels(model, &ctx->labels))) {
+        goto error_exit;
     }
 
     /* Obtain the dictionary interface representing the attributes in the model. */
-    if (ret = model->get_attrs(model, &attrs)) {
-        goto force_exit;
+    if ((ret = model->get_attrs(model, &ctx->attrs))) {
+        goto error_exit;
     }
 
     /* Obtain the tagger interface. */
-    if (ret = model->get_tagger(model, &tagger)) {
-        goto force_exit;
+    if ((ret = model->get_tagger(model, &ctx->tagger))) {
+        goto error_exit;
     }
 
-    /* Initialize the objects for instance and evaluation. */
-    L = labels->num(labels);
-    crfsuite_instance_init(&inst);
-    crfsuite_evaluation_init(&eval, L);
+    /* Enable the result cache of the tagger if specified. */
+    if (0 < opt->cache_size) {
+        int flags = CRFSUITE_CACHE_PATH;
+        if (opt->probability || opt->marginal || opt->marginal_all) {
+            flags |= CRFSUITE_CACHE_MARGINALS;
+        }
+        if ((ret = ctx->tagger->set_cache(ctx->tagger, opt->cache_size, flags))) {
+            goto error_exit;
+        }
+    }
 
-    /* Open the stream for the input data. */
-    fp = (strcmp(opt->input, "-") == 0) ? fpi : fopen(opt->input, "r");
-    if (fp == NULL) {
-        fprintf(fpe, "ERROR: failed to open the stream for the input data,\n");
-        fprintf(fpe, "  %s\n", opt->input);
-        ret = 1;
-        goto force_exit;
+    /* Enable the statistics if specified. */
+    if (opt->stats) {
+        ctx->stats = (crfsuite_tagger_stats_t*)calloc(1, sizeof(crfsuite_tagger_stats_t));
+        if (ctx->stats == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        if ((ret = ctx->tagger->set_stats(ctx->tagger, 1))) {
+            goto error_exit;
+        }
     }
 
-    /* Open a IWA reader. */
-    iwa = iwa_reader(fp);
-    if (iwa == NULL) {
-        fprintf(fpe, "ERROR: Failed to initialize the parser for the input data.\n");
-        ret = 1;
-        goto force_exit;
+    ctx->num_labels = ctx->labels->num(ctx->labels);
+    crfsuite_evaluation_init(&ctx->eval, ctx->num_labels);
+    return 0;
+
+error_exit:
+    tag_context_finish(ctx);
+    return ret;
+}
+
+void tag_context_finish(tag_context_t* ctx)
+{
+    if (ctx->eval.tbl != NULL) {
+        crfsuite_evaluation_finish(&ctx->eval);
     }
+    free(ctx->output);
+    free(ctx->stats);
+    iwa_delete(ctx->iwa);
+    crfsuite_item_finish(&ctx->item);
+    crfsuite_instance_finish(&ctx->inst);
+    SAFE_RELEASE(ctx->tagger);
+    SAFE_RELEASE(ctx->attrs);
+    SAFE_RELEASE(ctx->labels);
+    memset(ctx, 0, sizeof(*ctx));
+}
 
-    /* Read the input data and assign labels. */
-    clk0 = clock();
-    while (token = iwa_read(iwa), token != NULL) {
+void tag_context_cache_stats(tag_context_t* ctx, crfsuite_cache_stats_t* total)
+{
+    crfsuite_cache_stats_t stats;
+
+    ctx->tagger->cache_stats(ctx->tagger, &stats);
+    total->max_entries += stats.max_entries;
+    total->num_entries += stats.num_entries;
+    total->num_lookups += stats.num_lookups;
+    total->num_hits += stats.num_hits;
+    total->num_evictions += stats.num_evictions;
+}
+
+void tag_output_cache_stats(FILE *fp, const crfsuite_cache_stats_t* stats)
+{
+    fprintf(fp, "Cache hits: %ld / %ld (%.4f), entries: %d / %d, evictions: %ld\n",
+        stats->num_hits, stats->num_lookups,
+        0 < stats->num_lookups ? stats->num_hits / (double)stats->num_lookups : 0.,
+        stats->num_entries, stats->max_entries, stats->num_evictions);
+}
+
+void tag_context_stats(tag_context_t* ctx, crfsuite_tagger_stats_t* total)
+{
+    crfsuite_tagger_stats_t* stats = (crfsuite_tagger_stats_t*)malloc(sizeof(crfsuite_tagger_stats_t));
+
+    /* The tagger measures the scoring and inference; the context the others. */
+    if (stats != NULL) {
+        ctx->tagger->stats(ctx->tagger, stats);
+        crfsuite_tagger_stats_merge(total, stats);
+        free(stats);
+    }
+    if (ctx->stats != NULL) {
+        crfsuite_tagger_stats_merge(total, ctx->stats);
+    }
+}
+
+void tag_output_stats(FILE *fp, const crfsuite_tagger_stats_t* stats, double seconds)
+{
+    int i;
+    static const char *names[CRFSUITE_NUM_STAGES] = {
+        "parse", "lookup", "score", "inference", "output",
+    };
+    const long num_attributes = stats->num_attributes + stats->num_unknown_attributes;
+
+    fprintf(fp, "Throughput: %ld instances, %ld items in %f [sec] (%.1f [instance/sec], %.1f [item/sec])\n",
+        stats->num_instances, stats->num_items, seconds,
+        0 < seconds ? stats->num_instances / seconds : 0.,
+        0 < seconds ? stats->num_items / seconds : 0.);
+    fprintf(fp, "Unknown attributes: %ld / %ld (%.4f)\n",
+        stats->num_unknown_attributes, num_attributes,
+        0 < num_attributes ? stats->num_unknown_attributes / (double)num_attributes : 0.);
+    fprintf(fp, "Features touched per item: %.1f\n",
+        0 < stats->num_items ? stats->num_features / (double)stats->num_items : 0.);
+    fprintf(fp, "%-10s %12s %10s %10s %10s %10s %10s %10s\n",
+        "Stage", "Total [sec]", "inst p50", "inst p95", "inst p99",
+        "item p50", "item p95", "item p99");
+    for (i = 0;i < CRFSUITE_NUM_STAGES;++i) {
+        const crfsuite_latency_t* lat = &stats->stages[i];
+        fprintf(fp, "%-10s %12.6f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+            names[i], lat->seconds,
+            crfsuite_latency_percentile(lat, 0.50, 0) * 1e6,
+            crfsuite_latency_percentile(lat, 0.95, 0) * 1e6,
+            crfsuite_latency_percentile(lat, 0.99, 0) * 1e6,
+            crfsuite_latency_percentile(lat, 0.50, 1) * 1e6,
+            crfsuite_latency_percentile(lat, 0.95, 1) * 1e6,
+            crfsuite_latency_percentile(lat, 0.99, 1) * 1e6);
+    }
+    fprintf(fp, "(latencies in [usec])\n");
+}
+
+/**
+ * Tag an instance and format the result.
+ *  @return int         The status code.
+ */
+static int tag_instance(tag_context_t* ctx, crfsuite_instance_t* inst, textbuf_t* buf)
+{
+    int ret = 0;
+    floatval_t score = 0;
+    crfsuite_tagger_t* tagger = ctx->tagger;
+    const tagger_option_t* opt = ctx->opt;
+
+    /* Expand the array to receive the tagging result if necessary. */
+    if (ctx->cap_output < inst->num_items) {
+        int *output = (int*)realloc(ctx->output, sizeof(int) * inst->num_items);
+        if (output == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        ctx->output = output;
+        ctx->cap_output = inst->num_items;
+    }
+
+    /* Set the instance to the tagger. */
+    if ((ret = tagger->set(tagger, inst))) {
+        return ret;
+    }
+
+    /* Obtain the viterbi label sequence. */
+    if ((ret = tagger->viterbi(tagger, ctx->output, &score))) {
+        return ret;
+    }
+
+    ++ctx->num_instances;
+
+    /* Accumulate the tagging performance. */
+    if (opt->evaluate) {
+        crfsuite_evaluation_accmulate(&ctx->eval, inst->labels, ctx->output, inst->num_items);
+    }
+
+    /* Account the parsing of the instance. */
+    if (ctx->stats != NULL) {
+        crfsuite_latency_add(&ctx->stats->stages[CRFSUITE_STAGE_PARSE], ctx->parse_seconds, inst->num_items);
+        crfsuite_latency_add(&ctx->stats->stages[CRFSUITE_STAGE_LOOKUP], ctx->lookup_seconds, inst->num_items);
+        ctx->parse_seconds = 0.;
+        ctx->lookup_seconds = 0.;
+    }
+
+    if (!opt->quiet) {
+        double begin = (ctx->stats != NULL) ? crfsuite_wallclock() : 0.;
+        output_result(buf, tagger, inst, ctx->output, ctx->labels, score, opt);
+        if (ctx->stats != NULL) {
+            crfsuite_latency_add(&ctx->stats->stages[CRFSUITE_STAGE_OUTPUT], crfsuite_wallclock() - begin, inst->num_items);
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * The text is modified by the parser, and must have a writable byte just
+ * after the text (text[size]). The results are appended to the output.
+ */
+int tag_text(tag_context_t* ctx, char *text, size_t size, textbuf_t* out)
+{
+    int ret = 0, lid = -1;
+    crfsuite_attribute_t cont;
+    const iwa_token_t* token = NULL;
+    crfsuite_dictionary_t *attrs = ctx->attrs, *labels = ctx->labels;
+    crfsuite_instance_t* inst = &ctx->inst;
+    crfsuite_item_t* item = &ctx->item;
+    crfsuite_tagger_stats_t* stats = ctx->stats;
+    double now = 0., last = 0.;
+
+    /* Reuse the reader and the instance of the previous call. */
+    if (ctx->iwa == NULL) {
+        ctx->iwa = iwa_reader_memory(text, size);
+        if (ctx->iwa == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+    } else {
+        iwa_reset_memory(ctx->iwa, text, size);
+    }
+    crfsuite_instance_clear(inst);
+    ctx->parse_seconds = 0.;
+    ctx->lookup_seconds = 0.;
+
+    /*
+        With the statistics, the time between tokens is accounted to the
+        parsing except for the lookup of attributes and the tagging.
+     */
+    if (stats != NULL) {
+        last = crfsuite_wallclock();
+    }
+
+    while (token = iwa_read(ctx->iwa), token != NULL) {
+        if (stats != NULL) {
+            now = crfsuite_wallclock();
+            ctx->parse_seconds += now - last;
+            last = now;
+        }
         switch (token->type) {
         case IWA_BOI:
             /* Initialize an item. */
             lid = -1;
-            crfsuite_item_init(&item);
-            free(comment);
-            comment = NULL;
+            crfsuite_item_clear(item);
             break;
         case IWA_EOI:
-            /* Append the item to the instance. */
-            crfsuite_instance_append(&inst, &item, lid);
-            crfsuite_item_finish(&item);
+            /* Move the item to the instance. */
+            if (crfsuite_instance_append_move(inst, item, lid) != 0) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
             break;
         case IWA_ITEM:
             if (lid == -1) {
                 /* The first field in a line presents a label. */
                 lid = labels->to_id(labels, token->attr);
-                if (lid < 0) lid = L;    /* #L stands for a unknown label. */
+                if (lid < 0) lid = ctx->num_labels;    /* #L stands for a unknown label. */
             } else {
                 /* Fields after the first field present attributes. */
                 int aid = attrs->to_id(attrs, token->attr);
+                if (stats != NULL) {
+                    now = crfsuite_wallclock();
+                    ctx->lookup_seconds += now - last;
+                    last = now;
+                    if (aid < 0) {
+                        ++stats->num_unknown_attributes;
+                    }
+                }
                 /* Ignore attributes 'unknown' to the model. */
                 if (0 <= aid) {
                     /* Associate the attribute with the current item. */
                     if (token->value && *token->value) {
-                        crfsuite_attribute_set(&cont, aid, atof(token->value));
+                        crfsuite_attribute_set(&cont, aid, iwa_atof(token->value));
                     } else {
                         crfsuite_attribute_set(&cont, aid, 1.0);
                     }
-                    crfsuite_item_append_attribute(&item, &cont);
+                    if (crfsuite_item_append_attribute(item, &cont) != 0) {
+                        return CRFSUITEERR_OUTOFMEMORY;
+                    }
                 }
             }
             break;
         case IWA_NONE:
         case IWA_EOF:
-            if (!crfsuite_instance_empty(&inst)) {
-                /* Initialize the object to receive the tagging result. */
-                floatval_t score = 0;
-                int *output = calloc(sizeof(int), inst.num_items);
-
-                /* Set the instance to the tagger. */
-                if ((ret = tagger->set(tagger, &inst))) {
-                    goto force_exit;
+            if (!crfsuite_instance_empty(inst)) {
+                ret = tag_instance(ctx, inst, out);
+                crfsuite_instance_clear(inst);
+                if (ret) {
+                    return ret;
                 }
-
-                /* Obtain the viterbi label sequence. */
-                if ((ret = tagger->viterbi(tagger, output, &score))) {
-                    goto force_exit;
+                if (stats != NULL) {
+                    last = crfsuite_wallclock();
                 }
+            }
+            break;
+        }
+    }
 
-                ++N;
+    return ret;
+}
 
-                /* Accumulate the tagging performance. */
-                if (opt->evaluate) {
-                    crfsuite_evaluation_accmulate(&eval, inst.labels, output, inst.num_items);
-                }
+/**
+ * Parse the chunk of a job and tag the instances in the chunk.
+ *  @return int         The status code.
+ */
+static int tag_job(tag_worker_t* wk, tag_job_t* job)
+{
+    job->output.size = 0;
+    return tag_text(&wk->ctx, job->input.str, job->input.size, &job->output);
+}
 
-                if (!opt->quiet) {
-                    output_result(fpo, tagger, &inst, output, labels, score, opt);
-                }
+#ifdef  HAVE_PTHREAD_H
+static void* tag_worker(void *arg)
+{
+    tag_worker_t* wk = (tag_worker_t*)arg;
+    tag_pipeline_t* pl = wk->pl;
+
+    for (;;) {
+        int ret;
+        tag_job_t* job = NULL;
+
+        /* Wait for a job from the reader. */
+        pthread_mutex_lock(&pl->mutex);
+        while (!pl->abort && !pl->eof && pl->num_taken == pl->num_read) {
+            pthread_cond_wait(&pl->cond, &pl->mutex);
+        }
+        if (pl->abort || pl->num_taken == pl->num_read) {
+            pthread_mutex_unlock(&pl->mutex);
+            break;
+        }
+        job = &pl->jobs[pl->num_taken++ % pl->num_jobs];
+        pthread_mutex_unlock(&pl->mutex);
+
+        ret = tag_job(wk, job);
 
-                free(output);
-                crfsuite_instance_finish(&inst);
+        /* Pass the job to the writer. */
+        pthread_mutex_lock(&pl->mutex);
+        job->status = JOB_DONE;
+        if (ret) {
+            wk->ret = ret;
+            pl->abort = 1;
+        }
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->mutex);
+    }
+
+    return NULL;
+}
+
+static void* tag_writer(void *arg)
+{
+    tag_pipeline_t* pl = (tag_pipeline_t*)arg;
+
+    for (;;) {
+        tag_job_t* job = NULL;
+
+        /* Wait for the next job in the input order. */
+        pthread_mutex_lock(&pl->mutex);
+        for (;;) {
+            job = &pl->jobs[pl->num_written % pl->num_jobs];
+            if (pl->abort) {
+                job = NULL;
+                break;
             }
+            if (pl->num_written < pl->num_read && job->status == JOB_DONE) {
+                break;
+            }
+            if (pl->eof && pl->num_written == pl->num_read) {
+                job = NULL;
+                break;
+            }
+            pthread_cond_wait(&pl->cond, &pl->mutex);
+        }
+        pthread_mutex_unlock(&pl->mutex);
+        if (job == NULL) {
             break;
         }
+
+        fwrite(job->output.str, sizeof(char), job->output.size, pl->fpo);
+
+        /* Return the slot to the reader. */
+        pthread_mutex_lock(&pl->mutex);
+        job->status = JOB_EMPTY;
+        ++pl->num_written;
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->mutex);
+    }
+
+    return NULL;
+}
+#endif/*HAVE_PTHREAD_H*/
+
+static void merge_evaluation(crfsuite_evaluation_t* dst, const crfsuite_evaluation_t* src)
+{
+    int i;
+
+    for (i = 0;i <= dst->num_labels;++i) {
+        dst->tbl[i].num_correct += src->tbl[i].num_correct;
+        dst->tbl[i].num_observation += src->tbl[i].num_observation;
+        dst->tbl[i].num_model += src->tbl[i].num_model;
+    }
+    dst->item_total_num += src->item_total_num;
+    dst->inst_total_correct += src->inst_total_correct;
+    dst->inst_total_num += src->inst_total_num;
+}
+
+static int tag(tagger_option_t* opt, crfsuite_model_t* model)
+{
+    int i, N = 0, ret = 0, num_workers = 0;
+    double t0, t1;
+#ifdef  HAVE_PTHREAD_H
+    int threads_started = 0, writer_started = 0, read_failed = 0;
+    pthread_t writer;
+#endif/*HAVE_PTHREAD_H*/
+    tag_reader_t rd;
+    tag_pipeline_t pl;
+    tag_worker_t* workers = NULL;
+    FILE *fp = NULL, *fpi = opt->fpi, *fpo = opt->fpo, *fpe = opt->fpe;
+
+    memset(&rd, 0, sizeof(rd));
+    memset(&pl, 0, sizeof(pl));
+
+    /* Initialize the workers, each of which has its own tagger. */
+    num_workers = (1 < opt->num_threads) ? opt->num_threads : 1;
+#ifndef HAVE_PTHREAD_H
+    /* Tag the instances on this thread without the support of threads. */
+    num_workers = 1;
+#endif/*HAVE_PTHREAD_H*/
+    workers = (tag_worker_t*)calloc(num_workers, sizeof(tag_worker_t));
+    if (workers == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto force_exit;
+    }
+    for (i = 0;i < num_workers;++i) {
+        workers[i].pl = &pl;
+        if ((ret = tag_context_init(&workers[i].ctx, model, opt))) {
+            goto force_exit;
+        }
+    }
+
+    /* Initialize the pipeline. */
+    pl.num_jobs = (1 < num_workers) ? num_workers * 4 : 1;
+    pl.jobs = (tag_job_t*)calloc(pl.num_jobs, sizeof(tag_job_t));
+    if (pl.jobs == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto force_exit;
+    }
+    pl.fpo = fpo;
+
+    /* Open the stream for the input data. */
+    fp = (strcmp(opt->input, "-") == 0) ? fpi : fopen(opt->input, "r");
+    if (fp == NULL) {
+        fprintf(fpe, "ERROR: failed to open the stream for the input data,\n");
+        fprintf(fpe, "  %s\n", opt->input);
+        ret = 1;
+        goto force_exit;
+    }
+    rd.ins = instream_open(fp);
+    if (rd.ins == NULL) {
+        fprintf(fpe, "ERROR: failed to open the stream for the input data,\n");
+        fprintf(fpe, "  %s\n", opt->input);
+        ret = 1;
+        goto force_exit;
+    }
+
+    /* Read the input data and assign labels. */
+    t0 = crfsuite_wallclock();
+    if (num_workers == 1) {
+        /* Run the stages in turn on this thread. */
+        while ((ret = read_job(&rd, &pl.jobs[0])) == 1) {
+            if ((ret = tag_job(&workers[0], &pl.jobs[0]))) {
+                goto force_exit;
+            }
+            fwrite(pl.jobs[0].output.str, sizeof(char), pl.jobs[0].output.size, fpo);
+        }
+        if (ret < 0) {
+            goto read_error;
+        }
+    }
+#ifdef  HAVE_PTHREAD_H
+    else {
+        pthread_mutex_init(&pl.mutex, NULL);
+        pthread_cond_init(&pl.cond, NULL);
+
+        /* Start the workers and writer. */
+        for (i = 0;i < num_workers;++i) {
+            if (pthread_create(&workers[i].thread, NULL, tag_worker, &workers[i]) != 0) {
+                break;
+            }
+            ++threads_started;
+        }
+        if (threads_started == num_workers) {
+            if (pthread_create(&writer, NULL, tag_writer, &pl) == 0) {
+                writer_started = 1;
+            }
+        }
+        if (!writer_started) {
+            fprintf(fpe, "ERROR: Failed to create a thread.\n");
+            ret = 1;
+            pthread_mutex_lock(&pl.mutex);
+            pl.abort = 1;
+            pthread_cond_broadcast(&pl.cond);
+            pthread_mutex_unlock(&pl.mutex);
+        }
+
+        /* The reader stage runs on this thread. */
+        for (;;) {
+            int n;
+            tag_job_t* job = NULL;
+
+            /* Wait for a vacant slot. */
+            pthread_mutex_lock(&pl.mutex);
+            while (!pl.abort && pl.num_jobs <= pl.num_read - pl.num_written) {
+                pthread_cond_wait(&pl.cond, &pl.mutex);
+            }
+            if (pl.abort) {
+                pthread_mutex_unlock(&pl.mutex);
+                break;
+            }
+            job = &pl.jobs[pl.num_read % pl.num_jobs];
+            pthread_mutex_unlock(&pl.mutex);
+
+            n = read_job(&rd, job);
+
+            /* Pass the job to the workers. */
+            pthread_mutex_lock(&pl.mutex);
+            if (0 < n) {
+                job->status = JOB_READY;
+                ++pl.num_read;
+            } else {
+                if (n < 0) {
+                    read_failed = 1;
+                    pl.abort = 1;
+                }
+                pl.eof = 1;
+            }
+            pthread_cond_broadcast(&pl.cond);
+            pthread_mutex_unlock(&pl.mutex);
+
+            if (n <= 0) {
+                break;
+            }
+        }
+
+        /* Wait for the workers and writer. */
+        for (i = 0;i < threads_started;++i) {
+            pthread_join(workers[i].thread, NULL);
+            if (workers[i].ret) {
+                ret = workers[i].ret;
+            }
+        }
+        if (writer_started) {
+            pthread_join(writer, NULL);
+        }
+        pthread_cond_destroy(&pl.cond);
+        pthread_mutex_destroy(&pl.mutex);
+        if (read_failed) {
+            goto read_error;
+        }
+        if (ret) {
+            goto force_exit;
+        }
+    }
+#endif/*HAVE_PTHREAD_H*/
+    t1 = crfsuite_wallclock();
+
+    /* Merge the counts of the workers. */
+    for (i = 0;i < num_workers;++i) {
+        N += workers[i].ctx.num_instances;
+        if (0 < i) {
+            merge_evaluation(&workers[0].ctx.eval, &workers[i].ctx.eval);
+        }
     }
-    clk1 = clock();
 
     /* Compute the performance if specified. */
     if (opt->evaluate) {
-        double sec = (clk1 - clk0) / (double)CLOCKS_PER_SEC;
-        crfsuite_evaluation_finalize(&eval);
-        crfsuite_evaluation_output(&eval, labels, message_callback, stdout);
+        double sec = t1 - t0;
+        crfsuite_evaluation_finalize(&workers[0].ctx.eval);
+        crfsuite_evaluation_output(&workers[0].ctx.eval, workers[0].ctx.labels, message_callback, stdout);
         fprintf(fpo, "Elapsed time: %f [sec] (%.1f [instance/sec])\n", sec, N / sec);
+        if (0 < opt->cache_size) {
+            crfsuite_cache_stats_t stats;
+            memset(&stats, 0, sizeof(stats));
+            for (i = 0;i < num_workers;++i) {
+                tag_context_cache_stats(&workers[i].ctx, &stats);
+            }
+            tag_output_cache_stats(fpo, &stats);
+        }
     }
 
-force_exit:
-    /* Close the IWA parser. */
-    iwa_delete(iwa);
-    iwa = NULL;
+    /* Report the statistics if specified. */
+    if (opt->stats) {
+        crfsuite_tagger_stats_t* stats = (crfsuite_tagger_stats_t*)calloc(1, sizeof(crfsuite_tagger_stats_t));
+        if (stats == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto force_exit;
+        }
+        for (i = 0;i < num_workers;++i) {
+            tag_context_stats(&workers[i].ctx, stats);
+        }
+        tag_output_stats(fpo, stats, t1 - t0);
+        free(stats);
+    }
+
+    goto force_exit;
+
+read_error:
+    if (instream_error(rd.ins)) {
+        fprintf(fpe, "ERROR: failed to read the input data (truncated or corrupted),\n");
+        fprintf(fpe, "  %s\n", opt->input);
+        ret = 1;
+    } else {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+    }
 
+force_exit:
     /* Close the input stream if necessary. */
+    instream_close(rd.ins);
     if (fp != NULL && fp != fpi) {
         fclose(fp);
         fp = NULL;
     }
 
-    free(comment);
-    crfsuite_instance_finish(&inst);
-    crfsuite_evaluation_finish(&eval);
-
-    SAFE_RELEASE(tagger);
-    SAFE_RELEASE(attrs);
-    SAFE_RELEASE(labels);
+    free(rd.rest.str);
+    if (pl.jobs != NULL) {
+        for (i = 0;i < pl.num_jobs;++i) {
+            free(pl.jobs[i].input.str);
+            free(pl.jobs[i].output.str);
+        }
+        free(pl.jobs);
+    }
+    if (workers != NULL) {
+        for (i = 0;i < num_workers;++i) {
+            tag_context_finish(&workers[i].ctx);
+        }
+        free(workers);
+    }
 
     return ret;
 }
@@ -425,6 +1114,7 @@ int main_tag(int argc, char *argv[], const char *argv0)
     if (opt.model != NULL) {
         /* Create a model instance corresponding to the model file. */
         if (ret = crfsuite_create_instance_from_file(opt.model, (void**)&model)) {
+            fprintf(fpe, "ERROR: Failed to read the model (missing, or of an unknown format): %s\n", opt.model);
             goto force_exit;
         }
 
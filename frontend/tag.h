@@ -0,0 +1,103 @@
+/*
+ *        Tagging routines shared by the tag and serve commands.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifndef    __TAG_H__
+#define    __TAG_H__
+
+typedef struct {
+    char *input;
+    char *model;
+    int evaluate;
+    int probability;
+    int marginal;
+    int marginal_all;
+    int quiet;
+    int reference;
+    int num_threads;
+    int cache_size;
+    int stats;
+    int help;
+
+    int num_params;
+    char **params;
+
+    FILE *fpi;
+    FILE *fpo;
+    FILE *fpe;
+} tagger_option_t;
+
+/**
+ * A growable text buffer for chunks of the input and output data.
+ */
+typedef struct {
+    char *str;
+    size_t size;
+    size_t cap;
+} textbuf_t;
+
+int textbuf_reserve(textbuf_t* buf, size_t size);
+int textbuf_append(textbuf_t* buf, const char *str, size_t size);
+void textbuf_printf(textbuf_t* buf, const char *format, ...);
+
+/**
+ * A tagger with the dictionaries of its model and the working memory.
+ *  A context is used by one thread at a time. The working memory is kept
+ *  across calls of tag_text() so that tagging does not allocate memory
+ *  once the buffers have grown large enough.
+ */
+typedef struct {
+    crfsuite_tagger_t* tagger;
+    crfsuite_dictionary_t* attrs;
+    crfsuite_dictionary_t* labels;
+    int num_labels;
+    const tagger_option_t* opt;
+    crfsuite_evaluation_t eval;
+    int* output;
+    int cap_output;
+    int num_instances;
+    iwa_t* iwa;                 /**< The reader of the text (reused). */
+    crfsuite_instance_t inst;   /**< The instance being read (reused). */
+    crfsuite_item_t item;       /**< The item being read (reused). */
+    crfsuite_tagger_stats_t* stats; /**< Statistics of the stages outside the tagger (NULL if disabled). */
+    double parse_seconds;       /**< Seconds spent parsing the instance being read. */
+    double lookup_seconds;      /**< Seconds spent looking up the attributes of the instance. */
+} tag_context_t;
+
+int tag_context_init(tag_context_t* ctx, crfsuite_model_t* model, const tagger_option_t* opt);
+void tag_context_finish(tag_context_t* ctx);
+int tag_text(tag_context_t* ctx, char *text, size_t size, textbuf_t* out);
+void tag_context_cache_stats(tag_context_t* ctx, crfsuite_cache_stats_t* total);
+void tag_output_cache_stats(FILE *fp, const crfsuite_cache_stats_t* stats);
+void tag_context_stats(tag_context_t* ctx, crfsuite_tagger_stats_t* total);
+void tag_output_stats(FILE *fp, const crfsuite_tagger_stats_t* stats, double seconds);
+
+#endif/*__TAG_H__*/
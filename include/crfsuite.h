@@ -85,6 +85,8 @@ enum {
     CRFSUITEERR_OVERFLOW,
     /** Not implemented. */
     CRFSUITEERR_NOTIMPLEMENTED,
+    /** Training stopped before completing an iteration. */
+    CRFSUITEERR_STOPPED,
 };
 
 /**@}*/
@@ -108,6 +110,10 @@ struct tag_crfsuite_tagger;
 /** CRFSuite tagger interface. */
 typedef struct tag_crfsuite_tagger crfsuite_tagger_t;
 
+struct tag_crfsuite_learner;
+/** CRFSuite online learner interface. */
+typedef struct tag_crfsuite_learner crfsuite_learner_t;
+
 struct tag_crfsuite_dictionary;
 /** CRFSuite dictionary interface. */
 typedef struct tag_crfsuite_dictionary crfsuite_dictionary_t;
@@ -138,7 +144,7 @@ typedef struct {
  * An item.
  *  An item consists of an array of attributes.
  */
-typedef struct {
+typedef struct tag_crfsuite_item {
     /** Number of contents associated with the item. */
     int             num_contents;
     /** Maximum number of contents (internal use). */
@@ -151,7 +157,7 @@ typedef struct {
  * An instance (sequence of items and labels).
  *  An instance consists of a sequence of items and labels.
  */
-typedef struct {
+typedef struct tag_crfsuite_instance {
     /** Number of items/labels in the sequence. */
     int         num_items;
     /** Maximum number of items/labels (internal use). */
@@ -166,10 +172,17 @@ typedef struct {
 	int         group;
 } crfsuite_instance_t;
 
+/**
+ * Shards storing the instances of a data set in files (opaque).
+ */
+typedef struct tag_crfsuite_shards crfsuite_shards_t;
+
 /**
  * A data set.
  *  A data set consists of an array of instances and dictionary objects
- *  for attributes and labels.
+ *  for attributes and labels. In the streaming mode (see
+ *  crfsuite_data_stream()), the instances are stored in shards instead of
+ *  the array.
  */
 typedef struct {
     /** Number of instances. */
@@ -183,6 +196,9 @@ typedef struct {
     crfsuite_dictionary_t    *attrs;
     /** Dictionary object for labels. */
     crfsuite_dictionary_t    *labels;
+
+    /** Shards of instances in the streaming mode (NULL otherwise). */
+    crfsuite_shards_t        *shards;
 } crfsuite_data_t;
 
 /**@}*/
@@ -247,6 +263,93 @@ typedef struct {
     floatval_t  macro_fmeasure;
 } crfsuite_evaluation_t;
 
+/**
+ * Flags for the result cache of a tagger.
+ */
+enum {
+    /** Store the label sequence and its score (default). */
+    CRFSUITE_CACHE_PATH = 0x00,
+    /** Store the partition factor and marginal probabilities as well. */
+    CRFSUITE_CACHE_MARGINALS = 0x01,
+};
+
+/**
+ * Counters of the result cache of a tagger.
+ */
+typedef struct {
+    /** Maximum number of entries. */
+    int         max_entries;
+    /** Number of entries in the cache. */
+    int         num_entries;
+    /** Number of lookups. */
+    long        num_lookups;
+    /** Number of lookups that found an entry. */
+    long        num_hits;
+    /** Number of entries evicted to make room for new ones. */
+    long        num_evictions;
+} crfsuite_cache_stats_t;
+
+/**
+ * Stages of tagging measured by the statistics of a tagger.
+ *  The tagger measures CRFSUITE_STAGE_SCORE and CRFSUITE_STAGE_INFERENCE;
+ *  an application may measure the other stages with crfsuite_latency_add().
+ */
+enum {
+    /** Reading and parsing the input data. */
+    CRFSUITE_STAGE_PARSE = 0,
+    /** Looking up the attribute identifiers. */
+    CRFSUITE_STAGE_LOOKUP,
+    /** Computing the state scores, i.e., crfsuite_tagger_t::set(). */
+    CRFSUITE_STAGE_SCORE,
+    /** The Viterbi and forward-backward algorithms. */
+    CRFSUITE_STAGE_INFERENCE,
+    /** Formatting the output. */
+    CRFSUITE_STAGE_OUTPUT,
+    /** The number of the stages. */
+    CRFSUITE_NUM_STAGES,
+};
+
+/**
+ * The number of the buckets in a latency histogram.
+ */
+#define CRFSUITE_LATENCY_BUCKETS    320
+
+/**
+ * Latency histograms of a tagging stage.
+ *  The bucket #b counts the latencies between 2^(b/8) and 2^((b+1)/8)
+ *  nanoseconds, so that a percentile is accurate within 9%.
+ */
+typedef struct {
+    /** Total seconds. */
+    double      seconds;
+    /** Number of instances measured. */
+    long        num_instances;
+    /** Number of items in the instances measured. */
+    long        num_items;
+    /** Histogram of the latencies per instance. */
+    long        instances[CRFSUITE_LATENCY_BUCKETS];
+    /** Histogram of the latencies per item, counted for every item. */
+    long        items[CRFSUITE_LATENCY_BUCKETS];
+} crfsuite_latency_t;
+
+/**
+ * Statistics of a tagger.
+ */
+typedef struct {
+    /** Number of instances tagged. */
+    long        num_instances;
+    /** Number of items tagged. */
+    long        num_items;
+    /** Number of attributes in the items (known to the model). */
+    long        num_attributes;
+    /** Number of attributes unknown to the model (counted by the application). */
+    long        num_unknown_attributes;
+    /** Number of state features whose weights were read. */
+    long        num_features;
+    /** Latencies of the stages. */
+    crfsuite_latency_t  stages[CRFSUITE_NUM_STAGES];
+} crfsuite_tagger_stats_t;
+
 /**@}*/
 
 
@@ -264,6 +367,62 @@ typedef struct {
  */
 typedef int (*crfsuite_logging_callback)(void *user, const char *format, va_list args);
 
+/**
+ * The progress of a training process.
+ */
+typedef struct {
+    int         iteration;          /**< The number of iterations (epochs) done. */
+    floatval_t  loss;               /**< The loss of the latest iteration. */
+    double      elapsed;            /**< Seconds elapsed since the training began. */
+} crfsuite_progress_t;
+
+/**
+ * Type of callback function for the training progress.
+ *  A training algorithm calls this function at the end of every iteration
+ *  (epoch). When this function returns a non-zero value, the training stops
+ *  and the best feature weights seen so far are stored in the model.
+ *  @param  user        Pointer to the user-defined data.
+ *  @param  progress    The progress of the training.
+ *  @return int         \c 0 to continue; non-zero to stop the training.
+ */
+typedef int (*crfsuite_progress_callback)(void *user, const crfsuite_progress_t *progress);
+
+/**
+ * Type of callback function for the training metrics.
+ *  A training algorithm calls this function at the end of every iteration
+ *  (epoch) with a record of the metrics, which is a JSON object in a single
+ *  line (without a newline character), e.g.,
+ *  {"iteration":3,"loss":1234.5,"elapsed":0.82,"max_rss_kb":10240,...}.
+ *  The members "iteration", "loss", and "elapsed" (wall-clock seconds
+ *  since the training began) are always present; the others depend on the
+ *  training algorithm and the availability of the holdout data: e.g.,
+ *  "seconds" (of the iteration), "feature_norm", "feature_l1_norm",
+ *  "error_norm", "active_features", "active_set", "learning_rate",
+ *  "improvement", "updates", "linesearch_trials", "linesearch_step",
+ *  "holdout_accuracy", and "holdout_macro_f1". Values that are not finite
+ *  are written as null.
+ *  @param  user        Pointer to the user-defined data.
+ *  @param  record      The record of the metrics.
+ */
+typedef void (*crfsuite_metrics_callback)(void *user, const char *record);
+
+/**
+ * A parameter setting of a sweep and its result.
+ */
+typedef struct {
+    /** Comma-separated assignments of parameters (e.g., "c1=0,c2=0.1"). */
+    const char  *params;
+    /** Index of the earlier setting whose weights initialize this one (-1 for none). */
+    int         warm_start;
+    /** Status code of the training (set by the trainer). */
+    int         status;
+    /** Item-level accuracy on the holdout data (set by the trainer). */
+    floatval_t  item_accuracy;
+    /** Macro-averaged F1 score on the holdout data (set by the trainer). */
+    floatval_t  macro_fmeasure;
+    /** Seconds required for the training (set by the trainer). */
+    double      seconds;
+} crfsuite_sweep_t;
 
 /**
  * CRFSuite model interface.
@@ -385,6 +544,50 @@ struct tag_crfsuite_trainer {
      *  @return int         The status code.
      */
     int (*train)(crfsuite_trainer_t* trainer, const crfsuite_data_t *data, const char *filename, int holdout);
+
+    /**
+     * Set the progress callback function and user-defined data.
+     *  The callback can stop the training, as the parameter "max_seconds"
+     *  does when the time budget is exhausted; the training then stores the
+     *  best feature weights seen so far and returns successfully.
+     *  @param  trainer     The pointer to this trainer instance.
+     *  @param  user        The pointer to the user-defined data.
+     *  @param  cbp         The pointer to the callback function.
+     */
+    void (*set_progress_callback)(crfsuite_trainer_t* trainer, void *user, crfsuite_progress_callback cbp);
+
+    /**
+     * Train models with multiple parameter settings (a parameter sweep).
+     *  The features are generated from the data once and shared by all
+     *  settings, which are trained concurrently by the given number of
+     *  threads. A setting whose warm_start member points to an earlier
+     *  setting waits for it, and starts from its weights; a regularization
+     *  path is thus a chain of settings. Every setting is evaluated on the
+     *  holdout group, and the model of the best setting (by the macro F1
+     *  score if the parameter "early_stopping" is "f1", by the item
+     *  accuracy otherwise) is stored.
+     *  @param  trainer     The pointer to this trainer instance.
+     *  @param  data        The poiinter to the data set.
+     *  @param  filename    The filename to which the trainer stores the
+     *                      model of the best setting (no model if empty).
+     *  @param  holdout     The holdout group (required).
+     *  @param  settings    The array of parameter settings, which receive
+     *                      the results.
+     *  @param  num_settings    The number of settings.
+     *  @param  num_threads     The number of threads.
+     *  @return int         The status code.
+     */
+    int (*sweep)(crfsuite_trainer_t* trainer, const crfsuite_data_t *data, const char *filename, int holdout, crfsuite_sweep_t *settings, int num_settings, int num_threads);
+
+    /**
+     * Set the metrics callback function and user-defined data.
+     *  The records of the metrics are also appended to the file specified
+     *  by the parameter "metrics.file", one record per line.
+     *  @param  trainer     The pointer to this trainer instance.
+     *  @param  user        The pointer to the user-defined data.
+     *  @param  cbm         The pointer to the callback function.
+     */
+    void (*set_metrics_callback)(crfsuite_trainer_t* trainer, void *user, crfsuite_metrics_callback cbm);
 };
 
 /**
@@ -487,6 +690,175 @@ struct tag_crfsuite_tagger {
      *  @return int         The status code.
      */
     int (*marginal_path)(crfsuite_tagger_t *tagger, const int *path, int begin, int end, floatval_t *ptr_prob);
+
+    /**
+     * Enable the result cache of the tagger.
+     *  The cache keeps the tagging results of the most recently used
+     *  instances, each identified by its sequence of attribute ids and
+     *  values. When set() receives an instance in the cache, viterbi()
+     *  (and lognorm() and marginal_point() with CRFSUITE_CACHE_MARGINALS)
+     *  reuse the stored results instead of scoring the instance. The
+     *  instance must remain valid until the next call of set(), since the
+     *  other functions score it on demand. The cache is owned by this
+     *  tagger and is not shared with other threads.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  max_entries The maximum number of entries; zero disables
+     *                      the cache.
+     *  @param  flags       The results to be stored (CRFSUITE_CACHE_*).
+     *  @return int         The status code.
+     */
+    int (*set_cache)(crfsuite_tagger_t *tagger, int max_entries, int flags);
+
+    /**
+     * Obtain the counters of the result cache.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  stats       The pointer to a structure that receives the
+     *                      counters.
+     *  @return int         The status code.
+     */
+    int (*cache_stats)(crfsuite_tagger_t *tagger, crfsuite_cache_stats_t *stats);
+
+    /**
+     * Enable the statistics of the tagger.
+     *  The tagger then measures the latencies of computing state scores
+     *  and of the inference for every instance, and counts the items,
+     *  attributes, and features, at the cost of reading the clock a few
+     *  times per instance. This function clears the statistics.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  enable      Non-zero to enable the statistics, zero to
+     *                      disable.
+     *  @return int         The status code.
+     */
+    int (*set_stats)(crfsuite_tagger_t *tagger, int enable);
+
+    /**
+     * Obtain the statistics of the tagger.
+     *  @param  tagger      The pointer to this tagger instance.
+     *  @param  stats       The pointer to a structure that receives the
+     *                      statistics (cleared if they are disabled).
+     *  @return int         The status code.
+     */
+    int (*stats)(crfsuite_tagger_t *tagger, crfsuite_tagger_stats_t *stats);
+};
+
+/**
+ * CRFSuite online learner interface.
+ *  An online learner keeps a model in memory and updates its feature
+ *  weights with one labeled instance at a time (with Passive Aggressive
+ *  or AROW). Unlike a trainer, the learner generates the features of
+ *  attributes and labels as they appear in the instances. A learner is
+ *  created by crfsuite_create_instance() with the interface identifier
+ *  "learner/crf1d/passive-aggressive" or "learner/crf1d/arow". A learner
+ *  object (and the taggers obtained from it) must not be used by more than
+ *  one thread at a time.
+ */
+struct tag_crfsuite_learner {
+    /**
+     * Pointer to the internal data (internal use only).
+     */
+    void *internal;
+
+    /**
+     * Reference counter (internal use only).
+     */
+    int nref;
+
+    /**
+     * Increment the reference counter.
+     *  @param  learner     The pointer to this learner instance.
+     *  @return int         The reference count after this increment.
+     */
+    int (*addref)(crfsuite_learner_t* learner);
+
+    /**
+     * Decrement the reference counter.
+     *  @param  learner     The pointer to this learner instance.
+     *  @return int         The reference count after this operation.
+     */
+    int (*release)(crfsuite_learner_t* learner);
+
+    /**
+     * Obtain the pointer to crfsuite_params_t interface.
+     *  @param  learner     The pointer to this learner instance.
+     *  @return crfsuite_params_t*  The pointer to crfsuite_params_t.
+     */
+    crfsuite_params_t* (*params)(crfsuite_learner_t* learner);
+
+    /**
+     * Set the callback function and user-defined data.
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  user        The pointer to the user-defined data.
+     *  @param  cbm         The pointer to the callback function.
+     */
+    void (*set_message_callback)(crfsuite_learner_t* learner, void *user, crfsuite_logging_callback cbm);
+
+    /**
+     * Start learning from an existing model.
+     *  This function discards the current state of the learner and reads
+     *  the labels, attributes, and feature weights from the model file.
+     *  Without calling this function, a learner starts from an empty model.
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  filename    The filename of the model.
+     *  @return int         The status code.
+     */
+    int (*open)(crfsuite_learner_t* learner, const char *filename);
+
+    /**
+     * Obtain the pointer to crfsuite_dictionary_t interface for labels.
+     *  The dictionary grows as new labels are given to get().
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  ptr_labels  The pointer that receives the pointer to
+     *                      crfsuite_dictionary_t interface.
+     *  @return int         The status code.
+     */
+    int (*get_labels)(crfsuite_learner_t* learner, crfsuite_dictionary_t** ptr_labels);
+
+    /**
+     * Obtain the pointer to crfsuite_dictionary_t interface for attributes.
+     *  The dictionary grows as new attributes are given to get().
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  ptr_attrs   The pointer that receives the pointer to
+     *                      crfsuite_dictionary_t interface.
+     *  @return int         The status code.
+     */
+    int (*get_attrs)(crfsuite_learner_t* learner, crfsuite_dictionary_t** ptr_attrs);
+
+    /**
+     * Obtain the pointer to crfsuite_tagger_t interface.
+     *  The tagger uses the current feature weights of the learner; an
+     *  instance set to the tagger after an update is tagged with the
+     *  updated model. The tagger does not support the result cache.
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  ptr_tagger  The pointer that receives the pointer to
+     *                      crfsuite_tagger_t interface.
+     *  @return int         The status code.
+     */
+    int (*get_tagger)(crfsuite_learner_t* learner, crfsuite_tagger_t** ptr_tagger);
+
+    /**
+     * Update the model with a labeled instance.
+     *  When the parameter "snapshot.file" is set, this function stores the
+     *  model to the file after every "snapshot.period" instances, and
+     *  returns the status code of storing it (after updating the model).
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  inst        The instance whose attribute and label ids are
+     *                      obtained from the dictionaries of this learner.
+     *  @param  ptr_loss    The pointer to a float variable that receives the
+     *                      loss (cost) of the instance before the update,
+     *                      zero if the model tags the instance correctly.
+     *                      This can be \c NULL.
+     *  @return int         The status code.
+     */
+    int (*update)(crfsuite_learner_t* learner, const crfsuite_instance_t *inst, floatval_t *ptr_loss);
+
+    /**
+     * Store the current model to a file.
+     *  The file is replaced only after the whole model is written.
+     *  @param  learner     The pointer to this learner instance.
+     *  @param  filename    The filename to which the model is stored.
+     *  @return int         The status code.
+     */
+    int (*save)(crfsuite_learner_t* learner, const char *filename);
 };
 
 /**
@@ -836,6 +1208,14 @@ void crfsuite_item_init_n(crfsuite_item_t* item, int num_attributes);
  */
 void crfsuite_item_finish(crfsuite_item_t* item);
 
+/**
+ * Remove all attributes from an item structure.
+ *  Unlike crfsuite_item_finish(), this function keeps the memory block for
+ *  the attributes so that the item can be reused without allocation.
+ *  @param  item        The pointer to crfsuite_item_t.
+ */
+void crfsuite_item_clear(crfsuite_item_t* item);
+
 /**
  * Copy the content of an item structure.
  *  @param  dst         The pointer to the destination.
@@ -886,6 +1266,15 @@ void crfsuite_instance_init_n(crfsuite_instance_t* seq, int num_items);
  */
 void crfsuite_instance_finish(crfsuite_instance_t* seq);
 
+/**
+ * Remove all items and labels from an instance structure.
+ *  Unlike crfsuite_instance_finish(), this function keeps the memory blocks
+ *  for the items (including those for their attributes) so that the
+ *  instance can be reused without allocation.
+ *  @param  seq         The pointer to crfsuite_instance_t.
+ */
+void crfsuite_instance_clear(crfsuite_instance_t* seq);
+
 /**
  * Copy the content of an instance structure.
  *  @param  dst         The pointer to the destination.
@@ -909,6 +1298,19 @@ void crfsuite_instance_swap(crfsuite_instance_t* x, crfsuite_instance_t* y);
  */
 int  crfsuite_instance_append(crfsuite_instance_t* seq, const crfsuite_item_t* item, int label);
 
+/**
+ * Move a pair of item and label to the instance structure.
+ *  Unlike crfsuite_instance_append(), this function takes over the memory
+ *  block owned by the item instead of copying it. The item receives the
+ *  vacant memory block that the instance kept for reuse (if any), and is
+ *  empty when this function returns.
+ *  @param  seq         The pointer to crfsuite_instance_t.
+ *  @param  item        The item to be moved to the instance.
+ *  @param  label       The label to be added to the instance.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+int  crfsuite_instance_append_move(crfsuite_instance_t* seq, crfsuite_item_t* item, int label);
+
 /**
  * Check whether the instance has no item.
  *  @param  seq         The pointer to crfsuite_instance_t.
@@ -937,6 +1339,16 @@ void crfsuite_data_init_n(crfsuite_data_t* data, int n);
  */
 void crfsuite_data_finish(crfsuite_data_t* data);
 
+/**
+ * Remove all instances from a dataset structure.
+ *  Unlike crfsuite_data_finish(), this function keeps the memory blocks for
+ *  the instances so that the dataset can be refilled without allocation.
+ *  The dictionary objects are kept. In the streaming mode, the shard files
+ *  are removed and the dataset returns to the in-memory mode.
+ *  @param  data        The pointer to crfsuite_data_t.
+ */
+void crfsuite_data_clear(crfsuite_data_t* data);
+
 /**
  * Copy the content of a dataset structure.
  *  @param  dst         The pointer to the destination.
@@ -959,6 +1371,45 @@ void crfsuite_data_swap(crfsuite_data_t* x, crfsuite_data_t* y);
  */
 int  crfsuite_data_append(crfsuite_data_t* data, const crfsuite_instance_t* inst);
 
+/**
+ * Move an instance to the dataset structure.
+ *  Unlike crfsuite_data_append(), this function takes over the memory
+ *  blocks owned by the instance instead of copying them. The instance
+ *  receives the vacant memory blocks that the dataset kept for reuse (if
+ *  any), and is empty when this function returns; call
+ *  crfsuite_instance_finish() to release it.
+ *  @param  data        The pointer to crfsuite_data_t.
+ *  @param  inst        The instance to be moved to the dataset.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+int  crfsuite_data_append_move(crfsuite_data_t* data, crfsuite_instance_t* inst);
+
+/**
+ * Reserve the memory space for instances in the dataset structure.
+ *  @param  data        The pointer to crfsuite_data_t.
+ *  @param  n           The number of instances that the dataset will hold.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+int  crfsuite_data_reserve(crfsuite_data_t* data, int n);
+
+/**
+ * Store the instances of the dataset in shard files (streaming mode).
+ *  After this call, crfsuite_data_append() and crfsuite_data_append_move()
+ *  write instances to the shard files PREFIX.NNNNN.shard instead of the
+ *  memory, and training algorithms read the instances from the shards in
+ *  each pass. In a shuffled pass, the shards are visited in a random order
+ *  and instances are drawn randomly from a window of instances read ahead.
+ *  This allows online training algorithms to process a data set larger
+ *  than the memory. The instances already in the dataset are moved to the
+ *  shards. The shard files are removed by crfsuite_data_finish().
+ *  @param  data        The pointer to crfsuite_data_t.
+ *  @param  prefix      The prefix of the shard files.
+ *  @param  shard_size  The maximum number of instances in a shard file.
+ *  @param  window      The number of instances in the window for shuffling.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+int  crfsuite_data_stream(crfsuite_data_t* data, const char *prefix, int shard_size, int window);
+
 /**
  * Obtain the maximum length of the instances in the dataset.
  *  @param  data        The pointer to crfsuite_data_t.
@@ -974,6 +1425,15 @@ int  crfsuite_data_maxlength(crfsuite_data_t* data);
  */
 int  crfsuite_data_totalitems(crfsuite_data_t* data);
 
+/**
+ * Obtain the total number of instances in the dataset.
+ *  Unlike crfsuite_data_t::num_instances, this includes the instances
+ *  stored in shards in the streaming mode.
+ *  @param  data        The pointer to crfsuite_data_t.
+ *  @return int         The total number of instances in the dataset.
+ */
+int  crfsuite_data_totalinstances(crfsuite_data_t* data);
+
 /**@}*/
 
 /**
@@ -1026,6 +1486,37 @@ void crfsuite_evaluation_finalize(crfsuite_evaluation_t* eval);
  */
 void crfsuite_evaluation_output(crfsuite_evaluation_t* eval, crfsuite_dictionary_t* labels, crfsuite_logging_callback cbm, void *user);
 
+/**
+ * Read the monotonic wall clock for measuring latencies.
+ *  @return double      The time in seconds from an arbitrary origin.
+ */
+double crfsuite_wallclock(void);
+
+/**
+ * Add the latency of an instance to the histograms of a stage.
+ *  @param  lat         The pointer to crfsuite_latency_t.
+ *  @param  seconds     The latency of the stage for the instance.
+ *  @param  num_items   The number of items in the instance.
+ */
+void crfsuite_latency_add(crfsuite_latency_t* lat, double seconds, int num_items);
+
+/**
+ * Compute a percentile of the latencies of a stage.
+ *  @param  lat         The pointer to crfsuite_latency_t.
+ *  @param  p           The percentile in [0, 1], e.g., 0.99.
+ *  @param  per_item    Non-zero for the latencies per item, zero for
+ *                      those per instance.
+ *  @return double      The latency in seconds (0 if nothing measured).
+ */
+double crfsuite_latency_percentile(const crfsuite_latency_t* lat, double p, int per_item);
+
+/**
+ * Add the statistics of a tagger to another.
+ *  @param  dst         The pointer to the statistics receiving the sum.
+ *  @param  src         The pointer to the statistics to be added.
+ */
+void crfsuite_tagger_stats_merge(crfsuite_tagger_stats_t* dst, const crfsuite_tagger_stats_t* src);
+
 /**@}*/
 
 
@@ -136,11 +136,95 @@ void Trainer::append(const ItemSequence& xseq, const StringList& yseq, int group
     }
     _inst.group = group;
 
-    // Append the instance to the training set.
-    crfsuite_data_append(data, &_inst);
-
-    // Finish the instance.
+    // Move the instance to the training set.
+    int ret = crfsuite_data_append_move(data, &_inst);
     crfsuite_instance_finish(&_inst);
+    if (ret != 0) {
+        throw std::runtime_error("Out of memory.");
+    }
+}
+
+void Trainer::append_batch(const StringList& attrs, const FloatList& values, const IntList& item_offsets, const StringList& labels, const IntList& seq_offsets, int group)
+{
+    // Create dictionary objects if necessary.
+    if (data->attrs == NULL || data->labels == NULL) {
+        init();
+    }
+
+    // Check the consistency of the arguments before modifying the data set.
+    if (!values.empty() && values.size() != attrs.size()) {
+        std::stringstream ss;
+        ss << "The numbers of attributes and values differ: |attrs| = " << attrs.size() << ", |values| = " << values.size();
+        throw std::invalid_argument(ss.str());
+    }
+    if (item_offsets.size() != labels.size() + 1) {
+        std::stringstream ss;
+        ss << "The number of item offsets must be |labels| + 1: |item_offsets| = " << item_offsets.size() << ", |labels| = " << labels.size();
+        throw std::invalid_argument(ss.str());
+    }
+    if (seq_offsets.empty()) {
+        throw std::invalid_argument("The list of sequence offsets is empty.");
+    }
+    for (size_t k = 0;k < item_offsets.size();++k) {
+        int prev = (0 < k) ? item_offsets[k-1] : 0;
+        if (item_offsets[k] < prev || (int)attrs.size() < item_offsets[k]) {
+            std::stringstream ss;
+            ss << "Invalid item offset: item_offsets[" << k << "] = " << item_offsets[k];
+            throw std::invalid_argument(ss.str());
+        }
+    }
+    if (item_offsets.back() != (int)attrs.size()) {
+        throw std::invalid_argument("The last item offset must be identical to |attrs|.");
+    }
+    for (size_t j = 0;j < seq_offsets.size();++j) {
+        int prev = (0 < j) ? seq_offsets[j-1] : 0;
+        if (seq_offsets[j] < prev || (int)labels.size() < seq_offsets[j]) {
+            std::stringstream ss;
+            ss << "Invalid sequence offset: seq_offsets[" << j << "] = " << seq_offsets[j];
+            throw std::invalid_argument(ss.str());
+        }
+    }
+    if (seq_offsets.back() != (int)labels.size()) {
+        throw std::invalid_argument("The last sequence offset must be identical to |labels|.");
+    }
+
+    // Allocate the space for the new instances at once.
+    const int n = (int)seq_offsets.size() - 1;
+    if (crfsuite_data_reserve(data, data->num_instances + n) != 0) {
+        throw std::runtime_error("Out of memory.");
+    }
+
+    for (int j = 0;j < n;++j) {
+        const int begin = seq_offsets[j];
+        const int T = seq_offsets[j+1] - begin;
+
+        // Build the instance in place.
+        crfsuite_instance_t _inst;
+        crfsuite_instance_init_n(&_inst, T);
+        for (int t = 0;t < T;++t) {
+            const int k = begin + t;
+            const int offset = item_offsets[k];
+            crfsuite_item_t* _item = &_inst.items[t];
+
+            // Set the attributes in the item.
+            crfsuite_item_init_n(_item, item_offsets[k+1] - offset);
+            for (int i = 0;i < _item->num_contents;++i) {
+                _item->contents[i].aid = data->attrs->get(data->attrs, attrs[offset+i].c_str());
+                _item->contents[i].value = values.empty() ? 1. : (floatval_t)values[offset+i];
+            }
+
+            // Set the label of the item.
+            _inst.labels[t] = data->labels->get(data->labels, labels[k].c_str());
+        }
+        _inst.group = group;
+
+        // Move the instance to the training set.
+        int ret = crfsuite_data_append_move(data, &_inst);
+        crfsuite_instance_finish(&_inst);
+        if (ret != 0) {
+            throw std::runtime_error("Out of memory.");
+        }
+    }
 }
 
 bool Trainer::select(const std::string& algorithm, const std::string& type)
@@ -167,6 +251,7 @@ bool Trainer::select(const std::string& algorithm, const std::string& type)
 
     // Set the callback function for receiving messages.
     tr->set_message_callback(tr, this, __logging_callback);
+    tr->set_progress_callback(tr, this, __progress_callback);
 
     return true;
 }
@@ -265,17 +350,36 @@ int Trainer::__logging_callback(void *instance, const char *format, va_list args
     return 0;
 }
 
+bool Trainer::progress(int iteration, double loss, double elapsed)
+{
+    return true;
+}
+
+int Trainer::__progress_callback(void *instance, const crfsuite_progress_t *progress)
+{
+    Trainer* trainer = reinterpret_cast<Trainer*>(instance);
+    return trainer->progress(progress->iteration, progress->loss, progress->elapsed) ? 0 : 1;
+}
+
 
 
 Tagger::Tagger()
 {
     model = NULL;
     tagger = NULL;
+    inst = new crfsuite_instance_t;
+    crfsuite_instance_init(inst);
+    item = new crfsuite_item_t;
+    crfsuite_item_init(item);
 }
 
 Tagger::~Tagger()
 {
     this->close();
+    crfsuite_item_finish(item);
+    delete item;
+    crfsuite_instance_finish(inst);
+    delete inst;
 }
 
 bool Tagger::open(const std::string& name)
@@ -369,8 +473,6 @@ StringList Tagger::tag(const ItemSequence& xseq)
 void Tagger::set(const ItemSequence& xseq)
 {
     int ret;
-    StringList yseq;
-    crfsuite_instance_t _inst;
     crfsuite_dictionary_t *attrs = NULL;
 
     if (model == NULL || tagger == NULL) {
@@ -382,32 +484,36 @@ void Tagger::set(const ItemSequence& xseq)
         throw std::runtime_error("Failed to obtain the dictionary interface for attributes");
     }
 
-    // Build an instance.
-    crfsuite_instance_init_n(&_inst, xseq.size());
+    // Build an instance in the buffer of the previous call.
+    crfsuite_instance_clear(inst);
     for (size_t t = 0;t < xseq.size();++t) {
-        const Item& item = xseq[t];
-        crfsuite_item_t* _item = &_inst.items[t];
+        const Item& xitem = xseq[t];
 
         // Set the attributes in the item.
-        crfsuite_item_init(_item);
-        for (size_t i = 0;i < item.size();++i) {
-            int aid = attrs->to_id(attrs, item[i].attr.c_str());
+        crfsuite_item_clear(item);
+        for (size_t i = 0;i < xitem.size();++i) {
+            int aid = attrs->to_id(attrs, xitem[i].attr.c_str());
             if (0 <= aid) {
                 crfsuite_attribute_t cont;
-                crfsuite_attribute_set(&cont, aid, item[i].value);
-                crfsuite_item_append_attribute(_item, &cont);
+                crfsuite_attribute_set(&cont, aid, xitem[i].value);
+                if (crfsuite_item_append_attribute(item, &cont) != 0) {
+                    attrs->release(attrs);
+                    throw std::runtime_error("Failed to allocate memory for an item.");
+                }
             }
         }
+        if (crfsuite_instance_append_move(inst, item, 0) != 0) {
+            attrs->release(attrs);
+            throw std::runtime_error("Failed to allocate memory for an instance.");
+        }
     }
 
     // Set the instance to the tagger.
-    if ((ret = tagger->set(tagger, &_inst))) {
-        crfsuite_instance_finish(&_inst);
+    if ((ret = tagger->set(tagger, inst))) {
         attrs->release(attrs);
         throw std::runtime_error("Failed to set the instance to the tagger.");
     }
 
-    crfsuite_instance_finish(&_inst);
     attrs->release(attrs);
 }
 
@@ -434,9 +540,8 @@ StringList Tagger::viterbi()
 
     // Run the Viterbi algorithm.
     floatval_t score;
-    int *path = new int[T];
-    if ((ret = tagger->viterbi(tagger, path, &score))) {
-        delete[] path;
+    path.resize(T);
+    if ((ret = tagger->viterbi(tagger, &path[0], &score))) {
         labels->release(labels);
         throw std::runtime_error("Failed to find the Viterbi path.");
     }
@@ -446,7 +551,6 @@ StringList Tagger::viterbi()
     for (size_t t = 0;t < T;++t) {
         const char *label = NULL;
         if (labels->to_string(labels, path[t], &label) != 0) {
-            delete[] path;
             labels->release(labels);
             throw std::runtime_error("Failed to convert a label identifier to string.");
         }
@@ -455,7 +559,6 @@ StringList Tagger::viterbi()
     }
 
     labels->release(labels);
-    delete[] path;
     return yseq;
 }
 
@@ -463,7 +566,6 @@ double Tagger::probability(const StringList& yseq)
 {
     int ret;
     size_t T;
-    int *path = NULL;
     std::stringstream msg;
     floatval_t score, lognorm;
     crfsuite_dictionary_t *labels = NULL;
@@ -492,7 +594,7 @@ double Tagger::probability(const StringList& yseq)
     }
 
     // Convert string labels into label IDs.
-    path = new int[T];
+    path.resize(T);
     for (size_t t = 0;t < T;++t) {
         int l = labels->to_id(labels, yseq[t].c_str());
         if (l < 0) {
@@ -503,7 +605,7 @@ double Tagger::probability(const StringList& yseq)
     }
 
     // Compute the score of the path.
-    if ((ret = tagger->score(tagger, path, &score))) {
+    if ((ret = tagger->score(tagger, &path[0], &score))) {
         msg << "Failed to score the label sequence";
         goto error_exit;
     }
@@ -515,7 +617,6 @@ double Tagger::probability(const StringList& yseq)
     }
 
     labels->release(labels);
-    delete[] path;
     return std::exp((double)(score - lognorm));
 
 error_exit:
@@ -523,7 +624,6 @@ error_exit:
         labels->release(labels);
         labels = NULL;
     }
-    delete[] path;
     throw std::runtime_error(msg.str());
 }
 
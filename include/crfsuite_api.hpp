@@ -48,6 +48,12 @@ typedef struct tag_crfsuite_model crfsuite_model_t;
 struct tag_crfsuite_data;
 typedef struct tag_crfsuite_data crfsuite_data_t;
 
+struct tag_crfsuite_item;
+typedef struct tag_crfsuite_item crfsuite_item_t;
+
+struct tag_crfsuite_instance;
+typedef struct tag_crfsuite_instance crfsuite_instance_t;
+
 struct tag_crfsuite_trainer;
 typedef struct tag_crfsuite_trainer crfsuite_trainer_t;
 
@@ -166,6 +172,16 @@ typedef std::vector<Item>  ItemSequence;
  */
 typedef std::vector<std::string> StringList;
 
+/**
+ * Type of an integer list.
+ */
+typedef std::vector<int> IntList;
+
+/**
+ * Type of a floating-point value list.
+ */
+typedef std::vector<double> FloatList;
+
 
 
 
@@ -176,7 +192,8 @@ typedef std::vector<std::string> StringList;
  *  procedure for implementing a trainer is:
  *  - create a class by inheriting this class
  *  - overwrite message() function to receive messages of training progress
- *  - call append() to append item/label sequences to the training set
+ *  - call append() (or append_batch() for a large number of sequences) to
+ *    append item/label sequences to the training set
  *  - call select() to specify a graphical model and an algorithm
  *  - call set() to configure parameters specific to the model and algorithm
  *  - call train() to start a training process with the current setting
@@ -214,6 +231,33 @@ public:
      */
     void append(const ItemSequence& xseq, const StringList& yseq, int group);
 
+    /**
+     * Append a batch of instances to the data set.
+     *  This function receives a number of instances in a flat representation,
+     *  which avoids building an ItemSequence object for every instance. The
+     *  instances are built directly in the data set without an extra copy.
+     *  @param  attrs       The attribute names of all items in the batch,
+     *                      concatenated in the order of instances and items.
+     *  @param  values      The attribute values parallel to attrs. Specify
+     *                      an empty list to set 1.0 to all attributes.
+     *  @param  item_offsets    The offsets to attrs at which items begin.
+     *                      The k-th item consists of attributes in the range
+     *                      [item_offsets[k], item_offsets[k+1]); the list
+     *                      thus has one more element than labels, and the
+     *                      last element must be identical to the number of
+     *                      elements in attrs.
+     *  @param  labels      The labels of all items in the batch.
+     *  @param  seq_offsets The offsets to labels (items) at which instances
+     *                      begin. The j-th instance consists of items in the
+     *                      range [seq_offsets[j], seq_offsets[j+1]); the last
+     *                      element must be identical to the number of
+     *                      elements in labels.
+     *  @param  group       The group number of the instances.
+     *  @throw  std::invalid_argument   The offsets are inconsistent.
+     *  @throw  std::runtime_error      Out of memory.
+     */
+    void append_batch(const StringList& attrs, const FloatList& values, const IntList& item_offsets, const StringList& labels, const IntList& seq_offsets, int group);
+
     /**
      * Initialize the training algorithm.
      *  @param  algorithm   The name of the training algorithm.
@@ -287,9 +331,23 @@ public:
      */
     virtual void message(const std::string& msg);
 
+    /**
+     * Receive the progress of the training algorithm.
+     *  Override this member function to monitor the training at the end
+     *  of every iteration, or to stop it; the trainer then stores the best
+     *  feature weights seen so far.
+     *  @param  iteration   The number of iterations done.
+     *  @param  loss        The loss of the latest iteration.
+     *  @param  elapsed     Seconds elapsed since the training began.
+     *  @return bool        \c true to continue the training, \c false to
+     *                      stop it.
+     */
+    virtual bool progress(int iteration, double loss, double elapsed);
+
 protected:
     void init();
     static int __logging_callback(void *userdata, const char *format, va_list args);
+    static int __progress_callback(void *userdata, const crfsuite_progress_t *progress);
 };
 
 
@@ -305,6 +363,11 @@ protected:
     crfsuite_model_t *model;
     crfsuite_tagger_t *tagger;
 
+    // Buffers reused across calls to avoid allocating memory per sequence.
+    crfsuite_instance_t *inst;
+    crfsuite_item_t *item;
+    IntList path;
+
 public:
     /**
      * Construct a tagger.
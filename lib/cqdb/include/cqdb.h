@@ -99,17 +99,18 @@ struct tag_cqdb_writer;
 typedef struct tag_cqdb_writer cqdb_writer_t;    /**< Typedef of a CQDB writer. */
 
 /**
- * Create a new CQDB writer on a seekable stream.
+ * Create a new CQDB writer on a stream.
  *
- *    This function initializes a database on the seekable stream and returns
- *    the pointer to a ::cqdb_writer_t instance to write the database.
- *    The stream must have the writable and binary flags. The database creation
- *    flag must be zero except when the reverse lookup array is unnecessary;
- *    specifying ::CQDB_ONEWAY flag will save the storage space for the reverse
- *    lookup array. Once calling this function, one should avoid accessing the
- *    seekable stream directly until calling cqdb_writer_close().
+ *    This function returns the pointer to a ::cqdb_writer_t instance to
+ *    write a database on the stream. The stream must have the writable and
+ *    binary flags. The database creation flag must be zero except when the
+ *    reverse lookup array is unnecessary; specifying ::CQDB_ONEWAY flag will
+ *    save the storage space for the reverse lookup array. The database is
+ *    built on memory and written at the current position of the stream by
+ *    cqdb_writer_close(); one should avoid writing to the stream directly
+ *    until calling cqdb_writer_close().
  *
- *    @param    fp                The pointer to the writable and seekable stream.
+ *    @param    fp                The pointer to the writable stream.
  *    @param    flag            Database creation flag.
  *    @retval    cqdb_writer_t*    The pointer to the new ::cqdb_writer_t instance if
  *                            successful; otherwise \c NULL.
@@ -133,11 +134,10 @@ int cqdb_writer_put(cqdb_writer_t* dbw, const char *str, int id);
 /**
  * Close a CQDB writer.
  *
- *    This function finalizes the database on the stream. If successful, the
- *    data remaining on the memory is flushed to the stream; the stream position
- *    is moved to the end of the chunk. If an unexpected error occurs, this
- *    function tries to rewind the stream position to the original position when
- *    the function cqdb_writer() was called.
+ *    This function finalizes the database and writes the whole chunk to the
+ *    stream with a single write operation; the stream position is moved to
+ *    the end of the chunk. If an unexpected error occurs, nothing is written
+ *    to the stream.
  *
  *    @param    dbw            The pointer to the ::cqdb_writer_t instance.
  *    @retval    int            Zero if successful, or a status code otherwise.
@@ -87,10 +87,13 @@ typedef struct {
 struct tag_cqdb_writer {
     uint32_t    flag;           /**< Operation flag. */
     FILE*       fp;             /**< File pointer. */
-    uint32_t    begin;          /**< Offset address to the head of this database. */
     uint32_t    cur;            /**< Offset address to a new key/data pair. */
     table_t     ht[NUM_TABLES]; /**< Hash tables (string -> id). */
 
+    uint8_t*    data;           /**< Key/data pairs serialized so far. */
+    size_t      data_size;      /**< Number of bytes used in the data block. */
+    size_t      data_cap;       /**< Number of bytes allocated for the data block. */
+
     uint32_t*   bwd;            /**< Backlink array. */
     uint32_t    bwd_num;        /**< */
     uint32_t    bwd_size;       /**< Number of elements in the backlink array. */
@@ -117,19 +120,36 @@ uint32_t hashlittle(const void *key, size_t length, uint32_t initval);
 
 
 
-static size_t write_uint32(cqdb_writer_t* wt, uint32_t value)
+static uint8_t* put_uint32(uint8_t* p, uint32_t value)
 {
-    uint8_t buffer[4];
-    buffer[0] = (uint8_t)(value & 0xFF);
-    buffer[1] = (uint8_t)(value >> 8);
-    buffer[2] = (uint8_t)(value >> 16);
-    buffer[3] = (uint8_t)(value >> 24);
-    return fwrite(buffer, sizeof(uint8_t), 4, wt->fp) / sizeof(value);
+    p[0] = (uint8_t)(value & 0xFF);
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + sizeof(value);
 }
 
-static size_t write_data(cqdb_writer_t* wt, const void *data, size_t size)
+static uint8_t* reserve_data(cqdb_writer_t* wt, size_t size)
 {
-    return fwrite(data, size, 1, wt->fp);
+    uint8_t* p = NULL;
+
+    /* Expand the data block if necessary. */
+    if (wt->data_cap < wt->data_size + size) {
+        size_t cap = wt->data_cap;
+        uint8_t* data = NULL;
+
+        while (cap < wt->data_size + size) cap = (cap + 1) * 2;
+        data = (uint8_t*)realloc(wt->data, cap);
+        if (data == NULL) {
+            return NULL;
+        }
+        wt->data = data;
+        wt->data_cap = cap;
+    }
+
+    p = wt->data + wt->data_size;
+    wt->data_size += size;
+    return p;
 }
 
 cqdb_writer_t* cqdb_writer(FILE *fp, int flag)
@@ -142,7 +162,6 @@ cqdb_writer_t* cqdb_writer(FILE *fp, int flag)
         memset(dbw, 0, sizeof(*dbw));
         dbw->flag = flag;
         dbw->fp = fp;
-        dbw->begin = ftell(dbw->fp);
         dbw->cur = OFFSET_DATA;
 
         /* Initialize the hash tables.*/
@@ -150,21 +169,16 @@ cqdb_writer_t* cqdb_writer(FILE *fp, int flag)
             dbw->ht[i].bucket = NULL;
         }
 
+        dbw->data = NULL;
+        dbw->data_size = 0;
+        dbw->data_cap = 0;
+
         dbw->bwd = NULL;
         dbw->bwd_num = 0;
         dbw->bwd_size = 0;
-
-        /* Move the file pointer to the offset to the first key/data pair. */
-        if (fseek(dbw->fp, dbw->begin + dbw->cur, SEEK_SET) != 0) {
-            goto error_exit;    /* Seek error. */
-        }
     }
 
     return dbw;
-
-error_exit:
-    free(dbw);
-    return NULL;
 }
 
 static int cqdb_writer_delete(cqdb_writer_t* dbw)
@@ -175,6 +189,7 @@ static int cqdb_writer_delete(cqdb_writer_t* dbw)
     for (i = 0;i < NUM_TABLES;++i) {
         free(dbw->ht[i].bucket);
     }
+    free(dbw->data);
     free(dbw->bwd);
     free(dbw);
     return 0;
@@ -183,6 +198,7 @@ static int cqdb_writer_delete(cqdb_writer_t* dbw)
 int cqdb_writer_put(cqdb_writer_t* dbw, const char *str, int id)
 {
     int ret = 0;
+    uint8_t* p = NULL;
     const void *key = str;
     uint32_t ksize = (uint32_t)(strlen(str) + 1);
 
@@ -196,14 +212,15 @@ int cqdb_writer_put(cqdb_writer_t* dbw, const char *str, int id)
         goto error_exit;
     }
 
-    /* Write out the current data. */
-    write_uint32(dbw, (uint32_t)id);
-    write_uint32(dbw, (uint32_t)ksize);
-    write_data(dbw, key, ksize);
-    if (ferror(dbw->fp)) {
-        ret = CQDB_ERROR_FILEWRITE;
+    /* Append the current data to the data block. */
+    p = reserve_data(dbw, sizeof(uint32_t) + sizeof(uint32_t) + ksize);
+    if (p == NULL) {
+        ret = CQDB_ERROR_OUTOFMEMORY;
         goto error_exit;
     }
+    p = put_uint32(p, (uint32_t)id);
+    p = put_uint32(p, (uint32_t)ksize);
+    memcpy(p, key, ksize);
 
     /* Expand the bucket if necessary. */
     if (ht->size <= ht->num) {
@@ -257,7 +274,8 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
 {
     uint32_t i, j;
     int k, ret = 0;
-    long offset = 0;
+    uint32_t offset = 0;
+    uint8_t *block = NULL, *p = NULL;
     header_t header;
 
     /* If an error have occurred, just free the memory blocks. */
@@ -274,9 +292,59 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
     header.bwd_size = dbw->bwd_num;
 
     /*
-        Store the hash tables. At this moment, the file pointer refers to
-        the offset succeeding the last key/data pair.
+        Compute the layout of the chunk: the header, references to hash
+        tables, key/data pairs, hash tables, and the backlink array. At
+        this moment, dbw->cur points to the offset succeeding the last
+        key/data pair.
+     */
+    offset = dbw->cur;
+    for (i = 0;i < NUM_TABLES;++i) {
+        offset += (dbw->ht[i].num * 2) * sizeof(bucket_t);
+    }
+    if (!(dbw->flag & CQDB_ONEWAY) && 0 < dbw->bwd_size) {
+        header.bwd_offset = offset;
+        offset += sizeof(uint32_t) * dbw->bwd_num;
+    }
+    header.size = offset;
+
+    /*
+        Serialize the whole chunk into a memory block so that it reaches
+        the stream with a single write.
      */
+    block = (uint8_t*)malloc(header.size);
+    if (block == NULL) {
+        ret = CQDB_ERROR_OUTOFMEMORY;
+        goto error_exit;
+    }
+
+    /* Write the file header. */
+    p = block;
+    memcpy(p, header.chunkid, 4);
+    p += 4;
+    p = put_uint32(p, header.size);
+    p = put_uint32(p, header.flag);
+    p = put_uint32(p, header.byteorder);
+    p = put_uint32(p, header.bwd_size);
+    p = put_uint32(p, header.bwd_offset);
+
+    /* Write references to hash tables. */
+    offset = dbw->cur;
+    for (i = 0;i < NUM_TABLES;++i) {
+        /* Offset to the hash table (or zero for non-existent tables). */
+        p = put_uint32(p, dbw->ht[i].num ? offset : 0);
+        /* Bucket size is double to the number of elements. */
+        p = put_uint32(p, dbw->ht[i].num * 2);
+        /* Advance the offset counter. */
+        offset += (dbw->ht[i].num * 2) * sizeof(bucket_t);
+    }
+
+    /* Write the key/data pairs. */
+    if (0 < dbw->data_size) {
+        memcpy(p, dbw->data, dbw->data_size);
+        p += dbw->data_size;
+    }
+
+    /* Store the hash tables. */
     for (i = 0;i < NUM_TABLES;++i) {
         table_t* ht = &dbw->ht[i];
 
@@ -314,8 +382,8 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
 
             /* Write the bucket. */
             for (k = 0;k < n;++k) {
-                write_uint32(dbw, dst[k].hash);
-                write_uint32(dbw, dst[k].offset);
+                p = put_uint32(p, dst[k].hash);
+                p = put_uint32(p, dst[k].offset);
             }
 
             /* Free the bucket. */
@@ -325,73 +393,23 @@ int cqdb_writer_close(cqdb_writer_t* dbw)
 
     /* Write the backlink array if specified. */
     if (!(dbw->flag & CQDB_ONEWAY) && 0 < dbw->bwd_size) {
-        /* Store the offset to the head of this array. */
-        header.bwd_offset = ftell(dbw->fp) - dbw->begin;
-        /* Store the contents of the backlink array. */
         for (i = 0;i < dbw->bwd_num;++i) {
-            write_uint32(dbw, dbw->bwd[i]);
+            p = put_uint32(p, dbw->bwd[i]);
         }
     }
 
-    /* Check for an occurrence of a file-related error. */
-    if (ferror(dbw->fp)) {
+    /* Write the chunk to the stream. */
+    if (fwrite(block, 1, header.size, dbw->fp) != header.size) {
         ret = CQDB_ERROR_FILEWRITE;
         goto error_exit;
     }
 
-    /* Store the current position. */
-    offset = ftell(dbw->fp);
-    if (offset == -1) {
-        ret = CQDB_ERROR_FILETELL;
-        goto error_exit;
-    }
-    header.size = (uint32_t)offset - dbw->begin;
-
-    /* Rewind the current position to the beginning. */
-    if (fseek(dbw->fp, dbw->begin, SEEK_SET) != 0) {
-        ret = CQDB_ERROR_FILESEEK;
-        goto error_exit;
-    }
-
-    /* Write the file header. */
-    write_data(dbw, header.chunkid, 4);
-    write_uint32(dbw, header.size);
-    write_uint32(dbw, header.flag);
-    write_uint32(dbw, header.byteorder);
-    write_uint32(dbw, header.bwd_size);
-    write_uint32(dbw, header.bwd_offset);
-
-    /*
-        Write references to hash tables. At this moment, dbw->cur points
-        to the offset succeeding the last key/data pair. 
-     */
-    for (i = 0;i < NUM_TABLES;++i) {
-        /* Offset to the hash table (or zero for non-existent tables). */
-        write_uint32(dbw, dbw->ht[i].num ? dbw->cur : 0);
-        /* Bucket size is double to the number of elements. */
-        write_uint32(dbw, dbw->ht[i].num * 2);
-        /* Advance the offset counter. */
-        dbw->cur += (dbw->ht[i].num * 2) * sizeof(bucket_t);
-    }
-
-    /* Check an occurrence of a file-related error. */
-    if (ferror(dbw->fp)) {
-        ret = CQDB_ERROR_FILEWRITE;
-        goto error_exit;
-    }
-
-    /* Seek to the last position. */
-    if (fseek(dbw->fp, offset, SEEK_SET) != 0) {
-        ret = CQDB_ERROR_FILESEEK;
-        goto error_exit;
-    }
-
+    free(block);
     cqdb_writer_delete(dbw);
     return ret;
 
 error_exit:
-    /* Seek to the first position. */
-    fseek(dbw->fp, dbw->begin, SEEK_SET);
+    free(block);
     cqdb_writer_delete(dbw);
     return ret;
 }
@@ -0,0 +1,562 @@
+/*
+ *      Checkpoints of the training state.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef  HAVE_FSYNC
+#include <unistd.h>
+#endif/*HAVE_FSYNC*/
+#ifdef  HAVE_PTHREAD_H
+#include <pthread.h>
+#endif/*HAVE_PTHREAD_H*/
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+#include "params.h"
+#include "profile.h"
+
+/*
+ *  A checkpoint file consists of a header and a sequence of named entries.
+ *  Because checkpoints are resumed on the machine that wrote them, the
+ *  values are stored in the native byte order; the header records the byte
+ *  order and the size of floatval_t so that foreign files are rejected.
+ *
+ *  Header:
+ *      char[4]     magic ("CRFK")
+ *      uint32_t    byte-order mark (BYTE_ORDER_MARK)
+ *      uint32_t    version (CHECKPOINT_VERSION)
+ *      uint32_t    sizeof(floatval_t)
+ *      char[16]    algorithm name
+ *  Entry:
+ *      uint32_t    length of the name (including the terminating NUL)
+ *      char[]      name
+ *      uint32_t    type (ENTRY_INT or ENTRY_FLOAT)
+ *      uint32_t    number of elements
+ *      ...         elements
+ */
+#define MAGIC               "CRFK"
+#define BYTE_ORDER_MARK     0x01020304
+#define CHECKPOINT_VERSION  1
+#define ALGORITHM_SIZE      16
+#define HEADER_SIZE         (16 + ALGORITHM_SIZE)
+
+enum {
+    ENTRY_INT = 1,
+    ENTRY_FLOAT,
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+} buffer_t;
+
+typedef struct {
+    char *tmpname;          /**< The temporary file written before renaming. */
+    char algorithm[ALGORITHM_SIZE];
+    buffer_t current;       /**< The state being serialized (or read). */
+    buffer_t pending;       /**< The state being written to the file. */
+    int status;             /**< The result of the last write. */
+#ifdef  HAVE_PTHREAD_H
+    pthread_t thread;       /**< The thread writing the pending state. */
+    int running;            /**< Whether the thread is running. */
+#endif/*HAVE_PTHREAD_H*/
+} checkpoint_internal_t;
+
+static int buffer_append(buffer_t* buf, const void *data, size_t size)
+{
+    if (buf->cap < buf->size + size) {
+        uint8_t *p = NULL;
+        size_t cap = buf->cap;
+        while (cap < buf->size + size) {
+            cap = (cap + 1) * 2;
+        }
+        p = (uint8_t*)realloc(buf->data, cap);
+        if (p == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        buf->data = p;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    return 0;
+}
+
+static int write_file(const char *filename, const char *tmpname, const buffer_t* buf)
+{
+    FILE *fp = fopen(tmpname, "wb");
+    if (fp == NULL) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    if (fwrite(buf->data, 1, buf->size, fp) != buf->size || fflush(fp) != 0) {
+        fclose(fp);
+        remove(tmpname);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+#ifdef  HAVE_FSYNC
+    /* Make sure that the data reach the disk before the file is renamed. */
+    fsync(fileno(fp));
+#endif/*HAVE_FSYNC*/
+    if (fclose(fp) != 0) {
+        remove(tmpname);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    /* Replace the previous checkpoint only after the new one is complete. */
+#ifdef  _WIN32
+    remove(filename);
+#endif/*_WIN32*/
+    if (rename(tmpname, filename) != 0) {
+        remove(tmpname);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    return 0;
+}
+
+#ifdef  HAVE_PTHREAD_H
+static void *write_thread(void *arg)
+{
+    checkpoint_t* ck = (checkpoint_t*)arg;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+    cki->status = write_file(ck->filename, cki->tmpname, &cki->pending);
+    return NULL;
+}
+#endif/*HAVE_PTHREAD_H*/
+
+/* Waits for the pending write, and reports its result. */
+static int wait_pending(checkpoint_t* ck)
+{
+    int ret = 0;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+#ifdef  HAVE_PTHREAD_H
+    if (cki->running) {
+        pthread_join(cki->thread, NULL);
+        cki->running = 0;
+    }
+#endif/*HAVE_PTHREAD_H*/
+    ret = cki->status;
+    cki->status = 0;
+    if (ret != 0) {
+        logging(ck->lg, "ERROR: Failed to write the checkpoint: %s\n", ck->filename);
+    }
+    return ret;
+}
+
+static const uint8_t *find_entry(checkpoint_internal_t* cki, const char *name, int type, int n)
+{
+    const uint8_t *p = cki->current.data + HEADER_SIZE;
+    const uint8_t *last = cki->current.data + cki->current.size;
+
+    while (p + sizeof(uint32_t) <= last) {
+        size_t elem;
+        uint32_t len, etype, num;
+        const char *ename = (const char*)p + sizeof(uint32_t);
+        memcpy(&len, p, sizeof(uint32_t));
+        if ((size_t)(last - p) < sizeof(uint32_t) * 3 + len) {
+            break;
+        }
+        p += sizeof(uint32_t) + len;
+        memcpy(&etype, p, sizeof(uint32_t));
+        memcpy(&num, p + sizeof(uint32_t), sizeof(uint32_t));
+        p += sizeof(uint32_t) * 2;
+        elem = (etype == ENTRY_INT) ? sizeof(int) : sizeof(floatval_t);
+        if ((size_t)(last - p) / elem < num) {
+            break;
+        }
+        if (len != 0 && ename[len-1] == 0 && strcmp(ename, name) == 0) {
+            return (etype == (uint32_t)type && num == (uint32_t)n) ? p : NULL;
+        }
+        p += elem * num;
+    }
+    return NULL;
+}
+
+static int put_entry(checkpoint_t* ck, const char *name, int type, const void *values, int n)
+{
+    int ret = 0;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+    buffer_t* buf = &cki->current;
+    const uint32_t len = (uint32_t)strlen(name) + 1;
+    const uint32_t etype = (uint32_t)type;
+    const uint32_t num = (uint32_t)n;
+    const size_t elem = (type == ENTRY_INT) ? sizeof(int) : sizeof(floatval_t);
+
+    if ((ret = buffer_append(buf, &len, sizeof(len)))) return ret;
+    if ((ret = buffer_append(buf, name, len))) return ret;
+    if ((ret = buffer_append(buf, &etype, sizeof(etype)))) return ret;
+    if ((ret = buffer_append(buf, &num, sizeof(num)))) return ret;
+    return buffer_append(buf, values, elem * n);
+}
+
+static int get_entry(checkpoint_t* ck, const char *name, int type, void *values, int n)
+{
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+    const size_t elem = (type == ENTRY_INT) ? sizeof(int) : sizeof(floatval_t);
+    const uint8_t *p = find_entry(cki, name, type, n);
+
+    if (p == NULL) {
+        logging(ck->lg, "ERROR: Missing or incompatible state in the checkpoint: %s\n", name);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    memcpy(values, p, elem * n);
+    return 0;
+}
+
+static int read_file(checkpoint_t* ck)
+{
+    FILE *fp = NULL;
+    long size = 0;
+    uint32_t value;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+    buffer_t* buf = &cki->current;
+
+    fp = fopen(ck->filename, "rb");
+    if (fp == NULL) {
+        logging(ck->lg, "ERROR: Failed to open the checkpoint: %s\n", ck->filename);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (size < HEADER_SIZE) {
+        fclose(fp);
+        goto incompatible;
+    }
+    buf->size = 0;
+    if (buf->cap < (size_t)size) {
+        uint8_t *p = (uint8_t*)realloc(buf->data, size);
+        if (p == NULL) {
+            fclose(fp);
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        buf->data = p;
+        buf->cap = size;
+    }
+    if (fread(buf->data, 1, size, fp) != (size_t)size) {
+        fclose(fp);
+        goto incompatible;
+    }
+    fclose(fp);
+    buf->size = size;
+
+    /* Check the header. */
+    if (memcmp(buf->data, MAGIC, 4) != 0) {
+        goto incompatible;
+    }
+    memcpy(&value, buf->data + 4, sizeof(value));
+    if (value != BYTE_ORDER_MARK) {
+        goto incompatible;
+    }
+    memcpy(&value, buf->data + 8, sizeof(value));
+    if (value != CHECKPOINT_VERSION) {
+        goto incompatible;
+    }
+    memcpy(&value, buf->data + 12, sizeof(value));
+    if (value != sizeof(floatval_t)) {
+        goto incompatible;
+    }
+    if (memcmp(buf->data + 16, cki->algorithm, ALGORITHM_SIZE) != 0) {
+        logging(ck->lg, "ERROR: The checkpoint was written by another training algorithm: %s\n", ck->filename);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    return 0;
+
+incompatible:
+    logging(ck->lg, "ERROR: Not a checkpoint or a corrupted checkpoint: %s\n", ck->filename);
+    return CRFSUITEERR_INCOMPATIBLE;
+}
+
+int checkpoint_init(checkpoint_t* ck, crfsuite_params_t *params, const char *algorithm, logging_t *lg)
+{
+    int ret = 0;
+    char *filename = NULL;
+    checkpoint_internal_t* cki = NULL;
+
+    memset(ck, 0, sizeof(*ck));
+    ck->lg = lg;
+
+    params->get_string(params, "checkpoint.file", &filename);
+    params->get_int(params, "checkpoint.period", &ck->period);
+    params->get_int(params, "checkpoint.resume", &ck->resume);
+    if (filename == NULL || *filename == '\0') {
+        if (ck->resume) {
+            logging(lg, "ERROR: No checkpoint file is specified for resuming the training\n");
+            return CRFSUITEERR_INCOMPATIBLE;
+        }
+        return 0;
+    }
+
+    cki = (checkpoint_internal_t*)calloc(1, sizeof(checkpoint_internal_t));
+    ck->filename = (char*)malloc(strlen(filename) + 1);
+    if (cki == NULL || ck->filename == NULL) {
+        free(cki);
+        free(ck->filename);
+        ck->filename = NULL;
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    ck->internal = cki;
+    strcpy(ck->filename, filename);
+    strncpy(cki->algorithm, algorithm, ALGORITHM_SIZE-1);
+
+    cki->tmpname = (char*)malloc(strlen(filename) + 5);
+    if (cki->tmpname == NULL) {
+        checkpoint_finish(ck);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    strcpy(cki->tmpname, filename);
+    strcat(cki->tmpname, ".tmp");
+
+    logging(lg, "Checkpoint file: %s\n", ck->filename);
+    logging(lg, "Checkpoint period: %d\n", ck->period);
+
+    /* Read the state to be resumed. */
+    if (ck->resume) {
+        profile_clock_t clk;
+        logging(lg, "Resuming the training from the checkpoint\n");
+        PROFILE_ENTER(lg->prof, clk);
+        ret = read_file(ck);
+        PROFILE_LEAVE(lg->prof, PROFILE_IO, clk);
+        if (ret) {
+            checkpoint_finish(ck);
+            return ret;
+        }
+    }
+    logging(lg, "\n");
+    return 0;
+}
+
+/**
+ * Test whether the checkpoint file was written by a training algorithm.
+ *  An algorithm running others in phases finds the phase to resume with this.
+ *  @return int         Non-zero if the file exists and was written by the algorithm.
+ */
+int checkpoint_written_by(crfsuite_params_t *params, const char *algorithm)
+{
+    FILE *fp = NULL;
+    char *filename = NULL;
+    uint8_t header[HEADER_SIZE];
+    char name[ALGORITHM_SIZE];
+
+    params->get_string(params, "checkpoint.file", &filename);
+    if (filename == NULL || *filename == '\0') {
+        return 0;
+    }
+    fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fread(header, 1, HEADER_SIZE, fp) != HEADER_SIZE) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    memset(name, 0, sizeof(name));
+    strncpy(name, algorithm, ALGORITHM_SIZE-1);
+    return memcmp(header, MAGIC, 4) == 0 && memcmp(header + 16, name, ALGORITHM_SIZE) == 0;
+}
+
+int checkpoint_finish(checkpoint_t* ck)
+{
+    int ret = 0;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+    if (cki != NULL) {
+        ret = wait_pending(ck);
+        free(cki->pending.data);
+        free(cki->current.data);
+        free(cki->tmpname);
+        free(cki);
+        ck->internal = NULL;
+    }
+    free(ck->filename);
+    ck->filename = NULL;
+    return ret;
+}
+
+int checkpoint_due(checkpoint_t* ck, int iteration)
+{
+    return ck->internal != NULL && 0 < ck->period && iteration % ck->period == 0;
+}
+
+int checkpoint_begin(checkpoint_t* ck)
+{
+    int ret = 0;
+    uint32_t value;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+    buffer_t* buf = &cki->current;
+
+    /* The state read from the file is no longer necessary. */
+    ck->resume = 0;
+
+    buf->size = 0;
+    if ((ret = buffer_append(buf, MAGIC, 4))) return ret;
+    value = BYTE_ORDER_MARK;
+    if ((ret = buffer_append(buf, &value, sizeof(value)))) return ret;
+    value = CHECKPOINT_VERSION;
+    if ((ret = buffer_append(buf, &value, sizeof(value)))) return ret;
+    value = sizeof(floatval_t);
+    if ((ret = buffer_append(buf, &value, sizeof(value)))) return ret;
+    return buffer_append(buf, cki->algorithm, ALGORITHM_SIZE);
+}
+
+int checkpoint_put_int(checkpoint_t* ck, const char *name, int value)
+{
+    return put_entry(ck, name, ENTRY_INT, &value, 1);
+}
+
+int checkpoint_put_float(checkpoint_t* ck, const char *name, floatval_t value)
+{
+    return put_entry(ck, name, ENTRY_FLOAT, &value, 1);
+}
+
+int checkpoint_put_ints(checkpoint_t* ck, const char *name, const int *values, int n)
+{
+    return put_entry(ck, name, ENTRY_INT, values, n);
+}
+
+int checkpoint_put_floats(checkpoint_t* ck, const char *name, const floatval_t *values, int n)
+{
+    return put_entry(ck, name, ENTRY_FLOAT, values, n);
+}
+
+int checkpoint_put_dataset(checkpoint_t* ck, const dataset_t *ds)
+{
+    int ret = 0;
+    if ((ret = checkpoint_put_int(ck, "dataset.rng", (int)ds->rng))) {
+        return ret;
+    }
+    if (ds->perm != NULL) {
+        ret = checkpoint_put_ints(ck, "dataset.perm", ds->perm, ds->num_instances);
+    }
+    return ret;
+}
+
+static int commit(checkpoint_t* ck)
+{
+    int ret = 0;
+    buffer_t tmp;
+    checkpoint_internal_t* cki = (checkpoint_internal_t*)ck->internal;
+
+    /* Wait for the previous write before reusing its buffer. */
+    if ((ret = wait_pending(ck))) {
+        return ret;
+    }
+
+    /* Hand the serialized state over to the writer. */
+    tmp = cki->pending;
+    cki->pending = cki->current;
+    cki->current = tmp;
+
+#ifdef  HAVE_PTHREAD_H
+    if (pthread_create(&cki->thread, NULL, write_thread, ck) == 0) {
+        cki->running = 1;
+        return 0;
+    }
+#endif/*HAVE_PTHREAD_H*/
+
+    /* Write the state in this thread. */
+    cki->status = write_file(ck->filename, cki->tmpname, &cki->pending);
+    return wait_pending(ck);
+}
+
+int checkpoint_commit(checkpoint_t* ck)
+{
+    int ret;
+    profile_clock_t clk;
+
+    /* Only the time spent in the training thread is counted. */
+    PROFILE_ENTER(ck->lg->prof, clk);
+    ret = commit(ck);
+    PROFILE_LEAVE(ck->lg->prof, PROFILE_IO, clk);
+    return ret;
+}
+
+int checkpoint_get_int(checkpoint_t* ck, const char *name, int *value)
+{
+    return get_entry(ck, name, ENTRY_INT, value, 1);
+}
+
+int checkpoint_get_float(checkpoint_t* ck, const char *name, floatval_t *value)
+{
+    return get_entry(ck, name, ENTRY_FLOAT, value, 1);
+}
+
+int checkpoint_get_ints(checkpoint_t* ck, const char *name, int *values, int n)
+{
+    return get_entry(ck, name, ENTRY_INT, values, n);
+}
+
+int checkpoint_get_floats(checkpoint_t* ck, const char *name, floatval_t *values, int n)
+{
+    return get_entry(ck, name, ENTRY_FLOAT, values, n);
+}
+
+int checkpoint_get_dataset(checkpoint_t* ck, dataset_t *ds)
+{
+    int ret = 0, rng = 0;
+    if ((ret = checkpoint_get_int(ck, "dataset.rng", &rng))) {
+        return ret;
+    }
+    if (rng == 0) {
+        logging(ck->lg, "ERROR: Corrupted state in the checkpoint: dataset.rng\n");
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    ds->rng = (unsigned int)rng;
+    if (ds->perm != NULL) {
+        int i, *perm = (int*)malloc(sizeof(int) * (ds->num_instances + 1));
+        if (perm == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        ret = checkpoint_get_ints(ck, "dataset.perm", perm, ds->num_instances);
+        for (i = 0;ret == 0 && i < ds->num_instances;++i) {
+            if (perm[i] < 0 || ds->data->num_instances <= perm[i]) {
+                logging(ck->lg, "ERROR: The checkpoint does not match the training data\n");
+                ret = CRFSUITEERR_INCOMPATIBLE;
+            }
+        }
+        if (ret == 0) {
+            memcpy(ds->perm, perm, sizeof(int) * ds->num_instances);
+        }
+        free(perm);
+    }
+    return ret;
+}
@@ -293,6 +293,21 @@ int crf1df_init_references(
     const int L
     );
 
+int crf1df_save_model(
+    const char *filename,
+    int version,
+    const crf1df_feature_t *features,
+    const feature_refs_t *attributes,
+    const feature_refs_t *forward_trans,
+    const int K,
+    const int A,
+    const int L,
+    const floatval_t *w,
+    crfsuite_dictionary_t *attrs,
+    crfsuite_dictionary_t *labels,
+    logging_t *lg
+    );
+
 /** @} */
 
 
@@ -315,8 +330,9 @@ typedef struct {
     floatval_t weight;
 } crf1dm_feature_t;
 
-crf1dmw_t* crf1mmw(const char *filename);
+crf1dmw_t* crf1mmw(const char *filename, int version);
 int crf1dmw_close(crf1dmw_t* writer);
+void crf1dmw_abort(crf1dmw_t* writer);
 int crf1dmw_open_labels(crf1dmw_t* writer, int num_labels);
 int crf1dmw_close_labels(crf1dmw_t* writer);
 int crf1dmw_put_label(crf1dmw_t* writer, int lid, const char *value);
@@ -332,6 +348,12 @@ int crf1dmw_put_attrref(crf1dmw_t* writer, int aid, const feature_refs_t* ref, i
 int crf1dmw_open_features(crf1dmw_t* writer);
 int crf1dmw_close_features(crf1dmw_t* writer);
 int crf1dmw_put_feature(crf1dmw_t* writer, int fid, const crf1dm_feature_t* f);
+int crf1dmw_open_transitions(crf1dmw_t* writer, int num_labels);
+int crf1dmw_close_transitions(crf1dmw_t* writer);
+int crf1dmw_put_transition(crf1dmw_t* writer, int from, int to, floatval_t weight);
+int crf1dmw_open_states(crf1dmw_t* writer, int num_attrs, int num_labels);
+int crf1dmw_close_states(crf1dmw_t* writer);
+int crf1dmw_put_states(crf1dmw_t* writer, int aid, const int *labels, const floatval_t *weights, int n);
 
 crf1dm_t* crf1dm_new(const char *filename);
 crf1dm_t* crf1dm_new_from_memory(const void *data, size_t size);
@@ -346,9 +368,59 @@ int crf1dm_get_labelref(crf1dm_t* model, int lid, feature_refs_t* ref);
 int crf1dm_get_attrref(crf1dm_t* model, int aid, feature_refs_t* ref);
 int crf1dm_get_featureid(feature_refs_t* ref, int i);
 int crf1dm_get_feature(crf1dm_t* model, int fid, crf1dm_feature_t* f);
+const floatval_t* crf1dm_get_transitions(crf1dm_t* model);
+int crf1dm_get_states(crf1dm_t* model, int aid, const int **labels, const floatval_t **weights);
 void crf1dm_dump(crf1dm_t* model, FILE *fp);
 
 /** @} */
 
 
+
+/**
+ * \defgroup crf1d_cache.c
+ */
+/** @{ */
+
+/**
+ * The key of a tagging result: the attribute ids and values of the items.
+ */
+typedef struct {
+    unsigned int hash;                  /**< Hash value of the key. */
+    int num_items;                      /**< Number of items (T). */
+    int num_contents;                   /**< Total number of attributes. */
+    int *sizes;                         /**< [T] Number of attributes of each item. */
+    crfsuite_attribute_t *contents;     /**< Attributes of the items in order. */
+    int cap_items;
+    int cap_contents;
+} crf1d_cache_key_t;
+
+typedef struct tag_crf1d_cache_entry crf1d_cache_entry_t;
+
+/**
+ * A tagging result in the cache.
+ */
+struct tag_crf1d_cache_entry {
+    crf1d_cache_key_t key;              /**< Key (sharing the memory block of the entry). */
+    int *labels;                        /**< [T] Viterbi label sequence. */
+    floatval_t score;                   /**< Score of the Viterbi label sequence. */
+    floatval_t lognorm;                 /**< Partition factor (with marginals). */
+    floatval_t *marginals;              /**< [T][L] Marginal probabilities (or NULL). */
+    crf1d_cache_entry_t *chain;         /**< Next entry in the hash bucket. */
+    crf1d_cache_entry_t *prev;          /**< More recently used entry. */
+    crf1d_cache_entry_t *next;          /**< Less recently used entry. */
+};
+
+typedef struct tag_crf1d_cache crf1d_cache_t;
+
+int crf1d_cache_key_set(crf1d_cache_key_t* key, const crfsuite_instance_t* inst);
+void crf1d_cache_key_finish(crf1d_cache_key_t* key);
+crf1d_cache_t* crf1d_cache_new(int max_entries, int num_labels, int flags);
+void crf1d_cache_delete(crf1d_cache_t* cache);
+crf1d_cache_entry_t* crf1d_cache_find(crf1d_cache_t* cache, const crf1d_cache_key_t* key);
+crf1d_cache_entry_t* crf1d_cache_insert(crf1d_cache_t* cache, const crf1d_cache_key_t* key);
+void crf1d_cache_stats(const crf1d_cache_t* cache, crfsuite_cache_stats_t* stats);
+
+/** @} */
+
+
 #endif/*__CRF1D_H__*/
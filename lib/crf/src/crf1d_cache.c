@@ -0,0 +1,320 @@
+/*
+ *      Result cache for the CRF1d tagger.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+
+#include "crf1d.h"
+
+struct tag_crf1d_cache {
+    int max_entries;
+    int num_entries;
+    int num_labels;
+    int flags;
+    int num_buckets;                /**< Number of hash buckets (a power of two). */
+    crf1d_cache_entry_t **buckets;
+    crf1d_cache_entry_t *head;      /**< Most recently used entry. */
+    crf1d_cache_entry_t *tail;      /**< Least recently used entry. */
+    long num_lookups;
+    long num_hits;
+    long num_evictions;
+};
+
+#define    HASH_BASIS   2166136261U
+#define    HASH_PRIME   16777619U
+
+static unsigned int hash_word(unsigned int h, unsigned int x)
+{
+    return (h ^ x) * HASH_PRIME;
+}
+
+static unsigned int hash_value(unsigned int h, floatval_t value)
+{
+    size_t i;
+    unsigned int x[(sizeof(floatval_t) + sizeof(unsigned int) - 1) / sizeof(unsigned int)];
+
+    memset(x, 0, sizeof(x));
+    memcpy(x, &value, sizeof(value));
+    for (i = 0;i < sizeof(x) / sizeof(x[0]);++i) {
+        h = hash_word(h, x[i]);
+    }
+    return h;
+}
+
+int crf1d_cache_key_set(crf1d_cache_key_t* key, const crfsuite_instance_t* inst)
+{
+    int i, t, n = 0;
+    unsigned int h = HASH_BASIS;
+    const int T = inst->num_items;
+
+    for (t = 0;t < T;++t) {
+        n += inst->items[t].num_contents;
+    }
+
+    /* Expand the buffers if necessary. */
+    if (key->cap_items < T) {
+        int *sizes = (int*)realloc(key->sizes, sizeof(int) * T);
+        if (sizes == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        key->sizes = sizes;
+        key->cap_items = T;
+    }
+    if (key->cap_contents < n) {
+        crfsuite_attribute_t *contents = (crfsuite_attribute_t*)realloc(
+            key->contents, sizeof(crfsuite_attribute_t) * n);
+        if (contents == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        key->contents = contents;
+        key->cap_contents = n;
+    }
+
+    /* Copy the attributes, and compute the hash value. */
+    n = 0;
+    for (t = 0;t < T;++t) {
+        const crfsuite_item_t* item = &inst->items[t];
+        key->sizes[t] = item->num_contents;
+        h = hash_word(h, (unsigned int)item->num_contents);
+        for (i = 0;i < item->num_contents;++i) {
+            key->contents[n] = item->contents[i];
+            h = hash_word(h, (unsigned int)item->contents[i].aid);
+            h = hash_value(h, item->contents[i].value);
+            ++n;
+        }
+    }
+
+    key->hash = h;
+    key->num_items = T;
+    key->num_contents = n;
+    return 0;
+}
+
+void crf1d_cache_key_finish(crf1d_cache_key_t* key)
+{
+    free(key->contents);
+    free(key->sizes);
+    memset(key, 0, sizeof(*key));
+}
+
+static int key_equal(const crf1d_cache_key_t* x, const crf1d_cache_key_t* y)
+{
+    int i;
+
+    if (x->hash != y->hash || x->num_items != y->num_items || x->num_contents != y->num_contents) {
+        return 0;
+    }
+    if (memcmp(x->sizes, y->sizes, sizeof(int) * x->num_items) != 0) {
+        return 0;
+    }
+    for (i = 0;i < x->num_contents;++i) {
+        if (x->contents[i].aid != y->contents[i].aid ||
+            x->contents[i].value != y->contents[i].value) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+crf1d_cache_t* crf1d_cache_new(int max_entries, int num_labels, int flags)
+{
+    crf1d_cache_t* cache = (crf1d_cache_t*)calloc(1, sizeof(crf1d_cache_t));
+
+    if (cache != NULL) {
+        cache->max_entries = max_entries;
+        cache->num_labels = num_labels;
+        cache->flags = flags;
+
+        /* Keep the load factor of the hash table at most one. */
+        cache->num_buckets = 16;
+        while (cache->num_buckets < max_entries) {
+            cache->num_buckets *= 2;
+        }
+        cache->buckets = (crf1d_cache_entry_t**)calloc(cache->num_buckets, sizeof(crf1d_cache_entry_t*));
+        if (cache->buckets == NULL) {
+            free(cache);
+            cache = NULL;
+        }
+    }
+
+    return cache;
+}
+
+void crf1d_cache_delete(crf1d_cache_t* cache)
+{
+    if (cache != NULL) {
+        crf1d_cache_entry_t* entry = cache->head;
+        while (entry != NULL) {
+            crf1d_cache_entry_t* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+        free(cache->buckets);
+        free(cache);
+    }
+}
+
+static void lru_unlink(crf1d_cache_t* cache, crf1d_cache_entry_t* entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(crf1d_cache_t* cache, crf1d_cache_entry_t* entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+        cache->head->prev = entry;
+    } else {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+crf1d_cache_entry_t* crf1d_cache_find(crf1d_cache_t* cache, const crf1d_cache_key_t* key)
+{
+    crf1d_cache_entry_t* entry = cache->buckets[key->hash & (cache->num_buckets-1)];
+
+    ++cache->num_lookups;
+    for (;entry != NULL;entry = entry->chain) {
+        if (key_equal(&entry->key, key)) {
+            /* Mark the entry as the most recently used one. */
+            ++cache->num_hits;
+            if (entry != cache->head) {
+                lru_unlink(cache, entry);
+                lru_push_front(cache, entry);
+            }
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void evict(crf1d_cache_t* cache)
+{
+    crf1d_cache_entry_t* entry = cache->tail;
+    crf1d_cache_entry_t** p = &cache->buckets[entry->key.hash & (cache->num_buckets-1)];
+
+    while (*p != entry) {
+        p = &(*p)->chain;
+    }
+    *p = entry->chain;
+    lru_unlink(cache, entry);
+    free(entry);
+    --cache->num_entries;
+    ++cache->num_evictions;
+}
+
+crf1d_cache_entry_t* crf1d_cache_insert(crf1d_cache_t* cache, const crf1d_cache_key_t* key)
+{
+    char *p = NULL;
+    size_t size = 0;
+    crf1d_cache_entry_t* entry = NULL;
+    crf1d_cache_entry_t** bucket = NULL;
+    const int T = key->num_items;
+    const int L = cache->num_labels;
+    const int marginals = (cache->flags & CRFSUITE_CACHE_MARGINALS);
+
+    if (cache->max_entries <= 0) {
+        return NULL;
+    }
+    if (cache->max_entries <= cache->num_entries) {
+        evict(cache);
+    }
+
+    /* Allocate the entry and its arrays in a block, larger members first. */
+    size = sizeof(crf1d_cache_entry_t);
+    size += sizeof(crfsuite_attribute_t) * key->num_contents;
+    if (marginals) {
+        size += sizeof(floatval_t) * T * L;
+    }
+    size += sizeof(int) * T * 2;
+    entry = (crf1d_cache_entry_t*)calloc(1, size);
+    if (entry == NULL) {
+        return NULL;
+    }
+    p = (char*)(entry + 1);
+    entry->key.contents = (crfsuite_attribute_t*)p;
+    p += sizeof(crfsuite_attribute_t) * key->num_contents;
+    if (marginals) {
+        entry->marginals = (floatval_t*)p;
+        p += sizeof(floatval_t) * T * L;
+    }
+    entry->key.sizes = (int*)p;
+    p += sizeof(int) * T;
+    entry->labels = (int*)p;
+
+    /* Copy the key. */
+    entry->key.hash = key->hash;
+    entry->key.num_items = T;
+    entry->key.num_contents = key->num_contents;
+    entry->key.cap_items = T;
+    entry->key.cap_contents = key->num_contents;
+    memcpy(entry->key.sizes, key->sizes, sizeof(int) * T);
+    memcpy(entry->key.contents, key->contents, sizeof(crfsuite_attribute_t) * key->num_contents);
+
+    /* Link the entry to the hash bucket and the LRU list. */
+    bucket = &cache->buckets[key->hash & (cache->num_buckets-1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    lru_push_front(cache, entry);
+    ++cache->num_entries;
+    return entry;
+}
+
+void crf1d_cache_stats(const crf1d_cache_t* cache, crfsuite_cache_stats_t* stats)
+{
+    stats->max_entries = cache->max_entries;
+    stats->num_entries = cache->num_entries;
+    stats->num_lookups = cache->num_lookups;
+    stats->num_hits = cache->num_hits;
+    stats->num_evictions = cache->num_evictions;
+}
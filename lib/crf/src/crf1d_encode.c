@@ -46,6 +46,7 @@
 #include "crf1d.h"
 #include "params.h"
 #include "logging.h"
+#include "profile.h"
 
 /**
  * Parameters for feature generation.
@@ -54,6 +55,7 @@ typedef struct {
     floatval_t  feature_minfreq;                /** The threshold for occurrences of features. */
     int         feature_possible_states;        /** Dense state features. */
     int         feature_possible_transitions;   /** Dense transition features. */
+    int         model_version;                  /** Version of the model format. */
 } crf1de_option_t;
 
 /**
@@ -72,6 +74,12 @@ typedef struct {
 
     crf1d_context_t *ctx;           /**< CRF1d context. */
     crf1de_option_t opt;            /**< CRF1d options. */
+    int shared;                     /**< Non-zero if the features are owned by another encoder. */
+
+    int restricted;                 /**< Non-zero if only the active features are used. */
+    int *active;                    /**< Flags of the active features [K]. */
+    feature_refs_t* active_attributes;  /**< References to active attribute features [A]. */
+    int *active_fids;               /**< The storage of the active references. */
 } crf1de_t;
 
 #define    FEATURE(crf1de, k) \
@@ -80,6 +88,8 @@ typedef struct {
     (&(crf1de)->attributes[(a)])
 #define    TRANSITION(crf1de, i) \
     (&(crf1de)->forward_trans[(i)])
+#define    ACTIVE_ATTRIBUTE(crf1de, a) \
+    ((crf1de)->restricted ? &(crf1de)->active_attributes[(a)] : ATTRIBUTE(crf1de, a))
 
 
 
@@ -93,6 +103,11 @@ static void crf1de_init(crf1de_t *crf1de)
     crf1de->attributes = NULL;
     crf1de->forward_trans = NULL;
     crf1de->ctx = NULL;
+    crf1de->shared = 0;
+    crf1de->restricted = 0;
+    crf1de->active = NULL;
+    crf1de->active_attributes = NULL;
+    crf1de->active_fids = NULL;
     /* Initialize except for opt. */
 }
 
@@ -104,6 +119,20 @@ static void crf1de_finish(crf1de_t *crf1de)
         crf1dc_delete(crf1de->ctx);
         crf1de->ctx = NULL;
     }
+    free(crf1de->active);
+    free(crf1de->active_attributes);
+    free(crf1de->active_fids);
+    crf1de->active = NULL;
+    crf1de->active_attributes = NULL;
+    crf1de->active_fids = NULL;
+    crf1de->restricted = 0;
+    if (crf1de->shared) {
+        /* The features belong to the encoder from which this was cloned. */
+        crf1de->features = NULL;
+        crf1de->attributes = NULL;
+        crf1de->forward_trans = NULL;
+        return;
+    }
     if (crf1de->features != NULL) {
         free(crf1de->features);
         crf1de->features = NULL;
@@ -144,7 +173,7 @@ static void crf1de_state_score(
         for (i = 0;i < item->num_contents;++i) {
             /* Access the list of state features associated with the attribute. */
             int a = item->contents[i].aid;
-            const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
+            const feature_refs_t *attr = ACTIVE_ATTRIBUTE(crf1de, a);
             floatval_t value = item->contents[i].value;
 
             /* Loop over the state features associated with the attribute. */
@@ -186,7 +215,7 @@ crf1de_state_score_scaled(
         for (i = 0;i < item->num_contents;++i) {
             /* Access the list of state features associated with the attribute. */
             int a = item->contents[i].aid;
-            const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
+            const feature_refs_t *attr = ACTIVE_ATTRIBUTE(crf1de, a);
             floatval_t value = item->contents[i].value * scale;
 
             /* Loop over the state features associated with the attribute. */
@@ -306,6 +335,47 @@ crf1de_features_on_path(
     }
 }
 
+static void
+crf1de_features_on_instance(
+    crf1de_t *crf1de,
+    const crfsuite_instance_t *inst,
+    crfsuite_encoder_features_on_path_callback func,
+    void *instance
+    )
+{
+    int c, i, t, r;
+    const int T = inst->num_items;
+    const int L = crf1de->num_labels;
+
+    /* Loop over the items in the sequence. */
+    for (t = 0;t < T;++t) {
+        const crfsuite_item_t *item = &inst->items[t];
+
+        /* Loop over the contents (attributes) attached to the item. */
+        for (c = 0;c < item->num_contents;++c) {
+            /* Access the list of state features associated with the attribute. */
+            int a = item->contents[c].aid;
+            const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
+            floatval_t value = item->contents[c].value;
+
+            /* Loop over the state features associated with the attribute. */
+            for (r = 0;r < attr->num_features;++r) {
+                func(instance, attr->fids[r], value);
+            }
+        }
+    }
+
+    /* Transition features are involved in any sequence. */
+    if (0 < T) {
+        for (i = 0;i < L;++i) {
+            const feature_refs_t *edge = TRANSITION(crf1de, i);
+            for (r = 0;r < edge->num_features;++r) {
+                func(instance, edge->fids[r], 1.);
+            }
+        }
+    }
+}
+
 static void
 crf1de_observation_expectation(
     crf1de_t* crf1de,
@@ -329,7 +399,7 @@ crf1de_observation_expectation(
         for (c = 0;c < item->num_contents;++c) {
             /* Access the list of state features associated with the attribute. */
             int a = item->contents[c].aid;
-            const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
+            const feature_refs_t *attr = ACTIVE_ATTRIBUTE(crf1de, a);
             floatval_t value = item->contents[c].value;
 
             /* Loop over the state features associated with the attribute. */
@@ -383,7 +453,7 @@ crf1de_model_expectation(
             /* Access the attribute. */
             floatval_t value = item->contents[c].value;
             a = item->contents[c].aid;
-            attr = ATTRIBUTE(crf1de, a);
+            attr = ACTIVE_ATTRIBUTE(crf1de, a);
 
             /* Loop over state features for the attribute. */
             for (r = 0;r < attr->num_features;++r) {
@@ -407,6 +477,62 @@ crf1de_model_expectation(
     }
 }
 
+static int
+crf1de_set_active_features(
+    crf1de_t *crf1de,
+    const int *active
+    )
+{
+    int a, k, r, n = 0;
+    const int A = crf1de->num_attributes;
+    const int K = crf1de->num_features;
+
+    if (active == NULL) {
+        crf1de->restricted = 0;
+        return 0;
+    }
+
+    /* Allocate the arrays at the first call. */
+    if (crf1de->active == NULL) {
+        crf1de->active = (int*)calloc(K+1, sizeof(int));
+        crf1de->active_attributes = (feature_refs_t*)calloc(A+1, sizeof(feature_refs_t));
+        crf1de->active_fids = (int*)calloc(K+1, sizeof(int));
+        if (crf1de->active == NULL || crf1de->active_attributes == NULL || crf1de->active_fids == NULL) {
+            free(crf1de->active);
+            free(crf1de->active_attributes);
+            free(crf1de->active_fids);
+            crf1de->active = NULL;
+            crf1de->active_attributes = NULL;
+            crf1de->active_fids = NULL;
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+    }
+
+    /* Transition features are always active. */
+    for (k = 0;k < K;++k) {
+        const crf1df_feature_t *f = FEATURE(crf1de, k);
+        crf1de->active[k] = (f->type == FT_TRANS || active[k]) ? 1 : 0;
+    }
+
+    /* Compact the references to the state features of each attribute. */
+    for (a = 0;a < A;++a) {
+        const feature_refs_t *attr = ATTRIBUTE(crf1de, a);
+        feature_refs_t *refs = &crf1de->active_attributes[a];
+        refs->fids = &crf1de->active_fids[n];
+        refs->num_features = 0;
+        for (r = 0;r < attr->num_features;++r) {
+            int fid = attr->fids[r];
+            if (crf1de->active[fid]) {
+                refs->fids[refs->num_features++] = fid;
+            }
+        }
+        n += refs->num_features;
+    }
+
+    crf1de->restricted = 1;
+    return 0;
+}
+
 static int
 crf1de_set_data(
     crf1de_t *crf1de,
@@ -416,12 +542,11 @@ crf1de_set_data(
     logging_t *lg
     )
 {
-    int i, ret = 0;
+    int ret = 0;
     clock_t begin = 0;
     int T = 0;
     const int L = num_labels;
     const int A = num_attributes;
-    const int N = ds->num_instances;
     crf1de_option_t *opt = &crf1de->opt;
 
     /* Initialize the member variables. */
@@ -430,12 +555,7 @@ crf1de_set_data(
     crf1de->num_labels = L;
 
     /* Find the maximum length of items in the data set. */
-    for (i = 0;i < N;++i) {
-        const crfsuite_instance_t *inst = dataset_get(ds, i);
-        if (T < inst->num_items) {
-            T = inst->num_items;
-        }
-    }
+    T = dataset_maxlength(ds);
 
     /* Construct a CRF context. */
     crf1de->ctx = crf1dc_new(CTXF_MARGINALS | CTXF_VITERBI, L, T);
@@ -500,193 +620,171 @@ crf1de_save_model(
     logging_t *lg
     )
 {
-    int a, k, l, ret;
+    return crf1df_save_model(
+        filename,
+        (crf1de->opt.model_version == 2) ? 2 : 1,
+        crf1de->features,
+        crf1de->attributes,
+        crf1de->forward_trans,
+        crf1de->num_features,
+        crf1de->num_attributes,
+        crf1de->num_labels,
+        w,
+        attrs,
+        labels,
+        lg
+        );
+}
+
+static int
+crf1de_load_weights(
+    crf1de_t *crf1de,
+    const char *filename,
+    floatval_t *w,
+    crfsuite_dictionary_t *attrs,
+    crfsuite_dictionary_t *labels,
+    logging_t *lg
+    )
+{
+    int a, i, j, k, l, r, n, ma, ML, ret = 0;
+    int num_init = 0;
     clock_t begin;
-    int *fmap = NULL, *amap = NULL;
-    crf1dmw_t* writer = NULL;
+    int *lmap = NULL, *fmap = NULL;
+    crf1dm_t *model = NULL;
+    const floatval_t *trans = NULL;
     const feature_refs_t *edge = NULL, *attr = NULL;
-    const floatval_t threshold = 0.01;
     const int L = crf1de->num_labels;
     const int A = crf1de->num_attributes;
     const int K = crf1de->num_features;
-    int J = 0, B = 0;
 
-    /* Start storing the model. */
-    logging(lg, "Storing the model\n");
+    logging(lg, "Initializing feature weights from the model: %s\n", filename);
     begin = clock();
 
-    /* Allocate and initialize the feature mapping. */
-    fmap = (int*)calloc(K, sizeof(int));
-    if (fmap == NULL) {
+    model = crf1dm_new(filename);
+    if (model == NULL) {
+        logging(lg, "ERROR: Failed to read the model\n");
+        ret = CRFSUITEERR_INCOMPATIBLE;
         goto error_exit;
     }
-#ifdef  CRF_TRAIN_SAVE_NO_PRUNING
-    for (k = 0;k < K;++k) fmap[k] = k;
-    J = K;
-#else
-    for (k = 0;k < K;++k) fmap[k] = -1;
-#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
+    ML = crf1dm_get_num_labels(model);
+    trans = crf1dm_get_transitions(model);
 
-    /* Allocate and initialize the attribute mapping. */
-    amap = (int*)calloc(A, sizeof(int));
-    if (amap == NULL) {
+    /* Map the labels of the model to the labels of the training data. */
+    lmap = (int*)calloc(ML + 1, sizeof(int));
+    fmap = (int*)calloc(L * L + 1, sizeof(int));
+    if (lmap == NULL || fmap == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
     }
-#ifdef  CRF_TRAIN_SAVE_NO_PRUNING
-    for (a = 0;a < A;++a) amap[a] = a;
-    B = A;
-#else
-    for (a = 0;a < A;++a) amap[a] = -1;
-#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
-
-    /*
-     *  Open a model writer.
-     */
-    writer = crf1mmw(filename);
-    if (writer == NULL) {
-        goto error_exit;
+    for (i = 0;i < ML;++i) {
+        const char *str = crf1dm_to_label(model, i);
+        lmap[i] = (str != NULL) ? labels->to_id(labels, str) : -1;
     }
 
-    /* Open a feature chunk in the model file. */
-    if (ret = crf1dmw_open_features(writer)) {
-        goto error_exit;
+    /* Map every label pair to its transition feature (if any). */
+    for (i = 0;i < L * L;++i) fmap[i] = -1;
+    for (i = 0;i < L;++i) {
+        edge = TRANSITION(crf1de, i);
+        for (r = 0;r < edge->num_features;++r) {
+            k = edge->fids[r];
+            fmap[i * L + crf1de->features[k].dst] = k;
+        }
     }
 
-    /*
-     *  Write the feature values.
-     *     (with determining active features and attributes).
-     */
-    for (k = 0;k < K;++k) {
-        crf1df_feature_t* f = &crf1de->features[k];
-        if (w[k] != 0) {
-            int src;
-            crf1dm_feature_t feat;
-
-#ifndef CRF_TRAIN_SAVE_NO_PRUNING
-            /* The feature (#k) will have a new feature id (#J). */
-            fmap[k] = J++;        /* Feature #k -> #fmap[k]. */
-
-            /* Map the source of the field. */
-            if (f->type == FT_STATE) {
-                /* The attribute #(f->src) will have a new attribute id (#B). */
-                if (amap[f->src] < 0) amap[f->src] = B++;    /* Attribute #a -> #amap[a]. */
-                src = amap[f->src];
-            } else {
-                src = f->src;
+    /* Copy the transition weights. */
+    for (i = 0;i < ML;++i) {
+        if (lmap[i] < 0) {
+            continue;
+        }
+        if (trans != NULL) {
+            for (j = 0;j < ML;++j) {
+                const floatval_t weight = trans[i * ML + j];
+                if (weight != 0. && 0 <= lmap[j]) {
+                    k = fmap[lmap[i] * L + lmap[j]];
+                    if (0 <= k) {
+                        w[k] = weight;
+                        ++num_init;
+                    }
+                }
             }
-#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
-
-            feat.type = f->type;
-            feat.src = src;
-            feat.dst = f->dst;
-            feat.weight = w[k];
-
-            /* Write the feature. */
-            if (ret = crf1dmw_put_feature(writer, fmap[k], &feat)) {
-                goto error_exit;
+        } else {
+            feature_refs_t refs;
+            crf1dm_get_labelref(model, i, &refs);
+            for (r = 0;r < refs.num_features;++r) {
+                crf1dm_feature_t f;
+                crf1dm_get_feature(model, crf1dm_get_featureid(&refs, r), &f);
+                if (0 <= f.dst && f.dst < ML && 0 <= lmap[f.dst]) {
+                    k = fmap[lmap[i] * L + lmap[f.dst]];
+                    if (0 <= k) {
+                        w[k] = f.weight;
+                        ++num_init;
+                    }
+                }
             }
         }
     }
 
-    /* Close the feature chunk. */
-    if (ret = crf1dmw_close_features(writer)) {
-        goto error_exit;
-    }
-
-    logging(lg, "Number of active features: %d (%d)\n", J, K);
-    logging(lg, "Number of active attributes: %d (%d)\n", B, A);
-    logging(lg, "Number of active labels: %d (%d)\n", L, L);
-
-    /* Write labels. */
-    logging(lg, "Writing labels\n", L);
-    if (ret = crf1dmw_open_labels(writer, L)) {
-        goto error_exit;
-    }
-    for (l = 0;l < L;++l) {
+    /*
+     *  Copy the state weights of every attribute that the model knows,
+     *  using the first L elements of fmap as a label -> feature table.
+     */
+    for (l = 0;l < L;++l) fmap[l] = -1;
+    for (a = 0;a < A;++a) {
         const char *str = NULL;
-        labels->to_string(labels, l, &str);
-        if (str != NULL) {
-            if (ret = crf1dmw_put_label(writer, l, str)) {
-                goto error_exit;
-            }
-            labels->free(labels, str);
+        if (attrs->to_string(attrs, a, &str) != 0) {
+            continue;
         }
-    }
-    if (ret = crf1dmw_close_labels(writer)) {
-        goto error_exit;
-    }
-
-    /* Write attributes. */
-    logging(lg, "Writing attributes\n");
-    if (ret = crf1dmw_open_attrs(writer, B)) {
-        goto error_exit;
-    }
-    for (a = 0;a < A;++a) {
-        if (0 <= amap[a]) {
-            const char *str = NULL;
-            attrs->to_string(attrs, a, &str);
-            if (str != NULL) {
-                if (ret = crf1dmw_put_attr(writer, amap[a], str)) {
-                    goto error_exit;
-                }
-                attrs->free(attrs, str);
-            }
+        ma = crf1dm_to_aid(model, str);
+        attrs->free(attrs, str);
+        if (ma < 0) {
+            continue;
         }
-    }
-    if (ret = crf1dmw_close_attrs(writer)) {
-        goto error_exit;
-    }
 
-    /* Write label feature references. */
-    logging(lg, "Writing feature references for transitions\n");
-    if (ret = crf1dmw_open_labelrefs(writer, L+2)) {
-        goto error_exit;
-    }
-    for (l = 0;l < L;++l) {
-        edge = TRANSITION(crf1de, l);
-        if (ret = crf1dmw_put_labelref(writer, l, edge, fmap)) {
-            goto error_exit;
+        attr = ATTRIBUTE(crf1de, a);
+        for (r = 0;r < attr->num_features;++r) {
+            k = attr->fids[r];
+            fmap[crf1de->features[k].dst] = k;
         }
-    }
-    if (ret = crf1dmw_close_labelrefs(writer)) {
-        goto error_exit;
-    }
 
-    /* Write attribute feature references. */
-    logging(lg, "Writing feature references for attributes\n");
-    if (ret = crf1dmw_open_attrrefs(writer, B)) {
-        goto error_exit;
-    }
-    for (a = 0;a < A;++a) {
-        if (0 <= amap[a]) {
-            attr = ATTRIBUTE(crf1de, a);
-            if (ret = crf1dmw_put_attrref(writer, amap[a], attr, fmap)) {
-                goto error_exit;
+        if (trans != NULL) {
+            const int *mlabels = NULL;
+            const floatval_t *weights = NULL;
+            n = crf1dm_get_states(model, ma, &mlabels, &weights);
+            for (r = 0;r < n;++r) {
+                l = lmap[mlabels[r]];
+                if (weights[r] != 0. && 0 <= l && 0 <= fmap[l]) {
+                    w[fmap[l]] = weights[r];
+                    ++num_init;
+                }
+            }
+        } else {
+            feature_refs_t refs;
+            crf1dm_get_attrref(model, ma, &refs);
+            for (r = 0;r < refs.num_features;++r) {
+                crf1dm_feature_t f;
+                crf1dm_get_feature(model, crf1dm_get_featureid(&refs, r), &f);
+                l = (0 <= f.dst && f.dst < ML) ? lmap[f.dst] : -1;
+                if (0 <= l && 0 <= fmap[l]) {
+                    w[fmap[l]] = f.weight;
+                    ++num_init;
+                }
             }
         }
-    }
-    if (ret = crf1dmw_close_attrrefs(writer)) {
-        goto error_exit;
+
+        for (r = 0;r < attr->num_features;++r) {
+            fmap[crf1de->features[attr->fids[r]].dst] = -1;
+        }
     }
 
-    /* Close the writer. */
-    crf1dmw_close(writer);
+    logging(lg, "Number of initialized features: %d (out of %d)\n", num_init, K);
     logging(lg, "Seconds required: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
     logging(lg, "\n");
 
-    free(amap);
-    free(fmap);
-    return 0;
-
 error_exit:
-    if (writer != NULL) {
-        crf1dmw_close(writer);
-    }
-    if (amap != NULL) {
-        free(amap);
-    }
-    if (fmap != NULL) {
-        free(fmap);
+    free(fmap);
+    free(lmap);
+    if (model != NULL) {
+        crf1dm_close(model);
     }
     return ret;
 }
@@ -706,6 +804,11 @@ static int crf1de_exchange_options(crfsuite_params_t* params, crf1de_option_t* o
             "feature.possible_transitions", opt->feature_possible_transitions, 0,
             "Force to generate possible transition features."
             )
+        DDX_PARAM_INT(
+            "model.version", opt->model_version, 1,
+            "The version of the model format (1: compact and readable by older releases,\n"
+            "2: laid out for tagging)."
+            )
     END_PARAM_MAP()
 
     return 0;
@@ -734,6 +837,8 @@ static void set_level(encoder_t *self, int level)
 {
     int prev = self->level;
     crf1de_t *crf1de = (crf1de_t*)self->internal;
+    profile_t *prof = self->prof;
+    profile_clock_t clk;
 
     /*
         Each training algorithm has a different requirement for processing a
@@ -744,28 +849,40 @@ static void set_level(encoder_t *self, int level)
 
     /* LEVEL_WEIGHT: set transition scores. */
     if (LEVEL_WEIGHT <= level && prev < LEVEL_WEIGHT) {
+        PROFILE_ENTER(prof, clk);
         crf1dc_reset(crf1de->ctx, RF_TRANS);
         crf1de_transition_score_scaled(crf1de, self->w, self->scale);
+        PROFILE_LEAVE(prof, PROFILE_STATE_SCORE, clk);
     }
 
     /* LEVEL_INSTANCE: set state scores. */
     if (LEVEL_INSTANCE <= level && prev < LEVEL_INSTANCE) {
+        PROFILE_ENTER(prof, clk);
         crf1dc_set_num_items(crf1de->ctx, self->inst->num_items);
         crf1dc_reset(crf1de->ctx, RF_STATE);
         crf1de_state_score_scaled(crf1de, self->inst, self->w, self->scale);
+        PROFILE_LEAVE(prof, PROFILE_STATE_SCORE, clk);
     }
 
     /* LEVEL_ALPHABETA: perform the forward-backward algorithm. */
     if (LEVEL_ALPHABETA <= level && prev < LEVEL_ALPHABETA) {
+        PROFILE_ENTER(prof, clk);
         crf1dc_exp_transition(crf1de->ctx);
         crf1dc_exp_state(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_EXP, clk);
+        PROFILE_ENTER(prof, clk);
         crf1dc_alpha_score(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_ALPHA, clk);
+        PROFILE_ENTER(prof, clk);
         crf1dc_beta_score(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_BETA, clk);
     }
 
     /* LEVEL_MARGINAL: compute the marginal probability. */
     if (LEVEL_MARGINAL <= level && prev < LEVEL_MARGINAL) {
+        PROFILE_ENTER(prof, clk);
         crf1dc_marginals(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_MARGINALS, clk);
     }
 
     self->level = level;
@@ -800,6 +917,8 @@ static int encoder_objective_and_gradients_batch(encoder_t *self, dataset_t *ds,
     int i;
     floatval_t logp = 0, logl = 0;
     crf1de_t *crf1de = (crf1de_t*)self->internal;
+    profile_t *prof = self->prof;
+    profile_clock_t clk;
     const int N = ds->num_instances;
     const int K = crf1de->num_features;
 
@@ -808,16 +927,20 @@ static int encoder_objective_and_gradients_batch(encoder_t *self, dataset_t *ds,
      */
     for (i = 0;i < K;++i) {
         crf1df_feature_t* f = &crf1de->features[i];
-        g[i] = -f->freq;
+        g[i] = (!crf1de->restricted || crf1de->active[i]) ? -f->freq : 0.;
     }
 
     /*
         Set the scores (weights) of transition features here because
         these are independent of input label sequences.
      */
+    PROFILE_ENTER(prof, clk);
     crf1dc_reset(crf1de->ctx, RF_TRANS);
     crf1de_transition_score(crf1de, w);
+    PROFILE_LEAVE(prof, PROFILE_STATE_SCORE, clk);
+    PROFILE_ENTER(prof, clk);
     crf1dc_exp_transition(crf1de->ctx);
+    PROFILE_LEAVE(prof, PROFILE_EXP, clk);
 
     /*
         Compute model expectations.
@@ -826,15 +949,25 @@ static int encoder_objective_and_gradients_batch(encoder_t *self, dataset_t *ds,
         const crfsuite_instance_t *seq = dataset_get(ds, i);
 
         /* Set label sequences and state scores. */
+        PROFILE_ENTER(prof, clk);
         crf1dc_set_num_items(crf1de->ctx, seq->num_items);
         crf1dc_reset(crf1de->ctx, RF_STATE);
         crf1de_state_score(crf1de, seq, w);
+        PROFILE_LEAVE(prof, PROFILE_STATE_SCORE, clk);
+        PROFILE_ENTER(prof, clk);
         crf1dc_exp_state(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_EXP, clk);
 
         /* Compute forward/backward scores. */
+        PROFILE_ENTER(prof, clk);
         crf1dc_alpha_score(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_ALPHA, clk);
+        PROFILE_ENTER(prof, clk);
         crf1dc_beta_score(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_BETA, clk);
+        PROFILE_ENTER(prof, clk);
         crf1dc_marginals(crf1de->ctx);
+        PROFILE_LEAVE(prof, PROFILE_MARGINALS, clk);
 
         /* Compute the probability of the input sequence on the model. */
         logp = crf1dc_score(crf1de->ctx, seq->labels) - crf1dc_lognorm(crf1de->ctx);
@@ -842,7 +975,9 @@ static int encoder_objective_and_gradients_batch(encoder_t *self, dataset_t *ds,
         logl += logp * seq->weight;
 
         /* Update the model expectations of features. */
+        PROFILE_ENTER(prof, clk);
         crf1de_model_expectation(crf1de, seq, g, seq->weight);
+        PROFILE_LEAVE(prof, PROFILE_EXPECTATION, clk);
     }
 
     *f = -logl;
@@ -857,6 +992,21 @@ static int encoder_features_on_path(encoder_t *self, const crfsuite_instance_t *
     return 0;
 }
 
+/* LEVEL_NONE -> LEVEL_NONE. */
+static int encoder_features_on_instance(encoder_t *self, const crfsuite_instance_t *inst, crfsuite_encoder_features_on_path_callback func, void *instance)
+{
+    crf1de_t *crf1de = (crf1de_t*)self->internal;
+    crf1de_features_on_instance(crf1de, inst, func, instance);
+    return 0;
+}
+
+/* LEVEL_NONE -> LEVEL_NONE. */
+static int encoder_set_active_features(encoder_t *self, const int *active)
+{
+    crf1de_t *crf1de = (crf1de_t*)self->internal;
+    return crf1de_set_active_features(crf1de, active);
+}
+
 /* LEVEL_NONE -> LEVEL_NONE. */
 static int encoder_save_model(encoder_t *self, const char *filename, const floatval_t *w, logging_t *lg)
 {
@@ -864,6 +1014,13 @@ static int encoder_save_model(encoder_t *self, const char *filename, const float
     return crf1de_save_model(crf1de, filename, w, self->ds->data->attrs,  self->ds->data->labels, lg);
 }
 
+/* LEVEL_NONE -> LEVEL_NONE. */
+static int encoder_load_weights(encoder_t *self, const char *filename, floatval_t *w, logging_t *lg)
+{
+    crf1de_t *crf1de = (crf1de_t*)self->internal;
+    return crf1de_load_weights(crf1de, filename, w, self->ds->data->attrs, self->ds->data->labels, lg);
+}
+
 /* LEVEL_NONE -> LEVEL_WEIGHT. */
 static int encoder_set_weights(encoder_t *self, const floatval_t *w, floatval_t scale)
 {
@@ -917,14 +1074,48 @@ static int encoder_partition_factor(encoder_t *self, floatval_t *ptr_pf)
 static int encoder_objective_and_gradients(encoder_t *self, floatval_t *f, floatval_t *g, floatval_t gain, floatval_t weight)
 {
     crf1de_t *crf1de = (crf1de_t*)self->internal;
+    profile_clock_t clk;
     set_level(self, LEVEL_MARGINAL);
     gain *= weight;
+    PROFILE_ENTER(self->prof, clk);
     crf1de_observation_expectation(crf1de, self->inst, self->inst->labels, g, gain);
     crf1de_model_expectation(crf1de, self->inst, g, -gain);
+    PROFILE_LEAVE(self->prof, PROFILE_EXPECTATION, clk);
     *f = (-crf1dc_score(crf1de->ctx,  self->inst->labels) + crf1dc_lognorm(crf1de->ctx)) * weight;
     return 0;
 }
 
+static encoder_t* encoder_clone(encoder_t *self)
+{
+    crf1de_t *crf1de = (crf1de_t*)self->internal;
+    encoder_t *clone = crf1d_create_encoder();
+    crf1de_t *dst = NULL;
+
+    if (clone == NULL || clone->internal == NULL) {
+        free(clone);
+        return NULL;
+    }
+
+    /* Share the features and references, but use a context of its own. */
+    dst = (crf1de_t*)clone->internal;
+    *dst = *crf1de;
+    dst->shared = 1;
+    dst->restricted = 0;
+    dst->active = NULL;
+    dst->active_attributes = NULL;
+    dst->active_fids = NULL;
+    dst->ctx = crf1dc_new(CTXF_MARGINALS | CTXF_VITERBI, crf1de->num_labels, crf1de->ctx->cap_items);
+    if (dst->ctx == NULL) {
+        clone->release(clone);
+        return NULL;
+    }
+
+    clone->ds = self->ds;
+    clone->num_features = self->num_features;
+    clone->cap_items = self->cap_items;
+    return clone;
+}
+
 static void encoder_release(encoder_t *self)
 {
     crf1de_t *crf1de = (crf1de_t*)self->internal;
@@ -945,13 +1136,17 @@ encoder_t *crf1d_create_encoder()
             self->initialize = encoder_initialize;
             self->objective_and_gradients_batch = encoder_objective_and_gradients_batch;
             self->save_model = encoder_save_model;
+            self->load_weights = encoder_load_weights;
             self->features_on_path = encoder_features_on_path;
+            self->features_on_instance = encoder_features_on_instance;
+            self->set_active_features = encoder_set_active_features;
             self->set_weights =  encoder_set_weights;
             self->set_instance = encoder_set_instance;
             self->score = encoder_score;
             self->viterbi = encoder_viterbi;
             self->partition_factor = encoder_partition_factor;
             self->objective_and_gradients = encoder_objective_and_gradients;
+            self->clone = encoder_clone;
             self->release = encoder_release;
             self->internal = enc;
         }
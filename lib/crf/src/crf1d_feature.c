@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <crfsuite.h>
 
@@ -350,3 +351,279 @@ error_exit:
     *ptr_trans = NULL;
     return -1;
 }
+
+int crf1df_save_model(
+    const char *filename,
+    int version,
+    const crf1df_feature_t *features,
+    const feature_refs_t *attributes,
+    const feature_refs_t *forward_trans,
+    const int K,
+    const int A,
+    const int L,
+    const floatval_t *w,
+    crfsuite_dictionary_t *attrs,
+    crfsuite_dictionary_t *labels,
+    logging_t *lg
+    )
+{
+    int a, k, l, r, n, ret;
+    clock_t begin;
+    int *fmap = NULL, *amap = NULL, *lbuf = NULL;
+    floatval_t *wbuf = NULL;
+    crf1dmw_t* writer = NULL;
+    const feature_refs_t *edge = NULL, *attr = NULL;
+    const floatval_t threshold = 0.01;
+    int J = 0, B = 0;
+
+    /* Start storing the model. */
+    logging(lg, "Storing the model\n");
+    begin = clock();
+
+    /* Allocate and initialize the feature mapping. */
+    fmap = (int*)calloc(K, sizeof(int));
+    if (fmap == NULL) {
+        goto error_exit;
+    }
+#ifdef  CRF_TRAIN_SAVE_NO_PRUNING
+    for (k = 0;k < K;++k) fmap[k] = k;
+    J = K;
+#else
+    for (k = 0;k < K;++k) fmap[k] = -1;
+#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
+
+    /* Allocate and initialize the attribute mapping. */
+    amap = (int*)calloc(A, sizeof(int));
+    if (amap == NULL) {
+        goto error_exit;
+    }
+#ifdef  CRF_TRAIN_SAVE_NO_PRUNING
+    for (a = 0;a < A;++a) amap[a] = a;
+    B = A;
+#else
+    for (a = 0;a < A;++a) amap[a] = -1;
+#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
+
+    /*
+     *  Open a model writer.
+     */
+    writer = crf1mmw(filename, version);
+    if (writer == NULL) {
+        goto error_exit;
+    }
+
+    /* Open a feature chunk in the model file. */
+    if (version == 1 && (ret = crf1dmw_open_features(writer))) {
+        goto error_exit;
+    }
+
+#ifndef CRF_TRAIN_SAVE_NO_PRUNING
+    /* Number the active attributes in ascending order of their ids. */
+    for (k = 0;k < K;++k) {
+        if (w[k] != 0 && features[k].type == FT_STATE) {
+            amap[features[k].src] = 0;
+        }
+    }
+    for (a = 0;a < A;++a) {
+        if (0 <= amap[a]) amap[a] = B++;    /* Attribute #a -> #amap[a]. */
+    }
+#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
+
+    /*
+     *  Write the feature values.
+     *     (with determining active features).
+     */
+    for (k = 0;k < K;++k) {
+        const crf1df_feature_t* f = &features[k];
+        if (w[k] != 0) {
+            int src;
+            crf1dm_feature_t feat;
+
+#ifndef CRF_TRAIN_SAVE_NO_PRUNING
+            /* The feature (#k) will have a new feature id (#J). */
+            fmap[k] = J++;        /* Feature #k -> #fmap[k]. */
+
+            /* Map the source of the field. */
+            if (f->type == FT_STATE) {
+                src = amap[f->src];
+            } else {
+                src = f->src;
+            }
+#endif/*CRF_TRAIN_SAVE_NO_PRUNING*/
+
+            feat.type = f->type;
+            feat.src = src;
+            feat.dst = f->dst;
+            feat.weight = w[k];
+
+            /* Write the feature. */
+            if (version == 1 && (ret = crf1dmw_put_feature(writer, fmap[k], &feat))) {
+                goto error_exit;
+            }
+        }
+    }
+
+    /* Close the feature chunk. */
+    if (version == 1 && (ret = crf1dmw_close_features(writer))) {
+        goto error_exit;
+    }
+
+    logging(lg, "Number of active features: %d (%d)\n", J, K);
+    logging(lg, "Number of active attributes: %d (%d)\n", B, A);
+    logging(lg, "Number of active labels: %d (%d)\n", L, L);
+
+    /* Write labels. */
+    logging(lg, "Writing labels\n", L);
+    if (ret = crf1dmw_open_labels(writer, L)) {
+        goto error_exit;
+    }
+    for (l = 0;l < L;++l) {
+        const char *str = NULL;
+        labels->to_string(labels, l, &str);
+        if (str != NULL) {
+            if (ret = crf1dmw_put_label(writer, l, str)) {
+                goto error_exit;
+            }
+            labels->free(labels, str);
+        }
+    }
+    if (ret = crf1dmw_close_labels(writer)) {
+        goto error_exit;
+    }
+
+    /* Write attributes. */
+    logging(lg, "Writing attributes\n");
+    if (ret = crf1dmw_open_attrs(writer, B)) {
+        goto error_exit;
+    }
+    for (a = 0;a < A;++a) {
+        if (0 <= amap[a]) {
+            const char *str = NULL;
+            attrs->to_string(attrs, a, &str);
+            if (str != NULL) {
+                if (ret = crf1dmw_put_attr(writer, amap[a], str)) {
+                    goto error_exit;
+                }
+                attrs->free(attrs, str);
+            }
+        }
+    }
+    if (ret = crf1dmw_close_attrs(writer)) {
+        goto error_exit;
+    }
+
+    if (version == 2) {
+        /* Write the transition matrix. */
+        logging(lg, "Writing transition weights\n");
+        if (ret = crf1dmw_open_transitions(writer, L)) {
+            goto error_exit;
+        }
+        for (l = 0;l < L;++l) {
+            edge = &forward_trans[l];
+            for (r = 0;r < edge->num_features;++r) {
+                k = edge->fids[r];
+                if (0 <= fmap[k]) {
+                    const crf1df_feature_t* f = &features[k];
+                    if (ret = crf1dmw_put_transition(writer, f->src, f->dst, w[k])) {
+                        goto error_exit;
+                    }
+                }
+            }
+        }
+        if (ret = crf1dmw_close_transitions(writer)) {
+            goto error_exit;
+        }
+
+        /* Write the state weights of attributes. */
+        logging(lg, "Writing state weights\n");
+        lbuf = (int*)calloc(L, sizeof(int));
+        wbuf = (floatval_t*)calloc(L, sizeof(floatval_t));
+        if (lbuf == NULL || wbuf == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        if (ret = crf1dmw_open_states(writer, B, L)) {
+            goto error_exit;
+        }
+        for (a = 0;a < A;++a) {
+            if (0 <= amap[a]) {
+                attr = &attributes[a];
+                for (n = 0, r = 0;r < attr->num_features;++r) {
+                    k = attr->fids[r];
+                    if (0 <= fmap[k]) {
+                        lbuf[n] = features[k].dst;
+                        wbuf[n] = w[k];
+                        ++n;
+                    }
+                }
+                if (ret = crf1dmw_put_states(writer, amap[a], lbuf, wbuf, n)) {
+                    goto error_exit;
+                }
+            }
+        }
+        if (ret = crf1dmw_close_states(writer)) {
+            goto error_exit;
+        }
+    } else {
+        /* Write label feature references. */
+        logging(lg, "Writing feature references for transitions\n");
+        if (ret = crf1dmw_open_labelrefs(writer, L+2)) {
+            goto error_exit;
+        }
+        for (l = 0;l < L;++l) {
+            edge = &forward_trans[l];
+            if (ret = crf1dmw_put_labelref(writer, l, edge, fmap)) {
+                goto error_exit;
+            }
+        }
+        if (ret = crf1dmw_close_labelrefs(writer)) {
+            goto error_exit;
+        }
+
+        /* Write attribute feature references. */
+        logging(lg, "Writing feature references for attributes\n");
+        if (ret = crf1dmw_open_attrrefs(writer, B)) {
+            goto error_exit;
+        }
+        for (a = 0;a < A;++a) {
+            if (0 <= amap[a]) {
+                attr = &attributes[a];
+                if (ret = crf1dmw_put_attrref(writer, amap[a], attr, fmap)) {
+                    goto error_exit;
+                }
+            }
+        }
+        if (ret = crf1dmw_close_attrrefs(writer)) {
+            goto error_exit;
+        }
+    }
+
+    /* Close the writer, which replaces the model file on success. */
+    ret = crf1dmw_close(writer);
+    writer = NULL;
+    if (ret) {
+        goto error_exit;
+    }
+    logging(lg, "Seconds required: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
+    logging(lg, "\n");
+
+    free(wbuf);
+    free(lbuf);
+    free(amap);
+    free(fmap);
+    return 0;
+
+error_exit:
+    if (writer != NULL) {
+        crf1dmw_abort(writer);
+    }
+    free(wbuf);
+    free(lbuf);
+    if (amap != NULL) {
+        free(amap);
+    }
+    if (fmap != NULL) {
+        free(fmap);
+    }
+    return ret;
+}
@@ -0,0 +1,1154 @@
+/*
+ *      CRF1d online learner (implementation of crfsuite_learner_t).
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+/*
+ * The learner keeps the features in the same layout as the encoder
+ * (crf1d_encode.c): an array of feature descriptors with the references
+ * from attributes and source labels. Features are appended as new pairs
+ * of an attribute (or a previous label) and a label appear in the
+ * reference label sequences, and the weights are updated in place. The
+ * taggers created by the learner score instances with the current
+ * weights; a tagger notices an update by the version number of the
+ * learner and recomputes its transition scores.
+ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+#include "params.h"
+#include "logging.h"
+#include "crf1d.h"
+
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+int crfsuite_dictionary_create_instance(const char *interface, void **ptr);
+
+/**
+ * Update algorithms.
+ */
+enum {
+    LEARN_NONE = 0,
+    LEARN_PASSIVE_AGGRESSIVE,
+    LEARN_AROW,
+};
+
+/**
+ * Learning parameters (configurable with crfsuite_params_t interface).
+ */
+typedef struct {
+    int type;
+    floatval_t c;
+    int error_sensitive;
+    floatval_t variance;
+    floatval_t gamma;
+    int snapshot_period;
+    int model_version;
+} crf1dl_option_t;
+
+/**
+ * CRF1d online learner.
+ */
+typedef struct {
+    int algorithm;                  /**< Update algorithm (LEARN_*). */
+    crfsuite_params_t *params;      /**< Parameters. */
+    logging_t *lg;                  /**< Logging. */
+    crf1dl_option_t opt;            /**< Options read at the latest update. */
+
+    crfsuite_dictionary_t *attrs;   /**< Dictionary of attributes. */
+    crfsuite_dictionary_t *labels;  /**< Dictionary of labels. */
+
+    int num_labels;                 /**< Number of labels with features (L). */
+    int num_attributes;             /**< Number of attributes with features (A). */
+    int num_features;               /**< Number of features (K). */
+    int cap_labels;
+    int cap_attributes;
+    int cap_features;
+
+    crf1df_feature_t *features;     /**< Array of feature descriptors [K]. */
+    feature_refs_t *attributes;     /**< References to attribute features [A]. */
+    feature_refs_t *forward_trans;  /**< References to transition features [L]. */
+    floatval_t *w;                  /**< Feature weights [K]. */
+    floatval_t *cov;                /**< Variances of feature weights [K] (AROW). */
+
+    floatval_t *delta;              /**< Difference vector F(x, y) - F(x, y') [K]. */
+    char *used;                     /**< Flags for collapsing indices [K]. */
+    int *actives;                   /**< Indices of non-zero elements in delta. */
+    int num_actives;
+    int cap_actives;
+
+    crf1d_context_t *ctx;           /**< CRF context for updates. */
+    int *viterbi;                   /**< Viterbi label sequence. */
+    int cap_viterbi;
+
+    int version;                    /**< Incremented when the weights change. */
+    int num_updates;                /**< Number of instances given to update(). */
+} crf1dl_t;
+
+/**
+ * Tagger attached to a learner.
+ */
+typedef struct {
+    crfsuite_learner_t *learner;    /**< Learner (referenced). */
+    crf1d_context_t *ctx;           /**< CRF context. */
+    int version;                    /**< Version of the weights in ctx. */
+    int level;                      /**< Non-zero if alpha/beta are computed. */
+} crf1dlt_t;
+
+
+
+static int exchange_options(crfsuite_params_t* params, crf1dl_option_t* opt, int algorithm, int mode)
+{
+    if (algorithm == LEARN_PASSIVE_AGGRESSIVE) {
+        BEGIN_PARAM_MAP(params, mode)
+            DDX_PARAM_INT(
+                "type", opt->type, 1,
+                "The strategy for updating feature weights: {\n"
+                "    0: PA without slack variables,\n"
+                "    1: PA type I,\n"
+                "    2: PA type II\n"
+                "}.\n"
+                )
+            DDX_PARAM_FLOAT(
+                "c", opt->c, 1.,
+                "The aggressiveness parameter."
+                )
+            DDX_PARAM_INT(
+                "error_sensitive", opt->error_sensitive, 1,
+                "Consider the number of incorrect labels to the cost function."
+                )
+        END_PARAM_MAP()
+    } else {
+        BEGIN_PARAM_MAP(params, mode)
+            DDX_PARAM_FLOAT(
+                "variance", opt->variance, 1.,
+                "The initial variance of every feature weight."
+                )
+            DDX_PARAM_FLOAT(
+                "gamma", opt->gamma, 1.,
+                "Tradeoff parameter."
+                )
+        END_PARAM_MAP()
+    }
+
+    BEGIN_PARAM_MAP(params, mode)
+        DDX_PARAM_INT(
+            "snapshot.period", opt->snapshot_period, 1000,
+            "The number of updates between snapshots to ${snapshot.file}."
+            )
+        DDX_PARAM_INT(
+            "model.version", opt->model_version, 1,
+            "The version of the model format (1: compact and readable by older releases,\n"
+            "2: laid out for tagging)."
+            )
+    END_PARAM_MAP()
+
+    return 0;
+}
+
+
+
+static int refs_append(feature_refs_t *refs, int fid)
+{
+    const int n = refs->num_features;
+
+    /* The capacity of fids is the smallest power of two above n. */
+    if ((n & (n - 1)) == 0) {
+        int *fids = (int*)realloc(refs->fids, sizeof(int) * (n ? n * 2 : 1));
+        if (fids == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        refs->fids = fids;
+    }
+    refs->fids[refs->num_features++] = fid;
+    return 0;
+}
+
+static void refs_delete(feature_refs_t *refs, int n)
+{
+    int i;
+    if (refs != NULL) {
+        for (i = 0;i < n;++i) {
+            free(refs[i].fids);
+        }
+        free(refs);
+    }
+}
+
+static void crf1dl_clear(crf1dl_t *crf1dl)
+{
+    refs_delete(crf1dl->attributes, crf1dl->num_attributes);
+    refs_delete(crf1dl->forward_trans, crf1dl->num_labels);
+    free(crf1dl->features);
+    free(crf1dl->w);
+    free(crf1dl->cov);
+    free(crf1dl->delta);
+    free(crf1dl->used);
+    free(crf1dl->actives);
+    free(crf1dl->viterbi);
+    if (crf1dl->ctx != NULL) {
+        crf1dc_delete(crf1dl->ctx);
+    }
+    if (crf1dl->attrs != NULL) {
+        crf1dl->attrs->release(crf1dl->attrs);
+    }
+    if (crf1dl->labels != NULL) {
+        crf1dl->labels->release(crf1dl->labels);
+    }
+
+    crf1dl->attrs = NULL;
+    crf1dl->labels = NULL;
+    crf1dl->num_labels = crf1dl->cap_labels = 0;
+    crf1dl->num_attributes = crf1dl->cap_attributes = 0;
+    crf1dl->num_features = crf1dl->cap_features = 0;
+    crf1dl->features = NULL;
+    crf1dl->attributes = NULL;
+    crf1dl->forward_trans = NULL;
+    crf1dl->w = NULL;
+    crf1dl->cov = NULL;
+    crf1dl->delta = NULL;
+    crf1dl->used = NULL;
+    crf1dl->actives = NULL;
+    crf1dl->num_actives = crf1dl->cap_actives = 0;
+    crf1dl->ctx = NULL;
+    crf1dl->viterbi = NULL;
+    crf1dl->cap_viterbi = 0;
+    crf1dl->num_updates = 0;
+    ++crf1dl->version;
+}
+
+static int crf1dl_reset(crf1dl_t *crf1dl)
+{
+    crf1dl_clear(crf1dl);
+    if (crfsuite_dictionary_create_instance("dictionary", (void**)&crf1dl->attrs) != 0) {
+        crf1dl->attrs = NULL;
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    if (crfsuite_dictionary_create_instance("dictionary", (void**)&crf1dl->labels) != 0) {
+        crf1dl->labels = NULL;
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    return 0;
+}
+
+static int crf1dl_grow_labels(crf1dl_t *crf1dl, int L)
+{
+    if (crf1dl->cap_labels < L) {
+        int cap = crf1dl->cap_labels;
+        feature_refs_t *refs = NULL;
+        while (cap < L) cap = (cap + 1) * 2;
+        refs = (feature_refs_t*)realloc(crf1dl->forward_trans, sizeof(feature_refs_t) * cap);
+        if (refs == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dl->forward_trans = refs;
+        crf1dl->cap_labels = cap;
+    }
+    if (crf1dl->num_labels < L) {
+        memset(&crf1dl->forward_trans[crf1dl->num_labels], 0,
+            sizeof(feature_refs_t) * (L - crf1dl->num_labels));
+        crf1dl->num_labels = L;
+    }
+    return 0;
+}
+
+static int crf1dl_grow_attributes(crf1dl_t *crf1dl, int A)
+{
+    if (crf1dl->cap_attributes < A) {
+        int cap = crf1dl->cap_attributes;
+        feature_refs_t *refs = NULL;
+        while (cap < A) cap = (cap + 1) * 2;
+        refs = (feature_refs_t*)realloc(crf1dl->attributes, sizeof(feature_refs_t) * cap);
+        if (refs == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dl->attributes = refs;
+        crf1dl->cap_attributes = cap;
+    }
+    if (crf1dl->num_attributes < A) {
+        memset(&crf1dl->attributes[crf1dl->num_attributes], 0,
+            sizeof(feature_refs_t) * (A - crf1dl->num_attributes));
+        crf1dl->num_attributes = A;
+    }
+    return 0;
+}
+
+static int crf1dl_find_feature(crf1dl_t *crf1dl, const feature_refs_t *refs, int dst)
+{
+    int r;
+    for (r = 0;r < refs->num_features;++r) {
+        const int k = refs->fids[r];
+        if (crf1dl->features[k].dst == dst) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Add a feature with the weight (unless it exists).
+ *  The attribute (for a state feature) or the source label (for a
+ *  transition feature) must be covered by the reference tables.
+ */
+static int crf1dl_add_feature(crf1dl_t *crf1dl, int type, int src, int dst, floatval_t weight)
+{
+    int k;
+    crf1df_feature_t *f = NULL;
+    feature_refs_t *refs = (type == FT_STATE) ?
+        &crf1dl->attributes[src] : &crf1dl->forward_trans[src];
+
+    if (0 <= crf1dl_find_feature(crf1dl, refs, dst)) {
+        return 0;
+    }
+
+    /* Expand the arrays of features if necessary. */
+    if (crf1dl->cap_features <= crf1dl->num_features) {
+        const int cap = (crf1dl->cap_features + 1) * 2;
+        void *p = NULL;
+
+        if ((p = realloc(crf1dl->features, sizeof(crf1df_feature_t) * cap)) == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dl->features = (crf1df_feature_t*)p;
+        if ((p = realloc(crf1dl->w, sizeof(floatval_t) * cap)) == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dl->w = (floatval_t*)p;
+        if ((p = realloc(crf1dl->delta, sizeof(floatval_t) * cap)) == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dl->delta = (floatval_t*)p;
+        if ((p = realloc(crf1dl->used, sizeof(char) * cap)) == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dl->used = (char*)p;
+        if (crf1dl->algorithm == LEARN_AROW) {
+            if ((p = realloc(crf1dl->cov, sizeof(floatval_t) * cap)) == NULL) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
+            crf1dl->cov = (floatval_t*)p;
+        }
+        crf1dl->cap_features = cap;
+    }
+
+    k = crf1dl->num_features;
+    if (refs_append(refs, k) != 0) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    f = &crf1dl->features[k];
+    f->type = type;
+    f->src = src;
+    f->dst = dst;
+    f->freq = 0;
+    crf1dl->w[k] = weight;
+    crf1dl->delta[k] = 0;
+    crf1dl->used[k] = 0;
+    if (crf1dl->cov != NULL) {
+        crf1dl->cov[k] = crf1dl->opt.variance;
+    }
+    ++crf1dl->num_features;
+    return 0;
+}
+
+static int crf1dl_open(crf1dl_t *crf1dl, const char *filename)
+{
+    int a, i, j, l, r, n, A, L, ret = 0;
+    const floatval_t *trans = NULL;
+    crf1dm_t *model = NULL;
+    crfsuite_dictionary_t *attrs = NULL, *labels = NULL;
+
+    exchange_options(crf1dl->params, &crf1dl->opt, crf1dl->algorithm, -1);
+    if ((ret = crf1dl_reset(crf1dl))) {
+        goto error_exit;
+    }
+    attrs = crf1dl->attrs;
+    labels = crf1dl->labels;
+
+    model = crf1dm_new(filename);
+    if (model == NULL) {
+        ret = CRFSUITEERR_INCOMPATIBLE;
+        goto error_exit;
+    }
+    L = crf1dm_get_num_labels(model);
+    A = crf1dm_get_num_attrs(model);
+    trans = crf1dm_get_transitions(model);
+
+    /* Register the labels and attributes with the same ids as the model. */
+    for (l = 0;l < L;++l) {
+        const char *str = crf1dm_to_label(model, l);
+        if (str == NULL || labels->get(labels, str) != l) {
+            ret = CRFSUITEERR_INCOMPATIBLE;
+            goto error_exit;
+        }
+    }
+    for (a = 0;a < A;++a) {
+        const char *str = crf1dm_to_attr(model, a);
+        if (str == NULL || attrs->get(attrs, str) != a) {
+            ret = CRFSUITEERR_INCOMPATIBLE;
+            goto error_exit;
+        }
+    }
+    if ((ret = crf1dl_grow_labels(crf1dl, L)) ||
+        (ret = crf1dl_grow_attributes(crf1dl, A))) {
+        goto error_exit;
+    }
+
+    /* Add the transition features with non-zero weights. */
+    for (i = 0;i < L;++i) {
+        if (trans != NULL) {
+            for (j = 0;j < L;++j) {
+                const floatval_t weight = trans[i * L + j];
+                if (weight != 0. &&
+                    (ret = crf1dl_add_feature(crf1dl, FT_TRANS, i, j, weight))) {
+                    goto error_exit;
+                }
+            }
+        } else {
+            feature_refs_t refs;
+            crf1dm_get_labelref(model, i, &refs);
+            for (r = 0;r < refs.num_features;++r) {
+                crf1dm_feature_t f;
+                crf1dm_get_feature(model, crf1dm_get_featureid(&refs, r), &f);
+                if (0 <= f.dst && f.dst < L && f.weight != 0. &&
+                    (ret = crf1dl_add_feature(crf1dl, FT_TRANS, i, f.dst, f.weight))) {
+                    goto error_exit;
+                }
+            }
+        }
+    }
+
+    /* Add the state features with non-zero weights. */
+    for (a = 0;a < A;++a) {
+        if (trans != NULL) {
+            const int *mlabels = NULL;
+            const floatval_t *weights = NULL;
+            n = crf1dm_get_states(model, a, &mlabels, &weights);
+            for (r = 0;r < n;++r) {
+                if (weights[r] != 0. &&
+                    (ret = crf1dl_add_feature(crf1dl, FT_STATE, a, mlabels[r], weights[r]))) {
+                    goto error_exit;
+                }
+            }
+        } else {
+            feature_refs_t refs;
+            crf1dm_get_attrref(model, a, &refs);
+            for (r = 0;r < refs.num_features;++r) {
+                crf1dm_feature_t f;
+                crf1dm_get_feature(model, crf1dm_get_featureid(&refs, r), &f);
+                if (0 <= f.dst && f.dst < L && f.weight != 0. &&
+                    (ret = crf1dl_add_feature(crf1dl, FT_STATE, a, f.dst, f.weight))) {
+                    goto error_exit;
+                }
+            }
+        }
+    }
+
+    logging(crf1dl->lg, "Model: %s\n", filename);
+    logging(crf1dl->lg, "Number of labels: %d\n", L);
+    logging(crf1dl->lg, "Number of attributes: %d\n", A);
+    logging(crf1dl->lg, "Number of features: %d\n", crf1dl->num_features);
+    logging(crf1dl->lg, "\n");
+
+    crf1dm_close(model);
+    return 0;
+
+error_exit:
+    if (model != NULL) {
+        crf1dm_close(model);
+    }
+    crf1dl_reset(crf1dl);
+    return ret;
+}
+
+static int crf1dl_save(crf1dl_t *crf1dl, const char *filename)
+{
+    return crf1df_save_model(
+        filename,
+        (crf1dl->opt.model_version == 2) ? 2 : 1,
+        crf1dl->features,
+        crf1dl->attributes,
+        crf1dl->forward_trans,
+        crf1dl->num_features,
+        crf1dl->num_attributes,
+        crf1dl->num_labels,
+        crf1dl->w,
+        crf1dl->attrs,
+        crf1dl->labels,
+        crf1dl->lg
+        );
+}
+
+static void crf1dl_transition_score(crf1dl_t *crf1dl, crf1d_context_t *ctx)
+{
+    int i, r;
+    const int L = ctx->num_labels;
+
+    for (i = 0;i < L;++i) {
+        floatval_t *trans = TRANS_SCORE(ctx, i);
+        const feature_refs_t *edge = &crf1dl->forward_trans[i];
+        for (r = 0;r < edge->num_features;++r) {
+            const int k = edge->fids[r];
+            trans[crf1dl->features[k].dst] = crf1dl->w[k];
+        }
+    }
+}
+
+static void crf1dl_state_score(crf1dl_t *crf1dl, crf1d_context_t *ctx, const crfsuite_instance_t *inst)
+{
+    int c, r, t;
+    const int A = crf1dl->num_attributes;
+    const int T = inst->num_items;
+
+    for (t = 0;t < T;++t) {
+        const crfsuite_item_t *item = &inst->items[t];
+        floatval_t *state = STATE_SCORE(ctx, t);
+
+        for (c = 0;c < item->num_contents;++c) {
+            const int a = item->contents[c].aid;
+            const floatval_t value = item->contents[c].value;
+            const feature_refs_t *attr = NULL;
+
+            /* Attributes without features do not contribute to the scores. */
+            if (a < 0 || A <= a) {
+                continue;
+            }
+            attr = &crf1dl->attributes[a];
+            for (r = 0;r < attr->num_features;++r) {
+                const int k = attr->fids[r];
+                state[crf1dl->features[k].dst] += crf1dl->w[k] * value;
+            }
+        }
+    }
+}
+
+/**
+ * Prepare a context for the current labels and transition weights.
+ *  The context is recreated when the number of labels changed.
+ */
+static int crf1dl_prepare_context(crf1dl_t *crf1dl, crf1d_context_t **ptr_ctx, int flag, int T)
+{
+    crf1d_context_t *ctx = *ptr_ctx;
+
+    if (ctx != NULL && ctx->num_labels != crf1dl->num_labels) {
+        crf1dc_delete(ctx);
+        *ptr_ctx = ctx = NULL;
+    }
+    if (ctx == NULL) {
+        ctx = crf1dc_new(flag, crf1dl->num_labels, T);
+        if (ctx == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        *ptr_ctx = ctx;
+    }
+    if (crf1dc_set_num_items(ctx, T) != 0) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    return 0;
+}
+
+static void crf1dl_delta_collect(crf1dl_t *crf1dl, const crfsuite_instance_t *inst, const int *path, floatval_t c)
+{
+    int i = -1, t, n, k;
+    const int T = inst->num_items;
+
+    for (t = 0;t < T;++t) {
+        const crfsuite_item_t *item = &inst->items[t];
+        const int j = path[t];
+
+        for (n = 0;n < item->num_contents;++n) {
+            const int a = item->contents[n].aid;
+            k = crf1dl_find_feature(crf1dl, &crf1dl->attributes[a], j);
+            if (0 <= k) {
+                crf1dl->actives[crf1dl->num_actives++] = k;
+                crf1dl->delta[k] += c * item->contents[n].value;
+            }
+        }
+        if (i != -1) {
+            k = crf1dl_find_feature(crf1dl, &crf1dl->forward_trans[i], j);
+            if (0 <= k) {
+                crf1dl->actives[crf1dl->num_actives++] = k;
+                crf1dl->delta[k] += c;
+            }
+        }
+        i = j;
+    }
+}
+
+static void crf1dl_delta_finalize(crf1dl_t *crf1dl)
+{
+    int i, j = 0, k;
+
+    /* Collapse the duplicated indices. */
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        k = crf1dl->actives[i];
+        if (!crf1dl->used[k]) {
+            crf1dl->actives[j++] = k;
+            crf1dl->used[k] = 1;
+        }
+    }
+    crf1dl->num_actives = j;
+
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        crf1dl->used[crf1dl->actives[i]] = 0;
+    }
+}
+
+static void crf1dl_delta_reset(crf1dl_t *crf1dl)
+{
+    int i;
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        crf1dl->delta[crf1dl->actives[i]] = 0;
+    }
+    crf1dl->num_actives = 0;
+}
+
+static floatval_t crf1dl_update_pa(crf1dl_t *crf1dl, const crfsuite_instance_t *inst, floatval_t sv, floatval_t sc, int d)
+{
+    int i;
+    floatval_t cost, tau, norm2 = 0.;
+    const crf1dl_option_t *opt = &crf1dl->opt;
+
+    /* Compute the cost of this instance. */
+    if (opt->error_sensitive) {
+        cost = (sv - sc) + sqrt((double)d);
+    } else {
+        cost = (sv - sc) + 1.;
+    }
+
+    /* Compute tau (dpending on PA, PA-I, and PA-II). */
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        const int k = crf1dl->actives[i];
+        norm2 += crf1dl->delta[k] * crf1dl->delta[k];
+    }
+    if (opt->type == 1) {
+        tau = MIN(opt->c, cost / norm2);
+    } else if (opt->type == 2) {
+        tau = cost / (norm2 + 0.5 / opt->c);
+    } else {
+        tau = cost / norm2;
+    }
+    tau *= inst->weight;
+
+    /* Update the feature weights: w[k] += tau * delta[k]. */
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        const int k = crf1dl->actives[i];
+        crf1dl->w[k] += tau * crf1dl->delta[k];
+    }
+    return cost;
+}
+
+static floatval_t crf1dl_update_arow(crf1dl_t *crf1dl, const crfsuite_instance_t *inst, floatval_t sv, floatval_t sc, int d)
+{
+    int i;
+    floatval_t alpha, frac, cost;
+    const crf1dl_option_t *opt = &crf1dl->opt;
+
+    /* Compute the cost of this instance. */
+    cost = sv - sc + (double)d;
+
+    /* Compute alpha (delta is scaled by the instance weight). */
+    frac = opt->gamma;
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        const int k = crf1dl->actives[i];
+        frac += crf1dl->delta[k] * crf1dl->delta[k] * crf1dl->cov[k];
+    }
+    alpha = cost / frac;
+
+    /* Update the mean and covariance (diagonal matrix). */
+    for (i = 0;i < crf1dl->num_actives;++i) {
+        const int k = crf1dl->actives[i];
+        const floatval_t prod = crf1dl->delta[k] * crf1dl->delta[k];
+        crf1dl->w[k] += alpha * crf1dl->cov[k] * crf1dl->delta[k];
+        crf1dl->cov[k] = 1.0 / ((1.0 / crf1dl->cov[k]) + prod / opt->gamma);
+    }
+    return cost;
+}
+
+static int crf1dl_update(crf1dl_t *crf1dl, const crfsuite_instance_t *inst, floatval_t *ptr_loss)
+{
+    int c, d = 0, t, ret = 0;
+    floatval_t sv, sc, loss = 0.;
+    char *snapshot = NULL;
+    const int T = inst->num_items;
+    const int L = crf1dl->labels->num(crf1dl->labels);
+    const int A = crf1dl->attrs->num(crf1dl->attrs);
+
+    exchange_options(crf1dl->params, &crf1dl->opt, crf1dl->algorithm, -1);
+
+    /* Check the attributes and labels of the instance. */
+    for (t = 0;t < T;++t) {
+        const crfsuite_item_t *item = &inst->items[t];
+        if (inst->labels[t] < 0 || L <= inst->labels[t]) {
+            return CRFSUITEERR_INCOMPATIBLE;
+        }
+        for (c = 0;c < item->num_contents;++c) {
+            if (item->contents[c].aid < 0 || A <= item->contents[c].aid) {
+                return CRFSUITEERR_INCOMPATIBLE;
+            }
+        }
+    }
+
+    if (0 < T) {
+        /* Generate the features on the reference label sequence. */
+        if ((ret = crf1dl_grow_labels(crf1dl, L)) ||
+            (ret = crf1dl_grow_attributes(crf1dl, A))) {
+            return ret;
+        }
+        for (t = 0;t < T;++t) {
+            const crfsuite_item_t *item = &inst->items[t];
+            const int j = inst->labels[t];
+            for (c = 0;c < item->num_contents;++c) {
+                if ((ret = crf1dl_add_feature(crf1dl, FT_STATE, item->contents[c].aid, j, 0.))) {
+                    return ret;
+                }
+            }
+            if (0 < t &&
+                (ret = crf1dl_add_feature(crf1dl, FT_TRANS, inst->labels[t-1], j, 0.))) {
+                return ret;
+            }
+        }
+
+        /* Expand the work spaces if necessary. */
+        if (crf1dl->cap_viterbi < T) {
+            int *viterbi = (int*)realloc(crf1dl->viterbi, sizeof(int) * T);
+            if (viterbi == NULL) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
+            crf1dl->viterbi = viterbi;
+            crf1dl->cap_viterbi = T;
+        }
+        c = 0;
+        for (t = 0;t < T;++t) {
+            c += inst->items[t].num_contents + 1;
+        }
+        if (crf1dl->cap_actives < 2 * c) {
+            int *actives = (int*)realloc(crf1dl->actives, sizeof(int) * 2 * c);
+            if (actives == NULL) {
+                return CRFSUITEERR_OUTOFMEMORY;
+            }
+            crf1dl->actives = actives;
+            crf1dl->cap_actives = 2 * c;
+        }
+
+        /* Tag the sequence with the current model. */
+        if ((ret = crf1dl_prepare_context(crf1dl, &crf1dl->ctx, CTXF_VITERBI, T))) {
+            return ret;
+        }
+        crf1dc_reset(crf1dl->ctx, RF_TRANS | RF_STATE);
+        crf1dl_transition_score(crf1dl, crf1dl->ctx);
+        crf1dl_state_score(crf1dl, crf1dl->ctx, inst);
+        sv = crf1dc_viterbi(crf1dl->ctx, crf1dl->viterbi);
+
+        /* Compute the number of different labels. */
+        for (t = 0;t < T;++t) {
+            if (inst->labels[t] != crf1dl->viterbi[t]) {
+                ++d;
+            }
+        }
+
+        if (0 < d) {
+            sc = crf1dc_score(crf1dl->ctx, inst->labels);
+
+            /* delta = F(x, y) - F(x, y') (scaled by the weight for AROW). */
+            c = (crf1dl->algorithm == LEARN_AROW);
+            crf1dl_delta_collect(crf1dl, inst, inst->labels, c ? inst->weight : 1.);
+            crf1dl_delta_collect(crf1dl, inst, crf1dl->viterbi, c ? -inst->weight : -1.);
+            crf1dl_delta_finalize(crf1dl);
+
+            if (crf1dl->algorithm == LEARN_AROW) {
+                loss = crf1dl_update_arow(crf1dl, inst, sv, sc, d);
+            } else {
+                loss = crf1dl_update_pa(crf1dl, inst, sv, sc, d);
+            }
+            loss *= inst->weight;
+
+            crf1dl_delta_reset(crf1dl);
+            ++crf1dl->version;
+        }
+    }
+
+    if (ptr_loss != NULL) {
+        *ptr_loss = loss;
+    }
+
+    /* Store a snapshot of the model periodically. */
+    ++crf1dl->num_updates;
+    crf1dl->params->get_string(crf1dl->params, "snapshot.file", &snapshot);
+    if (snapshot != NULL && *snapshot != '\0' && 0 < crf1dl->opt.snapshot_period &&
+        crf1dl->num_updates % crf1dl->opt.snapshot_period == 0) {
+        ret = crf1dl_save(crf1dl, snapshot);
+    }
+    return ret;
+}
+
+
+
+/*
+ *    Implementation of crfsuite_tagger_t object.
+ *    This object is instantiated only by a crfsuite_learner_t object.
+ */
+
+static int tagger_addref(crfsuite_tagger_t* tagger)
+{
+    return crfsuite_interlocked_increment(&tagger->nref);
+}
+
+static int tagger_release(crfsuite_tagger_t* tagger)
+{
+    int count = crfsuite_interlocked_decrement(&tagger->nref);
+    if (count == 0) {
+        /* This instance is being destroyed. */
+        crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+        if (crf1dlt->ctx != NULL) {
+            crf1dc_delete(crf1dlt->ctx);
+        }
+        crf1dlt->learner->release(crf1dlt->learner);
+        free(crf1dlt);
+        free(tagger);
+    }
+    return count;
+}
+
+static int tagger_set(crfsuite_tagger_t* tagger, crfsuite_instance_t *inst)
+{
+    int ret = 0, renew = 0;
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+    crf1dl_t *crf1dl = (crf1dl_t*)crf1dlt->learner->internal;
+    crf1d_context_t *ctx = NULL;
+
+    /* No label can be predicted before the learner sees one. */
+    if (crf1dl->num_labels == 0) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    renew = (crf1dlt->ctx == NULL || crf1dlt->ctx->num_labels != crf1dl->num_labels);
+    if ((ret = crf1dl_prepare_context(crf1dl, &crf1dlt->ctx, CTXF_VITERBI | CTXF_MARGINALS, inst->num_items))) {
+        return ret;
+    }
+    ctx = crf1dlt->ctx;
+
+    /* Recompute the transition scores after an update. */
+    if (renew || crf1dlt->version != crf1dl->version) {
+        crf1dc_reset(ctx, RF_TRANS);
+        crf1dl_transition_score(crf1dl, ctx);
+        crf1dc_exp_transition(ctx);
+        crf1dlt->version = crf1dl->version;
+    }
+
+    crf1dc_reset(ctx, RF_STATE);
+    crf1dl_state_score(crf1dl, ctx, inst);
+    crf1dlt->level = 0;
+    return 0;
+}
+
+static int tagger_length(crfsuite_tagger_t* tagger)
+{
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+    return (crf1dlt->ctx != NULL) ? crf1dlt->ctx->num_items : 0;
+}
+
+static void tagger_alpha_beta(crf1dlt_t *crf1dlt)
+{
+    if (!crf1dlt->level) {
+        crf1dc_exp_state(crf1dlt->ctx);
+        crf1dc_alpha_score(crf1dlt->ctx);
+        crf1dc_beta_score(crf1dlt->ctx);
+        crf1dlt->level = 1;
+    }
+}
+
+static int tagger_viterbi(crfsuite_tagger_t* tagger, int *labels, floatval_t *ptr_score)
+{
+    floatval_t score;
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+
+    score = crf1dc_viterbi(crf1dlt->ctx, labels);
+    if (ptr_score != NULL) {
+        *ptr_score = score;
+    }
+    return 0;
+}
+
+static int tagger_score(crfsuite_tagger_t* tagger, int *path, floatval_t *ptr_score)
+{
+    floatval_t score;
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+
+    score = crf1dc_score(crf1dlt->ctx, path);
+    if (ptr_score != NULL) {
+        *ptr_score = score;
+    }
+    return 0;
+}
+
+static int tagger_lognorm(crfsuite_tagger_t* tagger, floatval_t *ptr_norm)
+{
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+    tagger_alpha_beta(crf1dlt);
+    *ptr_norm = crf1dc_lognorm(crf1dlt->ctx);
+    return 0;
+}
+
+static int tagger_marginal_point(crfsuite_tagger_t *tagger, int l, int t, floatval_t *ptr_prob)
+{
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+    tagger_alpha_beta(crf1dlt);
+    *ptr_prob = crf1dc_marginal_point(crf1dlt->ctx, l, t);
+    return 0;
+}
+
+static int tagger_marginal_path(crfsuite_tagger_t *tagger, const int *path, int begin, int end, floatval_t *ptr_prob)
+{
+    crf1dlt_t *crf1dlt = (crf1dlt_t*)tagger->internal;
+    tagger_alpha_beta(crf1dlt);
+    *ptr_prob = crf1dc_marginal_path(crf1dlt->ctx, path, begin, end);
+    return 0;
+}
+
+static int tagger_set_cache(crfsuite_tagger_t *tagger, int max_entries, int flags)
+{
+    /* The results would be stale after an update. */
+    return (0 < max_entries) ? CRFSUITEERR_NOTSUPPORTED : 0;
+}
+
+static int tagger_cache_stats(crfsuite_tagger_t *tagger, crfsuite_cache_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+static int tagger_set_stats(crfsuite_tagger_t *tagger, int enable)
+{
+    /* The statistics are measured by the taggers of stored models. */
+    return enable ? CRFSUITEERR_NOTSUPPORTED : 0;
+}
+
+static int tagger_stats(crfsuite_tagger_t *tagger, crfsuite_tagger_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+
+
+/*
+ *    Implementation of crfsuite_learner_t object.
+ */
+
+static int learner_addref(crfsuite_learner_t* learner)
+{
+    return crfsuite_interlocked_increment(&learner->nref);
+}
+
+static int learner_release(crfsuite_learner_t* learner)
+{
+    int count = crfsuite_interlocked_decrement(&learner->nref);
+    if (count == 0) {
+        /* This instance is being destroyed. */
+        crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+        crf1dl_clear(crf1dl);
+        crf1dl->params->release(crf1dl->params);
+        free(crf1dl->lg);
+        free(crf1dl);
+        free(learner);
+    }
+    return count;
+}
+
+static crfsuite_params_t* learner_params(crfsuite_learner_t* learner)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    crfsuite_params_t* params = crf1dl->params;
+    params->addref(params);
+    return params;
+}
+
+static void learner_set_message_callback(crfsuite_learner_t* learner, void *instance, crfsuite_logging_callback cbm)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    crf1dl->lg->func = cbm;
+    crf1dl->lg->instance = instance;
+}
+
+static int learner_open(crfsuite_learner_t* learner, const char *filename)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    return crf1dl_open(crf1dl, filename);
+}
+
+static int learner_get_labels(crfsuite_learner_t* learner, crfsuite_dictionary_t** ptr_labels)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    /* We don't increment the reference counter. */
+    *ptr_labels = crf1dl->labels;
+    return 0;
+}
+
+static int learner_get_attrs(crfsuite_learner_t* learner, crfsuite_dictionary_t** ptr_attrs)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    /* We don't increment the reference counter. */
+    *ptr_attrs = crf1dl->attrs;
+    return 0;
+}
+
+static int learner_get_tagger(crfsuite_learner_t* learner, crfsuite_tagger_t** ptr_tagger)
+{
+    crf1dlt_t *crf1dlt = NULL;
+    crfsuite_tagger_t *tagger = NULL;
+
+    crf1dlt = (crf1dlt_t*)calloc(1, sizeof(crf1dlt_t));
+    tagger = (crfsuite_tagger_t*)calloc(1, sizeof(crfsuite_tagger_t));
+    if (crf1dlt == NULL || tagger == NULL) {
+        free(crf1dlt);
+        free(tagger);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    /* The tagger keeps the learner alive. */
+    learner->addref(learner);
+    crf1dlt->learner = learner;
+
+    tagger->internal = crf1dlt;
+    tagger->nref = 1;
+    tagger->addref = tagger_addref;
+    tagger->release = tagger_release;
+    tagger->set = tagger_set;
+    tagger->length = tagger_length;
+    tagger->viterbi = tagger_viterbi;
+    tagger->score = tagger_score;
+    tagger->lognorm = tagger_lognorm;
+    tagger->marginal_point = tagger_marginal_point;
+    tagger->marginal_path = tagger_marginal_path;
+    tagger->set_cache = tagger_set_cache;
+    tagger->cache_stats = tagger_cache_stats;
+    tagger->set_stats = tagger_set_stats;
+    tagger->stats = tagger_stats;
+
+    *ptr_tagger = tagger;
+    return 0;
+}
+
+static int learner_update(crfsuite_learner_t* learner, const crfsuite_instance_t *inst, floatval_t *ptr_loss)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    return crf1dl_update(crf1dl, inst, ptr_loss);
+}
+
+static int learner_save(crfsuite_learner_t* learner, const char *filename)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)learner->internal;
+    exchange_options(crf1dl->params, &crf1dl->opt, crf1dl->algorithm, -1);
+    return crf1dl_save(crf1dl, filename);
+}
+
+static crf1dl_t* crf1dl_new(int algorithm)
+{
+    crf1dl_t *crf1dl = (crf1dl_t*)calloc(1, sizeof(crf1dl_t));
+    if (crf1dl != NULL) {
+        crf1dl->algorithm = algorithm;
+        crf1dl->lg = (logging_t*)calloc(1, sizeof(logging_t));
+        crf1dl->params = params_create_instance();
+        if (crf1dl->lg == NULL || crf1dl->params == NULL || crf1dl_reset(crf1dl) != 0) {
+            crf1dl_clear(crf1dl);
+            if (crf1dl->params != NULL) {
+                crf1dl->params->release(crf1dl->params);
+            }
+            free(crf1dl->lg);
+            free(crf1dl);
+            return NULL;
+        }
+
+        exchange_options(crf1dl->params, &crf1dl->opt, algorithm, 0);
+        params_add_string(
+            crf1dl->params, "snapshot.file", "",
+            "The file to which the model is stored periodically."
+            );
+        exchange_options(crf1dl->params, &crf1dl->opt, algorithm, -1);
+    }
+    return crf1dl;
+}
+
+int crf1dl_create_instance(const char *interface, void **ptr)
+{
+    int algorithm = LEARN_NONE;
+    crfsuite_learner_t *learner = NULL;
+
+    /* Check if the interface name begins with "learner/crf1d/". */
+    if (strncmp(interface, "learner/crf1d/", 14) != 0) {
+        return 1;
+    }
+    interface += 14;
+
+    /* Obtain the update algorithm. */
+    if (strcmp(interface, "passive-aggressive") == 0) {
+        algorithm = LEARN_PASSIVE_AGGRESSIVE;
+    } else if (strcmp(interface, "arow") == 0) {
+        algorithm = LEARN_AROW;
+    } else {
+        return 1;
+    }
+
+    /* Create an instance. */
+    learner = (crfsuite_learner_t*)calloc(1, sizeof(crfsuite_learner_t));
+    if (learner == NULL) {
+        return 1;
+    }
+    learner->internal = crf1dl_new(algorithm);
+    if (learner->internal == NULL) {
+        free(learner);
+        return 1;
+    }
+    learner->nref = 1;
+    learner->addref = learner_addref;
+    learner->release = learner_release;
+    learner->params = learner_params;
+    learner->set_message_callback = learner_set_message_callback;
+    learner->open = learner_open;
+    learner->get_labels = learner_get_labels;
+    learner->get_attrs = learner_get_attrs;
+    learner->get_tagger = learner_get_tagger;
+    learner->update = learner_update;
+    learner->save = learner_save;
+
+    *ptr = learner;
+    return 0;
+}
@@ -44,12 +44,18 @@
 #define FILEMAGIC       "lCRF"
 #define MODELTYPE       "FOMC"
 #define VERSION_NUMBER  (100)
+#define VERSION_NUMBER_V2   (200)
 #define CHUNK_LABELREF  "LFRF"
 #define CHUNK_ATTRREF   "AFRF"
 #define CHUNK_FEATURE   "FEAT"
+#define CHUNK_TRANS     "TRAN"
+#define CHUNK_STATE     "STAT"
 #define HEADER_SIZE     48
+#define HEADER_SIZE_V2  64
 #define CHUNK_SIZE      12
+#define CHUNK_SIZE_V2   64
 #define FEATURE_SIZE    20
+#define SECTION_ALIGN   64
 
 enum {
     WSTATE_NONE,
@@ -58,6 +64,8 @@ enum {
     WSTATE_LABELREFS,
     WSTATE_ATTRREFS,
     WSTATE_FEATURES,
+    WSTATE_TRANS,
+    WSTATE_STATES,
 };
 
 typedef struct {
@@ -73,6 +81,8 @@ typedef struct {
     uint32_t    off_attrs;      /* Offset to attribute CQDB. */
     uint32_t    off_labelrefs;  /* Offset to label feature references. */
     uint32_t    off_attrrefs;   /* Offset to attribute feature references. */
+    uint32_t    off_trans;      /* Offset to transition weights (version 2). */
+    uint32_t    off_state;      /* Offset to state weights (version 2). */
 } header_t;
 
 typedef struct {
@@ -88,6 +98,30 @@ typedef struct {
     uint32_t    num;            /* Number of items. */
 } feature_header_t;
 
+/*
+    Version 2 models lay the weights out for inference: the transition
+    chunk holds a dense L x L matrix of weights, and the state chunk
+    holds a run of (label, weight) pairs for every attribute.  A run with
+    as many pairs as labels is dense; its weights are indexed by labels.
+    Every section is aligned to SECTION_ALIGN bytes and stores values in
+    little-endian order, so the model is used in place on such hosts.
+ */
+typedef struct {
+    uint8_t     chunk[4];       /* Chunk id */
+    uint32_t    size;           /* Chunk size. */
+    uint32_t    num;            /* Number of attributes. */
+    uint32_t    num_entries;    /* Number of (label, weight) pairs. */
+    uint32_t    off_runs;       /* Offset to the (begin, num) array of runs. */
+    uint32_t    off_weights;    /* Offset to the weight array. */
+    uint32_t    off_labels;     /* Offset to the label array. */
+} state_header_t;
+
+typedef struct {
+    uint8_t*    data;           /* Serialized data. */
+    size_t      size;           /* Number of bytes used. */
+    size_t      cap;            /* Number of bytes allocated. */
+} membuf_t;
+
 struct tag_crf1dm {
     uint8_t*       buffer_orig;
     const uint8_t* buffer;
@@ -95,15 +129,27 @@ struct tag_crf1dm {
     header_t*      header;
     cqdb_t*        labels;
     cqdb_t*        attrs;
+    const floatval_t* trans;    /* Transition weights (version 2). */
+    const uint32_t*   runs;     /* Runs of state weights (version 2). */
+    const floatval_t* weights;  /* State weights (version 2). */
+    const int*        state_labels; /* Labels of state weights (version 2). */
 };
 
 struct tag_crf1dmw {
     FILE *fp;
+    char *filename;             /* Destination of the model. */
+    char *tmpname;              /* File being written. */
     int state;
     header_t header;
     cqdb_writer_t* dbw;
     featureref_header_t* href;
     feature_header_t* hfeat;
+    state_header_t* hstate;
+    membuf_t buf;               /* Serialized data not yet written. */
+    membuf_t labels;            /* Labels of the state chunk being written. */
+    uint32_t offset;            /* File offset of the head of the buffer. */
+    uint32_t align;             /* Alignment of chunks. */
+    int num_labels;             /* Number of labels (version 2). */
 };
 
 
@@ -117,9 +163,10 @@ enum {
     KT_FEATURE,
 };
 
-static int write_uint8(FILE *fp, uint8_t value)
+static int write_uint8(uint8_t* buffer, uint8_t value)
 {
-    return fwrite(&value, sizeof(value), 1, fp) == 1 ? 0 : 1;
+    *buffer = value;
+    return sizeof(value);
 }
 
 static int read_uint8(const uint8_t* buffer, uint8_t* value)
@@ -128,14 +175,13 @@ static int read_uint8(const uint8_t* buffer, uint8_t* value)
     return sizeof(*value);
 }
 
-static int write_uint32(FILE *fp, uint32_t value)
+static int write_uint32(uint8_t* buffer, uint32_t value)
 {
-    uint8_t buffer[4];
     buffer[0] = (uint8_t)(value & 0xFF);
     buffer[1] = (uint8_t)(value >> 8);
     buffer[2] = (uint8_t)(value >> 16);
     buffer[3] = (uint8_t)(value >> 24);
-    return fwrite(buffer, sizeof(uint8_t), 4, fp) == 4 ? 0 : 1;
+    return sizeof(value);
 }
 
 static int read_uint32(const uint8_t* buffer, uint32_t* value)
@@ -147,12 +193,14 @@ static int read_uint32(const uint8_t* buffer, uint32_t* value)
     return sizeof(*value);
 }
 
-static int write_uint8_array(FILE *fp, uint8_t *array, size_t n)
+static int write_uint8_array(uint8_t* buffer, const uint8_t *array, size_t n)
 {
     size_t i;
     int ret = 0;
     for (i = 0;i < n;++i) {
-        ret |= write_uint8(fp, array[i]);
+        int size = write_uint8(buffer, array[i]);
+        buffer += size;
+        ret += size;
     }
     return ret;
 }
@@ -169,7 +217,7 @@ static int read_uint8_array(const uint8_t* buffer, uint8_t *array, size_t n)
     return ret;
 }
 
-static void write_float(FILE *fp, floatval_t value)
+static int write_float(uint8_t* buffer, floatval_t value)
 {
     /*
         We assume:
@@ -178,7 +226,6 @@ static void write_float(FILE *fp, floatval_t value)
             - ARM's mixed-endian is not supported
     */
     uint64_t iv;
-    uint8_t buffer[8];
 
     /* Copy the memory image of floatval_t value to uint64_t. */
     memcpy(&iv, &value, sizeof(iv));
@@ -191,7 +238,7 @@ static void write_float(FILE *fp, floatval_t value)
     buffer[5] = (uint8_t)(iv >> 40);
     buffer[6] = (uint8_t)(iv >> 48);
     buffer[7] = (uint8_t)(iv >> 56);
-    fwrite(buffer, sizeof(uint8_t), 8, fp);
+    return sizeof(iv);
 }
 
 static int read_float(const uint8_t* buffer, floatval_t* value)
@@ -209,7 +256,85 @@ static int read_float(const uint8_t* buffer, floatval_t* value)
     return sizeof(*value);
 }
 
-crf1dmw_t* crf1mmw(const char *filename)
+static uint32_t header_size(const header_t* header)
+{
+    return header->version == VERSION_NUMBER_V2 ? HEADER_SIZE_V2 : HEADER_SIZE;
+}
+
+static uint8_t* membuf_reserve(membuf_t* mb, size_t size)
+{
+    uint8_t* p = NULL;
+
+    /* Expand the buffer if necessary. */
+    if (mb->cap < mb->size + size) {
+        size_t cap = mb->cap;
+        uint8_t* data = NULL;
+
+        while (cap < mb->size + size) cap = (cap + 1) * 2;
+        data = (uint8_t*)realloc(mb->data, cap);
+        if (data == NULL) {
+            return NULL;
+        }
+        mb->data = data;
+        mb->cap = cap;
+    }
+
+    p = mb->data + mb->size;
+    memset(p, 0, size);
+    mb->size += size;
+    return p;
+}
+
+static uint8_t* writer_reserve(crf1dmw_t* writer, size_t size)
+{
+    return membuf_reserve(&writer->buf, size);
+}
+
+static uint32_t writer_tell(crf1dmw_t* writer)
+{
+    return writer->offset + (uint32_t)writer->buf.size;
+}
+
+static int writer_align(crf1dmw_t* writer, uint32_t align)
+{
+    /* Pad zeros to align the current offset. */
+    uint32_t offset = writer_tell(writer);
+    if (offset % align != 0) {
+        if (writer_reserve(writer, align - offset % align) == NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int writer_flush(crf1dmw_t* writer)
+{
+    if (0 < writer->buf.size) {
+        if (fwrite(writer->buf.data, 1, writer->buf.size, writer->fp) != writer->buf.size) {
+            return 1;
+        }
+        writer->offset += (uint32_t)writer->buf.size;
+        writer->buf.size = 0;
+    }
+    return 0;
+}
+
+static void writer_delete(crf1dmw_t* writer)
+{
+    if (writer->fp != NULL) {
+        fclose(writer->fp);
+    }
+    free(writer->buf.data);
+    free(writer->labels.data);
+    free(writer->href);
+    free(writer->hfeat);
+    free(writer->hstate);
+    free(writer->tmpname);
+    free(writer->filename);
+    free(writer);
+}
+
+crf1dmw_t* crf1mmw(const char *filename, int version)
 {
     header_t *header = NULL;
     crf1dmw_t *writer = NULL;
@@ -220,8 +345,21 @@ crf1dmw_t* crf1mmw(const char *filename)
         goto error_exit;
     }
 
+    /*
+        The model is written to a temporary file next to the destination,
+        which replaces the destination only when the model is complete.
+     */
+    writer->filename = (char*)malloc(strlen(filename) + 1);
+    writer->tmpname = (char*)malloc(strlen(filename) + 5);
+    if (writer->filename == NULL || writer->tmpname == NULL) {
+        goto error_exit;
+    }
+    strcpy(writer->filename, filename);
+    strcpy(writer->tmpname, filename);
+    strcat(writer->tmpname, ".tmp");
+
     /* Open the file for writing. */
-    writer->fp = fopen(filename, "wb");
+    writer->fp = fopen(writer->tmpname, "wb");
     if (writer->fp == NULL) {
         goto error_exit;
     }
@@ -230,10 +368,16 @@ crf1dmw_t* crf1mmw(const char *filename)
     header = &writer->header;
     memcpy(header->magic, FILEMAGIC, 4);
     memcpy(header->type, MODELTYPE, 4);
-    header->version = VERSION_NUMBER;
+    if (version == 1) {
+        header->version = VERSION_NUMBER;
+        writer->align = 4;
+    } else {
+        header->version = VERSION_NUMBER_V2;
+        writer->align = SECTION_ALIGN;
+    }
 
-    /* Advance the file position to skip the file header. */
-    if (fseek(writer->fp, HEADER_SIZE, SEEK_CUR) != 0) {
+    /* Reserve the space for the file header. */
+    if (writer_reserve(writer, header_size(header)) == NULL) {
         goto error_exit;
     }
 
@@ -243,59 +387,96 @@ error_exit:
     if (writer != NULL) {
         if (writer->fp != NULL) {
             fclose(writer->fp);
+            writer->fp = NULL;
+            remove(writer->tmpname);
         }
-        free(writer);
+        writer_delete(writer);
     }
     return NULL;
 }
 
 int crf1dmw_close(crf1dmw_t* writer)
 {
-    FILE *fp = writer->fp;
+    uint8_t buffer[HEADER_SIZE_V2], *p = buffer;
     header_t *header = &writer->header;
+    const uint32_t size = header_size(header);
+
+    /* Make sure that every chunk has been closed. */
+    if (writer->state != WSTATE_NONE) {
+        goto error_exit;
+    }
+
+    /* Write the remaining data. */
+    if (writer_flush(writer)) {
+        goto error_exit;
+    }
 
     /* Store the file size. */
-    header->size = (uint32_t)ftell(fp);
+    header->size = writer_tell(writer);
+
+    /* Serialize the file header. */
+    p += write_uint8_array(p, header->magic, sizeof(header->magic));
+    p += write_uint32(p, header->size);
+    p += write_uint8_array(p, header->type, sizeof(header->type));
+    p += write_uint32(p, header->version);
+    p += write_uint32(p, header->num_features);
+    p += write_uint32(p, header->num_labels);
+    p += write_uint32(p, header->num_attrs);
+    p += write_uint32(p, header->off_features);
+    p += write_uint32(p, header->off_labels);
+    p += write_uint32(p, header->off_attrs);
+    p += write_uint32(p, header->off_labelrefs);
+    p += write_uint32(p, header->off_attrrefs);
+    if (header->version == VERSION_NUMBER_V2) {
+        p += write_uint32(p, header->off_trans);
+        p += write_uint32(p, header->off_state);
+        memset(p, 0, buffer + size - p);
+    }
 
-    /* Move the file position to the head. */
-    if (fseek(fp, 0, SEEK_SET) != 0) {
+    /* Write the file header at the head of the file. */
+    if (fseek(writer->fp, 0, SEEK_SET) != 0) {
+        goto error_exit;
+    }
+    if (fwrite(buffer, 1, size, writer->fp) != size) {
         goto error_exit;
     }
 
-    /* Write the file header. */
-    write_uint8_array(fp, header->magic, sizeof(header->magic));
-    write_uint32(fp, header->size);
-    write_uint8_array(fp, header->type, sizeof(header->type));
-    write_uint32(fp, header->version);
-    write_uint32(fp, header->num_features);
-    write_uint32(fp, header->num_labels);
-    write_uint32(fp, header->num_attrs);
-    write_uint32(fp, header->off_features);
-    write_uint32(fp, header->off_labels);
-    write_uint32(fp, header->off_attrs);
-    write_uint32(fp, header->off_labelrefs);
-    write_uint32(fp, header->off_attrrefs);
-
-    /* Check for any error occurrence. */
-    if (ferror(fp)) {
+    /* Close the file. */
+    if (fclose(writer->fp) != 0) {
+        writer->fp = NULL;
         goto error_exit;
     }
+    writer->fp = NULL;
 
-    /* Close the writer. */
-    fclose(fp);
-    free(writer);
+    /* Replace the destination with the complete model. */
+#ifdef  _WIN32
+    remove(writer->filename);
+#endif/*_WIN32*/
+    if (rename(writer->tmpname, writer->filename) != 0) {
+        goto error_exit;
+    }
+
+    writer_delete(writer);
     return 0;
 
 error_exit:
-    if (writer != NULL) {
-        if (writer->fp != NULL) {
-            fclose(writer->fp);
-        }
-        free(writer);
-    }
+    crf1dmw_abort(writer);
     return 1;
 }
 
+void crf1dmw_abort(crf1dmw_t* writer)
+{
+    if (writer->fp != NULL) {
+        fclose(writer->fp);
+        writer->fp = NULL;
+    }
+    if (writer->dbw != NULL) {
+        cqdb_writer_close(writer->dbw);
+    }
+    remove(writer->tmpname);
+    writer_delete(writer);
+}
+
 int crf1dmw_open_labels(crf1dmw_t* writer, int num_labels)
 {
     /* Check if we aren't writing anything at this moment. */
@@ -303,8 +484,16 @@ int crf1dmw_open_labels(crf1dmw_t* writer, int num_labels)
         return 1;
     }
 
+    /* The CQDB chunk is written directly to the file. */
+    if (writer->header.version == VERSION_NUMBER_V2 && writer_align(writer, SECTION_ALIGN)) {
+        return 1;
+    }
+    if (writer_flush(writer)) {
+        return 1;
+    }
+
     /* Store the current offset. */
-    writer->header.off_labels = (uint32_t)ftell(writer->fp);
+    writer->header.off_labels = writer_tell(writer);
 
     /* Open a CQDB chunk for writing. */
     writer->dbw = cqdb_writer(writer->fp, 0);
@@ -327,10 +516,12 @@ int crf1dmw_close_labels(crf1dmw_t* writer)
 
     /* Close the CQDB chunk. */
     if (cqdb_writer_close(writer->dbw)) {
+        writer->dbw = NULL;
         return 1;
     }
 
     writer->dbw = NULL;
+    writer->offset = (uint32_t)ftell(writer->fp);
     writer->state = WSTATE_NONE;
     return 0;
 }
@@ -357,8 +548,16 @@ int crf1dmw_open_attrs(crf1dmw_t* writer, int num_attrs)
         return 1;
     }
 
+    /* The CQDB chunk is written directly to the file. */
+    if (writer->header.version == VERSION_NUMBER_V2 && writer_align(writer, SECTION_ALIGN)) {
+        return 1;
+    }
+    if (writer_flush(writer)) {
+        return 1;
+    }
+
     /* Store the current offset. */
-    writer->header.off_attrs = (uint32_t)ftell(writer->fp);
+    writer->header.off_attrs = writer_tell(writer);
 
     /* Open a CQDB chunk for writing. */
     writer->dbw = cqdb_writer(writer->fp, 0);
@@ -381,10 +580,12 @@ int crf1dmw_close_attrs(crf1dmw_t* writer)
 
     /* Close the CQDB chunk. */
     if (cqdb_writer_close(writer->dbw)) {
+        writer->dbw = NULL;
         return 1;
     }
 
     writer->dbw = NULL;
+    writer->offset = (uint32_t)ftell(writer->fp);
     writer->state = WSTATE_NONE;
     return 0;
 }
@@ -404,12 +605,11 @@ int crf1dmw_put_attr(crf1dmw_t* writer, int aid, const char *value)
     return 0;
 }
 
-int crf1dmw_open_labelrefs(crf1dmw_t* writer, int num_labels)
+static int crf1dmw_open_refs(crf1dmw_t* writer, const char *chunk, int num, uint32_t *off)
 {
     uint32_t offset;
-    FILE *fp = writer->fp;
     featureref_header_t* href = NULL;
-    size_t size = CHUNK_SIZE + sizeof(uint32_t) * num_labels;
+    size_t size = CHUNK_SIZE + sizeof(uint32_t) * num;
 
     /* Check if we aren't writing anything at this moment. */
     if (writer->state != WSTATE_NONE) {
@@ -423,78 +623,68 @@ int crf1dmw_open_labelrefs(crf1dmw_t* writer, int num_labels)
     }
 
     /* Align the offset to a DWORD boundary. */
-    offset = (uint32_t)ftell(fp);
-    while (offset % 4 != 0) {
-        uint8_t c = 0;
-        fwrite(&c, sizeof(uint8_t), 1, fp);
-        ++offset;
+    if (writer_align(writer, writer->align)) {
+        free(href);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    offset = writer_tell(writer);
+
+    /* Reserve the space for the chunk header and offset array. */
+    if (writer_reserve(writer, size) == NULL) {
+        free(href);
+        return CRFSUITEERR_OUTOFMEMORY;
     }
 
     /* Store the current offset position to the file header. */
-    writer->header.off_labelrefs = offset;
-    fseek(fp, size, SEEK_CUR);
+    *off = offset;
 
     /* Fill members in the feature reference header. */
-    memcpy(href->chunk, CHUNK_LABELREF, 4);
+    memcpy(href->chunk, chunk, 4);
     href->size = 0;
-    href->num = num_labels;
+    href->num = num;
 
     writer->href = href;
-    writer->state = WSTATE_LABELREFS;
     return 0;
 }
 
-int crf1dmw_close_labelrefs(crf1dmw_t* writer)
+static int crf1dmw_close_refs(crf1dmw_t* writer, uint32_t begin)
 {
     uint32_t i;
-    FILE *fp = writer->fp;
     featureref_header_t* href = writer->href;
-    uint32_t begin = writer->header.off_labelrefs, end = 0;
-
-    /* Make sure that we are writing label feature references. */
-    if (writer->state != WSTATE_LABELREFS) {
-        return CRFSUITEERR_INTERNAL_LOGIC;
-    }
-
-    /* Store the current offset position. */
-    end = (uint32_t)ftell(fp);
+    uint8_t* p = writer->buf.data + (begin - writer->offset);
 
     /* Compute the size of this chunk. */
-    href->size = (end - begin);
+    href->size = writer_tell(writer) - begin;
 
-    /* Write the chunk header and offset array. */
-    fseek(fp, begin, SEEK_SET);
-    write_uint8_array(fp, href->chunk, 4);
-    write_uint32(fp, href->size);
-    write_uint32(fp, href->num);
+    /* Write the chunk header and offset array to the reserved space. */
+    p += write_uint8_array(p, href->chunk, 4);
+    p += write_uint32(p, href->size);
+    p += write_uint32(p, href->num);
     for (i = 0;i < href->num;++i) {
-        write_uint32(fp, href->offsets[i]);
+        p += write_uint32(p, href->offsets[i]);
     }
 
-    /* Move the file pointer to the tail. */
-    fseek(fp, end, SEEK_SET);
-
     /* Uninitialize. */
     free(href);
     writer->href = NULL;
     writer->state = WSTATE_NONE;
+
+    /* Write the chunk to the file. */
+    if (writer_flush(writer)) {
+        return CRFSUITEERR_UNKNOWN;
+    }
     return 0;
 }
 
-int crf1dmw_put_labelref(crf1dmw_t* writer, int lid, const feature_refs_t* ref, int *map)
+static int crf1dmw_put_ref(crf1dmw_t* writer, int id, const feature_refs_t* ref, int *map)
 {
     int i, fid;
-    uint32_t n = 0, offset = 0;
-    FILE *fp = writer->fp;
+    uint32_t n = 0;
+    uint8_t* p = NULL;
     featureref_header_t* href = writer->href;
 
-    /* Make sure that we are writing label feature references. */
-    if (writer->state != WSTATE_LABELREFS) {
-        return CRFSUITEERR_INTERNAL_LOGIC;
-    }
-
     /* Store the current offset to the offset array. */
-    href->offsets[lid] = ftell(fp);
+    href->offsets[id] = writer_tell(writer);
 
     /* Count the number of references to active features. */
     for (i = 0;i < ref->num_features;++i) {
@@ -502,125 +692,81 @@ int crf1dmw_put_labelref(crf1dmw_t* writer, int lid, const feature_refs_t* ref,
     }
 
     /* Write the feature reference. */
-    write_uint32(fp, (uint32_t)n);
+    p = writer_reserve(writer, sizeof(uint32_t) * (n + 1));
+    if (p == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    p += write_uint32(p, (uint32_t)n);
     for (i = 0;i < ref->num_features;++i) {
         fid = map[ref->fids[i]];
-        if (0 <= fid) write_uint32(fp, (uint32_t)fid);
+        if (0 <= fid) p += write_uint32(p, (uint32_t)fid);
     }
 
     return 0;
 }
 
-int crf1dmw_open_attrrefs(crf1dmw_t* writer, int num_attrs)
+int crf1dmw_open_labelrefs(crf1dmw_t* writer, int num_labels)
 {
-    uint32_t offset;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = NULL;
-    size_t size = CHUNK_SIZE + sizeof(uint32_t) * num_attrs;
+    int ret = crf1dmw_open_refs(
+        writer, CHUNK_LABELREF, num_labels, &writer->header.off_labelrefs);
+    if (ret == 0) {
+        writer->state = WSTATE_LABELREFS;
+    }
+    return ret;
+}
 
-    /* Check if we aren't writing anything at this moment. */
-    if (writer->state != WSTATE_NONE) {
+int crf1dmw_close_labelrefs(crf1dmw_t* writer)
+{
+    /* Make sure that we are writing label feature references. */
+    if (writer->state != WSTATE_LABELREFS) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Allocate a feature reference array. */
-    href = (featureref_header_t*)calloc(size, 1);
-    if (href == NULL) {
-        return CRFSUITEERR_OUTOFMEMORY;
-    }
+    return crf1dmw_close_refs(writer, writer->header.off_labelrefs);
+}
 
-    /* Align the offset to a DWORD boundary. */
-    offset = (uint32_t)ftell(fp);
-    while (offset % 4 != 0) {
-        uint8_t c = 0;
-        fwrite(&c, sizeof(uint8_t), 1, fp);
-        ++offset;
+int crf1dmw_put_labelref(crf1dmw_t* writer, int lid, const feature_refs_t* ref, int *map)
+{
+    /* Make sure that we are writing label feature references. */
+    if (writer->state != WSTATE_LABELREFS) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset position to the file header. */
-    writer->header.off_attrrefs = offset;
-    fseek(fp, size, SEEK_CUR);
-
-    /* Fill members in the feature reference header. */
-    memcpy(href->chunk, CHUNK_ATTRREF, 4);
-    href->size = 0;
-    href->num = num_attrs;
+    return crf1dmw_put_ref(writer, lid, ref, map);
+}
 
-    writer->href = href;
-    writer->state = WSTATE_ATTRREFS;
-    return 0;
+int crf1dmw_open_attrrefs(crf1dmw_t* writer, int num_attrs)
+{
+    int ret = crf1dmw_open_refs(
+        writer, CHUNK_ATTRREF, num_attrs, &writer->header.off_attrrefs);
+    if (ret == 0) {
+        writer->state = WSTATE_ATTRREFS;
+    }
+    return ret;
 }
 
 int crf1dmw_close_attrrefs(crf1dmw_t* writer)
 {
-    uint32_t i;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = writer->href;
-    uint32_t begin = writer->header.off_attrrefs, end = 0;
-
     /* Make sure that we are writing attribute feature references. */
     if (writer->state != WSTATE_ATTRREFS) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset position. */
-    end = (uint32_t)ftell(fp);
-
-    /* Compute the size of this chunk. */
-    href->size = (end - begin);
-
-    /* Write the chunk header and offset array. */
-    fseek(fp, begin, SEEK_SET);
-    write_uint8_array(fp, href->chunk, 4);
-    write_uint32(fp, href->size);
-    write_uint32(fp, href->num);
-    for (i = 0;i < href->num;++i) {
-        write_uint32(fp, href->offsets[i]);
-    }
-
-    /* Move the file pointer to the tail. */
-    fseek(fp, end, SEEK_SET);
-
-    /* Uninitialize. */
-    free(href);
-    writer->href = NULL;
-    writer->state = WSTATE_NONE;
-    return 0;
+    return crf1dmw_close_refs(writer, writer->header.off_attrrefs);
 }
 
 int crf1dmw_put_attrref(crf1dmw_t* writer, int aid, const feature_refs_t* ref, int *map)
 {
-    int i, fid;
-    uint32_t n = 0, offset = 0;
-    FILE *fp = writer->fp;
-    featureref_header_t* href = writer->href;
-
     /* Make sure that we are writing attribute feature references. */
     if (writer->state != WSTATE_ATTRREFS) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset to the offset array. */
-    href->offsets[aid] = ftell(fp);
-
-    /* Count the number of references to active features. */
-    for (i = 0;i < ref->num_features;++i) {
-        if (0 <= map[ref->fids[i]]) ++n;
-    }
-
-    /* Write the feature reference. */
-    write_uint32(fp, (uint32_t)n);
-    for (i = 0;i < ref->num_features;++i) {
-        fid = map[ref->fids[i]];
-        if (0 <= fid) write_uint32(fp, (uint32_t)fid);
-    }
-
-    return 0;
+    return crf1dmw_put_ref(writer, aid, ref, map);
 }
 
 int crf1dmw_open_features(crf1dmw_t* writer)
 {
-    FILE *fp = writer->fp;
     feature_header_t* hfeat = NULL;
 
     /* Check if we aren't writing anything at this moment. */
@@ -634,8 +780,12 @@ int crf1dmw_open_features(crf1dmw_t* writer)
         return CRFSUITEERR_OUTOFMEMORY;
     }
 
-    writer->header.off_features = (uint32_t)ftell(fp);
-    fseek(fp, CHUNK_SIZE, SEEK_CUR);
+    /* Reserve the space for the chunk header. */
+    writer->header.off_features = writer_tell(writer);
+    if (writer_reserve(writer, CHUNK_SIZE) == NULL) {
+        free(hfeat);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
 
     memcpy(hfeat->chunk, CHUNK_FEATURE, 4);
     writer->hfeat = hfeat;
@@ -646,40 +796,39 @@ int crf1dmw_open_features(crf1dmw_t* writer)
 
 int crf1dmw_close_features(crf1dmw_t* writer)
 {
-    FILE *fp = writer->fp;
     feature_header_t* hfeat = writer->hfeat;
-    uint32_t begin = writer->header.off_features, end = 0;
+    uint32_t begin = writer->header.off_features;
+    uint8_t* p = NULL;
 
     /* Make sure that we are writing attribute feature references. */
     if (writer->state != WSTATE_FEATURES) {
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    /* Store the current offset position. */
-    end = (uint32_t)ftell(fp);
-
     /* Compute the size of this chunk. */
-    hfeat->size = (end - begin);
-
-    /* Write the chunk header and offset array. */
-    fseek(fp, begin, SEEK_SET);
-    write_uint8_array(fp, hfeat->chunk, 4);
-    write_uint32(fp, hfeat->size);
-    write_uint32(fp, hfeat->num);
+    hfeat->size = writer_tell(writer) - begin;
 
-    /* Move the file pointer to the tail. */
-    fseek(fp, end, SEEK_SET);
+    /* Write the chunk header to the reserved space. */
+    p = writer->buf.data + (begin - writer->offset);
+    p += write_uint8_array(p, hfeat->chunk, 4);
+    p += write_uint32(p, hfeat->size);
+    p += write_uint32(p, hfeat->num);
 
     /* Uninitialize. */
     free(hfeat);
     writer->hfeat = NULL;
     writer->state = WSTATE_NONE;
+
+    /* Write the chunk to the file. */
+    if (writer_flush(writer)) {
+        return CRFSUITEERR_UNKNOWN;
+    }
     return 0;
 }
 
 int crf1dmw_put_feature(crf1dmw_t* writer, int fid, const crf1dm_feature_t* f)
 {
-    FILE *fp = writer->fp;
+    uint8_t* p = NULL;
     feature_header_t* hfeat = writer->hfeat;
 
     /* Make sure that we are writing attribute feature references. */
@@ -692,14 +841,305 @@ int crf1dmw_put_feature(crf1dmw_t* writer, int fid, const crf1dm_feature_t* f)
         return CRFSUITEERR_INTERNAL_LOGIC;
     }
 
-    write_uint32(fp, f->type);
-    write_uint32(fp, f->src);
-    write_uint32(fp, f->dst);
-    write_float(fp, f->weight);
+    p = writer_reserve(writer, FEATURE_SIZE);
+    if (p == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    p += write_uint32(p, f->type);
+    p += write_uint32(p, f->src);
+    p += write_uint32(p, f->dst);
+    p += write_float(p, f->weight);
     ++hfeat->num;
     return 0;
 }
 
+int crf1dmw_open_transitions(crf1dmw_t* writer, int num_labels)
+{
+    uint8_t* p = NULL;
+    size_t size = CHUNK_SIZE_V2 + sizeof(floatval_t) * num_labels * num_labels;
+
+    /* Check if we aren't writing anything at this moment. */
+    if (writer->state != WSTATE_NONE) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    /* Reserve the space for the chunk header and weight matrix. */
+    if (writer_align(writer, SECTION_ALIGN)) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    writer->header.off_trans = writer_tell(writer);
+    p = writer_reserve(writer, size);
+    if (p == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    /* Write the chunk header; the size of this chunk is known already. */
+    p += write_uint8_array(p, (const uint8_t*)CHUNK_TRANS, 4);
+    p += write_uint32(p, (uint32_t)size);
+    p += write_uint32(p, (uint32_t)num_labels);
+
+    writer->num_labels = num_labels;
+    writer->state = WSTATE_TRANS;
+    return 0;
+}
+
+int crf1dmw_close_transitions(crf1dmw_t* writer)
+{
+    /* Make sure that we are writing transition weights. */
+    if (writer->state != WSTATE_TRANS) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    writer->state = WSTATE_NONE;
+
+    /* Write the chunk to the file. */
+    if (writer_flush(writer)) {
+        return CRFSUITEERR_UNKNOWN;
+    }
+    return 0;
+}
+
+int crf1dmw_put_transition(crf1dmw_t* writer, int from, int to, floatval_t weight)
+{
+    const int L = writer->num_labels;
+    uint8_t* p = NULL;
+
+    /* Make sure that we are writing transition weights. */
+    if (writer->state != WSTATE_TRANS) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+    if (from < 0 || L <= from || to < 0 || L <= to) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    /* Store the weight to the element (from, to) of the matrix. */
+    p = writer->buf.data + (writer->header.off_trans - writer->offset);
+    p += CHUNK_SIZE_V2 + sizeof(floatval_t) * (from * L + to);
+    write_float(p, weight);
+    ++writer->header.num_features;
+    return 0;
+}
+
+int crf1dmw_open_states(crf1dmw_t* writer, int num_attrs, int num_labels)
+{
+    state_header_t* hstate = NULL;
+    size_t size = CHUNK_SIZE_V2 + sizeof(uint32_t) * 2 * num_attrs;
+
+    /* Check if we aren't writing anything at this moment. */
+    if (writer->state != WSTATE_NONE) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    /* Allocate a state chunk header. */
+    hstate = (state_header_t*)calloc(sizeof(state_header_t), 1);
+    if (hstate == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    /*
+        Reserve the space for the chunk header and the array of runs; the
+        weights follow the array, and the labels are kept aside until the
+        chunk is closed.
+     */
+    if (writer_align(writer, SECTION_ALIGN)) {
+        free(hstate);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    writer->header.off_state = writer_tell(writer);
+    if (writer_reserve(writer, size) == NULL ||
+        writer_align(writer, SECTION_ALIGN)) {
+        free(hstate);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    memcpy(hstate->chunk, CHUNK_STATE, 4);
+    hstate->num = num_attrs;
+    hstate->off_runs = CHUNK_SIZE_V2;
+    hstate->off_weights = writer_tell(writer) - writer->header.off_state;
+    writer->hstate = hstate;
+    writer->labels.size = 0;
+
+    writer->num_labels = num_labels;
+    writer->state = WSTATE_STATES;
+    return 0;
+}
+
+int crf1dmw_close_states(crf1dmw_t* writer)
+{
+    uint8_t* p = NULL;
+    state_header_t* hstate = writer->hstate;
+    uint32_t begin = writer->header.off_state;
+
+    /* Make sure that we are writing state weights. */
+    if (writer->state != WSTATE_STATES) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    /* Append the labels after the weights. */
+    if (writer_align(writer, SECTION_ALIGN)) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    hstate->off_labels = writer_tell(writer) - begin;
+    if (0 < writer->labels.size) {
+        p = writer_reserve(writer, writer->labels.size);
+        if (p == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        memcpy(p, writer->labels.data, writer->labels.size);
+    }
+
+    /* Compute the size of this chunk. */
+    hstate->size = writer_tell(writer) - begin;
+
+    /* Write the chunk header to the reserved space. */
+    p = writer->buf.data + (begin - writer->offset);
+    p += write_uint8_array(p, hstate->chunk, 4);
+    p += write_uint32(p, hstate->size);
+    p += write_uint32(p, hstate->num);
+    p += write_uint32(p, hstate->num_entries);
+    p += write_uint32(p, hstate->off_runs);
+    p += write_uint32(p, hstate->off_weights);
+    p += write_uint32(p, hstate->off_labels);
+
+    /* Uninitialize. */
+    free(hstate);
+    writer->hstate = NULL;
+    writer->state = WSTATE_NONE;
+
+    /* Write the chunk to the file. */
+    if (writer_flush(writer)) {
+        return CRFSUITEERR_UNKNOWN;
+    }
+    return 0;
+}
+
+int crf1dmw_put_states(crf1dmw_t* writer, int aid, const int *labels, const floatval_t *weights, int n)
+{
+    int i, num;
+    uint8_t *p = NULL, *q = NULL, *runs = NULL;
+    state_header_t* hstate = writer->hstate;
+    const int L = writer->num_labels;
+
+    /* Make sure that we are writing state weights. */
+    if (writer->state != WSTATE_STATES) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+    if (aid < 0 || hstate->num <= (uint32_t)aid) {
+        return CRFSUITEERR_INTERNAL_LOGIC;
+    }
+
+    /* Store high-fanout attributes as dense runs indexed by labels. */
+    num = (L <= 2 * n) ? L : n;
+
+    /* Store the position of the run to the array of runs. */
+    runs = writer->buf.data + (writer->header.off_state - writer->offset);
+    runs += CHUNK_SIZE_V2 + sizeof(uint32_t) * 2 * aid;
+    runs += write_uint32(runs, hstate->num_entries);
+    runs += write_uint32(runs, (uint32_t)num);
+
+    /* Reserve the space for the run (filled with zeros). */
+    p = writer_reserve(writer, sizeof(floatval_t) * num);
+    q = membuf_reserve(&writer->labels, sizeof(uint32_t) * num);
+    if (p == NULL || q == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    if (num == L) {
+        for (i = 0;i < L;++i) {
+            write_uint32(q + sizeof(uint32_t) * i, (uint32_t)i);
+        }
+        for (i = 0;i < n;++i) {
+            if (labels[i] < 0 || L <= labels[i]) {
+                return CRFSUITEERR_INTERNAL_LOGIC;
+            }
+            write_float(p + sizeof(floatval_t) * labels[i], weights[i]);
+        }
+    } else {
+        for (i = 0;i < n;++i) {
+            p += write_float(p, weights[i]);
+            q += write_uint32(q, (uint32_t)labels[i]);
+        }
+    }
+
+    hstate->num_entries += num;
+    writer->header.num_features += n;
+    return 0;
+}
+
+static int is_little_endian(void)
+{
+    const uint32_t value = 1;
+    return *(const uint8_t*)&value == 1;
+}
+
+static int crf1dm_setup_v2(crf1dm_t* model)
+{
+    uint32_t size, num, num_entries, off_runs, off_weights, off_labels;
+    const uint8_t* p = NULL;
+    const header_t* header = model->header;
+    const uint32_t L = header->num_labels;
+
+    /* The weights are used in place, which requires the byte order. */
+    if (!is_little_endian()) {
+        return 1;
+    }
+
+    /* Make an aligned copy of the model if the weights are misaligned. */
+    if ((uintptr_t)model->buffer % sizeof(floatval_t) != 0) {
+        uint8_t *buffer = NULL, *buffer_orig = NULL;
+
+        buffer = buffer_orig = (uint8_t*)malloc(model->size + SECTION_ALIGN);
+        if (buffer_orig == NULL) {
+            return 1;
+        }
+        while ((uintptr_t)buffer % SECTION_ALIGN != 0) {
+            ++buffer;
+        }
+        memcpy(buffer, model->buffer, model->size);
+        free(model->buffer_orig);
+        model->buffer_orig = buffer_orig;
+        model->buffer = buffer;
+    }
+
+    /* Locate the transition matrix. */
+    p = model->buffer + header->off_trans;
+    if (model->size < header->off_trans + CHUNK_SIZE_V2 ||
+        memcmp(p, CHUNK_TRANS, 4) != 0) {
+        return 1;
+    }
+    read_uint32(p + 4, &size);
+    read_uint32(p + 8, &num);
+    if (num != L || size < CHUNK_SIZE_V2 + sizeof(floatval_t) * L * L ||
+        model->size - header->off_trans < size) {
+        return 1;
+    }
+    model->trans = (const floatval_t*)(p + CHUNK_SIZE_V2);
+
+    /* Locate the runs, weights, and labels of state features. */
+    p = model->buffer + header->off_state;
+    if (model->size < header->off_state + CHUNK_SIZE_V2 ||
+        memcmp(p, CHUNK_STATE, 4) != 0) {
+        return 1;
+    }
+    read_uint32(p + 4, &size);
+    read_uint32(p + 8, &num);
+    read_uint32(p + 12, &num_entries);
+    read_uint32(p + 16, &off_runs);
+    read_uint32(p + 20, &off_weights);
+    read_uint32(p + 24, &off_labels);
+    if (num != header->num_attrs ||
+        model->size - header->off_state < size ||
+        size < off_runs + sizeof(uint32_t) * 2 * num ||
+        size < off_weights + sizeof(floatval_t) * num_entries ||
+        size < off_labels + sizeof(uint32_t) * num_entries) {
+        return 1;
+    }
+    model->runs = (const uint32_t*)(p + off_runs);
+    model->weights = (const floatval_t*)(p + off_weights);
+    model->state_labels = (const int*)(p + off_labels);
+    return 0;
+}
+
 static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, uint32_t size)
 {
     const uint8_t* p = NULL;
@@ -740,6 +1180,25 @@ static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, ui
     p += read_uint32(p, &header->off_attrrefs);
     model->header = header;
 
+    /* Reject files of other formats and of unknown versions. */
+    if (memcmp(header->magic, FILEMAGIC, 4) != 0) {
+        goto error_exit;
+    }
+    if (header->version != VERSION_NUMBER && header->version != VERSION_NUMBER_V2) {
+        goto error_exit;
+    }
+
+    if (header->version == VERSION_NUMBER_V2) {
+        if (model->size < HEADER_SIZE_V2) {
+            goto error_exit;
+        }
+        p += read_uint32(p, &header->off_trans);
+        p += read_uint32(p, &header->off_state);
+        if (crf1dm_setup_v2(model)) {
+            goto error_exit;
+        }
+    }
+
     model->labels = cqdb_reader(
         model->buffer + header->off_labels,
         model->size - header->off_labels
@@ -754,6 +1213,10 @@ static crf1dm_t* crf1dm_new_impl(uint8_t* buffer_orig, const uint8_t* buffer, ui
 
 error_exit:
     free(header);
+    if (model != NULL) {
+        /* The buffer may have been replaced by an aligned copy. */
+        buffer_orig = model->buffer_orig;
+    }
     free(model);
     free(buffer_orig);
     return NULL;
@@ -775,13 +1238,13 @@ crf1dm_t* crf1dm_new(const char *filename)
     size = (uint32_t)ftell(fp);
     fseek(fp, 0, SEEK_SET);
 
-    buffer = buffer_orig = (uint8_t*)malloc(size + 16);
-    if (buffer_orig = NULL) {
+    buffer = buffer_orig = (uint8_t*)malloc(size + SECTION_ALIGN);
+    if (buffer_orig == NULL) {
         goto error_exit;
     }
 
-    /* Align the buffer to 16 bytes. */
-    while ((uintptr_t)buffer % 16 != 0) {
+    /* Align the buffer to the alignment of sections. */
+    while ((uintptr_t)buffer % SECTION_ALIGN != 0) {
         ++buffer;
     }
 
@@ -877,6 +1340,13 @@ int crf1dm_get_labelref(crf1dm_t* model, int lid, feature_refs_t* ref)
     uint32_t offset;
     uint32_t num_features;
 
+    /* Version 2 models have no feature references. */
+    if (model->trans != NULL) {
+        ref->num_features = 0;
+        ref->fids = NULL;
+        return 1;
+    }
+
     p += model->header->off_labelrefs;
     p += CHUNK_SIZE;
     p += sizeof(uint32_t) * lid;
@@ -895,6 +1365,13 @@ int crf1dm_get_attrref(crf1dm_t* model, int aid, feature_refs_t* ref)
     uint32_t offset;
     uint32_t num_features;
 
+    /* Version 2 models have no feature references. */
+    if (model->trans != NULL) {
+        ref->num_features = 0;
+        ref->fids = NULL;
+        return 1;
+    }
+
     p += model->header->off_attrrefs;
     p += CHUNK_SIZE;
     p += sizeof(uint32_t) * aid;
@@ -933,6 +1410,59 @@ int crf1dm_get_feature(crf1dm_t* model, int fid, crf1dm_feature_t* f)
     return 0;
 }
 
+const floatval_t* crf1dm_get_transitions(crf1dm_t* model)
+{
+    return model->trans;
+}
+
+int crf1dm_get_states(crf1dm_t* model, int aid, const int **labels, const floatval_t **weights)
+{
+    const uint32_t* run = &model->runs[2 * aid];
+    *labels = &model->state_labels[run[0]];
+    *weights = &model->weights[run[0]];
+    return (int)run[1];
+}
+
+static void crf1dm_dump_weights(crf1dm_t* crf1dm, FILE *fp)
+{
+    int j, n;
+    uint32_t i;
+    const int *labels = NULL;
+    const floatval_t *weights = NULL;
+    const header_t* hfile = crf1dm->header;
+    const int L = (int)hfile->num_labels;
+
+    /* Dump the non-zero elements of the transition matrix. */
+    fprintf(fp, "TRANSITIONS = {\n");
+    for (i = 0;i < hfile->num_labels;++i) {
+        for (j = 0;j < L;++j) {
+            floatval_t w = crf1dm->trans[i * L + j];
+            if (w != 0.) {
+                const char *from = crf1dm_to_label(crf1dm, i);
+                const char *to = crf1dm_to_label(crf1dm, j);
+                fprintf(fp, "  (%d) %s --> %s: %f\n", FT_TRANS, from, to, w);
+            }
+        }
+    }
+    fprintf(fp, "}\n");
+    fprintf(fp, "\n");
+
+    /* Dump the non-zero state weights of the attributes. */
+    fprintf(fp, "STATE_FEATURES = {\n");
+    for (i = 0;i < hfile->num_attrs;++i) {
+        n = crf1dm_get_states(crf1dm, i, &labels, &weights);
+        for (j = 0;j < n;++j) {
+            if (weights[j] != 0.) {
+                const char *attr = crf1dm_to_attr(crf1dm, i);
+                const char *to = crf1dm_to_label(crf1dm, labels[j]);
+                fprintf(fp, "  (%d) %s --> %s: %f\n", FT_STATE, attr, to, weights[j]);
+            }
+        }
+    }
+    fprintf(fp, "}\n");
+    fprintf(fp, "\n");
+}
+
 void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
 {
     int j;
@@ -956,6 +1486,10 @@ void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
     fprintf(fp, "  off_attrs: 0x%" PRIX32 "\n", hfile->off_attrs);
     fprintf(fp, "  off_labelrefs: 0x%" PRIX32 "\n", hfile->off_labelrefs);
     fprintf(fp, "  off_attrrefs: 0x%" PRIX32 "\n", hfile->off_attrrefs);
+    if (hfile->version == VERSION_NUMBER_V2) {
+        fprintf(fp, "  off_trans: 0x%" PRIX32 "\n", hfile->off_trans);
+        fprintf(fp, "  off_state: 0x%" PRIX32 "\n", hfile->off_state);
+    }
     fprintf(fp, "}\n");
     fprintf(fp, "\n");
 
@@ -989,6 +1523,11 @@ void crf1dm_dump(crf1dm_t* crf1dm, FILE *fp)
     fprintf(fp, "}\n");
     fprintf(fp, "\n");
 
+    if (crf1dm->trans != NULL) {
+        crf1dm_dump_weights(crf1dm, fp);
+        return;
+    }
+
     /* Dump the transition features. */
     fprintf(fp, "TRANSITIONS = {\n");
     for (i = 0;i < hfile->num_labels;++i) {
@@ -44,9 +44,12 @@
 #include <crfsuite.h>
 
 #include "crf1d.h"
+#include "logging.h"
+#include "profile.h"
 
 enum {
     LEVEL_NONE = 0,
+    LEVEL_CACHED,
     LEVEL_SET,
     LEVEL_ALPHABETA,
 };
@@ -57,43 +60,96 @@ typedef struct {
     int num_labels;         /**< Number of distinct output labels (L). */
     int num_attributes;     /**< Number of distinct attributes (A). */
     int level;
+    int direct;             /**< Non-zero to use the weights of the model in place. */
+    crf1d_cache_t *cache;   /**< Result cache (NULL if disabled). */
+    crf1d_cache_key_t key;  /**< Cache key of the current instance. */
+    const crf1d_cache_entry_t *hit; /**< Cached result for the current instance. */
+    crfsuite_tagger_stats_t *stats; /**< Statistics (NULL if disabled). */
+    double inference;       /**< Seconds of the inference for the current instance. */
+    int inference_items;    /**< Number of items of the current instance (0 if not inferred yet). */
 } crf1dt_t;
 
-static void crf1dt_state_score(crf1dt_t *crf1dt, const crfsuite_instance_t *inst)
+static void crf1dt_state_score_item_direct(crf1dt_t *crf1dt, floatval_t *state, const crfsuite_attribute_t *contents, int n)
 {
-    int a, i, l, t, r, fid;
+    int i, l, r, num;
+    floatval_t value;
+    const int *labels = NULL;
+    const floatval_t *weights = NULL;
+    crf1dm_t* model = crf1dt->model;
+    const int L = crf1dt->num_labels;
+
+    /* Loop over the contents (attributes) attached to the item. */
+    for (i = 0;i < n;++i) {
+        /* Access the run of state weights associated with the attribute. */
+        num = crf1dm_get_states(model, contents[i].aid, &labels, &weights);
+        value = contents[i].value;
+
+        if (num == L) {
+            /* A dense run has the weights for all labels. */
+            for (l = 0;l < L;++l) {
+                state[l] += weights[l] * value;
+            }
+        } else {
+            for (r = 0;r < num;++r) {
+                state[labels[r]] += weights[r] * value;
+            }
+        }
+    }
+}
+
+static void crf1dt_state_score_item(crf1dt_t *crf1dt, int t, const crfsuite_attribute_t *contents, int n)
+{
+    int a, i, l, r, fid;
     crf1dm_feature_t f;
     feature_refs_t attr;
-    floatval_t value, *state = NULL;
+    floatval_t value, *state = STATE_SCORE(crf1dt->ctx, t);
     crf1dm_t* model = crf1dt->model;
-    crf1d_context_t* ctx = crf1dt->ctx;
-    const crfsuite_item_t* item = NULL;
+
+    if (crf1dt->direct) {
+        crf1dt_state_score_item_direct(crf1dt, state, contents, n);
+        return;
+    }
+
+    /* Loop over the contents (attributes) attached to the item. */
+    for (i = 0;i < n;++i) {
+        /* Access the list of state features associated with the attribute. */
+        a = contents[i].aid;
+        crf1dm_get_attrref(model, a, &attr);
+        /* A scale usually represents the atrribute frequency in the item. */
+        value = contents[i].value;
+
+        /* Loop over the state features associated with the attribute. */
+        for (r = 0;r < attr.num_features;++r) {
+            /* The state feature #(attr->fids[r]), which is represented by
+               the attribute #a, outputs the label #(f->dst). */
+            fid = crf1dm_get_featureid(&attr, r);
+            crf1dm_get_feature(model, fid, &f);
+            l = f.dst;
+            state[l] += f.weight * value;
+        }
+    }
+}
+
+static void crf1dt_state_score(crf1dt_t *crf1dt, const crfsuite_instance_t *inst)
+{
+    int t;
     const int T = inst->num_items;
-    const int L = crf1dt->num_labels;
 
     /* Loop over the items in the sequence. */
     for (t = 0;t < T;++t) {
-        item = &inst->items[t];
-        state = STATE_SCORE(ctx, t);
+        const crfsuite_item_t* item = &inst->items[t];
+        crf1dt_state_score_item(crf1dt, t, item->contents, item->num_contents);
+    }
+}
 
-        /* Loop over the contents (attributes) attached to the item. */
-        for (i = 0;i < item->num_contents;++i) {
-            /* Access the list of state features associated with the attribute. */
-            a = item->contents[i].aid;
-            crf1dm_get_attrref(model, a, &attr);
-            /* A scale usually represents the atrribute frequency in the item. */
-            value = item->contents[i].value;
-
-            /* Loop over the state features associated with the attribute. */
-            for (r = 0;r < attr.num_features;++r) {
-                /* The state feature #(attr->fids[r]), which is represented by
-                   the attribute #a, outputs the label #(f->dst). */
-                fid = crf1dm_get_featureid(&attr, r);
-                crf1dm_get_feature(model, fid, &f);
-                l = f.dst;
-                state[l] += f.weight * value;
-            }
-        }
+static void crf1dt_state_score_key(crf1dt_t *crf1dt, const crf1d_cache_key_t *key)
+{
+    int t, n = 0;
+
+    /* The key keeps the attributes of the items in order. */
+    for (t = 0;t < key->num_items;++t) {
+        crf1dt_state_score_item(crf1dt, t, &key->contents[n], key->sizes[t]);
+        n += key->sizes[t];
     }
 }
 
@@ -106,6 +162,16 @@ static void crf1dt_transition_score(crf1dt_t* crf1dt)
     crf1dm_t* model = crf1dt->model;
     crf1d_context_t* ctx = crf1dt->ctx;
     const int L = crf1dt->num_labels;
+    const floatval_t *matrix = crf1dm_get_transitions(model);
+
+    /* Copy the transition matrix stored in the model. */
+    if (matrix != NULL) {
+        for (i = 0;i < L;++i) {
+            trans = TRANS_SCORE(ctx, i);
+            memcpy(trans, &matrix[i * L], sizeof(floatval_t) * L);
+        }
+        return;
+    }
 
     /* Compute transition scores between two labels. */
     for (i = 0;i < L;++i) {
@@ -120,23 +186,86 @@ static void crf1dt_transition_score(crf1dt_t* crf1dt)
     }
 }
 
+/**
+ * Add the pending inference time of the current instance to the statistics.
+ */
+static void crf1dt_flush_stats(crf1dt_t *crf1dt)
+{
+    if (crf1dt->stats != NULL && 0 < crf1dt->inference_items) {
+        crfsuite_latency_add(
+            &crf1dt->stats->stages[CRFSUITE_STAGE_INFERENCE],
+            crf1dt->inference, crf1dt->inference_items);
+    }
+    crf1dt->inference = 0.;
+    crf1dt->inference_items = 0;
+}
+
+/**
+ * Count the items, attributes, and state features of an instance.
+ */
+static void crf1dt_count_stats(crf1dt_t *crf1dt, const crfsuite_instance_t *inst)
+{
+    int i, t;
+    const int *labels = NULL;
+    const floatval_t *weights = NULL;
+    feature_refs_t attr;
+    crfsuite_tagger_stats_t *stats = crf1dt->stats;
+
+    ++stats->num_instances;
+    stats->num_items += inst->num_items;
+    for (t = 0;t < inst->num_items;++t) {
+        const crfsuite_item_t* item = &inst->items[t];
+        stats->num_attributes += item->num_contents;
+        for (i = 0;i < item->num_contents;++i) {
+            const int a = item->contents[i].aid;
+            if (crf1dt->direct) {
+                stats->num_features += crf1dm_get_states(crf1dt->model, a, &labels, &weights);
+            } else {
+                crf1dm_get_attrref(crf1dt->model, a, &attr);
+                stats->num_features += attr.num_features;
+            }
+        }
+    }
+}
+
 static void crf1dt_set_level(crf1dt_t *crf1dt, int level)
 {
     int prev = crf1dt->level;
     crf1d_context_t* ctx = crf1dt->ctx;
+    double begin = 0.;
+
+    if (level <= prev) {
+        return;
+    }
+    if (crf1dt->stats != NULL) {
+        begin = profile_now();
+    }
 
-    if (level <= LEVEL_ALPHABETA && prev < LEVEL_ALPHABETA) {
+    if (prev == LEVEL_CACHED) {
+        /* Score the instance found in the cache on demand. */
+        crf1dc_reset(ctx, RF_STATE);
+        crf1dt_state_score_key(crf1dt, &crf1dt->key);
+    }
+
+    if (LEVEL_ALPHABETA <= level && prev < LEVEL_ALPHABETA) {
         crf1dc_exp_state(ctx);
         crf1dc_alpha_score(ctx);
         crf1dc_beta_score(ctx);
     }
 
     crf1dt->level = level;
+    if (crf1dt->stats != NULL) {
+        crf1dt->inference += profile_now() - begin;
+        crf1dt->inference_items = ctx->num_items;
+    }
 }
 
 static void crf1dt_delete(crf1dt_t* crf1dt)
 {
     /* Note: we don't own the model object (crf1t->model). */
+    free(crf1dt->stats);
+    crf1d_cache_delete(crf1dt->cache);
+    crf1d_cache_key_finish(&crf1dt->key);
     if (crf1dt->ctx != NULL) {
         crf1dc_delete(crf1dt->ctx);
         crf1dt->ctx = NULL;
@@ -153,6 +282,7 @@ static crf1dt_t *crf1dt_new(crf1dm_t* crf1dm)
         crf1dt->num_labels = crf1dm_get_num_labels(crf1dm);
         crf1dt->num_attributes = crf1dm_get_num_attrs(crf1dm);
         crf1dt->model = crf1dm;
+        crf1dt->direct = (crf1dm_get_transitions(crf1dm) != NULL);
         crf1dt->ctx = crf1dc_new(CTXF_VITERBI | CTXF_MARGINALS, crf1dt->num_labels, 0);
         if (crf1dt->ctx != NULL) {
             crf1dc_reset(crf1dt->ctx, RF_TRANS);
@@ -191,17 +321,50 @@ static int tagger_release(crfsuite_tagger_t* tagger)
     return count;
 }
 
-static int tagger_set(crfsuite_tagger_t* tagger, crfsuite_instance_t *inst)
+static int crf1dt_set(crf1dt_t* crf1dt, crfsuite_instance_t *inst)
 {
-    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
     crf1d_context_t* ctx = crf1dt->ctx;
     crf1dc_set_num_items(ctx, inst->num_items);
+    crf1dt->hit = NULL;
+
+    if (crf1dt->cache != NULL) {
+        if (crf1d_cache_key_set(&crf1dt->key, inst) != 0) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        crf1dt->hit = crf1d_cache_find(crf1dt->cache, &crf1dt->key);
+        if (crf1dt->hit != NULL) {
+            crf1dt->level = LEVEL_CACHED;
+            return 0;
+        }
+    }
+
     crf1dc_reset(crf1dt->ctx, RF_STATE);
     crf1dt_state_score(crf1dt, inst);
     crf1dt->level = LEVEL_SET;
     return 0;
 }
 
+static int tagger_set(crfsuite_tagger_t* tagger, crfsuite_instance_t *inst)
+{
+    int ret;
+    double begin;
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+
+    if (crf1dt->stats == NULL) {
+        return crf1dt_set(crf1dt, inst);
+    }
+
+    /* Measure the latency of computing the state scores. */
+    crf1dt_flush_stats(crf1dt);
+    begin = profile_now();
+    ret = crf1dt_set(crf1dt, inst);
+    crfsuite_latency_add(
+        &crf1dt->stats->stages[CRFSUITE_STAGE_SCORE],
+        profile_now() - begin, inst->num_items);
+    crf1dt_count_stats(crf1dt, inst);
+    return ret;
+}
+
 static int tagger_length(crfsuite_tagger_t* tagger)
 {
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
@@ -209,13 +372,62 @@ static int tagger_length(crfsuite_tagger_t* tagger)
     return ctx->num_items;
 }
 
+/**
+ * Store the result for the current instance to the cache.
+ */
+static void crf1dt_cache_store(crf1dt_t* crf1dt, const int *labels, floatval_t score)
+{
+    int l, t;
+    crf1d_context_t* ctx = crf1dt->ctx;
+    const int T = ctx->num_items;
+    const int L = crf1dt->num_labels;
+    crf1d_cache_entry_t* entry = crf1d_cache_insert(crf1dt->cache, &crf1dt->key);
+
+    /* Leave the result uncached when running out of memory. */
+    if (entry == NULL) {
+        return;
+    }
+
+    memcpy(entry->labels, labels, sizeof(int) * T);
+    entry->score = score;
+    if (entry->marginals != NULL) {
+        crf1dt_set_level(crf1dt, LEVEL_ALPHABETA);
+        entry->lognorm = crf1dc_lognorm(ctx);
+        for (t = 0;t < T;++t) {
+            for (l = 0;l < L;++l) {
+                entry->marginals[L*t+l] = crf1dc_marginal_point(ctx, l, t);
+            }
+        }
+    }
+    crf1dt->hit = entry;
+}
+
 static int tagger_viterbi(crfsuite_tagger_t* tagger, int *labels, floatval_t *ptr_score)
 {
     floatval_t score;
+    double begin = 0.;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
     crf1d_context_t* ctx = crf1dt->ctx;
+    const crf1d_cache_entry_t* hit = crf1dt->hit;
 
-    score = crf1dc_viterbi(ctx, labels);
+    if (crf1dt->stats != NULL) {
+        begin = profile_now();
+    }
+    if (hit != NULL) {
+        memcpy(labels, hit->labels, sizeof(int) * hit->key.num_items);
+        score = hit->score;
+    } else {
+        score = crf1dc_viterbi(ctx, labels);
+    }
+    if (crf1dt->stats != NULL) {
+        crf1dt->inference += profile_now() - begin;
+        crf1dt->inference_items = ctx->num_items;
+    }
+
+    /* Storing the marginals computes alpha/beta, which set_level() times itself. */
+    if (hit == NULL && crf1dt->cache != NULL) {
+        crf1dt_cache_store(crf1dt, labels, score);
+    }
     if (ptr_score != NULL) {
         *ptr_score = score;
     }
@@ -228,6 +440,7 @@ static int tagger_score(crfsuite_tagger_t* tagger, int *path, floatval_t *ptr_sc
     floatval_t score;
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
     crf1d_context_t* ctx = crf1dt->ctx;
+    crf1dt_set_level(crf1dt, LEVEL_SET);
     score = crf1dc_score(ctx, path);
     if (ptr_score != NULL) {
         *ptr_score = score;
@@ -238,6 +451,10 @@ static int tagger_score(crfsuite_tagger_t* tagger, int *path, floatval_t *ptr_sc
 static int tagger_lognorm(crfsuite_tagger_t* tagger, floatval_t *ptr_norm)
 {
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    if (crf1dt->hit != NULL && crf1dt->hit->marginals != NULL) {
+        *ptr_norm = crf1dt->hit->lognorm;
+        return 0;
+    }
     crf1dt_set_level(crf1dt, LEVEL_ALPHABETA);
     *ptr_norm = crf1dc_lognorm(crf1dt->ctx);
     return 0;
@@ -246,6 +463,10 @@ static int tagger_lognorm(crfsuite_tagger_t* tagger, floatval_t *ptr_norm)
 static int tagger_marginal_point(crfsuite_tagger_t *tagger, int l, int t, floatval_t *ptr_prob)
 {
     crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    if (crf1dt->hit != NULL && crf1dt->hit->marginals != NULL) {
+        *ptr_prob = crf1dt->hit->marginals[crf1dt->num_labels*t+l];
+        return 0;
+    }
     crf1dt_set_level(crf1dt, LEVEL_ALPHABETA);
     *ptr_prob = crf1dc_marginal_point(crf1dt->ctx, l, t);
     return 0;
@@ -259,6 +480,67 @@ static int tagger_marginal_path(crfsuite_tagger_t *tagger, const int *path, int
     return 0;
 }
 
+static int tagger_set_cache(crfsuite_tagger_t *tagger, int max_entries, int flags)
+{
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+
+    /* Score the current instance before its cached result goes away. */
+    if (crf1dt->level == LEVEL_CACHED) {
+        crf1dt_set_level(crf1dt, LEVEL_SET);
+    }
+    crf1dt->hit = NULL;
+
+    crf1d_cache_delete(crf1dt->cache);
+    crf1dt->cache = NULL;
+    if (0 < max_entries) {
+        crf1dt->cache = crf1d_cache_new(max_entries, crf1dt->num_labels, flags);
+        if (crf1dt->cache == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+    }
+    return 0;
+}
+
+static int tagger_cache_stats(crfsuite_tagger_t *tagger, crfsuite_cache_stats_t *stats)
+{
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    if (crf1dt->cache != NULL) {
+        crf1d_cache_stats(crf1dt->cache, stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+    return 0;
+}
+
+static int tagger_set_stats(crfsuite_tagger_t *tagger, int enable)
+{
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+
+    free(crf1dt->stats);
+    crf1dt->stats = NULL;
+    crf1dt->inference = 0.;
+    crf1dt->inference_items = 0;
+    if (enable) {
+        crf1dt->stats = (crfsuite_tagger_stats_t*)calloc(1, sizeof(crfsuite_tagger_stats_t));
+        if (crf1dt->stats == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+    }
+    return 0;
+}
+
+static int tagger_stats(crfsuite_tagger_t *tagger, crfsuite_tagger_stats_t *stats)
+{
+    crf1dt_t* crf1dt = (crf1dt_t*)tagger->internal;
+    if (crf1dt->stats != NULL) {
+        crf1dt_flush_stats(crf1dt);
+        memcpy(stats, crf1dt->stats, sizeof(*stats));
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+    return 0;
+}
+
 
 
 /*
@@ -423,6 +705,10 @@ static int model_get_tagger(crfsuite_model_t* model, crfsuite_tagger_t** ptr_tag
     tagger->lognorm = tagger_lognorm;
     tagger->marginal_point = tagger_marginal_point;
     tagger->marginal_path = tagger_marginal_path;
+    tagger->set_cache = tagger_set_cache;
+    tagger->cache_stats = tagger_cache_stats;
+    tagger->set_stats = tagger_set_stats;
+    tagger->stats = tagger_stats;
 
     *ptr_tagger = tagger;
     return 0;
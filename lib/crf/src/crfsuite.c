@@ -32,6 +32,7 @@
 
 #include <os.h>
 
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,16 +40,25 @@
 
 #include <crfsuite.h>
 #include "logging.h"
+#include "profile.h"
 
 int crf1de_create_instance(const char *iid, void **ptr);
+int crf1dl_create_instance(const char *iid, void **ptr);
 int crfsuite_dictionary_create_instance(const char *interface, void **ptr);
 int crf1m_create_instance_from_file(const char *filename, void **ptr);
 int crf1m_create_instance_from_memory(const void *data, size_t size, void **ptr);
+crfsuite_shards_t* shards_new(const char *prefix, int shard_size, int window);
+void shards_delete(crfsuite_shards_t* shards);
+int shards_put(crfsuite_shards_t* shards, const crfsuite_instance_t* inst);
+int shards_num_instances(crfsuite_shards_t* shards);
+int shards_num_items(crfsuite_shards_t* shards);
+int shards_max_items(crfsuite_shards_t* shards);
 
 int crfsuite_create_instance(const char *iid, void **ptr)
 {
     int ret = 
         crf1de_create_instance(iid, ptr) == 0 ||
+        crf1dl_create_instance(iid, ptr) == 0 ||
         crfsuite_dictionary_create_instance(iid, ptr) == 0;
 
     return ret;
@@ -116,12 +126,44 @@ void crfsuite_item_finish(crfsuite_item_t* item)
     crfsuite_item_init(item);
 }
 
+void crfsuite_item_clear(crfsuite_item_t* item)
+{
+    item->num_contents = 0;
+}
+
+static int item_reserve(crfsuite_item_t* item, int n)
+{
+    if (item->cap_contents < n) {
+        crfsuite_attribute_t* contents = (crfsuite_attribute_t*)realloc(
+            item->contents, sizeof(crfsuite_attribute_t) * n);
+        if (contents == NULL) {
+            return -1;
+        }
+        item->contents = contents;
+        item->cap_contents = n;
+    }
+    return 0;
+}
+
+/*
+ * Copy an item to another one whose memory block is reused.
+ */
+static int item_assign(crfsuite_item_t* dst, const crfsuite_item_t* src)
+{
+    if (item_reserve(dst, src->num_contents) != 0) {
+        return -1;
+    }
+    memcpy(dst->contents, src->contents, sizeof(crfsuite_attribute_t) * src->num_contents);
+    dst->num_contents = src->num_contents;
+    return 0;
+}
+
 void crfsuite_item_copy(crfsuite_item_t* dst, const crfsuite_item_t* src)
 {
     int i;
 
     dst->num_contents = src->num_contents;
-    dst->cap_contents = src->cap_contents;
+    dst->cap_contents = src->num_contents;
     dst->contents = (crfsuite_attribute_t*)calloc(dst->num_contents, sizeof(crfsuite_attribute_t));
     for (i = 0;i < dst->num_contents;++i) {
         crfsuite_attribute_copy(&dst->contents[i], &src->contents[i]);
@@ -142,9 +184,9 @@ void crfsuite_item_swap(crfsuite_item_t* x, crfsuite_item_t* y)
 int crfsuite_item_append_attribute(crfsuite_item_t* item, const crfsuite_attribute_t* cont)
 {
     if (item->cap_contents <= item->num_contents) {
-        item->cap_contents = (item->cap_contents + 1) * 2;
-        item->contents = (crfsuite_attribute_t*)realloc(
-            item->contents, sizeof(crfsuite_attribute_t) * item->cap_contents);
+        if (item_reserve(item, (item->cap_contents + 1) * 2) != 0) {
+            return -1;
+        }
     }
     crfsuite_attribute_copy(&item->contents[item->num_contents++], cont);
     return 0;
@@ -173,11 +215,15 @@ void crfsuite_instance_init_n(crfsuite_instance_t* inst, int num_items)
     inst->labels = (int*)calloc(num_items, sizeof(int));
 }
 
+/*
+ * The items in [num_items, cap_items) are initialized, and may keep the
+ * memory blocks of cleared items for reuse.
+ */
 void crfsuite_instance_finish(crfsuite_instance_t* inst)
 {
     int i;
 
-    for (i = 0;i < inst->num_items;++i) {
+    for (i = 0;i < inst->cap_items;++i) {
         crfsuite_item_finish(&inst->items[i]);
     }
     free(inst->labels);
@@ -190,7 +236,7 @@ void crfsuite_instance_copy(crfsuite_instance_t* dst, const crfsuite_instance_t*
     int i;
 
     dst->num_items = src->num_items;
-    dst->cap_items = src->cap_items;
+    dst->cap_items = src->num_items;
     dst->items = (crfsuite_item_t*)calloc(dst->num_items, sizeof(crfsuite_item_t));
     dst->labels = (int*)calloc(dst->num_items, sizeof(int));
     dst->weight = src->weight;
@@ -218,14 +264,93 @@ void crfsuite_instance_swap(crfsuite_instance_t* x, crfsuite_instance_t* y)
     y->group = tmp.group;
 }
 
+void crfsuite_instance_clear(crfsuite_instance_t* inst)
+{
+    int i;
+
+    for (i = 0;i < inst->num_items;++i) {
+        crfsuite_item_clear(&inst->items[i]);
+    }
+    inst->num_items = 0;
+    inst->weight = 1.;
+    inst->group = 0;
+}
+
+static int instance_reserve(crfsuite_instance_t* inst, int n)
+{
+    if (inst->cap_items < n) {
+        int *labels = NULL;
+        crfsuite_item_t* items = NULL;
+
+        labels = (int*)realloc(inst->labels, sizeof(int) * n);
+        if (labels == NULL) {
+            return -1;
+        }
+        inst->labels = labels;
+
+        items = (crfsuite_item_t*)realloc(inst->items, sizeof(crfsuite_item_t) * n);
+        if (items == NULL) {
+            return -1;
+        }
+        memset(items + inst->cap_items, 0, sizeof(crfsuite_item_t) * (n - inst->cap_items));
+        inst->items = items;
+        inst->cap_items = n;
+    }
+    return 0;
+}
+
+/*
+ * Copy an instance to another one whose memory blocks are reused.
+ */
+static int instance_assign(crfsuite_instance_t* dst, const crfsuite_instance_t* src)
+{
+    int i;
+
+    crfsuite_instance_clear(dst);
+    if (instance_reserve(dst, src->num_items) != 0) {
+        return -1;
+    }
+    for (i = 0;i < src->num_items;++i) {
+        if (item_assign(&dst->items[i], &src->items[i]) != 0) {
+            return -1;
+        }
+        dst->labels[i] = src->labels[i];
+        dst->num_items = i+1;
+    }
+    dst->weight = src->weight;
+    dst->group = src->group;
+    return 0;
+}
+
 int crfsuite_instance_append(crfsuite_instance_t* inst, const crfsuite_item_t* item, int label)
 {
     if (inst->cap_items <= inst->num_items) {
-        inst->cap_items = (inst->cap_items + 1) * 2;
-        inst->items = (crfsuite_item_t*)realloc(inst->items, sizeof(crfsuite_item_t) * inst->cap_items);
-        inst->labels = (int*)realloc(inst->labels, sizeof(int) * inst->cap_items);
+        if (instance_reserve(inst, (inst->cap_items + 1) * 2) != 0) {
+            return -1;
+        }
+    }
+    if (item_assign(&inst->items[inst->num_items], item) != 0) {
+        return -1;
     }
-    crfsuite_item_copy(&inst->items[inst->num_items], item);
+    inst->labels[inst->num_items] = label;
+    ++inst->num_items;
+    return 0;
+}
+
+int crfsuite_instance_append_move(crfsuite_instance_t* inst, crfsuite_item_t* item, int label)
+{
+    crfsuite_item_t* dst = NULL;
+
+    if (inst->cap_items <= inst->num_items) {
+        if (instance_reserve(inst, (inst->cap_items + 1) * 2) != 0) {
+            return -1;
+        }
+    }
+
+    /* Exchange the memory blocks of the item and the vacant slot. */
+    dst = &inst->items[inst->num_items];
+    crfsuite_item_clear(dst);
+    crfsuite_item_swap(dst, item);
     inst->labels[inst->num_items] = label;
     ++inst->num_items;
     return 0;
@@ -252,14 +377,19 @@ void crfsuite_data_init_n(crfsuite_data_t* data, int n)
     data->instances = (crfsuite_instance_t*)calloc(n, sizeof(crfsuite_instance_t));
 }
 
+/*
+ * The instances in [num_instances, cap_instances) are initialized, and may
+ * keep the memory blocks of cleared instances for reuse.
+ */
 void crfsuite_data_finish(crfsuite_data_t* data)
 {
     int i;
 
-    for (i = 0;i < data->num_instances;++i) {
+    for (i = 0;i < data->cap_instances;++i) {
         crfsuite_instance_finish(&data->instances[i]);
     }
     free(data->instances);
+    shards_delete(data->shards);
     crfsuite_data_init(data);
 }
 
@@ -268,7 +398,7 @@ void crfsuite_data_copy(crfsuite_data_t* dst, const crfsuite_data_t* src)
     int i;
 
     dst->num_instances = src->num_instances;
-    dst->cap_instances = src->cap_instances;
+    dst->cap_instances = src->num_instances;
     dst->instances = (crfsuite_instance_t*)calloc(dst->num_instances, sizeof(crfsuite_instance_t));
     for (i = 0;i < dst->num_instances;++i) {
         crfsuite_instance_copy(&dst->instances[i], &src->instances[i]);
@@ -281,27 +411,120 @@ void crfsuite_data_swap(crfsuite_data_t* x, crfsuite_data_t* y)
     x->num_instances = y->num_instances;
     x->cap_instances = y->cap_instances;
     x->instances = y->instances;
+    x->shards = y->shards;
     y->num_instances = tmp.num_instances;
     y->cap_instances = tmp.cap_instances;
     y->instances = tmp.instances;
+    y->shards = tmp.shards;
 }
 
 int  crfsuite_data_append(crfsuite_data_t* data, const crfsuite_instance_t* inst)
 {
+    if (data->shards != NULL) {
+        return shards_put(data->shards, inst);
+    }
+    if (0 < inst->num_items) {
+        if (data->cap_instances <= data->num_instances) {
+            if (crfsuite_data_reserve(data, (data->cap_instances + 1) * 2) != 0) {
+                return -1;
+            }
+        }
+        if (instance_assign(&data->instances[data->num_instances], inst) != 0) {
+            return -1;
+        }
+        ++data->num_instances;
+    }
+    return 0;
+}
+
+int  crfsuite_data_append_move(crfsuite_data_t* data, crfsuite_instance_t* inst)
+{
+    if (data->shards != NULL) {
+        int ret = shards_put(data->shards, inst);
+        crfsuite_instance_clear(inst);
+        return ret;
+    }
     if (0 < inst->num_items) {
+        crfsuite_instance_t* dst = NULL;
         if (data->cap_instances <= data->num_instances) {
-            data->cap_instances = (data->cap_instances + 1) * 2;
-            data->instances = (crfsuite_instance_t*)realloc(
-                data->instances, sizeof(crfsuite_instance_t) * data->cap_instances);
+            if (crfsuite_data_reserve(data, (data->cap_instances + 1) * 2) != 0) {
+                return -1;
+            }
+        }
+
+        /* Exchange the memory blocks of the instance and the vacant slot. */
+        dst = &data->instances[data->num_instances++];
+        crfsuite_instance_clear(dst);
+        crfsuite_instance_swap(dst, inst);
+    } else {
+        crfsuite_instance_clear(inst);
+    }
+    return 0;
+}
+
+void crfsuite_data_clear(crfsuite_data_t* data)
+{
+    int i;
+
+    for (i = 0;i < data->num_instances;++i) {
+        crfsuite_instance_clear(&data->instances[i]);
+    }
+    data->num_instances = 0;
+    shards_delete(data->shards);
+    data->shards = NULL;
+}
+
+int  crfsuite_data_reserve(crfsuite_data_t* data, int n)
+{
+    if (data->cap_instances < n) {
+        crfsuite_instance_t* instances = (crfsuite_instance_t*)realloc(
+            data->instances, sizeof(crfsuite_instance_t) * n);
+        if (instances == NULL) {
+            return -1;
         }
-        crfsuite_instance_copy(&data->instances[data->num_instances++], inst);
+        memset(instances + data->cap_instances, 0, sizeof(crfsuite_instance_t) * (n - data->cap_instances));
+        data->instances = instances;
+        data->cap_instances = n;
     }
     return 0;
 }
 
+int  crfsuite_data_stream(crfsuite_data_t* data, const char *prefix, int shard_size, int window)
+{
+    int i, ret = 0;
+    crfsuite_shards_t* shards = NULL;
+
+    if (data->shards != NULL) {
+        return -1;
+    }
+
+    shards = shards_new(prefix, shard_size, window);
+    if (shards == NULL) {
+        return -1;
+    }
+
+    /* Move the instances in the memory to the shards. */
+    for (i = 0;i < data->num_instances;++i) {
+        if (ret == 0) {
+            ret = shards_put(shards, &data->instances[i]);
+        }
+        crfsuite_instance_finish(&data->instances[i]);
+    }
+    free(data->instances);
+    data->instances = NULL;
+    data->num_instances = 0;
+    data->cap_instances = 0;
+
+    data->shards = shards;
+    return ret;
+}
+
 int crfsuite_data_maxlength(crfsuite_data_t* data)
 {
     int i, T = 0;
+    if (data->shards != NULL) {
+        T = shards_max_items(data->shards);
+    }
     for (i = 0;i < data->num_instances;++i) {
         if (T < data->instances[i].num_items) {
             T = data->instances[i].num_items;
@@ -313,12 +536,24 @@ int crfsuite_data_maxlength(crfsuite_data_t* data)
 int  crfsuite_data_totalitems(crfsuite_data_t* data)
 {
     int i, n = 0;
+    if (data->shards != NULL) {
+        n = shards_num_items(data->shards);
+    }
     for (i = 0;i < data->num_instances;++i) {
         n += data->instances[i].num_items;
     }
     return n;
 }
 
+int  crfsuite_data_totalinstances(crfsuite_data_t* data)
+{
+    int n = data->num_instances;
+    if (data->shards != NULL) {
+        n += shards_num_instances(data->shards);
+    }
+    return n;
+}
+
 static char *safe_strncpy(char *dst, const char *src, size_t n)
 {
     strncpy(dst, src, n-1);
@@ -491,6 +726,80 @@ void crfsuite_evaluation_output(crfsuite_evaluation_t* eval, crfsuite_dictionary
         );
 }
 
+static int latency_bucket(double seconds)
+{
+    const double ns = seconds * 1e9;
+    int b;
+
+    if (ns <= 1.) {
+        return 0;
+    }
+    b = (int)(log(ns) / log(2.) * 8.);
+    return (b < CRFSUITE_LATENCY_BUCKETS) ? b : CRFSUITE_LATENCY_BUCKETS-1;
+}
+
+double crfsuite_wallclock(void)
+{
+    return profile_now();
+}
+
+void crfsuite_latency_add(crfsuite_latency_t* lat, double seconds, int num_items)
+{
+    lat->seconds += seconds;
+    ++lat->num_instances;
+    ++lat->instances[latency_bucket(seconds)];
+    if (0 < num_items) {
+        lat->num_items += num_items;
+        lat->items[latency_bucket(seconds / num_items)] += num_items;
+    }
+}
+
+double crfsuite_latency_percentile(const crfsuite_latency_t* lat, double p, int per_item)
+{
+    int b;
+    long count = 0;
+    const long *hist = per_item ? lat->items : lat->instances;
+    const long n = per_item ? lat->num_items : lat->num_instances;
+    const double rank = p * n;
+
+    if (n <= 0) {
+        return 0.;
+    }
+
+    /* Find the bucket where the cumulative count reaches the rank. */
+    for (b = 0;b < CRFSUITE_LATENCY_BUCKETS-1;++b) {
+        count += hist[b];
+        if (rank <= count && 0 < count) {
+            break;
+        }
+    }
+
+    /* Return the geometric middle of the bucket. */
+    return pow(2., (b + 0.5) / 8.) * 1e-9;
+}
+
+void crfsuite_tagger_stats_merge(crfsuite_tagger_stats_t* dst, const crfsuite_tagger_stats_t* src)
+{
+    int i, b;
+
+    dst->num_instances += src->num_instances;
+    dst->num_items += src->num_items;
+    dst->num_attributes += src->num_attributes;
+    dst->num_unknown_attributes += src->num_unknown_attributes;
+    dst->num_features += src->num_features;
+    for (i = 0;i < CRFSUITE_NUM_STAGES;++i) {
+        crfsuite_latency_t* d = &dst->stages[i];
+        const crfsuite_latency_t* s = &src->stages[i];
+        d->seconds += s->seconds;
+        d->num_instances += s->num_instances;
+        d->num_items += s->num_items;
+        for (b = 0;b < CRFSUITE_LATENCY_BUCKETS;++b) {
+            d->instances[b] += s->instances[b];
+            d->items[b] += s->items[b];
+        }
+    }
+}
+
 int crfsuite_interlocked_increment(int *count)
 {
     return ++(*count);
@@ -49,6 +49,9 @@ enum {
     TRAIN_AVERAGED_PERCEPTRON,  /**< Averaged perceptron. */
     TRAIN_PASSIVE_AGGRESSIVE,
     TRAIN_AROW,
+    TRAIN_HYBRID,               /**< SGD followed by L-BFGS. */
+    TRAIN_SVRG,                 /**< Stochastic variance reduced gradient. */
+    TRAIN_L1SGD,                /**< SGD with L1 regularization (AdaGrad). */
 };
 
 struct tag_crfsuite_train_internal;
@@ -57,10 +60,22 @@ typedef struct tag_crfsuite_train_internal crfsuite_train_internal_t;
 struct tag_encoder;
 typedef struct tag_encoder encoder_t;
 
+struct tag_stream;
+typedef struct tag_stream stream_t;
+
+/**
+ * A data set for training or holdout evaluation.
+ *  The instances are read from the memory, or from the shards when the data
+ *  is stored in shards. In the latter case, an instance returned by
+ *  dataset_get() is valid only until the next call, and the instances
+ *  should be accessed sequentially in each pass.
+ */
 typedef struct {
     crfsuite_data_t *data;
     int *perm;
     int num_instances;
+    stream_t *stream;           /**< The stream of shards (NULL for the memory). */
+    unsigned int rng;           /**< The state of the random number generator for shuffling. */
 } dataset_t;
 
 void dataset_init_trainset(dataset_t *ds, crfsuite_data_t *data, int holdout);
@@ -68,6 +83,68 @@ void dataset_init_testset(dataset_t *ds, crfsuite_data_t *data, int holdout);
 void dataset_finish(dataset_t *ds);
 void dataset_shuffle(dataset_t *ds);
 crfsuite_instance_t *dataset_get(dataset_t *ds, int i);
+int dataset_maxlength(dataset_t *ds);
+
+/**
+ * \defgroup shards.c
+ */
+/** @{ */
+
+crfsuite_shards_t* shards_new(const char *prefix, int shard_size, int window);
+void shards_delete(crfsuite_shards_t* shards);
+int shards_put(crfsuite_shards_t* shards, const crfsuite_instance_t* inst);
+int shards_flush(crfsuite_shards_t* shards);
+int shards_num_instances(crfsuite_shards_t* shards);
+int shards_num_items(crfsuite_shards_t* shards);
+int shards_max_items(crfsuite_shards_t* shards);
+
+stream_t* stream_new(crfsuite_shards_t* shards, int holdout, int match);
+void stream_delete(stream_t* st);
+int stream_size(stream_t* st);
+void stream_shuffle(stream_t* st, unsigned int seed);
+crfsuite_instance_t* stream_get(stream_t* st, int i);
+
+/** @} */
+
+/**
+ * \defgroup checkpoint.c
+ */
+/** @{ */
+
+/**
+ * Checkpoints of the training state.
+ *  A training algorithm serializes its state between checkpoint_begin() and
+ *  checkpoint_commit(), which writes the state to the file in the background
+ *  and atomically replaces the previous checkpoint. When the training is
+ *  resumed, checkpoint_init() reads the state, which is available through
+ *  checkpoint_get_*() functions until the next checkpoint_begin().
+ */
+typedef struct {
+    char *filename;             /**< The checkpoint file (NULL if disabled). */
+    int period;                 /**< The number of iterations between checkpoints. */
+    int resume;                 /**< Whether the state to be resumed is read. */
+    logging_t *lg;              /**< The logging interface. */
+    void *internal;             /**< The serialized state and the writer. */
+} checkpoint_t;
+
+int checkpoint_init(checkpoint_t* ck, crfsuite_params_t *params, const char *algorithm, logging_t *lg);
+int checkpoint_written_by(crfsuite_params_t *params, const char *algorithm);
+int checkpoint_finish(checkpoint_t* ck);
+int checkpoint_due(checkpoint_t* ck, int iteration);
+int checkpoint_begin(checkpoint_t* ck);
+int checkpoint_put_int(checkpoint_t* ck, const char *name, int value);
+int checkpoint_put_float(checkpoint_t* ck, const char *name, floatval_t value);
+int checkpoint_put_ints(checkpoint_t* ck, const char *name, const int *values, int n);
+int checkpoint_put_floats(checkpoint_t* ck, const char *name, const floatval_t *values, int n);
+int checkpoint_put_dataset(checkpoint_t* ck, const dataset_t *ds);
+int checkpoint_commit(checkpoint_t* ck);
+int checkpoint_get_int(checkpoint_t* ck, const char *name, int *value);
+int checkpoint_get_float(checkpoint_t* ck, const char *name, floatval_t *value);
+int checkpoint_get_ints(checkpoint_t* ck, const char *name, int *values, int n);
+int checkpoint_get_floats(checkpoint_t* ck, const char *name, floatval_t *values, int n);
+int checkpoint_get_dataset(checkpoint_t* ck, dataset_t *ds);
+
+/** @} */
 
 typedef void (*crfsuite_encoder_features_on_path_callback)(void *instance, int fid, floatval_t value);
 
@@ -99,6 +176,8 @@ struct tag_encoder
     int num_features;
     int cap_items;
 
+    struct tag_profile *prof;   /**< The per-phase profile (NULL if disabled). */
+
     /**
      * Exchanges options.
      *  @param  self        The encoder instance.
@@ -131,6 +210,33 @@ struct tag_encoder
 
     int (*features_on_path)(encoder_t *self, const crfsuite_instance_t *inst, const int *path, crfsuite_encoder_features_on_path_callback func, void *instance);
 
+    /**
+     * Enumerates the features that the gradient of an instance involves.
+     *  These are the state features associated with the attributes in the
+     *  instance and all transition features, i.e., the weights that
+     *  objective_and_gradients() reads or updates for the instance. A
+     *  feature may be reported more than once.
+     *  @param  self        The encoder instance.
+     *  @param  inst        The instance.
+     *  @param  func        The callback function receiving a feature.
+     *  @param  instance    The pointer passed to the callback function.
+     *  @return             A status code.
+     */
+    int (*features_on_instance)(encoder_t *self, const crfsuite_instance_t *inst, crfsuite_encoder_features_on_path_callback func, void *instance);
+
+    /**
+     * Restricts the computation to the active features.
+     *  The scores and gradients computed afterwards involve only the active
+     *  state features (and all transition features); the gradients of the
+     *  other features are zero. The scores are exact as long as the weights
+     *  of the inactive features are zero.
+     *  @param  self        The encoder instance.
+     *  @param  active      The flags of the active features [K], or NULL
+     *                      to use all features.
+     *  @return             A status code.
+     */
+    int (*set_active_features)(encoder_t *self, const int *active);
+
     /**
      * Sets the feature weights (and their scale factor).
      *  @param  self        The encoder instance.
@@ -158,6 +264,28 @@ struct tag_encoder
 
     int (*save_model)(encoder_t *self, const char *filename, const floatval_t *w, logging_t *lg);
 
+    /**
+     * Initializes feature weights from an existing model.
+     *  Features are matched by their attribute and label strings; the
+     *  elements of w for features unknown to the model are left untouched.
+     *  @param  self        The encoder instance.
+     *  @param  filename    The file name of the model.
+     *  @param  w           The array of feature weights [K].
+     *  @param  lg          The logging interface.
+     *  @return             A status code.
+     */
+    int (*load_weights)(encoder_t *self, const char *filename, floatval_t *w, logging_t *lg);
+
+    /**
+     * Creates an encoder that shares the features with this encoder.
+     *  The clone has a context of its own, so that it can train a model
+     *  concurrently with this encoder; it must be released before this
+     *  encoder is.
+     *  @param  self        The initialized encoder instance.
+     *  @return             The new encoder (NULL if out of memory).
+     */
+    encoder_t* (*clone)(encoder_t *self);
+
     void (*release)(encoder_t *self);
 };
 
@@ -171,24 +299,137 @@ encoder_t *crf1d_create_encoder();
 /** @} */
 
 
+/**
+ * \defgroup holdout.c
+ */
+/** @{ */
+
+/**
+ * The performance on holdout data returned to a training algorithm.
+ */
+typedef struct {
+    floatval_t item_accuracy;   /**< Item-level accuracy. */
+    floatval_t macro_fmeasure;  /**< Macro-averaged F1 score. */
+} holdout_result_t;
+
 void holdout_evaluation(
     encoder_t *gm,
     dataset_t *testset,
     const floatval_t *w,
-    logging_t *lg
+    logging_t *lg,
+    holdout_result_t *result
     );
+
+enum {
+    EARLYSTOP_NONE = 0,
+    EARLYSTOP_ACCURACY,
+    EARLYSTOP_FMEASURE,
+};
+
+/**
+ * Early stopping on the holdout performance.
+ *  A training algorithm reports the holdout result of every iteration with
+ *  earlystop_update(), which keeps the weights of the best score and tells
+ *  when the score has not improved by more than ${early_stopping.delta}
+ *  for ${early_stopping.patience} iterations. earlystop_restore() then
+ *  copies the best weights to the output.
+ */
+typedef struct {
+    int metric;                 /**< The holdout metric (EARLYSTOP_NONE if disabled). */
+    int patience;               /**< The number of iterations to wait for an improvement. */
+    floatval_t delta;           /**< The minimum change counted as an improvement. */
+    floatval_t best_score;      /**< The best holdout score. */
+    int best_iteration;         /**< The iteration of the best holdout score. */
+    int num_waits;              /**< The number of iterations without improvement. */
+    floatval_t *best_w;         /**< The weights of the best holdout score. */
+    int num_features;           /**< The number of feature weights. */
+    logging_t *lg;              /**< The logging interface. */
+} earlystop_t;
+
+int earlystop_init(earlystop_t* es, crfsuite_params_t *params, dataset_t *testset, int K, logging_t *lg);
+void earlystop_finish(earlystop_t* es);
+int earlystop_update(earlystop_t* es, const holdout_result_t *result, const floatval_t *w, int iteration);
+void earlystop_restore(earlystop_t* es, floatval_t *w);
+
+/** @} */
     
+int crfsuite_train_run(
+    int algorithm,
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    );
+
+/**
+ * \defgroup sweep.c
+ */
+/** @{ */
+
+int sweep_run(
+    crfsuite_train_internal_t *tr,
+    crfsuite_data_t *data,
+    int holdout,
+    const floatval_t *w0,
+    crfsuite_sweep_t *settings,
+    int num_settings,
+    int num_threads,
+    floatval_t **ptr_w
+    );
+
+/** @} */
+
 int crfsuite_train_lbfgs(
     encoder_t *gm,
     dataset_t *trainset,
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     );
 
 void crfsuite_train_lbfgs_init(crfsuite_params_t* params);
 
+void crfsuite_train_hybrid_init(crfsuite_params_t* params);
+
+int crfsuite_train_hybrid(
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    );
+
+void crfsuite_train_l1sgd_init(crfsuite_params_t* params);
+
+int crfsuite_train_l1sgd(
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    );
+
+void crfsuite_train_svrg_init(crfsuite_params_t* params);
+
+int crfsuite_train_svrg(
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    );
+
 void crfsuite_train_averaged_perceptron_init(crfsuite_params_t* params);
 
 int crfsuite_train_averaged_perceptron(
@@ -197,17 +438,31 @@ int crfsuite_train_averaged_perceptron(
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     );
 
 void crfsuite_train_l2sgd_init(crfsuite_params_t* params);
 
+/**
+ * Calibrates the learning rate (eta) of SGD with ${calibration.*} parameters.
+ *  @return             The learning rate (0 if out of memory).
+ */
+floatval_t crfsuite_train_l2sgd_calibrate(
+    encoder_t *gm,
+    dataset_t *trainset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0
+    );
+
 int crfsuite_train_l2sgd(
     encoder_t *gm,
     dataset_t *trainset,
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     );
 
@@ -219,6 +474,7 @@ int crfsuite_train_passive_aggressive(
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     );
 
@@ -230,6 +486,7 @@ int crfsuite_train_arow(
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     );
 
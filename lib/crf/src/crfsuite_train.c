@@ -43,6 +43,7 @@
 #include "crfsuite_internal.h"
 #include "params.h"
 #include "logging.h"
+#include "profile.h"
 #include "crf1d.h"
 
 static crfsuite_train_internal_t* crfsuite_train_new(int ftype, int algorithm)
@@ -56,6 +57,59 @@ static crfsuite_train_internal_t* crfsuite_train_new(int ftype, int algorithm)
 
         tr->gm = crf1d_create_encoder();
         tr->gm->exchange_options(tr->gm, tr->params, 0);
+        params_add_string(
+            tr->params, "init_model", "",
+            "The model file from which the feature weights are initialized."
+            );
+        params_add_string(
+            tr->params, "checkpoint.file", "",
+            "The file to which the state of the training is saved periodically."
+            );
+        params_add_int(
+            tr->params, "checkpoint.period", 1,
+            "The number of iterations (epochs) between checkpoints."
+            );
+        params_add_int(
+            tr->params, "checkpoint.resume", 0,
+            "Resume the training from the state saved in ${checkpoint.file} (1) or not (0)."
+            );
+        params_add_float(
+            tr->params, "max_seconds", 0.,
+            "The wall-clock time limit of the training in seconds (0 for no limit);\n"
+            "the training then stores the best feature weights seen so far."
+            );
+        params_add_float(
+            tr->params, "target_loss", 0.,
+            "Report the wall-clock time when the loss reaches this value (0 for no report)."
+            );
+        params_add_string(
+            tr->params, "early_stopping", "",
+            "The holdout metric for early stopping: 'accuracy' (item accuracy),\n"
+            "'f1' (macro-average F1 score), or empty for no early stopping."
+            );
+        params_add_int(
+            tr->params, "early_stopping.patience", 5,
+            "The number of iterations (epochs) without improvement of the holdout\n"
+            "score before the training stops."
+            );
+        params_add_float(
+            tr->params, "early_stopping.delta", 0.,
+            "The minimum increase of the holdout score counted as an improvement."
+            );
+        params_add_int(
+            tr->params, "profile", 0,
+            "Measure the wall-clock time of the training phases (1), together with\n"
+            "the hardware counters of cycles and cache misses on Linux (2), or not (0)."
+            );
+        params_add_string(
+            tr->params, "profile.file", "",
+            "The file to which the profile is written as a tab-separated table."
+            );
+        params_add_string(
+            tr->params, "metrics.file", "",
+            "The file to which the metrics of every iteration are appended as JSON\n"
+            "lines (e.g., /dev/fd/3 to write them to a file descriptor)."
+            );
 
         /* Initialize parameters for the training algorithm. */
         switch (algorithm) {
@@ -74,6 +128,15 @@ static crfsuite_train_internal_t* crfsuite_train_new(int ftype, int algorithm)
         case TRAIN_AROW:
             crfsuite_train_arow_init(tr->params);
             break;
+        case TRAIN_HYBRID:
+            crfsuite_train_hybrid_init(tr->params);
+            break;
+        case TRAIN_SVRG:
+            crfsuite_train_svrg_init(tr->params);
+            break;
+        case TRAIN_L1SGD:
+            crfsuite_train_l1sgd_init(tr->params);
+            break;
         }
     }
 
@@ -117,6 +180,20 @@ static void crfsuite_train_set_message_callback(crfsuite_trainer_t* self, void *
     tr->lg->instance = instance;
 }
 
+static void crfsuite_train_set_progress_callback(crfsuite_trainer_t* self, void *instance, crfsuite_progress_callback cbp)
+{
+    crfsuite_train_internal_t *tr = (crfsuite_train_internal_t*)self->internal;
+    tr->lg->progress = cbp;
+    tr->lg->progress_instance = instance;
+}
+
+static void crfsuite_train_set_metrics_callback(crfsuite_trainer_t* self, void *instance, crfsuite_metrics_callback cbm)
+{
+    crfsuite_train_internal_t *tr = (crfsuite_train_internal_t*)self->internal;
+    tr->lg->metrics = cbm;
+    tr->lg->metrics_instance = instance;
+}
+
 static crfsuite_params_t* crfsuite_train_params(crfsuite_trainer_t* self)
 {
     crfsuite_train_internal_t *tr = (crfsuite_train_internal_t*)self->internal;
@@ -125,99 +202,318 @@ static crfsuite_params_t* crfsuite_train_params(crfsuite_trainer_t* self)
     return params;
 }
 
-static int crfsuite_train_train(
-    crfsuite_trainer_t* self,
-    const crfsuite_data_t *data,
-    const char *filename,
-    int holdout
+int crfsuite_train_run(
+    int algorithm,
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
     )
 {
-    char *algorithm = NULL;
-    crfsuite_train_internal_t *tr = (crfsuite_train_internal_t*)self->internal;
-    logging_t *lg = tr->lg;
-    encoder_t *gm = tr->gm;
-    floatval_t *w = NULL;
-    dataset_t trainset;
-    dataset_t testset;
-
-    /* Prepare the data set(s) for training (and holdout evaluation). */
-    dataset_init_trainset(&trainset, (crfsuite_data_t*)data, holdout);
-    if (0 <= holdout) {
-        dataset_init_testset(&testset, (crfsuite_data_t*)data, holdout);
-        logging(lg, "Holdout group: %d\n", holdout+1);
-        logging(lg, "\n");
-    }
-
-    /* Set the training set to the CRF, and generate features. */
-    gm->exchange_options(gm, tr->params, -1);
-    gm->initialize(gm, &trainset, lg);
+    int ret = 0;
 
-    /* Call the training algorithm. */
-    switch (tr->algorithm) {
+    switch (algorithm) {
     case TRAIN_LBFGS:
-        crfsuite_train_lbfgs(
+        ret = crfsuite_train_lbfgs(
             gm,
-            &trainset,
-            (holdout != -1 ? &testset : NULL),
-            tr->params,
+            trainset,
+            testset,
+            params,
             lg,
-            &w
+            w0,
+            ptr_w
             );
         break;
     case TRAIN_L2SGD:
-        crfsuite_train_l2sgd(
+        ret = crfsuite_train_l2sgd(
             gm,
-            &trainset,
-            (holdout != -1 ? &testset : NULL),
-            tr->params,
+            trainset,
+            testset,
+            params,
             lg,
-            &w
+            w0,
+            ptr_w
             );
         break;
     case TRAIN_AVERAGED_PERCEPTRON:
-        crfsuite_train_averaged_perceptron(
+        ret = crfsuite_train_averaged_perceptron(
             gm,
-            &trainset,
-            (holdout != -1 ? &testset : NULL),
-            tr->params,
+            trainset,
+            testset,
+            params,
             lg,
-            &w
+            w0,
+            ptr_w
             );
         break;
     case TRAIN_PASSIVE_AGGRESSIVE:
-        crfsuite_train_passive_aggressive(
+        ret = crfsuite_train_passive_aggressive(
             gm,
-            &trainset,
-            (holdout != -1 ? &testset : NULL),
-            tr->params,
+            trainset,
+            testset,
+            params,
             lg,
-            &w
+            w0,
+            ptr_w
             );
         break;
     case TRAIN_AROW:
-        crfsuite_train_arow(
+        ret = crfsuite_train_arow(
             gm,
-            &trainset,
-            (holdout != -1 ? &testset : NULL),
-            tr->params,
+            trainset,
+            testset,
+            params,
             lg,
-            &w
+            w0,
+            ptr_w
             );
         break;
+    case TRAIN_HYBRID:
+        ret = crfsuite_train_hybrid(
+            gm,
+            trainset,
+            testset,
+            params,
+            lg,
+            w0,
+            ptr_w
+            );
+        break;
+    case TRAIN_SVRG:
+        ret = crfsuite_train_svrg(
+            gm,
+            trainset,
+            testset,
+            params,
+            lg,
+            w0,
+            ptr_w
+            );
+        break;
+    case TRAIN_L1SGD:
+        ret = crfsuite_train_l1sgd(
+            gm,
+            trainset,
+            testset,
+            params,
+            lg,
+            w0,
+            ptr_w
+            );
+        break;
+    }
+
+    return ret;
+}
+
+static int crfsuite_train_train(
+    crfsuite_trainer_t* self,
+    const crfsuite_data_t *data,
+    const char *filename,
+    int holdout
+    )
+{
+    int ret = 0;
+    char *algorithm = NULL;
+    char *init_model = NULL;
+    char *profile_file = NULL;
+    char *metrics_file = NULL;
+    int profile = 0;
+    floatval_t max_seconds = 0, target_loss = 0;
+    crfsuite_train_internal_t *tr = (crfsuite_train_internal_t*)self->internal;
+    logging_t *lg = tr->lg;
+    encoder_t *gm = tr->gm;
+    floatval_t *w = NULL, *w0 = NULL;
+    profile_t *prof = NULL;
+    profile_clock_t clk;
+    dataset_t trainset;
+    dataset_t testset;
+
+    /* Start the clock for the time budget. */
+    tr->params->get_float(tr->params, "max_seconds", &max_seconds);
+    tr->params->get_float(tr->params, "target_loss", &target_loss);
+    logging_begin(lg, max_seconds, target_loss);
+
+    /* Start profiling the phases of the training if requested. */
+    tr->params->get_int(tr->params, "profile", &profile);
+    if (0 < profile) {
+        prof = profile_new(1 < profile);
+        if (prof == NULL) {
+            return CRFSUITEERR_OUTOFMEMORY;
+        }
+        if (1 < profile && prof->num_counters == 0) {
+            logging(lg, "WARNING: Hardware counters are unavailable; profiling the time only\n");
+            logging(lg, "\n");
+        }
+    }
+    lg->prof = prof;
+    gm->prof = prof;
+
+    /* Open the stream of the metrics if specified. */
+    tr->params->get_string(tr->params, "metrics.file", &metrics_file);
+    if (metrics_file != NULL && *metrics_file != '\0') {
+        lg->metrics_fp = fopen(metrics_file, "a");
+        if (lg->metrics_fp == NULL) {
+            logging(lg, "ERROR: Failed to open the metrics file: %s\n", metrics_file);
+            lg->prof = NULL;
+            gm->prof = NULL;
+            profile_delete(prof);
+            return CRFSUITEERR_INCOMPATIBLE;
+        }
+    }
+
+    /* Prepare the data set(s) for training (and holdout evaluation). */
+    dataset_init_trainset(&trainset, (crfsuite_data_t*)data, holdout);
+    if (0 <= holdout) {
+        dataset_init_testset(&testset, (crfsuite_data_t*)data, holdout);
+        logging(lg, "Holdout group: %d\n", holdout+1);
+        logging(lg, "\n");
+    }
+
+    /* Set the training set to the CRF, and generate features. */
+    gm->exchange_options(gm, tr->params, -1);
+    gm->initialize(gm, &trainset, lg);
+
+    /* Initialize the feature weights from an existing model if specified. */
+    tr->params->get_string(tr->params, "init_model", &init_model);
+    if (init_model != NULL && *init_model != '\0') {
+        w0 = (floatval_t*)calloc(gm->num_features + 1, sizeof(floatval_t));
+        if (w0 == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        PROFILE_ENTER(prof, clk);
+        ret = gm->load_weights(gm, init_model, w0, lg);
+        PROFILE_LEAVE(prof, PROFILE_IO, clk);
+        if (ret) {
+            goto error_exit;
+        }
+    }
+
+    /* Call the training algorithm. */
+    ret = crfsuite_train_run(
+        tr->algorithm,
+        gm,
+        &trainset,
+        (holdout != -1 ? &testset : NULL),
+        tr->params,
+        lg,
+        w0,
+        &w
+        );
+
+    /* Refuse to store the weights untouched by the training. */
+    if (ret == 0 && lg->stopped && lg->iterations == 0) {
+        logging(lg, "ERROR: The training stopped before completing the first iteration\n");
+        ret = CRFSUITEERR_STOPPED;
+        goto error_exit;
+    }
+
+    if (ret == 0 && 0 < target_loss && !lg->reached) {
+        logging(lg, "The target loss (%f) was not reached\n", target_loss);
+        logging(lg, "\n");
     }
 
-    /* Store the model file. */
-    if (filename != NULL && *filename != '\0') {
+    /* Store the model file (unless the training failed without weights). */
+    if (w != NULL && filename != NULL && *filename != '\0') {
+        PROFILE_ENTER(prof, clk);
         gm->save_model(gm, filename, w, lg);
+        PROFILE_LEAVE(prof, PROFILE_IO, clk);
+    }
+
+    /* Report the profile. */
+    if (prof != NULL) {
+        profile_report(prof, lg);
+        tr->params->get_string(tr->params, "profile.file", &profile_file);
+        if (profile_file != NULL && *profile_file != '\0') {
+            if (profile_dump(prof, profile_file) != 0) {
+                logging(lg, "ERROR: Failed to write the profile: %s\n", profile_file);
+            }
+        }
     }
 
+error_exit:
     if (0 <= holdout) {
         dataset_finish(&testset);
     }
     dataset_finish(&trainset);
+    lg->prof = NULL;
+    gm->prof = NULL;
+    profile_delete(prof);
+    if (lg->metrics_fp != NULL) {
+        fclose(lg->metrics_fp);
+        lg->metrics_fp = NULL;
+    }
+    free(w0);
     free(w);
 
-    return 0;
+    return ret;
+}
+
+static int crfsuite_train_sweep(
+    crfsuite_trainer_t* self,
+    const crfsuite_data_t *data,
+    const char *filename,
+    int holdout,
+    crfsuite_sweep_t *settings,
+    int num_settings,
+    int num_threads
+    )
+{
+    int ret = 0;
+    char *init_model = NULL;
+    crfsuite_train_internal_t *tr = (crfsuite_train_internal_t*)self->internal;
+    logging_t *lg = tr->lg;
+    encoder_t *gm = tr->gm;
+    floatval_t *w = NULL, *w0 = NULL;
+    dataset_t trainset;
+
+    /* The settings are selected by the holdout evaluation. */
+    if (holdout < 0) {
+        logging(lg, "ERROR: A parameter sweep requires a holdout group\n");
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+    /* Shards are read sequentially, and cannot be shared by threads. */
+    if (data->shards != NULL) {
+        logging(lg, "ERROR: A parameter sweep cannot read the data from shards\n");
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    /* Generate features once for all settings. */
+    dataset_init_trainset(&trainset, (crfsuite_data_t*)data, holdout);
+    logging(lg, "Holdout group: %d\n", holdout+1);
+    logging(lg, "\n");
+    gm->exchange_options(gm, tr->params, -1);
+    gm->initialize(gm, &trainset, lg);
+
+    /* Initialize the feature weights from an existing model if specified. */
+    tr->params->get_string(tr->params, "init_model", &init_model);
+    if (init_model != NULL && *init_model != '\0') {
+        w0 = (floatval_t*)calloc(gm->num_features + 1, sizeof(floatval_t));
+        if (w0 == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        if ((ret = gm->load_weights(gm, init_model, w0, lg))) {
+            goto error_exit;
+        }
+    }
+
+    ret = sweep_run(tr, (crfsuite_data_t*)data, holdout, w0, settings, num_settings, num_threads, &w);
+
+    /* Store the model of the best setting. */
+    if (w != NULL && filename != NULL && *filename != '\0') {
+        gm->save_model(gm, filename, w, lg);
+    }
+
+error_exit:
+    dataset_finish(&trainset);
+    free(w0);
+    free(w);
+    return ret;
 }
 
 int crf1de_create_instance(const char *interface, void **ptr)
@@ -250,6 +546,12 @@ int crf1de_create_instance(const char *interface, void **ptr)
         algorithm = TRAIN_PASSIVE_AGGRESSIVE;
     } else if (strcmp(interface, "arow") == 0) {
         algorithm = TRAIN_AROW;
+    } else if (strcmp(interface, "hybrid") == 0) {
+        algorithm = TRAIN_HYBRID;
+    } else if (strcmp(interface, "svrg") == 0) {
+        algorithm = TRAIN_SVRG;
+    } else if (strcmp(interface, "l1sgd") == 0) {
+        algorithm = TRAIN_L1SGD;
     } else {
         return 1;
     }
@@ -266,6 +568,9 @@ int crf1de_create_instance(const char *interface, void **ptr)
                 trainer->params = crfsuite_train_params;
                 trainer->set_message_callback = crfsuite_train_set_message_callback;
                 trainer->train = crfsuite_train_train;
+                trainer->set_progress_callback = crfsuite_train_set_progress_callback;
+                trainer->sweep = crfsuite_train_sweep;
+                trainer->set_metrics_callback = crfsuite_train_set_metrics_callback;
 
                 *ptr = trainer;
                 return 0;
@@ -40,10 +40,38 @@
 #include <crfsuite.h>
 #include "crfsuite_internal.h"
 
+/* The initial state of the random number generator for shuffling. */
+#define RNG_SEED    2463534242U
+
+static unsigned int dataset_random(dataset_t *ds)
+{
+    /* xorshift32; the state must not be zero. */
+    unsigned int x = ds->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ds->rng = x;
+    return x;
+}
+
+static void dataset_init_stream(dataset_t *ds, crfsuite_data_t *data, int holdout, int match)
+{
+    ds->data = data;
+    ds->perm = NULL;
+    ds->stream = stream_new(data->shards, holdout, match);
+    ds->rng = RNG_SEED;
+    ds->num_instances = (ds->stream != NULL) ? stream_size(ds->stream) : 0;
+}
+
 void dataset_init_trainset(dataset_t *ds, crfsuite_data_t *data, int holdout)
 {
     int i, n = 0;
 
+    if (data->shards != NULL) {
+        dataset_init_stream(ds, data, holdout, 0);
+        return;
+    }
+
     for (i = 0;i < data->num_instances;++i) {
         if (data->instances[i].group != holdout) {
             ++n;
@@ -53,6 +81,8 @@ void dataset_init_trainset(dataset_t *ds, crfsuite_data_t *data, int holdout)
     ds->data = data;
     ds->num_instances = n;
     ds->perm = (int*)malloc(sizeof(int) * n);
+    ds->stream = NULL;
+    ds->rng = RNG_SEED;
 
     n = 0;
     for (i = 0;i < data->num_instances;++i) {
@@ -66,6 +96,11 @@ void dataset_init_testset(dataset_t *ds, crfsuite_data_t *data, int holdout)
 {
     int i, n = 0;
 
+    if (data->shards != NULL) {
+        dataset_init_stream(ds, data, holdout, 1);
+        return;
+    }
+
     for (i = 0;i < data->num_instances;++i) {
         if (data->instances[i].group == holdout) {
             ++n;
@@ -75,6 +110,8 @@ void dataset_init_testset(dataset_t *ds, crfsuite_data_t *data, int holdout)
     ds->data = data;
     ds->num_instances = n;
     ds->perm = (int*)malloc(sizeof(int) * n);
+    ds->stream = NULL;
+    ds->rng = RNG_SEED;
 
     n = 0;
     for (i = 0;i < data->num_instances;++i) {
@@ -86,14 +123,21 @@ void dataset_init_testset(dataset_t *ds, crfsuite_data_t *data, int holdout)
 
 void dataset_finish(dataset_t *ds)
 {
+    stream_delete(ds->stream);
     free(ds->perm);
 }
 
 void dataset_shuffle(dataset_t *ds)
 {
     int i;
+
+    if (ds->stream != NULL) {
+        stream_shuffle(ds->stream, dataset_random(ds) | 1);
+        return;
+    }
+
     for (i = 0;i < ds->num_instances;++i) {
-        int j = rand() % ds->num_instances;
+        int j = (int)(dataset_random(ds) % (unsigned int)ds->num_instances);
         int tmp = ds->perm[j];
         ds->perm[j] = ds->perm[i];
         ds->perm[i] = tmp;
@@ -102,5 +146,26 @@ void dataset_shuffle(dataset_t *ds)
 
 crfsuite_instance_t *dataset_get(dataset_t *ds, int i)
 {
+    if (ds->stream != NULL) {
+        return stream_get(ds->stream, i);
+    }
     return &ds->data->instances[ds->perm[i]];
 }
+
+int dataset_maxlength(dataset_t *ds)
+{
+    int i, T = 0;
+
+    /* Avoid reading the whole stream only for the statistics. */
+    if (ds->stream != NULL) {
+        return shards_max_items(ds->data->shards);
+    }
+
+    for (i = 0;i < ds->num_instances;++i) {
+        const crfsuite_instance_t *inst = dataset_get(ds, i);
+        if (T < inst->num_items) {
+            T = inst->num_items;
+        }
+    }
+    return T;
+}
@@ -37,15 +37,19 @@
 #include <os.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <crfsuite.h>
 #include "crfsuite_internal.h"
 #include "logging.h"
+#include "profile.h"
+#include "vecmath.h"
 
 void holdout_evaluation(
     encoder_t *gm,
     dataset_t *ds,
     const floatval_t *w,
-    logging_t *lg
+    logging_t *lg,
+    holdout_result_t *result
     )
 {
     int i;
@@ -53,6 +57,9 @@ void holdout_evaluation(
     const int N = ds->num_instances;
     int *viterbi = NULL;
     int max_length = 0;
+    profile_clock_t clk;
+
+    PROFILE_ENTER(lg->prof, clk);
 
     /* Initialize the evaluation table. */
     crfsuite_evaluation_init(&eval, ds->data->labels->num(ds->data->labels));
@@ -66,6 +73,7 @@ void holdout_evaluation(
         if (max_length < inst->num_items) {
             free(viterbi);
             viterbi = (int*)malloc(sizeof(int) * inst->num_items);
+            max_length = inst->num_items;
         }
 
         gm->set_instance(gm, inst);
@@ -77,4 +85,104 @@ void holdout_evaluation(
     /* Report the performance. */
     crfsuite_evaluation_finalize(&eval);
     crfsuite_evaluation_output(&eval, ds->data->labels, lg->func, lg->instance);
+
+    /* Return the performance to the training algorithm. */
+    if (result != NULL) {
+        result->item_accuracy = eval.item_accuracy;
+        result->macro_fmeasure = eval.macro_fmeasure;
+    }
+    logging_metric_float(lg, "holdout_accuracy", eval.item_accuracy);
+    logging_metric_float(lg, "holdout_macro_f1", eval.macro_fmeasure);
+
+    crfsuite_evaluation_finish(&eval);
+    free(viterbi);
+
+    PROFILE_LEAVE(lg->prof, PROFILE_HOLDOUT, clk);
+}
+
+int earlystop_init(earlystop_t* es, crfsuite_params_t *params, dataset_t *testset, int K, logging_t *lg)
+{
+    char *metric = NULL;
+
+    memset(es, 0, sizeof(*es));
+    es->lg = lg;
+
+    params->get_string(params, "early_stopping", &metric);
+    params->get_int(params, "early_stopping.patience", &es->patience);
+    params->get_float(params, "early_stopping.delta", &es->delta);
+    if (metric == NULL || *metric == '\0') {
+        return 0;
+    } else if (strcmp(metric, "accuracy") == 0) {
+        es->metric = EARLYSTOP_ACCURACY;
+    } else if (strcmp(metric, "f1") == 0) {
+        es->metric = EARLYSTOP_FMEASURE;
+    } else {
+        logging(lg, "ERROR: Unknown metric for early stopping: %s\n", metric);
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    /* Early stopping requires a holdout data. */
+    if (testset == NULL) {
+        logging(lg, "WARNING: Early stopping is disabled without holdout data\n");
+        es->metric = EARLYSTOP_NONE;
+        return 0;
+    }
+
+    es->best_w = (floatval_t*)calloc(K, sizeof(floatval_t));
+    if (es->best_w == NULL) {
+        es->metric = EARLYSTOP_NONE;
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    es->num_features = K;
+    es->best_score = -1.;
+    return 0;
+}
+
+void earlystop_finish(earlystop_t* es)
+{
+    free(es->best_w);
+    es->best_w = NULL;
+    es->metric = EARLYSTOP_NONE;
+}
+
+int earlystop_update(earlystop_t* es, const holdout_result_t *result, const floatval_t *w, int iteration)
+{
+    floatval_t score = 0.;
+
+    if (es->metric == EARLYSTOP_NONE) {
+        return 0;
+    }
+
+    switch (es->metric) {
+    case EARLYSTOP_ACCURACY:
+        score = result->item_accuracy;
+        break;
+    case EARLYSTOP_FMEASURE:
+        score = result->macro_fmeasure;
+        break;
+    }
+
+    /* Keep the weights of the best holdout score. */
+    if (es->best_score < score) {
+        if (es->best_score + es->delta < score) {
+            es->num_waits = 0;
+        } else {
+            ++es->num_waits;
+        }
+        es->best_score = score;
+        es->best_iteration = iteration;
+        veccopy(es->best_w, w, es->num_features);
+    } else {
+        ++es->num_waits;
+    }
+
+    return (es->patience <= es->num_waits);
+}
+
+void earlystop_restore(earlystop_t* es, floatval_t *w)
+{
+    if (es->metric != EARLYSTOP_NONE && 0 < es->best_iteration) {
+        logging(es->lg, "Restoring the feature weights of iteration #%d (holdout score: %f)\n", es->best_iteration, es->best_score);
+        veccopy(w, es->best_w, es->num_features);
+    }
 }
@@ -30,15 +30,25 @@
 
 /* $Id$ */
 
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
 #include <os.h>
 
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#ifdef  HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif/*HAVE_SYS_RESOURCE_H*/
 
 #include <crfsuite.h>
 #include "logging.h"
+#include "profile.h"
 
 void logging(logging_t* lg, const char *format, ...)
 {
@@ -89,3 +99,171 @@ void logging_progress_end(logging_t* lg)
     logging_progress(lg, 100);
     logging(lg, "\n");
 }
+
+/**
+ * Start measuring the time budget of a training process.
+ */
+void logging_begin(logging_t* lg, double max_seconds, double target_loss)
+{
+    lg->wall_begin = profile_now();
+    lg->record_size = 0;
+    lg->record[0] = '\0';
+    lg->max_seconds = max_seconds;
+    lg->target_loss = target_loss;
+    lg->stopped = 0;
+    lg->reached = 0;
+    lg->iterations = 0;
+}
+
+/**
+ * Test whether the training may stop before the stopping criteria.
+ *  Training algorithms keep the best weights only when this is the case.
+ */
+int logging_stoppable(logging_t* lg)
+{
+    return (0 < lg->max_seconds || lg->progress != NULL);
+}
+
+/**
+ * Test whether the training should stop, checking the time budget.
+ *  This is cheap enough to be called for every instance.
+ */
+int logging_interrupted(logging_t* lg)
+{
+    if (!lg->stopped && 0 < lg->max_seconds) {
+        if (lg->max_seconds <= profile_now() - lg->wall_begin) {
+            logging(lg, "Time limit exceeded (%g seconds); stopping the training\n", lg->max_seconds);
+            lg->stopped = 1;
+        }
+    }
+    return lg->stopped;
+}
+
+/**
+ * Append a member to the metrics record of the current iteration.
+ *  A member that does not fit in the record is dropped.
+ */
+static void append_metric(logging_t* lg, const char *format, ...)
+{
+    int n;
+    va_list args;
+    const int avail = LOGGING_RECORD_SIZE - lg->record_size;
+
+    va_start(args, format);
+    n = vsnprintf(lg->record + lg->record_size, avail, format, args);
+    va_end(args);
+    if (0 <= n && n < avail) {
+        lg->record_size += n;
+    } else {
+        lg->record[lg->record_size] = '\0';
+    }
+}
+
+/**
+ * Test whether the metrics of iterations are recorded.
+ *  Training algorithms may skip computing metrics otherwise.
+ */
+int logging_metrics_enabled(logging_t* lg)
+{
+    return (lg->metrics != NULL || lg->metrics_fp != NULL);
+}
+
+/**
+ * Record an integer metric of the current iteration.
+ *  The metrics are emitted by logging_iteration() at the end of the iteration.
+ */
+void logging_metric_int(logging_t* lg, const char *name, int value)
+{
+    if (logging_metrics_enabled(lg)) {
+        append_metric(lg, ",\"%s\":%d", name, value);
+    }
+}
+
+/**
+ * Record a real-valued metric of the current iteration.
+ */
+void logging_metric_float(logging_t* lg, const char *name, double value)
+{
+    if (logging_metrics_enabled(lg)) {
+        if (isfinite(value)) {
+            append_metric(lg, ",\"%s\":%.10g", name, value);
+        } else {
+            append_metric(lg, ",\"%s\":null", name);
+        }
+    }
+}
+
+static long max_rss_kb(void)
+{
+#ifdef  HAVE_SYS_RESOURCE_H
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef  __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif/*__APPLE__*/
+    }
+#endif/*HAVE_SYS_RESOURCE_H*/
+    return -1;
+}
+
+/**
+ * Write the metrics of an iteration to the stream and the callback.
+ */
+static void emit_metrics(logging_t* lg, int iteration, floatval_t loss)
+{
+    char line[LOGGING_RECORD_SIZE + 256];
+    const long rss = max_rss_kb();
+    int n;
+
+    n = sprintf(line, "{\"iteration\":%d", iteration);
+    if (isfinite(loss)) {
+        n += sprintf(line + n, ",\"loss\":%.10g", loss);
+    } else {
+        n += sprintf(line + n, ",\"loss\":null");
+    }
+    n += sprintf(line + n, ",\"elapsed\":%.6f", profile_now() - lg->wall_begin);
+    if (0 <= rss) {
+        n += sprintf(line + n, ",\"max_rss_kb\":%ld", rss);
+    }
+    sprintf(line + n, "%s}", lg->record);
+    lg->record_size = 0;
+    lg->record[0] = '\0';
+
+    if (lg->metrics_fp != NULL) {
+        fprintf(lg->metrics_fp, "%s\n", line);
+        fflush(lg->metrics_fp);
+    }
+    if (lg->metrics != NULL) {
+        lg->metrics(lg->metrics_instance, line);
+    }
+}
+
+/**
+ * Report the end of an iteration to the progress callback.
+ *  @return int         Non-zero if the training should stop.
+ */
+int logging_iteration(logging_t* lg, int iteration, floatval_t loss)
+{
+    ++lg->iterations;
+    if (logging_metrics_enabled(lg)) {
+        emit_metrics(lg, iteration, loss);
+    }
+    if (0 < lg->target_loss && !lg->reached && loss <= lg->target_loss) {
+        logging(lg, "Reached the target loss (%f) in %.3f seconds\n",
+            lg->target_loss, profile_now() - lg->wall_begin);
+        lg->reached = 1;
+    }
+    if (!lg->stopped && lg->progress != NULL) {
+        crfsuite_progress_t pr;
+        pr.iteration = iteration;
+        pr.loss = loss;
+        pr.elapsed = profile_now() - lg->wall_begin;
+        if (lg->progress(lg->progress_instance, &pr) != 0) {
+            logging(lg, "Cancelled by the progress callback; stopping the training\n");
+            lg->stopped = 1;
+        }
+    }
+    return logging_interrupted(lg);
+}
@@ -33,10 +33,31 @@
 #ifndef    __LOGGING_H__
 #define    __LOGGING_H__
 
+#include <stdio.h>
+#include <time.h>
+
+#define    LOGGING_RECORD_SIZE  1024
+
 typedef struct {
     void *instance;
     crfsuite_logging_callback func;
     int percent;
+
+    void *progress_instance;
+    crfsuite_progress_callback progress;
+    double max_seconds;         /**< The time budget in seconds (0 for no limit). */
+    int stopped;                /**< Non-zero if the training was asked to stop. */
+    int iterations;             /**< The number of iterations completed in this run. */
+    double target_loss;         /**< The loss whose time is reported (0 for none). */
+    int reached;                /**< Non-zero if the target loss was reached. */
+    struct tag_profile *prof;   /**< The per-phase profile (NULL if disabled). */
+
+    void *metrics_instance;
+    crfsuite_metrics_callback metrics;
+    FILE *metrics_fp;           /**< The stream of the metrics records (NULL if disabled). */
+    double wall_begin;          /**< The monotonic clock when the training began. */
+    char record[LOGGING_RECORD_SIZE];   /**< The metrics of the current iteration. */
+    int record_size;            /**< The length of the metrics in record. */
 } logging_t;
 
 void logging(logging_t* lg, const char *format, ...);
@@ -45,4 +66,13 @@ void logging_progress_start(logging_t* lg);
 void logging_progress(logging_t* lg, int percent);
 void logging_progress_end(logging_t* lg);
 
+void logging_begin(logging_t* lg, double max_seconds, double target_loss);
+int logging_stoppable(logging_t* lg);
+int logging_interrupted(logging_t* lg);
+int logging_iteration(logging_t* lg, int iteration, floatval_t loss);
+
+int logging_metrics_enabled(logging_t* lg);
+void logging_metric_int(logging_t* lg, const char *name, int value);
+void logging_metric_float(logging_t* lg, const char *name, double value);
+
 #endif/*__LOGGING_H__*/
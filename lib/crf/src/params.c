@@ -335,3 +335,35 @@ int params_add_string(crfsuite_params_t* params, const char *name, const char *v
     par->help = mystrdup(help);
     return 0;
 }
+
+crfsuite_params_t* params_copy(crfsuite_params_t* params)
+{
+    int i;
+    params_t* src = (params_t*)params->internal;
+    crfsuite_params_t* copy = params_create_instance();
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    for (i = 0;i < src->num_params;++i) {
+        int ret = -1;
+        const param_t* par = &src->params[i];
+        switch (par->type) {
+        case PT_INT:
+            ret = params_add_int(copy, par->name, par->val_i, par->help);
+            break;
+        case PT_FLOAT:
+            ret = params_add_float(copy, par->name, par->val_f, par->help);
+            break;
+        case PT_STRING:
+            ret = params_add_string(copy, par->name, par->val_s, par->help);
+            break;
+        }
+        if (ret != 0) {
+            copy->release(copy);
+            return NULL;
+        }
+    }
+
+    return copy;
+}
@@ -37,6 +37,7 @@ crfsuite_params_t* params_create_instance();
 int params_add_int(crfsuite_params_t* params, const char *name, int value, const char *help);
 int params_add_float(crfsuite_params_t* params, const char *name, floatval_t value, const char *help);
 int params_add_string(crfsuite_params_t* params, const char *name, const char *value, const char *help);
+crfsuite_params_t* params_copy(crfsuite_params_t* params);
 
 enum {
     PARAMS_READ = -1,
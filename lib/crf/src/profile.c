@@ -0,0 +1,271 @@
+/*
+ *      Per-phase profiling of the training.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef  _WIN32
+#include <windows.h>
+#endif/*_WIN32*/
+
+#if     defined(__linux__) && defined(HAVE_LINUX_PERF_EVENT_H)
+#define USE_PERF_EVENT  1
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif/*__linux__*/
+
+#include <crfsuite.h>
+#include "logging.h"
+#include "profile.h"
+
+static const char *phase_names[PROFILE_MAX] = {
+    "state_score",
+    "exp",
+    "alpha",
+    "beta",
+    "marginals",
+    "expectation",
+    "regularization",
+    "holdout",
+    "io",
+};
+
+static const char *counter_names[PROFILE_MAX_COUNTERS] = {
+    "cycles",
+    "cache_misses",
+};
+
+/**
+ * Read the monotonic wall clock in seconds.
+ */
+double profile_now(void)
+{
+#ifdef  _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif/*_WIN32*/
+}
+
+#ifdef  USE_PERF_EVENT
+static int open_counter(unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    /* Count the events of this thread in the user space on any CPU. */
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif/*USE_PERF_EVENT*/
+
+/**
+ * Create a profile.
+ *  @param  counters    Non-zero to collect the hardware counters as well.
+ *                      The counters are unavailable (and silently omitted)
+ *                      unless the system is Linux and permits the access
+ *                      to the performance monitoring unit.
+ *  @return             The profile (NULL if out of memory).
+ */
+profile_t* profile_new(int counters)
+{
+    profile_t* prof = (profile_t*)calloc(1, sizeof(profile_t));
+    if (prof == NULL) {
+        return NULL;
+    }
+
+#ifdef  USE_PERF_EVENT
+    if (counters) {
+        static const unsigned long long configs[PROFILE_MAX_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_CACHE_MISSES,
+        };
+        int i;
+
+        /* Use the counters only if all of them are available. */
+        for (i = 0;i < PROFILE_MAX_COUNTERS;++i) {
+            prof->fds[i] = open_counter(configs[i]);
+            if (prof->fds[i] < 0) {
+                break;
+            }
+        }
+        if (i == PROFILE_MAX_COUNTERS) {
+            prof->num_counters = PROFILE_MAX_COUNTERS;
+        } else {
+            while (0 < i) {
+                close(prof->fds[--i]);
+            }
+        }
+    }
+#endif/*USE_PERF_EVENT*/
+
+    return prof;
+}
+
+void profile_delete(profile_t* prof)
+{
+    if (prof != NULL) {
+#ifdef  USE_PERF_EVENT
+        int i;
+        for (i = 0;i < prof->num_counters;++i) {
+            close(prof->fds[i]);
+        }
+#endif/*USE_PERF_EVENT*/
+        free(prof);
+    }
+}
+
+static void read_counters(profile_t* prof, unsigned long long *values)
+{
+#ifdef  USE_PERF_EVENT
+    int i;
+    for (i = 0;i < prof->num_counters;++i) {
+        if (read(prof->fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+            values[i] = 0;
+        }
+    }
+#endif/*USE_PERF_EVENT*/
+}
+
+/**
+ * Read the clock (and counters) at the beginning of a phase.
+ */
+void profile_enter(profile_t* prof, profile_clock_t *clk)
+{
+    read_counters(prof, clk->counters);
+    clk->seconds = profile_now();
+}
+
+/**
+ * Accumulate the time (and counts) elapsed since profile_enter() to a phase.
+ */
+void profile_leave(profile_t* prof, int phase, const profile_clock_t *clk)
+{
+    int i;
+    unsigned long long values[PROFILE_MAX_COUNTERS];
+
+    prof->seconds[phase] += profile_now() - clk->seconds;
+    prof->calls[phase] += 1;
+    if (0 < prof->num_counters) {
+        read_counters(prof, values);
+        for (i = 0;i < prof->num_counters;++i) {
+            prof->counters[phase][i] += values[i] - clk->counters[i];
+        }
+    }
+}
+
+const char *profile_name(int phase)
+{
+    return (0 <= phase && phase < PROFILE_MAX) ? phase_names[phase] : NULL;
+}
+
+/**
+ * Report the profile through the logging interface.
+ */
+void profile_report(profile_t* prof, logging_t *lg)
+{
+    int i, j;
+
+    logging(lg, "Profile (wall-clock seconds; holdout includes the phases it runs)\n");
+    logging(lg, "%-16s %12s %12s %12s", "phase", "calls", "seconds", "us/call");
+    for (j = 0;j < prof->num_counters;++j) {
+        logging(lg, " %16s", counter_names[j]);
+    }
+    logging(lg, "\n");
+
+    for (i = 0;i < PROFILE_MAX;++i) {
+        const double us = (0 < prof->calls[i]) ?
+            prof->seconds[i] * 1e6 / prof->calls[i] : 0.;
+        logging(lg, "%-16s %12lu %12.3f %12.3f",
+            phase_names[i], prof->calls[i], prof->seconds[i], us);
+        for (j = 0;j < prof->num_counters;++j) {
+            logging(lg, " %16llu", prof->counters[i][j]);
+        }
+        logging(lg, "\n");
+    }
+    if (prof->num_counters == 0) {
+        logging(lg, "(hardware counters unavailable or disabled)\n");
+    }
+    logging(lg, "\n");
+}
+
+/**
+ * Write the profile to a file as a tab-separated table.
+ *  The first line is the header naming the columns: phase, calls, seconds,
+ *  and the hardware counters (empty if unavailable).
+ *  @return             A status code.
+ */
+int profile_dump(profile_t* prof, const char *filename)
+{
+    int i, j;
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    fprintf(fp, "phase\tcalls\tseconds");
+    for (j = 0;j < PROFILE_MAX_COUNTERS;++j) {
+        fprintf(fp, "\t%s", counter_names[j]);
+    }
+    fprintf(fp, "\n");
+
+    for (i = 0;i < PROFILE_MAX;++i) {
+        fprintf(fp, "%s\t%lu\t%.9f", phase_names[i], prof->calls[i], prof->seconds[i]);
+        for (j = 0;j < PROFILE_MAX_COUNTERS;++j) {
+            if (j < prof->num_counters) {
+                fprintf(fp, "\t%llu", prof->counters[i][j]);
+            } else {
+                fprintf(fp, "\t");
+            }
+        }
+        fprintf(fp, "\n");
+    }
+
+    return (fclose(fp) == 0) ? 0 : CRFSUITEERR_INCOMPATIBLE;
+}
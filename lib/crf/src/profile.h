@@ -0,0 +1,95 @@
+/*
+ *      Per-phase profiling of the training.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/* $Id$ */
+
+#ifndef    __PROFILE_H__
+#define    __PROFILE_H__
+
+/**
+ * Phases of the training whose time is measured.
+ */
+enum {
+    PROFILE_STATE_SCORE = 0,    /**< Computing state and transition scores. */
+    PROFILE_EXP,                /**< Exponentiating the scores. */
+    PROFILE_ALPHA,              /**< The forward algorithm. */
+    PROFILE_BETA,               /**< The backward algorithm. */
+    PROFILE_MARGINALS,          /**< Computing the marginal probabilities. */
+    PROFILE_EXPECTATION,        /**< Scattering the expectations to gradients. */
+    PROFILE_REGULARIZATION,     /**< Applying the regularization terms. */
+    PROFILE_HOLDOUT,            /**< Holdout evaluations (including the phases they run). */
+    PROFILE_IO,                 /**< Reading and writing models and checkpoints. */
+    PROFILE_MAX,
+};
+
+/**
+ * Hardware counters collected per phase (Linux only).
+ */
+enum {
+    PROFILE_CYCLES = 0,         /**< CPU cycles in the user space. */
+    PROFILE_CACHE_MISSES,       /**< Last-level cache misses in the user space. */
+    PROFILE_MAX_COUNTERS,
+};
+
+/**
+ * A reading of the clock (and counters) at the beginning of a phase.
+ */
+typedef struct {
+    double seconds;
+    unsigned long long counters[PROFILE_MAX_COUNTERS];
+} profile_clock_t;
+
+/**
+ * The accumulated profile of a training process.
+ *  A profile is not thread-safe; encoders cloned for concurrent training
+ *  do not profile.
+ */
+typedef struct tag_profile {
+    int num_counters;           /**< The number of the hardware counters opened. */
+    int fds[PROFILE_MAX_COUNTERS];  /**< The file descriptors of the counters. */
+    double seconds[PROFILE_MAX];    /**< The wall-clock time of the phases. */
+    unsigned long calls[PROFILE_MAX];   /**< The number of calls of the phases. */
+    unsigned long long counters[PROFILE_MAX][PROFILE_MAX_COUNTERS];
+} profile_t;
+
+#define    PROFILE_ENTER(prof, clk) \
+    do { if ((prof) != NULL) profile_enter((prof), &(clk)); } while (0)
+#define    PROFILE_LEAVE(prof, phase, clk) \
+    do { if ((prof) != NULL) profile_leave((prof), (phase), &(clk)); } while (0)
+
+double profile_now(void);
+profile_t* profile_new(int counters);
+void profile_delete(profile_t* prof);
+void profile_enter(profile_t* prof, profile_clock_t *clk);
+void profile_leave(profile_t* prof, int phase, const profile_clock_t *clk);
+const char *profile_name(int phase);
+void profile_report(profile_t* prof, logging_t *lg);
+int profile_dump(profile_t* prof, const char *filename);
+
+#endif/*__PROFILE_H__*/
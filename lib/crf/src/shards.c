@@ -0,0 +1,653 @@
+/*
+ *      Data sets streamed from binary shards on disk.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef    HAVE_POSIX_FADVISE
+#include <fcntl.h>
+#endif/*HAVE_POSIX_FADVISE*/
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+
+/*
+ * A shard is a file storing a sequence of instance records. A record
+ * consists of a header (the size of the payload and the group number of
+ * the instance) followed by the payload (the number of items, the weight,
+ * and the labels and attributes of the items). Shards are temporary files
+ * read by the process that wrote them, and thus, the values are stored in
+ * the native byte order.
+ *
+ * A stream reads the shards sequentially in each pass over the data. When
+ * shuffled, it visits the shards in a random order, and draws instances
+ * randomly from a window of instances read ahead from the shards. This
+ * keeps the memory usage proportional to the window size rather than to
+ * the size of the data set.
+ */
+
+struct tag_crfsuite_shards {
+    char *prefix;           /**< The prefix of the shard files. */
+    int shard_size;         /**< The maximum number of instances in a shard. */
+    int window;             /**< The size of the window for shuffling. */
+
+    int num_shards;         /**< The number of shard files. */
+    FILE *fp;               /**< The shard being written (NULL if none). */
+    int num_written;        /**< The number of instances in the shard being written. */
+
+    int num_instances;      /**< The number of instances. */
+    int num_items;          /**< The total number of items. */
+    int max_items;          /**< The maximum number of items in an instance. */
+    int *group_counts;      /**< The number of instances in each group. */
+    int num_groups;         /**< The size of group_counts. */
+
+    char *buffer;           /**< The buffer for encoding a record. */
+    size_t cap_buffer;      /**< The size of the buffer. */
+};
+
+struct tag_stream {
+    crfsuite_shards_t *shards;
+    int holdout;            /**< The group number for the filter. */
+    int match;              /**< Read the instances in (1) or not in (0) the group. */
+    int num_instances;      /**< The number of instances in a pass. */
+
+    int *order;             /**< The order of shards in the current pass. */
+    int shard;              /**< The position in order of the shard being read. */
+    FILE *fp;               /**< The shard being read (NULL if none). */
+
+    char *buffer;           /**< The buffer for decoding a record. */
+    size_t cap_buffer;      /**< The size of the buffer. */
+
+    crfsuite_instance_t *window;    /**< The instances read ahead. */
+    int num_window;         /**< The number of instances in the window. */
+    int cap_window;         /**< The size of the window. */
+    crfsuite_instance_t cur;        /**< The instance returned last. */
+    int next;               /**< The number of instances returned in this pass. */
+
+    int shuffled;           /**< Whether the stream is shuffled. */
+    unsigned int seed;      /**< The seed of random numbers for this pass. */
+    unsigned int rng;       /**< The state of the random number generator. */
+};
+
+#define    SHARD_IO_BUFFER     (1 << 20)
+
+static char *shard_filename(const crfsuite_shards_t* shards, int i)
+{
+    char *filename = (char*)malloc(strlen(shards->prefix) + 32);
+    if (filename != NULL) {
+        sprintf(filename, "%s.%05d.shard", shards->prefix, i);
+    }
+    return filename;
+}
+
+static int reserve_buffer(char **ptr_buffer, size_t *ptr_cap, size_t size)
+{
+    if (*ptr_cap < size) {
+        size_t cap = (*ptr_cap + 1) * 2;
+        char *buffer = NULL;
+        if (cap < size) {
+            cap = size;
+        }
+        buffer = (char*)realloc(*ptr_buffer, cap);
+        if (buffer == NULL) {
+            return -1;
+        }
+        *ptr_buffer = buffer;
+        *ptr_cap = cap;
+    }
+    return 0;
+}
+
+static char *put_int(char *p, int value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+static char *put_float(char *p, floatval_t value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+static const char *get_int(const char *p, int *value)
+{
+    memcpy(value, p, sizeof(*value));
+    return p + sizeof(*value);
+}
+
+static const char *get_float(const char *p, floatval_t *value)
+{
+    memcpy(value, p, sizeof(*value));
+    return p + sizeof(*value);
+}
+
+crfsuite_shards_t* shards_new(const char *prefix, int shard_size, int window)
+{
+    crfsuite_shards_t* shards = (crfsuite_shards_t*)calloc(1, sizeof(crfsuite_shards_t));
+
+    if (shards != NULL) {
+        shards->prefix = (char*)malloc(strlen(prefix) + 1);
+        if (shards->prefix == NULL) {
+            free(shards);
+            return NULL;
+        }
+        strcpy(shards->prefix, prefix);
+        shards->shard_size = (0 < shard_size) ? shard_size : 1;
+        shards->window = (0 < window) ? window : 1;
+    }
+    return shards;
+}
+
+void shards_delete(crfsuite_shards_t* shards)
+{
+    int i;
+
+    if (shards != NULL) {
+        shards_flush(shards);
+
+        /* Remove the shard files. */
+        for (i = 0;i < shards->num_shards;++i) {
+            char *filename = shard_filename(shards, i);
+            if (filename != NULL) {
+                remove(filename);
+                free(filename);
+            }
+        }
+
+        free(shards->buffer);
+        free(shards->group_counts);
+        free(shards->prefix);
+        free(shards);
+    }
+}
+
+int shards_put(crfsuite_shards_t* shards, const crfsuite_instance_t* inst)
+{
+    int t, c;
+    char *p = NULL;
+    size_t size = 0;
+
+    if (inst->num_items <= 0) {
+        return 0;
+    }
+
+    /* Open a new shard if necessary. */
+    if (shards->fp == NULL) {
+        char *filename = shard_filename(shards, shards->num_shards);
+        if (filename == NULL) {
+            return -1;
+        }
+        shards->fp = fopen(filename, "wb");
+        free(filename);
+        if (shards->fp == NULL) {
+            return -1;
+        }
+        shards->num_written = 0;
+        ++shards->num_shards;
+    }
+
+    /* Count the group of the instance. */
+    if (0 <= inst->group && shards->num_groups <= inst->group) {
+        int n = inst->group + 1;
+        int *counts = (int*)realloc(shards->group_counts, sizeof(int) * n);
+        if (counts == NULL) {
+            return -1;
+        }
+        memset(counts + shards->num_groups, 0, sizeof(int) * (n - shards->num_groups));
+        shards->group_counts = counts;
+        shards->num_groups = n;
+    }
+
+    /* Compute the size of the record. */
+    size = sizeof(int) * 2 + sizeof(int) + sizeof(floatval_t);
+    for (t = 0;t < inst->num_items;++t) {
+        size += sizeof(int) * 2;
+        size += (sizeof(int) + sizeof(floatval_t)) * inst->items[t].num_contents;
+    }
+    if (reserve_buffer(&shards->buffer, &shards->cap_buffer, size) != 0) {
+        return -1;
+    }
+
+    /* Encode the instance. */
+    p = shards->buffer;
+    p = put_int(p, (int)(size - sizeof(int) * 2));
+    p = put_int(p, inst->group);
+    p = put_int(p, inst->num_items);
+    p = put_float(p, inst->weight);
+    for (t = 0;t < inst->num_items;++t) {
+        const crfsuite_item_t* item = &inst->items[t];
+        p = put_int(p, inst->labels[t]);
+        p = put_int(p, item->num_contents);
+        for (c = 0;c < item->num_contents;++c) {
+            p = put_int(p, item->contents[c].aid);
+            p = put_float(p, item->contents[c].value);
+        }
+    }
+
+    if (fwrite(shards->buffer, 1, size, shards->fp) != size) {
+        return -1;
+    }
+
+    /* Update the statistics. */
+    ++shards->num_instances;
+    shards->num_items += inst->num_items;
+    if (shards->max_items < inst->num_items) {
+        shards->max_items = inst->num_items;
+    }
+    if (0 <= inst->group) {
+        ++shards->group_counts[inst->group];
+    }
+
+    /* Close the shard when it is full. */
+    if (shards->shard_size <= ++shards->num_written) {
+        return shards_flush(shards);
+    }
+    return 0;
+}
+
+int shards_flush(crfsuite_shards_t* shards)
+{
+    int ret = 0;
+
+    if (shards->fp != NULL) {
+        ret = (fclose(shards->fp) == 0) ? 0 : -1;
+        shards->fp = NULL;
+    }
+    return ret;
+}
+
+int shards_num_instances(crfsuite_shards_t* shards)
+{
+    return shards->num_instances;
+}
+
+int shards_num_items(crfsuite_shards_t* shards)
+{
+    return shards->num_items;
+}
+
+int shards_max_items(crfsuite_shards_t* shards)
+{
+    return shards->max_items;
+}
+
+static unsigned int stream_random(stream_t* st)
+{
+    /* xorshift32; the state must not be zero. */
+    unsigned int x = st->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    st->rng = x;
+    return x;
+}
+
+static void stream_close_shard(stream_t* st)
+{
+    if (st->fp != NULL) {
+        fclose(st->fp);
+        st->fp = NULL;
+    }
+}
+
+/**
+ * Open the shard at the current position of the shard order.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+static int stream_open_shard(stream_t* st)
+{
+    char *filename = shard_filename(st->shards, st->order[st->shard]);
+
+    if (filename == NULL) {
+        return -1;
+    }
+    st->fp = fopen(filename, "rb");
+    free(filename);
+    if (st->fp == NULL) {
+        return -1;
+    }
+    setvbuf(st->fp, NULL, _IOFBF, SHARD_IO_BUFFER);
+
+#ifdef    HAVE_POSIX_FADVISE
+    /* Ask the system to read this shard sequentially, and the next one ahead. */
+    posix_fadvise(fileno(st->fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (st->shard + 1 < st->shards->num_shards) {
+        FILE *fp = NULL;
+        filename = shard_filename(st->shards, st->order[st->shard + 1]);
+        if (filename != NULL) {
+            fp = fopen(filename, "rb");
+            free(filename);
+        }
+        if (fp != NULL) {
+            posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_WILLNEED);
+            fclose(fp);
+        }
+    }
+#endif/*HAVE_POSIX_FADVISE*/
+
+    return 0;
+}
+
+static int reserve_instance(crfsuite_instance_t* inst, int num_items)
+{
+    if (inst->cap_items < num_items) {
+        crfsuite_item_t* items = NULL;
+        int *labels = NULL;
+
+        labels = (int*)realloc(inst->labels, sizeof(int) * num_items);
+        if (labels == NULL) {
+            return -1;
+        }
+        inst->labels = labels;
+
+        items = (crfsuite_item_t*)realloc(inst->items, sizeof(crfsuite_item_t) * num_items);
+        if (items == NULL) {
+            return -1;
+        }
+        memset(items + inst->cap_items, 0, sizeof(crfsuite_item_t) * (num_items - inst->cap_items));
+        inst->items = items;
+        inst->cap_items = num_items;
+    }
+    return 0;
+}
+
+static int reserve_item(crfsuite_item_t* item, int num_contents)
+{
+    if (item->cap_contents < num_contents) {
+        crfsuite_attribute_t* contents = (crfsuite_attribute_t*)realloc(
+            item->contents, sizeof(crfsuite_attribute_t) * num_contents);
+        if (contents == NULL) {
+            return -1;
+        }
+        item->contents = contents;
+        item->cap_contents = num_contents;
+    }
+    return 0;
+}
+
+/**
+ * Read the next instance in the stream.
+ *  The memory blocks of the instance are reused for the new instance.
+ *  @return int         \c 1 if an instance is read, \c 0 at the end of the
+ *                      pass, or \c -1 if an error occurred.
+ */
+static int stream_read(stream_t* st, crfsuite_instance_t* inst)
+{
+    int header[2];
+
+    for (;;) {
+        int t, c, T;
+        const char *p = NULL;
+
+        /* Move on to the next shard at the end of the current one. */
+        if (st->fp == NULL) {
+            if (st->shards->num_shards <= st->shard) {
+                return 0;
+            }
+            if (stream_open_shard(st) != 0) {
+                return -1;
+            }
+        }
+
+        if (fread(header, sizeof(int), 2, st->fp) != 2) {
+            if (ferror(st->fp)) {
+                return -1;
+            }
+            stream_close_shard(st);
+            ++st->shard;
+            continue;
+        }
+
+        /* Skip the instance if it is filtered out. */
+        if ((header[1] == st->holdout) != st->match) {
+            if (fseek(st->fp, header[0], SEEK_CUR) != 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        /* Read the payload. */
+        if (reserve_buffer(&st->buffer, &st->cap_buffer, header[0]) != 0) {
+            return -1;
+        }
+        if (fread(st->buffer, 1, header[0], st->fp) != (size_t)header[0]) {
+            return -1;
+        }
+
+        /* Decode the instance. */
+        p = get_int(st->buffer, &T);
+        if (reserve_instance(inst, T) != 0) {
+            return -1;
+        }
+        inst->num_items = T;
+        inst->group = header[1];
+        p = get_float(p, &inst->weight);
+        for (t = 0;t < T;++t) {
+            int C;
+            crfsuite_item_t* item = &inst->items[t];
+            p = get_int(p, &inst->labels[t]);
+            p = get_int(p, &C);
+            if (reserve_item(item, C) != 0) {
+                return -1;
+            }
+            item->num_contents = C;
+            for (c = 0;c < C;++c) {
+                p = get_int(p, &item->contents[c].aid);
+                p = get_float(p, &item->contents[c].value);
+            }
+        }
+        return 1;
+    }
+}
+
+/**
+ * Start a new pass over the stream.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+static int stream_rewind(stream_t* st)
+{
+    int i, W;
+    const int S = st->shards->num_shards;
+
+    stream_close_shard(st);
+    st->shard = 0;
+    st->next = 0;
+    st->num_window = 0;
+
+    /* Replay the random numbers of this pass. */
+    st->rng = st->seed;
+
+    /* Determine the order of the shards. */
+    for (i = 0;i < S;++i) {
+        st->order[i] = i;
+    }
+    if (st->shuffled) {
+        for (i = S - 1;0 < i;--i) {
+            int j = stream_random(st) % (i + 1);
+            int tmp = st->order[j];
+            st->order[j] = st->order[i];
+            st->order[i] = tmp;
+        }
+    }
+
+    /* Fill the window; an unshuffled stream needs only one instance. */
+    W = st->shuffled ? st->cap_window : 1;
+    while (st->num_window < W) {
+        int ret = stream_read(st, &st->window[st->num_window]);
+        if (ret <= 0) {
+            return ret;
+        }
+        ++st->num_window;
+    }
+    return 0;
+}
+
+/**
+ * Move on to the next instance in the pass.
+ *  @return int         \c 0 if successful, \c -1 otherwise.
+ */
+static int stream_advance(stream_t* st)
+{
+    int j = 0, ret = 0;
+    crfsuite_instance_t tmp;
+
+    if (st->num_window <= 0) {
+        return -1;
+    }
+
+    /* Draw an instance from the window. */
+    if (st->shuffled) {
+        j = (int)(stream_random(st) % (unsigned int)st->num_window);
+    }
+    tmp = st->cur;
+    st->cur = st->window[j];
+    st->window[j] = tmp;
+
+    /* Fill the vacant slot with the next instance. */
+    ret = stream_read(st, &st->window[j]);
+    if (ret < 0) {
+        return -1;
+    } else if (ret == 0) {
+        --st->num_window;
+        tmp = st->window[j];
+        st->window[j] = st->window[st->num_window];
+        st->window[st->num_window] = tmp;
+    }
+
+    ++st->next;
+    return 0;
+}
+
+stream_t* stream_new(crfsuite_shards_t* shards, int holdout, int match)
+{
+    int i;
+    stream_t* st = NULL;
+
+    /* Make the instances written so far readable. */
+    if (shards_flush(shards) != 0) {
+        return NULL;
+    }
+
+    st = (stream_t*)calloc(1, sizeof(stream_t));
+    if (st == NULL) {
+        return NULL;
+    }
+    st->shards = shards;
+    st->holdout = holdout;
+    st->match = match;
+    crfsuite_instance_init(&st->cur);
+
+    /* Count the instances in a pass. */
+    if (0 <= holdout && holdout < shards->num_groups) {
+        st->num_instances = shards->group_counts[holdout];
+    }
+    if (!match) {
+        st->num_instances = shards->num_instances - st->num_instances;
+    }
+
+    st->cap_window = shards->window;
+    st->order = (int*)calloc(shards->num_shards + 1, sizeof(int));
+    st->window = (crfsuite_instance_t*)calloc(st->cap_window, sizeof(crfsuite_instance_t));
+    if (st->order == NULL || st->window == NULL) {
+        stream_delete(st);
+        return NULL;
+    }
+    for (i = 0;i < st->cap_window;++i) {
+        crfsuite_instance_init(&st->window[i]);
+    }
+
+    /* Position the stream after the end so that the first access rewinds it. */
+    st->seed = 1;
+    st->next = st->num_instances;
+    return st;
+}
+
+void stream_delete(stream_t* st)
+{
+    int i;
+
+    if (st != NULL) {
+        stream_close_shard(st);
+        if (st->window != NULL) {
+            for (i = 0;i < st->cap_window;++i) {
+                crfsuite_instance_finish(&st->window[i]);
+            }
+        }
+        crfsuite_instance_finish(&st->cur);
+        free(st->window);
+        free(st->order);
+        free(st->buffer);
+        free(st);
+    }
+}
+
+int stream_size(stream_t* st)
+{
+    return st->num_instances;
+}
+
+void stream_shuffle(stream_t* st, unsigned int seed)
+{
+    st->shuffled = 1;
+    st->seed = seed;
+    st->next = st->num_instances;
+}
+
+crfsuite_instance_t* stream_get(stream_t* st, int i)
+{
+    if (i < 0 || st->num_instances <= i) {
+        return NULL;
+    }
+
+    /* Start a new pass when going backward. */
+    if (i < st->next) {
+        if (stream_rewind(st) != 0) {
+            return NULL;
+        }
+    }
+
+    /* Skip the instances until the requested one. */
+    while (st->next <= i) {
+        if (stream_advance(st) != 0) {
+            return NULL;
+        }
+    }
+    return &st->cur;
+}
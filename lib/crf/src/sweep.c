@@ -0,0 +1,439 @@
+/*
+ *      Parameter sweep with shared features.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef  HAVE_PTHREAD_H
+#include <pthread.h>
+#endif/*HAVE_PTHREAD_H*/
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+#include "params.h"
+#include "logging.h"
+#include "profile.h"
+
+/*
+ *  Every setting is trained by a clone of the encoder, which shares the
+ *  features generated from the training data, with a copy of the trainer
+ *  parameters. A setting becomes runnable when the setting from which it
+ *  warm-starts is finished; runnable settings are picked up in order by a
+ *  pool of worker threads. The weights of a finished setting are kept only
+ *  while a setting warm-started from them is unfinished, or while it is
+ *  the best setting so far.
+ */
+
+enum {
+    SWEEP_PENDING = 0,
+    SWEEP_RUNNING,
+    SWEEP_DONE,
+};
+
+typedef struct {
+    crfsuite_train_internal_t *tr;
+    crfsuite_data_t *data;
+    int holdout;                /**< The holdout group. */
+    const floatval_t *w0;       /**< The initial weights (NULL for zeros). */
+    crfsuite_sweep_t *settings;
+    int num_settings;
+    int metric;                 /**< The holdout metric for the selection. */
+
+    floatval_t **ws;            /**< The weights of finished settings. */
+    int *state;                 /**< The state of each setting. */
+    int *num_dependents;        /**< The number of unfinished settings warm-started from each. */
+    int num_pending;            /**< The number of settings not started. */
+    int best;                   /**< The best setting so far (-1 for none). */
+    int ret;                    /**< The first fatal error. */
+
+#ifdef  HAVE_PTHREAD_H
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif/*HAVE_PTHREAD_H*/
+} sweep_t;
+
+static void sweep_lock(sweep_t *sw)
+{
+#ifdef  HAVE_PTHREAD_H
+    pthread_mutex_lock(&sw->mutex);
+#endif/*HAVE_PTHREAD_H*/
+}
+
+static void sweep_unlock(sweep_t *sw)
+{
+#ifdef  HAVE_PTHREAD_H
+    pthread_mutex_unlock(&sw->mutex);
+#endif/*HAVE_PTHREAD_H*/
+}
+
+static floatval_t sweep_score(sweep_t *sw, int i)
+{
+    const crfsuite_sweep_t *st = &sw->settings[i];
+    return (sw->metric == EARLYSTOP_FMEASURE) ? st->macro_fmeasure : st->item_accuracy;
+}
+
+/* Applies comma-separated NAME=VALUE assignments to the parameters. */
+static int sweep_apply(crfsuite_params_t *params, const char *assignments, logging_t *lg)
+{
+    int ret = 0;
+    char *p = NULL, *name = NULL;
+    char *str = (char*)malloc(strlen(assignments) + 1);
+    if (str == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    strcpy(str, assignments);
+
+    for (name = str;name != NULL && *name;name = p) {
+        char *value = NULL;
+        p = strchr(name, ',');
+        if (p != NULL) {
+            *p++ = 0;
+        }
+        value = strchr(name, '=');
+        if (value != NULL) {
+            *value++ = 0;
+        }
+
+        /* The features are shared, so that they cannot vary. */
+        if (strncmp(name, "feature.", 8) == 0) {
+            logging(lg, "ERROR: Feature parameters cannot be swept: %s\n", name);
+            ret = CRFSUITEERR_INCOMPATIBLE;
+            break;
+        }
+        if (params->set(params, name, value) != 0) {
+            logging(lg, "ERROR: Parameter not found: %s\n", name);
+            ret = CRFSUITEERR_INCOMPATIBLE;
+            break;
+        }
+    }
+
+    free(str);
+    return ret;
+}
+
+/* Trains a setting and evaluates it on the holdout data. */
+static int sweep_train(sweep_t *sw, int i, const floatval_t *w0, floatval_t **ptr_w)
+{
+    int ret = 0;
+    double begin;
+    logging_t lg;
+    dataset_t trainset, testset;
+    floatval_t max_seconds = 0;
+    holdout_result_t result;
+    crfsuite_sweep_t *st = &sw->settings[i];
+    crfsuite_params_t *params = NULL;
+    encoder_t *gm = NULL;
+
+    begin = profile_now();
+    *ptr_w = NULL;
+
+    /* The training of a setting is silent, and never checkpointed. */
+    memset(&lg, 0, sizeof(lg));
+    params = params_copy(sw->tr->params);
+    if (params == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    if ((ret = sweep_apply(params, st->params, sw->tr->lg))) {
+        params->release(params);
+        return ret;
+    }
+    params->set(params, "checkpoint.file", "");
+    params->set_int(params, "checkpoint.resume", 0);
+    params->get_float(params, "max_seconds", &max_seconds);
+    logging_begin(&lg, max_seconds, 0.);
+
+    gm = sw->tr->gm->clone(sw->tr->gm);
+    if (gm == NULL) {
+        params->release(params);
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+
+    /* Each setting shuffles the instances in its own order. */
+    dataset_init_trainset(&trainset, sw->data, sw->holdout);
+    dataset_init_testset(&testset, sw->data, sw->holdout);
+
+    ret = crfsuite_train_run(sw->tr->algorithm, gm, &trainset, &testset, params, &lg, w0, ptr_w);
+    if (ret == 0 && *ptr_w != NULL) {
+        holdout_evaluation(gm, &testset, *ptr_w, &lg, &result);
+        st->item_accuracy = result.item_accuracy;
+        st->macro_fmeasure = result.macro_fmeasure;
+    }
+    st->seconds = profile_now() - begin;
+
+    dataset_finish(&testset);
+    dataset_finish(&trainset);
+    gm->release(gm);
+    params->release(params);
+    return ret;
+}
+
+/* Frees the weights of a setting unless they are still needed. */
+static void sweep_discard(sweep_t *sw, int i)
+{
+    if (sw->state[i] == SWEEP_DONE && sw->num_dependents[i] == 0 && sw->best != i) {
+        free(sw->ws[i]);
+        sw->ws[i] = NULL;
+    }
+}
+
+/* Finds a runnable setting (-1 if none). */
+static int sweep_next(sweep_t *sw)
+{
+    int i;
+    for (i = 0;i < sw->num_settings;++i) {
+        const int prev = sw->settings[i].warm_start;
+        if (sw->state[i] == SWEEP_PENDING && (prev < 0 || sw->state[prev] == SWEEP_DONE)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void *sweep_worker(void *arg)
+{
+    sweep_t *sw = (sweep_t*)arg;
+    logging_t *lg = sw->tr->lg;
+
+    sweep_lock(sw);
+    for (;;) {
+        int i, prev, ret;
+        const floatval_t *w0 = sw->w0;
+        floatval_t *w = NULL;
+
+        /* Wait for a runnable setting. */
+        while ((i = sweep_next(sw)) < 0 && 0 < sw->num_pending && sw->ret == 0) {
+#ifdef  HAVE_PTHREAD_H
+            pthread_cond_wait(&sw->cond, &sw->mutex);
+#endif/*HAVE_PTHREAD_H*/
+        }
+        if (i < 0 || sw->ret != 0) {
+            break;
+        }
+        sw->state[i] = SWEEP_RUNNING;
+        --sw->num_pending;
+
+        /* Warm-start from the weights of the previous setting if trained. */
+        prev = sw->settings[i].warm_start;
+        if (0 <= prev && sw->ws[prev] != NULL) {
+            w0 = sw->ws[prev];
+        }
+        sweep_unlock(sw);
+
+        ret = sweep_train(sw, i, w0, &w);
+
+        sweep_lock(sw);
+        sw->settings[i].status = ret;
+        sw->state[i] = SWEEP_DONE;
+        sw->ws[i] = w;
+        if (ret == CRFSUITEERR_OUTOFMEMORY || ret == CRFSUITEERR_INCOMPATIBLE) {
+            sw->ret = ret;
+        }
+        if (ret == 0) {
+            logging(lg, "Setting #%d (%s): accuracy %.4f, macro F1 %.4f, %.3f seconds\n",
+                i+1, sw->settings[i].params,
+                sw->settings[i].item_accuracy,
+                sw->settings[i].macro_fmeasure,
+                sw->settings[i].seconds
+                );
+            if (sw->best < 0 || sweep_score(sw, sw->best) < sweep_score(sw, i)) {
+                const int last = sw->best;
+                sw->best = i;
+                if (0 <= last) {
+                    sweep_discard(sw, last);
+                }
+            }
+        } else {
+            logging(lg, "Setting #%d (%s): failed with error code (%d)\n", i+1, sw->settings[i].params, ret);
+        }
+        if (0 <= prev) {
+            --sw->num_dependents[prev];
+            sweep_discard(sw, prev);
+        }
+        sweep_discard(sw, i);
+#ifdef  HAVE_PTHREAD_H
+        pthread_cond_broadcast(&sw->cond);
+#endif/*HAVE_PTHREAD_H*/
+    }
+    sweep_unlock(sw);
+    return NULL;
+}
+
+int sweep_run(
+    crfsuite_train_internal_t *tr,
+    crfsuite_data_t *data,
+    int holdout,
+    const floatval_t *w0,
+    crfsuite_sweep_t *settings,
+    int num_settings,
+    int num_threads,
+    floatval_t **ptr_w
+    )
+{
+    int i, ret = 0;
+    char *metric = NULL;
+    logging_t *lg = tr->lg;
+    sweep_t sw;
+
+    memset(&sw, 0, sizeof(sw));
+    sw.tr = tr;
+    sw.data = data;
+    sw.holdout = holdout;
+    sw.w0 = w0;
+    sw.settings = settings;
+    sw.num_settings = num_settings;
+    sw.num_pending = num_settings;
+    sw.best = -1;
+    *ptr_w = NULL;
+
+    /* Select the best setting by the metric of early stopping if any. */
+    tr->params->get_string(tr->params, "early_stopping", &metric);
+    sw.metric = (metric != NULL && strcmp(metric, "f1") == 0) ? EARLYSTOP_FMEASURE : EARLYSTOP_ACCURACY;
+
+    if (num_settings <= 0) {
+        logging(lg, "ERROR: No setting to sweep\n");
+        return CRFSUITEERR_INCOMPATIBLE;
+    }
+
+    /* A setting can only warm-start from an earlier one. */
+    for (i = 0;i < num_settings;++i) {
+        if (i <= settings[i].warm_start) {
+            logging(lg, "ERROR: Setting #%d warm-starts from a later setting\n", i+1);
+            return CRFSUITEERR_INCOMPATIBLE;
+        }
+        settings[i].status = 0;
+        settings[i].item_accuracy = 0;
+        settings[i].macro_fmeasure = 0;
+        settings[i].seconds = 0;
+    }
+
+    sw.ws = (floatval_t**)calloc(num_settings, sizeof(floatval_t*));
+    sw.state = (int*)calloc(num_settings, sizeof(int));
+    sw.num_dependents = (int*)calloc(num_settings, sizeof(int));
+    if (sw.ws == NULL || sw.state == NULL || sw.num_dependents == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+    for (i = 0;i < num_settings;++i) {
+        if (0 <= settings[i].warm_start) {
+            ++sw.num_dependents[settings[i].warm_start];
+        }
+    }
+
+    logging(lg, "Parameter sweep\n");
+    logging(lg, "Number of settings: %d\n", num_settings);
+    logging(lg, "Number of threads: %d\n", num_threads);
+    logging(lg, "\n");
+
+#ifdef  HAVE_PTHREAD_H
+    if (1 < num_threads) {
+        int num_started = 0;
+        pthread_t *threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+        if (threads == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+        pthread_mutex_init(&sw.mutex, NULL);
+        pthread_cond_init(&sw.cond, NULL);
+        for (i = 0;i < num_threads;++i) {
+            if (pthread_create(&threads[num_started], NULL, sweep_worker, &sw) == 0) {
+                ++num_started;
+            }
+        }
+        if (num_started == 0) {
+            /* Fall back to the calling thread. */
+            sweep_worker(&sw);
+        }
+        for (i = 0;i < num_started;++i) {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_cond_destroy(&sw.cond);
+        pthread_mutex_destroy(&sw.mutex);
+        free(threads);
+    } else {
+        pthread_mutex_init(&sw.mutex, NULL);
+        pthread_cond_init(&sw.cond, NULL);
+        sweep_worker(&sw);
+        pthread_cond_destroy(&sw.cond);
+        pthread_mutex_destroy(&sw.mutex);
+    }
+#else
+    sweep_worker(&sw);
+#endif/*HAVE_PTHREAD_H*/
+
+    if ((ret = sw.ret)) {
+        goto error_exit;
+    }
+
+    /* Report the results. */
+    logging(lg, "\n");
+    logging(lg, "Results of the parameter sweep\n");
+    logging(lg, "%4s %9s %9s %8s  %s\n", "#", "Accuracy", "Macro-F1", "Seconds", "Parameters");
+    for (i = 0;i < num_settings;++i) {
+        const crfsuite_sweep_t *st = &settings[i];
+        if (st->status == 0) {
+            logging(lg, "%4d %9.4f %9.4f %8.3f  %s%s\n",
+                i+1, st->item_accuracy, st->macro_fmeasure, st->seconds, st->params,
+                (i == sw.best) ? " (best)" : "");
+        } else {
+            logging(lg, "%4d %9s %9s %8.3f  %s (error %d)\n",
+                i+1, "-", "-", st->seconds, st->params, st->status);
+        }
+    }
+    logging(lg, "\n");
+
+    if (sw.best < 0) {
+        logging(lg, "ERROR: No setting was trained successfully\n");
+        ret = settings[0].status;
+        goto error_exit;
+    }
+
+    /* Hand the weights of the best setting to the caller. */
+    *ptr_w = sw.ws[sw.best];
+    sw.ws[sw.best] = NULL;
+
+error_exit:
+    if (sw.ws != NULL) {
+        for (i = 0;i < num_settings;++i) {
+            free(sw.ws[i]);
+        }
+    }
+    free(sw.num_dependents);
+    free(sw.state);
+    free(sw.ws);
+    return ret;
+}
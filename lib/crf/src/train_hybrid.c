@@ -0,0 +1,252 @@
+/*
+ *      Hybrid training with SGD followed by L-BFGS.
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+
+#include "logging.h"
+#include "params.h"
+#include "profile.h"
+
+/*
+ *  SGD approaches the optimum quickly from zero, but converges slowly near
+ *  it; L-BFGS is the other way around. This algorithm runs a few epochs of
+ *  SGD (with the calibrated learning rate), and then starts L-BFGS (OWL-QN
+ *  if c1 > 0) from the weights of SGD. Both minimize the same objective,
+ *  the negative log-likelihood plus c2 * |w|^2, but SGD ignores c1. The
+ *  parameters of the SGD phase are those of l2sgd prefixed by "sgd.".
+ */
+
+/**
+ * Training parameters (configurable with crfsuite_params_t interface).
+ */
+typedef struct {
+    floatval_t  c2;
+    int         sgd_max_iterations;
+    floatval_t  sgd_c2;
+    int         sgd_period;
+    floatval_t  sgd_delta;
+    floatval_t  sgd_calibration_eta;
+    floatval_t  sgd_calibration_rate;
+    int         sgd_calibration_samples;
+    int         sgd_calibration_candidates;
+    int         sgd_calibration_max_trials;
+} training_option_t;
+
+static int exchange_options(crfsuite_params_t* params, training_option_t* opt, int mode)
+{
+    BEGIN_PARAM_MAP(params, mode)
+        DDX_PARAM_INT(
+            "sgd.max_iterations", opt->sgd_max_iterations, 5,
+            "The number of SGD epochs before switching to L-BFGS."
+            )
+        DDX_PARAM_FLOAT(
+            "sgd.c2", opt->sgd_c2, -1.,
+            "Coefficient for L2 regularization in the SGD phase (negative: ${c2})."
+            )
+        DDX_PARAM_INT(
+            "sgd.period", opt->sgd_period, 10,
+            "The duration of epochs to test the stopping criterion of the SGD phase."
+            )
+        DDX_PARAM_FLOAT(
+            "sgd.delta", opt->sgd_delta, 1e-6,
+            "The threshold for the stopping criterion of the SGD phase."
+            )
+        DDX_PARAM_FLOAT(
+            "sgd.calibration.eta", opt->sgd_calibration_eta, 0.1,
+            "The initial value of learning rate (eta) used for calibration."
+            )
+        DDX_PARAM_FLOAT(
+            "sgd.calibration.rate", opt->sgd_calibration_rate, 2.,
+            "The rate of increase/decrease of learning rate for calibration."
+            )
+        DDX_PARAM_INT(
+            "sgd.calibration.samples", opt->sgd_calibration_samples, 1000,
+            "The number of instances used for calibration."
+            )
+        DDX_PARAM_INT(
+            "sgd.calibration.candidates", opt->sgd_calibration_candidates, 10,
+            "The number of candidates of learning rate."
+            )
+        DDX_PARAM_INT(
+            "sgd.calibration.max_trials", opt->sgd_calibration_max_trials, 20,
+            "The maximum number of trials of learning rates for calibration."
+            )
+    END_PARAM_MAP()
+
+    return 0;
+}
+
+/**
+ * Compute the objective of L-BFGS, including the L1 term ignored by SGD.
+ */
+static floatval_t hybrid_objective(encoder_t *gm, dataset_t *trainset, const floatval_t *w, floatval_t c1, floatval_t c2, floatval_t *g)
+{
+    int i;
+    floatval_t f = 0.;
+
+    gm->objective_and_gradients_batch(gm, trainset, w, &f, g);
+    for (i = 0;i < gm->num_features;++i) {
+        f += c1 * fabs(w[i]) + c2 * w[i] * w[i];
+    }
+    return f;
+}
+
+void crfsuite_train_hybrid_init(crfsuite_params_t* params)
+{
+    crfsuite_train_lbfgs_init(params);
+    exchange_options(params, NULL, 0);
+}
+
+int crfsuite_train_hybrid(
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    )
+{
+    int ret = 0, resume = 0, period = 0;
+    char *checkpoint = NULL;
+    floatval_t *ws = NULL;
+    crfsuite_params_t *sgdparams = NULL, *lbfgsparams = NULL;
+    training_option_t opt;
+
+    /* Obtain parameter values. */
+    exchange_options(params, &opt, -1);
+    params->get_float(params, "c2", &opt.c2);
+    params->get_string(params, "checkpoint.file", &checkpoint);
+    params->get_int(params, "checkpoint.period", &period);
+    params->get_int(params, "checkpoint.resume", &resume);
+
+    logging(lg, "Hybrid SGD and L-BFGS\n");
+    logging(lg, "sgd.max_iterations: %d\n", opt.sgd_max_iterations);
+    if (opt.sgd_c2 < 0) {
+        opt.sgd_c2 = opt.c2;
+    }
+    logging(lg, "sgd.c2: %f\n", opt.sgd_c2);
+    logging(lg, "\n");
+
+    /*
+        Both phases write checkpoints to the same file, which is replaced
+        by those of L-BFGS once SGD finishes. A checkpoint of SGD resumes
+        the first phase; any other resumes L-BFGS from its own.
+     */
+    if (opt.sgd_max_iterations <= 0 || (resume && !checkpoint_written_by(params, "l2sgd"))) {
+        return crfsuite_train_lbfgs(gm, trainset, testset, params, lg, w0, ptr_w);
+    }
+
+    /* SGD with the parameters prefixed by "sgd." and a few epochs. */
+    sgdparams = params_create_instance();
+    if (sgdparams == NULL) {
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    crfsuite_train_l2sgd_init(sgdparams);
+    sgdparams->set_float(sgdparams, "c2", opt.sgd_c2);
+    sgdparams->set_int(sgdparams, "max_iterations", opt.sgd_max_iterations);
+    sgdparams->set_int(sgdparams, "period", opt.sgd_period);
+    sgdparams->set_float(sgdparams, "delta", opt.sgd_delta);
+    sgdparams->set_float(sgdparams, "calibration.eta", opt.sgd_calibration_eta);
+    sgdparams->set_float(sgdparams, "calibration.rate", opt.sgd_calibration_rate);
+    sgdparams->set_int(sgdparams, "calibration.samples", opt.sgd_calibration_samples);
+    sgdparams->set_int(sgdparams, "calibration.candidates", opt.sgd_calibration_candidates);
+    sgdparams->set_int(sgdparams, "calibration.max_trials", opt.sgd_calibration_max_trials);
+    params_add_string(sgdparams, "checkpoint.file", checkpoint, "");
+    params_add_int(sgdparams, "checkpoint.period", period, "");
+    params_add_int(sgdparams, "checkpoint.resume", resume, "");
+
+    ret = crfsuite_train_l2sgd(gm, trainset, testset, sgdparams, lg, w0, &ws);
+    sgdparams->release(sgdparams);
+    if (ret != 0) {
+        free(ws);
+        *ptr_w = NULL;
+        return ret;
+    }
+
+    /* Keep the weights of SGD if the training was stopped. */
+    if (lg->stopped) {
+        *ptr_w = ws;
+        return 0;
+    }
+
+    logging(lg, "Switching to L-BFGS after %.3f seconds\n", profile_now() - lg->wall_begin);
+    logging(lg, "\n");
+
+    /* L-BFGS starts afresh after resuming SGD. */
+    lbfgsparams = params_copy(params);
+    if (lbfgsparams == NULL) {
+        free(ws);
+        *ptr_w = NULL;
+        return CRFSUITEERR_OUTOFMEMORY;
+    }
+    lbfgsparams->set_int(lbfgsparams, "checkpoint.resume", 0);
+    ret = crfsuite_train_lbfgs(gm, trainset, testset, lbfgsparams, lg, ws, ptr_w);
+    lbfgsparams->release(lbfgsparams);
+
+    /* Fall back to the weights of SGD unless L-BFGS improves them. */
+    if (ret != 0) {
+        logging(lg, "WARNING: L-BFGS failed with error code (%d); keeping the weights of SGD\n", ret);
+        logging(lg, "\n");
+        *ptr_w = ws;
+        return 0;
+    } else {
+        floatval_t c1 = 0., fs, fl;
+        floatval_t *g = (floatval_t*)malloc(sizeof(floatval_t) * gm->num_features);
+        if (g != NULL) {
+            params->get_float(params, "c1", &c1);
+            fs = hybrid_objective(gm, trainset, ws, c1, opt.c2, g);
+            fl = hybrid_objective(gm, trainset, *ptr_w, c1, opt.c2, g);
+            free(g);
+            if (fs < fl) {
+                logging(lg, "L-BFGS did not improve the weights of SGD (%f < %f); keeping them\n", fs, fl);
+                logging(lg, "\n");
+                free(*ptr_w);
+                *ptr_w = ws;
+                return 0;
+            }
+        }
+    }
+    free(ws);
+    return ret;
+}
@@ -0,0 +1,495 @@
+/*
+ *      Online training with L1-regularized Stochastic Gradient Descent (SGD).
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+/*
+    SGD for L1-regularized MAP estimation.
+
+    The L1 penalty is applied with the cumulative penalty:
+
+    Yoshimasa Tsuruoka, Jun'ichi Tsujii, and Sophia Ananiadou.
+    Stochastic Gradient Descent Training for L1-regularized Log-linear
+    Models with Cumulative Penalty.
+    In Proc. of ACL-IJCNLP 2009, pp 477-485, 2009.
+
+    and the learning rate of each feature is adapted with AdaGrad:
+
+    John Duchi, Elad Hazan, and Yoram Singer.
+    Adaptive Subgradient Methods for Online Learning and Stochastic
+    Optimization.
+    Journal of Machine Learning Research, 12:2121-2159, 2011.
+
+    The objective function to minimize is the same as that of OWL-QN:
+
+        f(w) = C * |w|_1 + \sum_i^N l_i(w)
+
+    For each instance i, the weight of a feature k is updated by
+
+        G_k += g_k^2
+        w_k -= (eta / sqrt(G_k)) * g_k
+
+    where g_k is the gradient of l_i(w). Every step adds the L1 penalty
+    (eta / sqrt(G_k)) * C / N of the step to u_k, the total penalty that
+    the feature could have received, and clips the weight to zero if it
+    would cross zero:
+
+        if w_k > 0:  w_k = max(0, w_k - (u_k + q_k))
+        if w_k < 0:  w_k = min(0, w_k + (u_k - q_k))
+
+    where q_k is the total penalty that the feature has actually received.
+    Since G_k changes only when the feature is used by an instance, the
+    penalty of the steps in between is added in one go when the feature is
+    used next (or at the end of an epoch). Therefore, a step costs
+    O(the number of features of the instance), not O(K). Features whose
+    gradient has been zero so far receive no penalty.
+*/
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+
+#include "logging.h"
+#include "params.h"
+#include "profile.h"
+#include "vecmath.h"
+
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) < (b) ? (b) : (a))
+
+/**
+ * Training parameters (configurable with crfsuite_params_t interface).
+ */
+typedef struct {
+    floatval_t  c1;
+    floatval_t  eta;
+    int         max_iterations;
+    int         period;
+    floatval_t  delta;
+} training_option_t;
+
+/**
+ * The state of the lazy updates.
+ */
+typedef struct {
+    floatval_t *w;          /**< The feature weights [K]. */
+    floatval_t *sum2;       /**< The sums of squared gradients (G) [K]. */
+    floatval_t *u;          /**< The total penalties to be received [K]. */
+    floatval_t *q;          /**< The total penalties received [K]. */
+    floatval_t *last;       /**< The step when the penalty was last added [K]. */
+    floatval_t eta;         /**< The learning rate. */
+    floatval_t c;           /**< The L1 penalty for one step (C / N). */
+} l1sgd_t;
+
+/**
+ * The set of features used by an instance.
+ */
+typedef struct {
+    int *stamp;             /**< The step when a feature was last collected [K]. */
+    int *fids;              /**< The features collected in the current step [K]. */
+    int num_fids;           /**< The number of features collected. */
+    int step;               /**< The current step. */
+} active_set_t;
+
+static void collect_feature(void *instance, int fid, floatval_t value)
+{
+    active_set_t *as = (active_set_t*)instance;
+    if (as->stamp[fid] != as->step) {
+        as->stamp[fid] = as->step;
+        as->fids[as->num_fids++] = fid;
+    }
+}
+
+/* Adds the L1 penalty of the steps until t to the feature k, and clips it. */
+static void apply_penalty(l1sgd_t *sgd, int k, floatval_t t)
+{
+    floatval_t z = sgd->w[k];
+
+    if (0. < sgd->sum2[k]) {
+        sgd->u[k] += (t - sgd->last[k]) * sgd->c * sgd->eta / sqrt(sgd->sum2[k]);
+    }
+    sgd->last[k] = t;
+
+    if (0. < z) {
+        sgd->w[k] = MAX(0., z - (sgd->u[k] + sgd->q[k]));
+    } else if (z < 0.) {
+        sgd->w[k] = MIN(0., z + (sgd->u[k] - sgd->q[k]));
+    }
+    sgd->q[k] += sgd->w[k] - z;
+}
+
+static int exchange_options(crfsuite_params_t* params, training_option_t* opt, int mode)
+{
+    BEGIN_PARAM_MAP(params, mode)
+        DDX_PARAM_FLOAT(
+            "c1", opt->c1, 1.,
+            "Coefficient for L1 regularization."
+            )
+        DDX_PARAM_FLOAT(
+            "eta", opt->eta, 0.1,
+            "The learning rate (eta) before the adaptation of AdaGrad."
+            )
+        DDX_PARAM_INT(
+            "max_iterations", opt->max_iterations, 100,
+            "The maximum number of iterations (epochs) for SGD optimization."
+            )
+        DDX_PARAM_INT(
+            "period", opt->period, 10,
+            "The duration of iterations to test the stopping criterion."
+            )
+        DDX_PARAM_FLOAT(
+            "delta", opt->delta, 1e-6,
+            "The threshold for the stopping criterion; an optimization process stops when\n"
+            "the improvement of the log likelihood over the last ${period} iterations is no\n"
+            "greater than this threshold."
+            )
+    END_PARAM_MAP()
+
+    return 0;
+}
+
+void crfsuite_train_l1sgd_init(crfsuite_params_t* params)
+{
+    exchange_options(params, NULL, 0);
+}
+
+int crfsuite_train_l1sgd(
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    )
+{
+    int i, k, n, epoch, start = 0, ret = 0, early = 0;
+    int num_active_features = 0;
+    floatval_t t = 0., loss = 0., sum_loss = 0., norm1 = 0.;
+    floatval_t improvement = 0., best_sum_loss = DBL_MAX;
+    floatval_t *g = NULL, *pf = NULL, *best_w = NULL;
+    l1sgd_t sgd;
+    active_set_t as;
+    holdout_result_t result;
+    checkpoint_t ck;
+    earlystop_t es;
+    training_option_t opt;
+    profile_clock_t clk;
+    double clk_prev, clk_begin = profile_now();
+    const int N = trainset->num_instances;
+    const int K = gm->num_features;
+
+    /* Obtain parameter values. */
+    exchange_options(params, &opt, -1);
+    memset(&sgd, 0, sizeof(sgd));
+    memset(&as, 0, sizeof(as));
+    memset(&ck, 0, sizeof(ck));
+    memset(&es, 0, sizeof(es));
+
+    /* Allocate arrays. */
+    sgd.w = (floatval_t*)calloc(sizeof(floatval_t), K);
+    sgd.sum2 = (floatval_t*)calloc(sizeof(floatval_t), K);
+    sgd.u = (floatval_t*)calloc(sizeof(floatval_t), K);
+    sgd.q = (floatval_t*)calloc(sizeof(floatval_t), K);
+    sgd.last = (floatval_t*)calloc(sizeof(floatval_t), K);
+    g = (floatval_t*)calloc(sizeof(floatval_t), K);
+    best_w = (floatval_t*)calloc(sizeof(floatval_t), K);
+    pf = (floatval_t*)calloc(sizeof(floatval_t), opt.period);
+    as.stamp = (int*)calloc(sizeof(int), K);
+    as.fids = (int*)calloc(sizeof(int), K);
+    if (sgd.w == NULL || sgd.sum2 == NULL || sgd.u == NULL || sgd.q == NULL ||
+        sgd.last == NULL || g == NULL || best_w == NULL || pf == NULL ||
+        as.stamp == NULL || as.fids == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+
+    sgd.eta = opt.eta;
+    sgd.c = opt.c1 / N;
+
+    logging(lg, "Stochastic Gradient Descent with L1 regularization (AdaGrad)\n");
+    logging(lg, "c1: %f\n", opt.c1);
+    logging(lg, "eta: %f\n", opt.eta);
+    logging(lg, "max_iterations: %d\n", opt.max_iterations);
+    logging(lg, "period: %d\n", opt.period);
+    logging(lg, "delta: %f\n", opt.delta);
+    logging(lg, "\n");
+
+    if ((ret = checkpoint_init(&ck, params, "l1sgd", lg))) {
+        goto error_exit;
+    }
+    if ((ret = earlystop_init(&es, params, testset, K, lg))) {
+        goto error_exit;
+    }
+
+    /* Initialize the feature weights. */
+    if (w0 != NULL) {
+        veccopy(sgd.w, w0, K);
+    }
+
+    /* Restore the state of the optimization from the checkpoint. */
+    if (ck.resume) {
+        if ((ret = checkpoint_get_int(&ck, "epoch", &start)) ||
+            (ret = checkpoint_get_float(&ck, "t", &t)) ||
+            (ret = checkpoint_get_floats(&ck, "w", sgd.w, K)) ||
+            (ret = checkpoint_get_floats(&ck, "sum2", sgd.sum2, K)) ||
+            (ret = checkpoint_get_floats(&ck, "u", sgd.u, K)) ||
+            (ret = checkpoint_get_floats(&ck, "q", sgd.q, K)) ||
+            (ret = checkpoint_get_floats(&ck, "best_w", best_w, K)) ||
+            (ret = checkpoint_get_float(&ck, "best_loss", &best_sum_loss)) ||
+            (ret = checkpoint_get_floats(&ck, "loss_history", pf, opt.period)) ||
+            (ret = checkpoint_get_dataset(&ck, trainset))) {
+            goto error_exit;
+        }
+        vecset(sgd.last, t, K);
+        logging(lg, "Resuming after epoch #%d\n", start);
+        logging(lg, "\n");
+    }
+
+    /* Loop for epochs. */
+    for (epoch = start + 1;epoch <= opt.max_iterations;++epoch) {
+        clk_prev = profile_now();
+        logging(lg, "***** Epoch #%d *****\n", epoch);
+
+        /* Shuffle the training instances. */
+        dataset_shuffle(trainset);
+        memset(as.stamp, 0, sizeof(int) * K);
+
+        /* Loop for instances. */
+        sum_loss = 0.;
+        for (i = 0;i < N;++i) {
+            const crfsuite_instance_t *inst = NULL;
+
+            /* Leave the epoch unfinished if the time budget is exhausted. */
+            if (logging_interrupted(lg)) {
+                break;
+            }
+
+            inst = dataset_get(trainset, i);
+
+            /* Catch up the penalty of the features used by the instance. */
+            as.step = i + 1;
+            as.num_fids = 0;
+            gm->features_on_instance(gm, inst, collect_feature, &as);
+            PROFILE_ENTER(gm->prof, clk);
+            for (n = 0;n < as.num_fids;++n) {
+                k = as.fids[n];
+                apply_penalty(&sgd, k, t);
+                g[k] = 0.;
+            }
+            PROFILE_LEAVE(gm->prof, PROFILE_REGULARIZATION, clk);
+
+            /* Compute the loss and (negative) gradients for the instance. */
+            gm->set_weights(gm, sgd.w, 1.);
+            gm->set_instance(gm, inst);
+            gm->objective_and_gradients(gm, &loss, g, 1., inst->weight);
+            sum_loss += loss;
+            ++t;
+
+            /* Update the weights, and add the penalty of this step. */
+            for (n = 0;n < as.num_fids;++n) {
+                k = as.fids[n];
+                if (g[k] != 0.) {
+                    sgd.sum2[k] += g[k] * g[k];
+                    sgd.w[k] += sgd.eta * g[k] / sqrt(sgd.sum2[k]);
+                }
+                apply_penalty(&sgd, k, t);
+            }
+        }
+
+        /* Terminate when the loss is abnormal (NaN, -Inf, +Inf). */
+        if (!isfinite(loss)) {
+            logging(lg, "ERROR: overflow loss\n");
+            ret = CRFSUITEERR_OVERFLOW;
+            goto error_exit;
+        }
+
+        /* Catch up the penalty of all features. */
+        norm1 = 0.;
+        num_active_features = 0;
+        PROFILE_ENTER(gm->prof, clk);
+        for (k = 0;k < K;++k) {
+            apply_penalty(&sgd, k, t);
+            if (sgd.w[k] != 0.) {
+                norm1 += fabs(sgd.w[k]);
+                ++num_active_features;
+            }
+        }
+        PROFILE_LEAVE(gm->prof, PROFILE_REGULARIZATION, clk);
+
+        /* The loss of an unfinished epoch is not comparable to the others. */
+        if (lg->stopped) {
+            break;
+        }
+
+        /* Include the L1 norm of feature weights to the objective. */
+        sum_loss += opt.c1 * norm1;
+
+        /* Check if the current epoch is the best. */
+        if (sum_loss < best_sum_loss) {
+            best_sum_loss = sum_loss;
+            veccopy(best_w, sgd.w, K);
+        }
+
+        /* We don't test the stopping criterion while period < epoch. */
+        if (opt.period < epoch) {
+            improvement = (pf[(epoch-1) % opt.period] - sum_loss) / sum_loss;
+        } else {
+            improvement = opt.delta;
+        }
+
+        /* Store the current value of the objective function. */
+        pf[(epoch-1) % opt.period] = sum_loss;
+
+        logging(lg, "Loss: %f\n", sum_loss);
+        if (opt.period < epoch) {
+            logging(lg, "Improvement ratio: %f\n", improvement);
+        }
+        logging(lg, "Feature L1-norm: %f\n", norm1);
+        logging(lg, "Active features: %d\n", num_active_features);
+        logging(lg, "Total number of feature updates: %.0f\n", t);
+        logging(lg, "Seconds required for this iteration: %.3f\n", profile_now() - clk_prev);
+
+        /* Record the metrics of the iteration. */
+        if (opt.period < epoch) {
+            logging_metric_float(lg, "improvement", improvement);
+        }
+        logging_metric_float(lg, "feature_l1_norm", norm1);
+        logging_metric_int(lg, "active_features", num_active_features);
+        logging_metric_float(lg, "updates", t);
+        logging_metric_float(lg, "seconds", profile_now() - clk_prev);
+
+        /* Holdout evaluation if necessary. */
+        if (testset != NULL) {
+            holdout_evaluation(gm, testset, sgd.w, lg, &result);
+            early = earlystop_update(&es, &result, sgd.w, epoch);
+        }
+        logging(lg, "\n");
+
+        /* Save the state of the optimization. */
+        if (checkpoint_due(&ck, epoch)) {
+            if ((ret = checkpoint_begin(&ck)) ||
+                (ret = checkpoint_put_int(&ck, "epoch", epoch)) ||
+                (ret = checkpoint_put_float(&ck, "t", t)) ||
+                (ret = checkpoint_put_floats(&ck, "w", sgd.w, K)) ||
+                (ret = checkpoint_put_floats(&ck, "sum2", sgd.sum2, K)) ||
+                (ret = checkpoint_put_floats(&ck, "u", sgd.u, K)) ||
+                (ret = checkpoint_put_floats(&ck, "q", sgd.q, K)) ||
+                (ret = checkpoint_put_floats(&ck, "best_w", best_w, K)) ||
+                (ret = checkpoint_put_float(&ck, "best_loss", best_sum_loss)) ||
+                (ret = checkpoint_put_floats(&ck, "loss_history", pf, opt.period)) ||
+                (ret = checkpoint_put_dataset(&ck, trainset)) ||
+                (ret = checkpoint_commit(&ck))) {
+                goto error_exit;
+            }
+        }
+
+        /* Stop when the time budget is exhausted or the caller cancels. */
+        if (logging_iteration(lg, epoch, sum_loss)) {
+            break;
+        }
+
+        /* Stop when the holdout score has not improved for a while. */
+        if (early) {
+            break;
+        }
+
+        /* Check for the stopping criterion. */
+        if (improvement < opt.delta) {
+            break;
+        }
+    }
+
+    if (lg->stopped) {
+        logging(lg, "SGD terminated before the stopping criteria\n");
+    } else if (early) {
+        logging(lg, "SGD terminated with early stopping on the holdout score\n");
+    } else if (epoch < opt.max_iterations) {
+        logging(lg, "SGD terminated with the stopping criteria\n");
+    } else {
+        logging(lg, "SGD terminated with the maximum number of iterations\n");
+    }
+
+    /* Restore the best weights (unless stopped before finishing an epoch). */
+    if (best_sum_loss < DBL_MAX) {
+        sum_loss = best_sum_loss;
+        veccopy(sgd.w, best_w, K);
+    }
+
+    /* Output the weights of the best holdout score for early stopping. */
+    earlystop_restore(&es, sgd.w);
+
+    /* Wait for the last checkpoint to be written. */
+    ret = checkpoint_finish(&ck);
+
+    logging(lg, "Loss: %f\n", sum_loss);
+    logging(lg, "Total seconds required for training: %.3f\n", profile_now() - clk_begin);
+    logging(lg, "\n");
+
+    earlystop_finish(&es);
+    free(as.fids);
+    free(as.stamp);
+    free(pf);
+    free(best_w);
+    free(g);
+    free(sgd.last);
+    free(sgd.q);
+    free(sgd.u);
+    free(sgd.sum2);
+    *ptr_w = sgd.w;
+    return ret;
+
+error_exit:
+    checkpoint_finish(&ck);
+    earlystop_finish(&es);
+    free(as.fids);
+    free(as.stamp);
+    free(pf);
+    free(best_w);
+    free(g);
+    free(sgd.last);
+    free(sgd.q);
+    free(sgd.u);
+    free(sgd.sum2);
+    free(sgd.w);
+    *ptr_w = NULL;
+    return ret;
+}
@@ -97,7 +97,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <math.h>
 
 #include <crfsuite.h>
@@ -105,6 +104,7 @@
 
 #include "logging.h"
 #include "params.h"
+#include "profile.h"
 #include "crf1d.h"
 #include "vecmath.h"
 
@@ -128,6 +128,7 @@ static int l2sgd(
     encoder_t *gm,
     dataset_t *trainset,
     dataset_t *testset,
+    const floatval_t *w0,
     floatval_t *w,
     logging_t *lg,
     const int N,
@@ -137,10 +138,12 @@ static int l2sgd(
     int calibration,
     int period,
     const floatval_t epsilon,
+    checkpoint_t *ck,
+    earlystop_t *es,
     floatval_t *ptr_loss
     )
 {
-    int i, epoch, ret = 0;
+    int i, epoch, start = 0, ret = 0, early = 0;
     floatval_t t = 0;
     floatval_t loss = 0, sum_loss = 0;
     floatval_t best_sum_loss = DBL_MAX;
@@ -149,11 +152,13 @@ static int l2sgd(
     floatval_t norm2 = 0.;
     floatval_t *pf = NULL;
     floatval_t *best_w = NULL;
-    clock_t clk_prev, clk_begin = clock();
+    holdout_result_t result;
+    profile_clock_t clk;
+    double clk_prev;
     const int K = gm->num_features;
 
     if (!calibration) {
-        pf = (floatval_t*)malloc(sizeof(floatval_t) * period);
+        pf = (floatval_t*)calloc(period, sizeof(floatval_t));
         best_w = (floatval_t*)calloc(K, sizeof(floatval_t));
         if (pf == NULL || best_w == NULL) {
             ret = CRFSUITEERR_OUTOFMEMORY;
@@ -162,11 +167,30 @@ static int l2sgd(
     }
 
     /* Initialize the feature weights. */
-    vecset(w, 0, K);
+    if (w0 != NULL) {
+        veccopy(w, w0, K);
+    } else {
+        vecset(w, 0, K);
+    }
+
+    /* Restore the state of the optimization from the checkpoint. */
+    if (ck != NULL && ck->resume) {
+        if ((ret = checkpoint_get_int(ck, "epoch", &start)) ||
+            (ret = checkpoint_get_float(ck, "t", &t)) ||
+            (ret = checkpoint_get_floats(ck, "w", w, K)) ||
+            (ret = checkpoint_get_floats(ck, "best_w", best_w, K)) ||
+            (ret = checkpoint_get_float(ck, "best_loss", &best_sum_loss)) ||
+            (ret = checkpoint_get_floats(ck, "loss_history", pf, period)) ||
+            (ret = checkpoint_get_dataset(ck, trainset))) {
+            goto error_exit;
+        }
+        logging(lg, "Resuming after epoch #%d\n", start);
+        logging(lg, "\n");
+    }
 
     /* Loop for epochs. */
-    for (epoch = 1;epoch <= num_epochs;++epoch) {
-        clk_prev = clock();
+    for (epoch = start + 1;epoch <= num_epochs;++epoch) {
+        clk_prev = profile_now();
 
         if (!calibration) {
             logging(lg, "***** Epoch #%d *****\n", epoch);
@@ -177,7 +201,14 @@ static int l2sgd(
         /* Loop for instances. */
         sum_loss = 0.;
         for (i = 0;i < N;++i) {
-            const crfsuite_instance_t *inst = dataset_get(trainset, i);
+            const crfsuite_instance_t *inst = NULL;
+
+            /* Leave the epoch unfinished if the time budget is exhausted. */
+            if (!calibration && logging_interrupted(lg)) {
+                break;
+            }
+
+            inst = dataset_get(trainset, i);
 
             /* Update various factors. */
             eta = 1 / (lambda * (t0 + t));
@@ -202,13 +233,22 @@ static int l2sgd(
         }
 
         /* Scale the feature weights. */
+        PROFILE_ENTER(gm->prof, clk);
         vecscale(w, decay, K);
         decay = 1.;
+        PROFILE_LEAVE(gm->prof, PROFILE_REGULARIZATION, clk);
+
+        /* The loss of an unfinished epoch is not comparable to the others. */
+        if (!calibration && lg->stopped) {
+            break;
+        }
 
         /* Include the L2 norm of feature weights to the objective. */
         /* The factor N is necessary because lambda = 2 * C / N. */
+        PROFILE_ENTER(gm->prof, clk);
         norm2 = vecdot(w, w, K);
         sum_loss += 0.5 * lambda * norm2 * N;
+        PROFILE_LEAVE(gm->prof, PROFILE_REGULARIZATION, clk);
 
         /* One epoch finished. */
         if (!calibration) {
@@ -236,14 +276,52 @@ static int l2sgd(
             logging(lg, "Feature L2-norm: %f\n", sqrt(norm2));
             logging(lg, "Learning rate (eta): %f\n", eta);
             logging(lg, "Total number of feature updates: %.0f\n", t);
-            logging(lg, "Seconds required for this iteration: %.3f\n", (clock() - clk_prev) / (double)CLOCKS_PER_SEC);
+            logging(lg, "Seconds required for this iteration: %.3f\n", profile_now() - clk_prev);
+
+            /* Record the metrics of the iteration. */
+            if (period < epoch) {
+                logging_metric_float(lg, "improvement", improvement);
+            }
+            logging_metric_float(lg, "feature_norm", sqrt(norm2));
+            logging_metric_float(lg, "learning_rate", eta);
+            logging_metric_float(lg, "updates", t);
+            logging_metric_float(lg, "seconds", profile_now() - clk_prev);
 
             /* Holdout evaluation if necessary. */
             if (testset != NULL) {
-                holdout_evaluation(gm, testset, w, lg);
+                holdout_evaluation(gm, testset, w, lg, &result);
+                if (es != NULL) {
+                    early = earlystop_update(es, &result, w, epoch);
+                }
             }
             logging(lg, "\n");
 
+            /* Save the state of the optimization. */
+            if (ck != NULL && checkpoint_due(ck, epoch)) {
+                if ((ret = checkpoint_begin(ck)) ||
+                    (ret = checkpoint_put_float(ck, "t0", t0)) ||
+                    (ret = checkpoint_put_int(ck, "epoch", epoch)) ||
+                    (ret = checkpoint_put_float(ck, "t", t)) ||
+                    (ret = checkpoint_put_floats(ck, "w", w, K)) ||
+                    (ret = checkpoint_put_floats(ck, "best_w", best_w, K)) ||
+                    (ret = checkpoint_put_float(ck, "best_loss", best_sum_loss)) ||
+                    (ret = checkpoint_put_floats(ck, "loss_history", pf, period)) ||
+                    (ret = checkpoint_put_dataset(ck, trainset)) ||
+                    (ret = checkpoint_commit(ck))) {
+                    goto error_exit;
+                }
+            }
+
+            /* Stop when the time budget is exhausted or the caller cancels. */
+            if (logging_iteration(lg, epoch, sum_loss)) {
+                break;
+            }
+
+            /* Stop when the holdout score has not improved for a while. */
+            if (early) {
+                break;
+            }
+
             /* Check for the stopping criterion. */
             if (improvement < epsilon) {
                 ret = 0;
@@ -255,7 +333,11 @@ static int l2sgd(
     /* Output the optimization result. */
     if (!calibration) {
         if (ret == 0) {
-            if (epoch < num_epochs) {
+            if (lg->stopped) {
+                logging(lg, "SGD terminated before the stopping criteria\n");
+            } else if (early) {
+                logging(lg, "SGD terminated with early stopping on the holdout score\n");
+            } else if (epoch < num_epochs) {
                 logging(lg, "SGD terminated with the stopping criteria\n");
             } else {
                 logging(lg, "SGD terminated with the maximum number of iterations\n");
@@ -265,12 +347,17 @@ static int l2sgd(
         }
     }
 
-    /* Restore the best weights. */
-    if (best_w != NULL) {
+    /* Restore the best weights (unless stopped before finishing an epoch). */
+    if (best_w != NULL && best_sum_loss < DBL_MAX) {
         sum_loss = best_sum_loss;
         veccopy(w, best_w, K);
     }
 
+    /* Output the weights of the best holdout score for early stopping. */
+    if (es != NULL) {
+        earlystop_restore(es, w);
+    }
+
 error_exit:
     free(best_w);
     free(pf);
@@ -284,6 +371,7 @@ static floatval_t
 l2sgd_calibration(
     encoder_t *gm,
     dataset_t *ds,
+    const floatval_t *w0,
     floatval_t *w,
     logging_t *lg,
     const training_option_t* opt
@@ -292,7 +380,7 @@ l2sgd_calibration(
     int i;
     int dec = 0, ok, trials = 1;
     int num = opt->calibration_candidates;
-    clock_t clk_begin = clock();
+    double clk_begin = profile_now();
     floatval_t loss = 0.;
     floatval_t init_loss = 0.;
     floatval_t best_loss = DBL_MAX;
@@ -315,8 +403,12 @@ l2sgd_calibration(
     /* Initialize a permutation that shuffles the instances. */
     dataset_shuffle(ds);
 
-    /* Initialize feature weights as zero. */
-    vecset(w, 0, K);
+    /* Initialize feature weights as zero (or the initial weights). */
+    if (w0 != NULL) {
+        veccopy(w, w0, K);
+    } else {
+        vecset(w, 0, K);
+    }
 
     /* Compute the initial loss. */
     gm->set_weights(gm, w, 1.);
@@ -341,9 +433,10 @@ l2sgd_calibration(
             gm,
             ds,
             NULL,
+            w0,
             w,
             lg,
-            S, 1.0 / (lambda * eta), lambda, 1, 1, 1, 0., &loss);
+            S, 1.0 / (lambda * eta), lambda, 1, 1, 1, 0., NULL, NULL, &loss);
 
         /* Make sure that the learning rate decreases the log-likelihood. */
         ok = isfinite(loss) && (loss < init_loss);
@@ -379,7 +472,7 @@ l2sgd_calibration(
 
     eta = best_eta;
     logging(lg, "Best learning rate (eta): %f\n", eta);
-    logging(lg, "Seconds required: %.3f\n", (clock() - clk_begin) / (double)CLOCKS_PER_SEC);
+    logging(lg, "Seconds required: %.3f\n", profile_now() - clk_begin);
     logging(lg, "\n");
 
     return 1.0 / (lambda * eta);
@@ -436,26 +529,56 @@ void crfsuite_train_l2sgd_init(crfsuite_params_t* params)
     exchange_options(params, NULL, 0);
 }
 
+floatval_t crfsuite_train_l2sgd_calibrate(
+    encoder_t *gm,
+    dataset_t *trainset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0
+    )
+{
+    floatval_t t0;
+    floatval_t *w = NULL;
+    training_option_t opt;
+    const int K = gm->num_features;
+
+    exchange_options(params, &opt, -1);
+    opt.lambda = 2. * opt.c2 / trainset->num_instances;
+
+    w = (floatval_t*)calloc(sizeof(floatval_t), K);
+    if (w == NULL) {
+        return 0.;
+    }
+    t0 = l2sgd_calibration(gm, trainset, w0, w, lg, &opt);
+    free(w);
+    return 1.0 / (opt.lambda * t0);
+}
+
 int crfsuite_train_l2sgd(
     encoder_t *gm,
     dataset_t *trainset,
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     )
 {
     int ret = 0;
     floatval_t *w = NULL;
-    clock_t clk_begin;
+    double clk_begin;
     floatval_t loss = 0;
     const int N = trainset->num_instances;
     const int K = gm->num_features;
     const int T = gm->cap_items;
     training_option_t opt;
+    checkpoint_t ck;
+    earlystop_t es;
 
     /* Obtain parameter values. */
     exchange_options(params, &opt, -1);
+    memset(&ck, 0, sizeof(ck));
+    memset(&es, 0, sizeof(es));
 
     /* Allocate arrays. */
     w = (floatval_t*)calloc(sizeof(floatval_t), K);
@@ -472,16 +595,30 @@ int crfsuite_train_l2sgd(
     logging(lg, "period: %d\n", opt.period);
     logging(lg, "delta: %f\n", opt.delta);
     logging(lg, "\n");
-    clk_begin = clock();
+    clk_begin = profile_now();
 
-    /* Calibrate the training rate (eta). */
-    opt.t0 = l2sgd_calibration(gm, trainset, w, lg, &opt);
+    if ((ret = checkpoint_init(&ck, params, "l2sgd", lg))) {
+        goto error_exit;
+    }
+    if ((ret = earlystop_init(&es, params, testset, K, lg))) {
+        goto error_exit;
+    }
+
+    /* Calibrate the training rate (eta) unless resuming the training. */
+    if (ck.resume) {
+        if ((ret = checkpoint_get_float(&ck, "t0", &opt.t0))) {
+            goto error_exit;
+        }
+    } else {
+        opt.t0 = l2sgd_calibration(gm, trainset, w0, w, lg, &opt);
+    }
 
     /* Perform stochastic gradient descent. */
     ret = l2sgd(
         gm,
         trainset,
         testset,
+        w0,
         w,
         lg,
         N,
@@ -491,17 +628,29 @@ int crfsuite_train_l2sgd(
         0,
         opt.period,
         opt.delta,
+        &ck,
+        &es,
         &loss
         );
 
+    /* Wait for the last checkpoint to be written. */
+    if (ret == 0) {
+        ret = checkpoint_finish(&ck);
+    } else {
+        checkpoint_finish(&ck);
+    }
+
     logging(lg, "Loss: %f\n", loss);
-    logging(lg, "Total seconds required for training: %.3f\n", (clock() - clk_begin) / (double)CLOCKS_PER_SEC);
+    logging(lg, "Total seconds required for training: %.3f\n", profile_now() - clk_begin);
     logging(lg, "\n");
 
+    earlystop_finish(&es);
     *ptr_w = w;
     return ret;
 
 error_exit:
+    checkpoint_finish(&ck);
+    earlystop_finish(&es);
     free(w);
     return ret;
 }
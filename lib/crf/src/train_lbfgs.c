@@ -40,13 +40,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
-#include <time.h>
+#include <float.h>
+#include <math.h>
 
 #include <crfsuite.h>
 #include "crfsuite_internal.h"
 
 #include "logging.h"
 #include "params.h"
+#include "profile.h"
 #include "vecmath.h"
 #include <lbfgs.h>
 
@@ -63,6 +65,7 @@ typedef struct {
     int         max_iterations;
     char*       linesearch;
     int         linesearch_max_iterations;
+    int         active_set_period;
 } training_option_t;
 
 /**
@@ -73,9 +76,21 @@ typedef struct {
     dataset_t *trainset;
     dataset_t *testset;
     logging_t *lg;
+    floatval_t c1;
     floatval_t c2;
     floatval_t* best_w;
-    clock_t begin;
+    floatval_t best_fx; /**< The objective value of best_w (DBL_MAX for the starting weights). */
+    double begin;
+    checkpoint_t *ck;
+    earlystop_t *es;
+    int early;          /**< Non-zero if the holdout score stopped improving. */
+    int offset;         /**< The number of iterations done before resuming. */
+    int ret;            /**< The error raised in the progress callback. */
+    int num_progress;   /**< The number of iterations reported in this run. */
+    int active_period;  /**< The number of iterations using only the active set after a refresh (0 if disabled). */
+    int *active;        /**< The flags of the active features. */
+    int num_active;     /**< The number of the active features (0 if all features are used). */
+    int num_restricted; /**< The number of iterations since the refresh of the active set. */
 } lbfgs_internal_t;
 
 static lbfgsfloatval_t lbfgs_evaluate(
@@ -88,6 +103,7 @@ static lbfgsfloatval_t lbfgs_evaluate(
 {
     int i;
     floatval_t f, norm = 0.;
+    profile_clock_t clk;
     lbfgs_internal_t *lbfgsi = (lbfgs_internal_t*)instance;
     encoder_t *gm = lbfgsi->gm;
     dataset_t *trainset = lbfgsi->trainset;
@@ -98,11 +114,13 @@ static lbfgsfloatval_t lbfgs_evaluate(
     /* L2 regularization. */
     if (0 < lbfgsi->c2) {
         const floatval_t c22 = lbfgsi->c2 * 2.;
+        PROFILE_ENTER(gm->prof, clk);
         for (i = 0;i < n;++i) {
             g[i] += (c22 * x[i]);
             norm += x[i] * x[i];
         }
         f += (lbfgsi->c2 * norm);
+        PROFILE_LEAVE(gm->prof, PROFILE_REGULARIZATION, clk);
     }
 
     return f;
@@ -121,21 +139,52 @@ static int lbfgs_progress(
     int ls)
 {
     int i, num_active_features = 0;
-    clock_t duration, clk = clock();
+    double seconds, now = profile_now();
     lbfgs_internal_t *lbfgsi = (lbfgs_internal_t*)instance;
     dataset_t *testset = lbfgsi->testset;
     encoder_t *gm = lbfgsi->gm;
     logging_t *lg = lbfgsi->lg;
 
     /* Compute the duration required for this iteration. */
-    duration = clk - lbfgsi->begin;
-    lbfgsi->begin = clk;
+    seconds = now - lbfgsi->begin;
+    lbfgsi->begin = now;
+    ++lbfgsi->num_progress;
 
-	/* Store the feature weight in case L-BFGS terminates with an error. */
+    /* Store the best feature weights in case L-BFGS terminates with an
+       error or is stopped. */
     for (i = 0;i < n;++i) {
-        lbfgsi->best_w[i] = x[i];
         if (x[i] != 0.) ++num_active_features;
     }
+    if (fx <= lbfgsi->best_fx) {
+        lbfgsi->best_fx = fx;
+        veccopy(lbfgsi->best_w, x, n);
+    }
+
+    /* Count the iterations done before resuming the training. */
+    k += lbfgsi->offset;
+
+    /*
+     *  Refresh the active set of features from the gradients of all
+     *  features: a feature is active if its weight is non-zero, or if
+     *  OWL-QN would move the weight from zero. The inactive features keep
+     *  their zero weights for the next ${active_set.period} iterations,
+     *  after which an iteration uses all features again to let them enter.
+     */
+    if (lbfgsi->active_period) {
+        if (!lbfgsi->num_active) {
+            for (i = 0;i < n;++i) {
+                lbfgsi->active[i] = (x[i] != 0. || lbfgsi->c1 < fabs(g[i]));
+                lbfgsi->num_active += lbfgsi->active[i];
+            }
+            if ((lbfgsi->ret = gm->set_active_features(gm, lbfgsi->active))) {
+                return 1;
+            }
+            lbfgsi->num_restricted = 0;
+        } else if (lbfgsi->active_period <= ++lbfgsi->num_restricted) {
+            gm->set_active_features(gm, NULL);
+            lbfgsi->num_active = 0;
+        }
+    }
 
     /* Report the progress. */
     logging(lg, "***** Iteration #%d *****\n", k);
@@ -143,17 +192,57 @@ static int lbfgs_progress(
     logging(lg, "Feature norm: %f\n", xnorm);
     logging(lg, "Error norm: %f\n", gnorm);
     logging(lg, "Active features: %d\n", num_active_features);
+    if (lbfgsi->num_active) {
+        logging(lg, "Active set: %d\n", lbfgsi->num_active);
+    }
     logging(lg, "Line search trials: %d\n", ls);
     logging(lg, "Line search step: %f\n", step);
-    logging(lg, "Seconds required for this iteration: %.3f\n", duration / (double)CLOCKS_PER_SEC);
+    logging(lg, "Seconds required for this iteration: %.3f\n", seconds);
+
+    /* Record the metrics of the iteration. */
+    logging_metric_float(lg, "feature_norm", xnorm);
+    logging_metric_float(lg, "error_norm", gnorm);
+    logging_metric_int(lg, "active_features", num_active_features);
+    if (lbfgsi->num_active) {
+        logging_metric_int(lg, "active_set", lbfgsi->num_active);
+    }
+    logging_metric_int(lg, "linesearch_trials", ls);
+    logging_metric_float(lg, "linesearch_step", step);
+    logging_metric_float(lg, "seconds", seconds);
 
     /* Send the tagger with the current parameters. */
     if (testset != NULL) {
-        holdout_evaluation(gm, testset, x, lg);
+        holdout_result_t result;
+        holdout_evaluation(gm, testset, x, lg, &result);
+        lbfgsi->early = earlystop_update(lbfgsi->es, &result, x, k);
     }
 
     logging(lg, "\n");
 
+    /*
+     *  Save the current weights. The limited memory of liblbfgs is not
+     *  accessible, so resuming restarts L-BFGS from these weights.
+     */
+    if (checkpoint_due(lbfgsi->ck, k)) {
+        checkpoint_t *ck = lbfgsi->ck;
+        if ((lbfgsi->ret = checkpoint_begin(ck)) ||
+            (lbfgsi->ret = checkpoint_put_int(ck, "iteration", k)) ||
+            (lbfgsi->ret = checkpoint_put_floats(ck, "w", x, n)) ||
+            (lbfgsi->ret = checkpoint_commit(ck))) {
+            return 1;
+        }
+    }
+
+    /* Stop when the time budget is exhausted or the caller cancels. */
+    if (logging_iteration(lg, k, fx)) {
+        return 1;
+    }
+
+    /* Stop when the holdout score has not improved for a while. */
+    if (lbfgsi->early) {
+        return 1;
+    }
+
     /* Continue. */
     return 0;
 }
@@ -203,6 +292,14 @@ static int exchange_options(crfsuite_params_t* params, training_option_t* opt, i
             "max_linesearch", opt->linesearch_max_iterations, 20,
             "The maximum number of trials for the line search algorithm."
             )
+        DDX_PARAM_INT(
+            "active_set.period", opt->active_set_period, 0,
+            "The number of iterations that skip the features whose weights are zero and\n"
+            "would stay zero, after each iteration with all features that refreshes this\n"
+            "active set; this applies to L1 regularization (c1 > 0) only. Zero (default)\n"
+            "uses all features in every iteration; a positive value may slow down the\n"
+            "convergence, since the L-BFGS history spans the changes of the active set."
+            )
     END_PARAM_MAP()
 
     return 0;
@@ -220,12 +317,13 @@ int crfsuite_train_lbfgs(
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     )
 {
     int ret = 0, lbret;
     floatval_t *w = NULL;
-    clock_t begin = clock();
+    double begin = profile_now();
     const int N = trainset->num_instances;
     const int L = trainset->data->labels->num(trainset->data->labels);
     const int A =  trainset->data->attrs->num(trainset->data->attrs);
@@ -233,10 +331,14 @@ int crfsuite_train_lbfgs(
     lbfgs_internal_t lbfgsi;
     lbfgs_parameter_t lbfgsparam;
     training_option_t opt;
+    checkpoint_t ck;
+    earlystop_t es;
 
 	/* Initialize the variables. */
 	memset(&lbfgsi, 0, sizeof(lbfgsi));
 	memset(&opt, 0, sizeof(opt));
+	memset(&ck, 0, sizeof(ck));
+    memset(&es, 0, sizeof(es));
     lbfgs_parameter_init(&lbfgsparam);
 
     /* Allocate an array that stores the current weights. As per the liblbfgs
@@ -246,6 +348,9 @@ int crfsuite_train_lbfgs(
 		ret = CRFSUITEERR_OUTOFMEMORY;
 		goto error_exit;
     }
+    if (w0 != NULL) {
+        veccopy(w, w0, K);
+    }
  
     /* Allocate an array that stores the best weights. */ 
     lbfgsi.best_w = (floatval_t*)calloc(sizeof(floatval_t), K);
@@ -266,14 +371,40 @@ int crfsuite_train_lbfgs(
     logging(lg, "delta: %f\n", opt.delta);
     logging(lg, "linesearch: %s\n", opt.linesearch);
     logging(lg, "linesearch.max_iterations: %d\n", opt.linesearch_max_iterations);
+    if (0 < opt.c1) {
+        logging(lg, "active_set.period: %d\n", opt.active_set_period);
+    }
     logging(lg, "\n");
 
+    /* Restore the weights from the checkpoint if necessary. */
+    if ((ret = checkpoint_init(&ck, params, "lbfgs", lg))) {
+        goto error_exit;
+    }
+    if ((ret = earlystop_init(&es, params, testset, K, lg))) {
+        goto error_exit;
+    }
+    if (ck.resume) {
+        if ((ret = checkpoint_get_int(&ck, "iteration", &lbfgsi.offset)) ||
+            (ret = checkpoint_get_floats(&ck, "w", w, K))) {
+            goto error_exit;
+        }
+        logging(lg, "Resuming after iteration #%d\n", lbfgsi.offset);
+        logging(lg, "\n");
+    }
+
+    /*
+        The starting weights are the result unless an iteration improves
+        them; liblbfgs may return without reporting any iteration, e.g.,
+        when the weights are already minimized.
+     */
+    veccopy(lbfgsi.best_w, w, K);
+
     /* Set parameters for L-BFGS. */
     lbfgsparam.m = opt.memory;
     lbfgsparam.epsilon = opt.epsilon;
     lbfgsparam.past = opt.stop;
     lbfgsparam.delta = opt.delta;
-    lbfgsparam.max_iterations = opt.max_iterations;
+    lbfgsparam.max_iterations = opt.max_iterations - lbfgsi.offset;
     if (strcmp(opt.linesearch, "Backtracking") == 0) {
         lbfgsparam.linesearch = LBFGS_LINESEARCH_BACKTRACKING;
     } else if (strcmp(opt.linesearch, "StrongBacktracking") == 0) {
@@ -291,25 +422,63 @@ int crfsuite_train_lbfgs(
         lbfgsparam.orthantwise_c = 0;
     }
 
+    /* Allocate the flags of the active features if necessary. */
+    if (0 < opt.c1 && 0 < opt.active_set_period) {
+        lbfgsi.active_period = opt.active_set_period;
+        lbfgsi.active = (int*)calloc(sizeof(int), K);
+        if (lbfgsi.active == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+    }
+
     /* Set other callback data. */
     lbfgsi.gm = gm;
     lbfgsi.trainset = trainset;
     lbfgsi.testset = testset;
+    lbfgsi.c1 = opt.c1;
     lbfgsi.c2 = opt.c2;
     lbfgsi.lg = lg;
-
-    /* Call the L-BFGS solver. */
-    lbfgsi.begin = clock();
-    lbret = lbfgs(
-        K,
-        w,
-        NULL,
-        lbfgs_evaluate,
-        lbfgs_progress,
-        &lbfgsi,
-        &lbfgsparam
-        );
-    if (lbret == LBFGS_CONVERGENCE) {
+    lbfgsi.ck = &ck;
+    lbfgsi.es = &es;
+    lbfgsi.best_fx = DBL_MAX;
+
+    /* Call the L-BFGS solver unless the resumed training has exhausted the
+       iterations (liblbfgs takes zero as no limit). */
+    lbfgsi.begin = profile_now();
+    if (0 < lbfgsi.offset && opt.max_iterations <= lbfgsi.offset) {
+        lbret = LBFGSERR_MAXIMUMITERATION;
+    } else {
+        lbret = lbfgs(
+            K,
+            w,
+            NULL,
+            lbfgs_evaluate,
+            lbfgs_progress,
+            &lbfgsi,
+            &lbfgsparam
+            );
+    }
+    if (lbfgsi.active_period) {
+        gm->set_active_features(gm, NULL);
+    }
+    if (lbfgsi.ret) {
+        ret = lbfgsi.ret;
+        goto error_exit;
+    }
+    if (lbret < 0 && lbfgsi.num_progress == 0 && !(0 < lbfgsi.offset && opt.max_iterations <= lbfgsi.offset)) {
+        logging(lg, "ERROR: L-BFGS failed before the first iteration with error code (%d)\n", lbret);
+        ret = CRFSUITEERR_UNKNOWN;
+        goto error_exit;
+    }
+    if ((ret = checkpoint_finish(&ck))) {
+        goto error_exit;
+    }
+    if (lg->stopped) {
+        logging(lg, "L-BFGS terminated before the stopping criteria\n");
+    } else if (lbfgsi.early) {
+        logging(lg, "L-BFGS terminated with early stopping on the holdout score\n");
+    } else if (lbret == LBFGS_CONVERGENCE) {
         logging(lg, "L-BFGS resulted in convergence\n");
     } else if (lbret == LBFGS_STOP) {
         logging(lg, "L-BFGS terminated with the stopping criteria\n");
@@ -319,19 +488,27 @@ int crfsuite_train_lbfgs(
         logging(lg, "L-BFGS terminated with error code (%d)\n", lbret);
     }
 
+    /* Output the weights of the best holdout score for early stopping. */
+    earlystop_restore(&es, lbfgsi.best_w);
+    earlystop_finish(&es);
+
     /* Set the best_w array (allocated by us) as the result array, which the
      * callee can safely `free`. */
     *ptr_w = lbfgsi.best_w;
 
 	/* Report the run-time for the training. */
-    logging(lg, "Total seconds required for training: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
+    logging(lg, "Total seconds required for training: %.3f\n", profile_now() - begin);
     logging(lg, "\n");
 
     /* Exit with success. */
+    free(lbfgsi.active);
     lbfgs_free(w);
     return 0;
 
 error_exit:
+    checkpoint_finish(&ck);
+    earlystop_finish(&es);
+	free(lbfgsi.active);
 	free(lbfgsi.best_w);
 	lbfgs_free(w);
 	*ptr_w = NULL;
@@ -36,14 +36,15 @@
 
 #include <os.h>
 
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 
 #include <crfsuite.h>
 #include "crfsuite_internal.h"
 #include "logging.h"
 #include "params.h"
+#include "profile.h"
 #include "vecmath.h"
 
 #define MIN(a, b)   ((a) < (b) ? (a) : (b))
@@ -251,22 +252,30 @@ int crfsuite_train_passive_aggressive(
     dataset_t *testset,
     crfsuite_params_t *params,
     logging_t *lg,
+    const floatval_t *w0,
     floatval_t **ptr_w
     )
 {
-    int n, i, u, ret = 0;
+    int n, i, u, start = 0, ret = 0, early = 0;
     int *viterbi = NULL;
     floatval_t *w = NULL, *ws = NULL, *wa = NULL;
+    floatval_t *best_w = NULL;
+    floatval_t best_loss = DBL_MAX;
     const int N = trainset->num_instances;
     const int K = gm->num_features;
     const int T = gm->cap_items;
     training_option_t opt;
     delta_t dc;
-    clock_t begin = clock();
+    checkpoint_t ck;
+    earlystop_t es;
+    holdout_result_t result;
+    double begin = profile_now();
     floatval_t (*cost_function)(floatval_t err, floatval_t d) = NULL;
     floatval_t (*tau_function)(floatval_t cost, floatval_t norm, floatval_t c) = NULL;
 
 	/* Initialize the variable. */
+    memset(&ck, 0, sizeof(ck));
+    memset(&es, 0, sizeof(es));
     if (delta_init(&dc, K) != 0) {
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
@@ -284,6 +293,19 @@ int crfsuite_train_passive_aggressive(
         ret = CRFSUITEERR_OUTOFMEMORY;
         goto error_exit;
     }
+    if (logging_stoppable(lg)) {
+        best_w = (floatval_t*)calloc(sizeof(floatval_t), K);
+        if (best_w == NULL) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+    }
+    if ((ret = earlystop_init(&es, params, testset, K, lg))) {
+        goto error_exit;
+    }
+    if (w0 != NULL) {
+        veccopy(w, w0, K);
+    }
 
     /* Set the cost function for instances. */
     if (opt.error_sensitive) {
@@ -313,10 +335,30 @@ int crfsuite_train_passive_aggressive(
 
     u = 1;
 
+    /* Restore the state of the training from the checkpoint. */
+    if ((ret = checkpoint_init(&ck, params, "pa", lg))) {
+        goto error_exit;
+    }
+    if (ck.resume) {
+        if ((ret = checkpoint_get_int(&ck, "epoch", &start)) ||
+            (ret = checkpoint_get_int(&ck, "u", &u)) ||
+            (ret = checkpoint_get_floats(&ck, "w", w, K)) ||
+            (ret = checkpoint_get_floats(&ck, "ws", ws, K)) ||
+            (ret = checkpoint_get_dataset(&ck, trainset))) {
+            goto error_exit;
+        }
+        veccopy(wa, w, K);
+        if (opt.averaging) {
+            vecasub(wa, 1./u, ws, K);
+        }
+        logging(lg, "Resuming after iteration #%d\n", start);
+        logging(lg, "\n");
+    }
+
 	/* Loop for epoch. */
-    for (i = 0;i < opt.max_iterations;++i) {
+    for (i = start;i < opt.max_iterations;++i) {
         floatval_t norm = 0., sum_loss = 0.;
-        clock_t iteration_begin = clock();
+        double iteration_begin = profile_now();
 
         /* Shuffle the instances. */
         dataset_shuffle(trainset);
@@ -325,7 +367,13 @@ int crfsuite_train_passive_aggressive(
         for (n = 0;n < N;++n) {
             int d = 0;
             floatval_t sv;
-            const crfsuite_instance_t *inst = dataset_get(trainset, n);
+            const crfsuite_instance_t *inst = NULL;
+
+            /* Leave the epoch unfinished if the time budget is exhausted. */
+            if (logging_interrupted(lg)) {
+                break;
+            }
+            inst = dataset_get(trainset, n);
 
             /* Set the feature weights to the encoder. */
             gm->set_weights(gm, w, 1.);
@@ -392,19 +440,60 @@ int crfsuite_train_passive_aggressive(
             veccopy(wa, w, K);
         }
 
+        /* The loss of an unfinished epoch is not comparable to the others. */
+        if (lg->stopped) {
+            break;
+        }
+
+        /* Keep the weights with the smallest loss in case of stopping. */
+        if (best_w != NULL && sum_loss < best_loss) {
+            best_loss = sum_loss;
+            veccopy(best_w, wa, K);
+        }
+
         /* Output the progress. */
         logging(lg, "***** Iteration #%d *****\n", i+1);
         logging(lg, "Loss: %f\n", sum_loss);
         logging(lg, "Feature norm: %f\n", sqrt(vecdot(w, w, K)));
-        logging(lg, "Seconds required for this iteration: %.3f\n", (clock() - iteration_begin) / (double)CLOCKS_PER_SEC);
+        logging(lg, "Seconds required for this iteration: %.3f\n", profile_now() - iteration_begin);
+
+        /* Record the metrics of the iteration. */
+        logging_metric_float(lg, "feature_norm", sqrt(vecdot(w, w, K)));
+        logging_metric_float(lg, "seconds", profile_now() - iteration_begin);
 
         /* Holdout evaluation if necessary. */
         if (testset != NULL) {
-            holdout_evaluation(gm, testset, wa, lg);
+            holdout_evaluation(gm, testset, wa, lg, &result);
+            early = earlystop_update(&es, &result, wa, i+1);
         }
 
         logging(lg, "\n");
 
+        /* Save the state of the training. */
+        if (checkpoint_due(&ck, i+1)) {
+            if ((ret = checkpoint_begin(&ck)) ||
+                (ret = checkpoint_put_int(&ck, "epoch", i+1)) ||
+                (ret = checkpoint_put_int(&ck, "u", u)) ||
+                (ret = checkpoint_put_floats(&ck, "w", w, K)) ||
+                (ret = checkpoint_put_floats(&ck, "ws", ws, K)) ||
+                (ret = checkpoint_put_dataset(&ck, trainset)) ||
+                (ret = checkpoint_commit(&ck))) {
+                goto error_exit;
+            }
+        }
+
+        /* Stop when the time budget is exhausted or the caller cancels. */
+        if (logging_iteration(lg, i+1, sum_loss)) {
+            break;
+        }
+
+        /* Stop when the holdout score has not improved for a while. */
+        if (early) {
+            logging(lg, "Terminated with early stopping on the holdout score\n");
+            logging(lg, "\n");
+            break;
+        }
+
         /* Convergence test. */
         if (sum_loss / N < opt.epsilon) {
             logging(lg, "Terminated with the stopping criterion\n");
@@ -413,9 +502,23 @@ int crfsuite_train_passive_aggressive(
         }
     }
 
-    logging(lg, "Total seconds required for training: %.3f\n", (clock() - begin) / (double)CLOCKS_PER_SEC);
+    if ((ret = checkpoint_finish(&ck))) {
+        goto error_exit;
+    }
+
+    /* Output the best weights seen so far if the training was stopped. */
+    if (lg->stopped && best_loss < DBL_MAX) {
+        veccopy(wa, best_w, K);
+    }
+
+    /* Output the weights of the best holdout score for early stopping. */
+    earlystop_restore(&es, wa);
+
+    logging(lg, "Total seconds required for training: %.3f\n", profile_now() - begin);
     logging(lg, "\n");
 
+    earlystop_finish(&es);
+    free(best_w);
     free(viterbi);
     free(ws);
     free(w);
@@ -424,6 +527,9 @@ int crfsuite_train_passive_aggressive(
     return ret;
 
 error_exit:
+    checkpoint_finish(&ck);
+    earlystop_finish(&es);
+    free(best_w);
     free(viterbi);
     free(wa);
     free(ws);
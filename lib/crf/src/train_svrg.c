@@ -0,0 +1,429 @@
+/*
+ *      Training with Stochastic Variance Reduced Gradient (SVRG).
+ *
+ * Copyright (c) 2007-2010, Naoaki Okazaki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of the authors nor the names of its contributors
+ *       may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* $Id$ */
+
+/*
+    SVRG for L2-regularized MAP estimation.
+
+    Rie Johnson and Tong Zhang.
+    Accelerating Stochastic Gradient Descent using Predictive Variance
+    Reduction.
+    In Proc. of NIPS 2013, pp 315-323, 2013.
+
+    The objective function to minimize is the same as that of L-BFGS and SGD:
+
+        f(w) = (lambda/2) * ||w||^2 + (1/N) * \sum_i^N l_i(w)
+        lambda = 2 * C / N
+
+    Each epoch takes a snapshot ws of the feature weights and computes the
+    average gradient mu of the loss at ws in one pass of the batch gradient.
+    Then, for each instance i in a random order, the weights are updated
+    with a constant learning rate eta:
+
+        w = (1 - eta * lambda) w - eta * (g_i(w) - g_i(ws) + mu)
+
+    The variance of the update vanishes as w and ws approach the optimum,
+    which allows the constant learning rate to converge to the optimum of
+    L-BFGS. The learning rate is calibrated in the same manner as SGD, and
+    halved whenever an epoch increases the objective; the epoch is then
+    discarded.
+
+    An update touches only the features of the instance except for mu,
+    which is dense. As in SGD, the weights are represented by w = a * v
+    so that the decay costs O(1); the updates of mu are applied lazily:
+
+        a *= (1 - eta * lambda)
+        C += eta / a
+        v_k -= mu_k * (C - C_k), C_k = C   (when the feature k is used)
+
+    Therefore, a step costs O(the number of features of the instance), and
+    an epoch costs about three passes of the forward-backward algorithm.
+*/
+
+#ifdef    HAVE_CONFIG_H
+#include <config.h>
+#endif/*HAVE_CONFIG_H*/
+
+#include <os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <crfsuite.h>
+#include "crfsuite_internal.h"
+
+#include "logging.h"
+#include "params.h"
+#include "profile.h"
+#include "vecmath.h"
+
+/**
+ * Training parameters (configurable with crfsuite_params_t interface).
+ */
+typedef struct {
+    floatval_t  c2;
+    int         max_iterations;
+    int         period;
+    floatval_t  delta;
+    floatval_t  eta;
+} training_option_t;
+
+/**
+ * The set of features used by an instance.
+ */
+typedef struct {
+    int *stamp;             /**< The step when a feature was last collected [K]. */
+    int *fids;              /**< The features collected in the current step [K]. */
+    int num_fids;           /**< The number of features collected. */
+    int step;               /**< The current step. */
+} active_set_t;
+
+static void collect_feature(void *instance, int fid, floatval_t value)
+{
+    active_set_t *as = (active_set_t*)instance;
+    if (as->stamp[fid] != as->step) {
+        as->stamp[fid] = as->step;
+        as->fids[as->num_fids++] = fid;
+    }
+}
+
+static int exchange_options(crfsuite_params_t* params, training_option_t* opt, int mode)
+{
+    BEGIN_PARAM_MAP(params, mode)
+        DDX_PARAM_FLOAT(
+            "eta", opt->eta, 0.,
+            "The learning rate (eta); the rate is calibrated in the same manner as SGD\n"
+            "if this is zero."
+            )
+    END_PARAM_MAP()
+
+    return 0;
+}
+
+void crfsuite_train_svrg_init(crfsuite_params_t* params)
+{
+    crfsuite_train_l2sgd_init(params);
+    exchange_options(params, NULL, 0);
+}
+
+int crfsuite_train_svrg(
+    encoder_t *gm,
+    dataset_t *trainset,
+    dataset_t *testset,
+    crfsuite_params_t *params,
+    logging_t *lg,
+    const floatval_t *w0,
+    floatval_t **ptr_w
+    )
+{
+    int i, n, epoch, start = 0, ret = 0, early = 0;
+    floatval_t a, C, gain, lambda, eta;
+    floatval_t loss = 0., f = 0., norm2 = 0., improvement = 0.;
+    floatval_t *w = NULL, *ws = NULL, *mu = NULL, *g = NULL, *last = NULL;
+    floatval_t *pf = NULL, *tmp = NULL;
+    active_set_t as;
+    holdout_result_t result;
+    checkpoint_t ck;
+    earlystop_t es;
+    training_option_t opt;
+    double clk_prev, clk_begin = profile_now();
+    const int N = trainset->num_instances;
+    const int K = gm->num_features;
+
+    /* Obtain parameter values. */
+    exchange_options(params, &opt, -1);
+    params->get_float(params, "c2", &opt.c2);
+    params->get_int(params, "max_iterations", &opt.max_iterations);
+    params->get_int(params, "period", &opt.period);
+    params->get_float(params, "delta", &opt.delta);
+    memset(&as, 0, sizeof(as));
+    memset(&ck, 0, sizeof(ck));
+    memset(&es, 0, sizeof(es));
+
+    /* Allocate arrays. */
+    w = (floatval_t*)calloc(sizeof(floatval_t), K);
+    ws = (floatval_t*)calloc(sizeof(floatval_t), K);
+    mu = (floatval_t*)calloc(sizeof(floatval_t), K);
+    g = (floatval_t*)calloc(sizeof(floatval_t), K);
+    last = (floatval_t*)calloc(sizeof(floatval_t), K);
+    pf = (floatval_t*)calloc(sizeof(floatval_t), opt.period);
+    as.stamp = (int*)calloc(sizeof(int), K);
+    as.fids = (int*)calloc(sizeof(int), K);
+    if (w == NULL || ws == NULL || mu == NULL || g == NULL || last == NULL ||
+        pf == NULL || as.stamp == NULL || as.fids == NULL) {
+        ret = CRFSUITEERR_OUTOFMEMORY;
+        goto error_exit;
+    }
+
+    lambda = 2. * opt.c2 / N;
+
+    logging(lg, "Stochastic Variance Reduced Gradient (SVRG)\n");
+    logging(lg, "c2: %f\n", opt.c2);
+    logging(lg, "max_iterations: %d\n", opt.max_iterations);
+    logging(lg, "period: %d\n", opt.period);
+    logging(lg, "delta: %f\n", opt.delta);
+    logging(lg, "\n");
+
+    if ((ret = checkpoint_init(&ck, params, "svrg", lg))) {
+        goto error_exit;
+    }
+    if ((ret = earlystop_init(&es, params, testset, K, lg))) {
+        goto error_exit;
+    }
+
+    /* Initialize the feature weights. */
+    if (w0 != NULL) {
+        veccopy(w, w0, K);
+    }
+
+    /* Restore the state of the optimization, or calibrate eta. */
+    if (ck.resume) {
+        if ((ret = checkpoint_get_int(&ck, "epoch", &start)) ||
+            (ret = checkpoint_get_float(&ck, "eta", &opt.eta)) ||
+            (ret = checkpoint_get_floats(&ck, "w", w, K)) ||
+            (ret = checkpoint_get_floats(&ck, "loss_history", pf, opt.period)) ||
+            (ret = checkpoint_get_dataset(&ck, trainset))) {
+            goto error_exit;
+        }
+        logging(lg, "Resuming after epoch #%d\n", start);
+        logging(lg, "\n");
+    } else if (opt.eta <= 0.) {
+        opt.eta = crfsuite_train_l2sgd_calibrate(gm, trainset, params, lg, w0);
+        if (opt.eta <= 0.) {
+            ret = CRFSUITEERR_OUTOFMEMORY;
+            goto error_exit;
+        }
+    }
+    eta = opt.eta;
+
+    /* Take the first snapshot. */
+    gm->objective_and_gradients_batch(gm, trainset, w, &loss, mu);
+    loss += opt.c2 * vecdot(w, w, K);
+    vecscale(mu, 1. / N, K);
+    veccopy(ws, w, K);
+    logging(lg, "Initial loss: %f\n", loss);
+    logging(lg, "Learning rate (eta): %f\n", eta);
+    logging(lg, "\n");
+
+    /* Loop for epochs. */
+    for (epoch = start + 1;epoch <= opt.max_iterations;++epoch) {
+        clk_prev = profile_now();
+        logging(lg, "***** Epoch #%d *****\n", epoch);
+
+        /* Shuffle the training instances. */
+        dataset_shuffle(trainset);
+
+        /* Start with no pending updates of mu. */
+        a = 1.;
+        C = 0.;
+        vecset(last, 0, K);
+        memset(as.stamp, 0, sizeof(int) * K);
+
+        /* Loop for instances. */
+        for (i = 0;i < N;++i) {
+            const crfsuite_instance_t *inst = NULL;
+
+            /* Leave the epoch unfinished if the time budget is exhausted. */
+            if (logging_interrupted(lg)) {
+                break;
+            }
+
+            inst = dataset_get(trainset, i);
+
+            /* Apply the pending updates of mu to the features of the instance. */
+            as.step = i + 1;
+            as.num_fids = 0;
+            gm->features_on_instance(gm, inst, collect_feature, &as);
+            for (n = 0;n < as.num_fids;++n) {
+                const int k = as.fids[n];
+                w[k] -= mu[k] * (C - last[k]);
+                last[k] = C;
+            }
+
+            /* Fix the scores at the current weights before the decay. */
+            gm->set_weights(gm, w, a);
+            gm->set_instance(gm, inst);
+            a *= (1. - eta * lambda);
+            gain = eta / a;
+
+            /* Add the gradient at the current weights. */
+            gm->objective_and_gradients(gm, &f, w, gain, inst->weight);
+
+            /* Subtract the gradient at the snapshot. */
+            gm->set_weights(gm, ws, 1.);
+            gm->set_instance(gm, inst);
+            gm->objective_and_gradients(gm, &f, w, -gain, inst->weight);
+
+            /* Postpone the update of mu. */
+            C += gain;
+        }
+
+        /* Apply all pending updates of mu, and scale the feature weights. */
+        for (n = 0;n < K;++n) {
+            w[n] = a * (w[n] - mu[n] * (C - last[n]));
+        }
+
+        /* Keep the snapshot if the epoch was left unfinished. */
+        if (lg->stopped) {
+            break;
+        }
+
+        /* Compute the objective and gradients for the next snapshot. */
+        gm->objective_and_gradients_batch(gm, trainset, w, &f, g);
+        norm2 = vecdot(w, w, K);
+        f += opt.c2 * norm2;
+
+        if (!isfinite(f) || loss < f) {
+            /* Discard the epoch, and retry with a smaller learning rate. */
+            logging(lg, "Discarded the epoch with the loss %f\n", f);
+            veccopy(w, ws, K);
+            norm2 = vecdot(w, w, K);
+            eta *= 0.5;
+        } else {
+            /* Take the snapshot. */
+            loss = f;
+            veccopy(ws, w, K);
+            tmp = mu;
+            mu = g;
+            g = tmp;
+            vecscale(mu, 1. / N, K);
+        }
+
+        /* We don't test the stopping criterion while period < epoch. */
+        if (opt.period < epoch) {
+            improvement = (pf[(epoch-1) % opt.period] - loss) / loss;
+        } else {
+            improvement = opt.delta;
+        }
+
+        /* Store the current value of the objective function. */
+        pf[(epoch-1) % opt.period] = loss;
+
+        logging(lg, "Loss: %f\n", loss);
+        if (opt.period < epoch) {
+            logging(lg, "Improvement ratio: %f\n", improvement);
+        }
+        logging(lg, "Feature L2-norm: %f\n", sqrt(norm2));
+        logging(lg, "Learning rate (eta): %f\n", eta);
+        logging(lg, "Seconds required for this iteration: %.3f\n", profile_now() - clk_prev);
+
+        /* Record the metrics of the iteration. */
+        if (opt.period < epoch) {
+            logging_metric_float(lg, "improvement", improvement);
+        }
+        logging_metric_float(lg, "feature_norm", sqrt(norm2));
+        logging_metric_float(lg, "learning_rate", eta);
+        logging_metric_float(lg, "seconds", profile_now() - clk_prev);
+
+        /* Holdout evaluation if necessary. */
+        if (testset != NULL) {
+            holdout_evaluation(gm, testset, w, lg, &result);
+            early = earlystop_update(&es, &result, w, epoch);
+        }
+        logging(lg, "\n");
+
+        /* Save the state of the optimization. */
+        if (checkpoint_due(&ck, epoch)) {
+            if ((ret = checkpoint_begin(&ck)) ||
+                (ret = checkpoint_put_int(&ck, "epoch", epoch)) ||
+                (ret = checkpoint_put_float(&ck, "eta", eta)) ||
+                (ret = checkpoint_put_floats(&ck, "w", w, K)) ||
+                (ret = checkpoint_put_floats(&ck, "loss_history", pf, opt.period)) ||
+                (ret = checkpoint_put_dataset(&ck, trainset)) ||
+                (ret = checkpoint_commit(&ck))) {
+                goto error_exit;
+            }
+        }
+
+        /* Stop when the time budget is exhausted or the caller cancels. */
+        if (logging_iteration(lg, epoch, loss)) {
+            break;
+        }
+
+        /* Stop when the holdout score has not improved for a while. */
+        if (early) {
+            break;
+        }
+
+        /* Check for the stopping criterion. */
+        if (improvement < opt.delta) {
+            break;
+        }
+    }
+
+    if (lg->stopped) {
+        logging(lg, "SVRG terminated before the stopping criteria\n");
+    } else if (early) {
+        logging(lg, "SVRG terminated with early stopping on the holdout score\n");
+    } else if (epoch < opt.max_iterations) {
+        logging(lg, "SVRG terminated with the stopping criteria\n");
+    } else {
+        logging(lg, "SVRG terminated with the maximum number of iterations\n");
+    }
+
+    /* Output the weights of the last snapshot (or the best holdout score). */
+    veccopy(w, ws, K);
+    earlystop_restore(&es, w);
+
+    /* Wait for the last checkpoint to be written. */
+    ret = checkpoint_finish(&ck);
+
+    logging(lg, "Loss: %f\n", loss);
+    logging(lg, "Total seconds required for training: %.3f\n", profile_now() - clk_begin);
+    logging(lg, "\n");
+
+    earlystop_finish(&es);
+    free(as.fids);
+    free(as.stamp);
+    free(pf);
+    free(last);
+    free(g);
+    free(mu);
+    free(ws);
+    *ptr_w = w;
+    return ret;
+
+error_exit:
+    checkpoint_finish(&ck);
+    earlystop_finish(&es);
+    free(as.fids);
+    free(as.stamp);
+    free(pf);
+    free(last);
+    free(g);
+    free(mu);
+    free(ws);
+    free(w);
+    *ptr_w = NULL;
+    return ret;
+}
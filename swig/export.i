@@ -44,3 +44,5 @@
 %template(Item) std::vector<CRFSuite::Attribute>;
 %template(ItemSequence) std::vector<CRFSuite::Item>;
 %template(StringList) std::vector<std::string>;
+%template(IntList) std::vector<int>;
+%template(FloatList) std::vector<double>;